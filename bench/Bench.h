@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+/**
+ * @brief Monotonic timestamp in nanoseconds for benchmark timing
+ * 
+ * @return uint64_t Nanoseconds from an arbitrary epoch
+ */
+static inline uint64_t BenchNowNs(void) {
+#if defined(_WIN32)
+  LARGE_INTEGER freq, now;
+  QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&now);
+  return (uint64_t)((double)now.QuadPart * 1e9 / (double)freq.QuadPart);
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+/**
+ * @brief Cheap deterministic PRNG (xorshift64) so runs are comparable across commits
+ * 
+ * @param state PRNG state, must be non-zero
+ * @return uint64_t Next pseudo-random value
+ */
+static inline uint64_t BenchRand(uint64_t *state) {
+  uint64_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  return *state = x;
+}
+
+/**
+ * @brief Print one result line in "bench=<name> key=value ..." form
+ */
+#define BENCH_REPORT(name, fmt, ...) \
+  printf("bench=%s " fmt "\n", name, __VA_ARGS__)
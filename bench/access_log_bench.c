@@ -0,0 +1,323 @@
+#include "Bench.h"
+#include "server/AccessLog.h"
+#include "server/Metrics.h"
+#include "server/Response.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(_WIN32)
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+// Cost of the access log on the request path. "requests" runs keep-alive
+// style round trips over a socketpair per thread (client write, server read,
+// answer, client read) with logging off and on in alternating rounds, so the
+// overhead is measured against real per-request syscalls and machine drift
+// hits both alike (the median round of each is reported). "flood" captures records in a tight loop,
+// far faster than any writer can format them: full rings must drop and count,
+// never stall the producers. "capture" times the request-path share alone:
+// blocks of records that fit in the ring, with the writer idle meanwhile (on a
+// single CPU the writer otherwise competes with the requests for the core).
+// "format" times the writer's share: formatting a ring of records into lines.
+// End-to-end: SERVER_ARGS="--access-log access.log" bench/load_mix.sh
+
+#define BENCH_SECONDS 0.5
+#define BENCH_ROUNDS 7
+#define BENCH_MAX_THREADS 4
+#define BENCH_LOG "access_log_bench.log"
+#define BENCH_ROTATE_BYTES (16 * 1024 * 1024)
+#define BENCH_CAPTURE_BLOCKS 200
+#define BENCH_FORMAT_PASSES 200
+
+static const char s_request[] = "GET /cache/items/sprites.rttex HTTP/1.1\r\n"
+                                "Host: 127.0.0.1\r\n"
+                                "Connection: keep-alive\r\n"
+                                "\r\n";
+
+//! Struct for one load thread and its tallies
+struct BenchClient {
+  GH_Thread thread;   //!< Thread handle
+  bool logging;       //!< Capture a record per request
+  bool io;            //!< Round-trip every request over a socketpair
+  uint64_t requests;  //!< Requests answered
+  uint64_t ns;        //!< Time spent, for per-request cost
+};
+
+static struct AccessLog s_log;
+
+// CPU time of the whole process; unlike wall time it does not count time a
+// shared machine gave to someone else
+static uint64_t cpu_now_ns(void) {
+#if defined(_WIN32)
+  FILETIME created, exited, kernel, user;
+  GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user);
+  return ((uint64_t) kernel.dwHighDateTime << 32 | kernel.dwLowDateTime) * 100 +
+         ((uint64_t) user.dwHighDateTime << 32 | user.dwLowDateTime) * 100;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+#endif
+}
+static char s_response[1024 + 256];
+static size_t s_response_len;
+static uint64_t s_deadline_ns;
+
+// What the server does per request (log_access in main.c); now_ms is a clock
+// reading the request path took anyway
+static void capture(const char *uri, size_t uri_len, uint32_t client, uint64_t now_ms, uint64_t elapsed_ns,
+                    const char *response, size_t response_len) {
+  struct AccessRecord *rec = GH_AccessLogReserve(&s_log);
+  if (rec == NULL) {
+    return;
+  }
+  rec->status = GH_ResponseStatus(response, response_len);
+  rec->millis = now_ms;
+  rec->bytes = response_len;
+  rec->duration_us = (uint32_t) (elapsed_ns / 1000);
+  memset(rec->ip, 0, sizeof(rec->ip));
+  rec->ip[0] = 10;
+  memcpy(rec->ip + 1, &client, 3);
+  rec->is_ip6 = 0;
+  memset(rec->method, 0, sizeof(rec->method));
+  memcpy(rec->method, "GET", 3);
+  rec->uri_truncated = 0;
+  rec->uri_len = (uint8_t) uri_len;
+  memcpy(rec->uri, uri, uri_len);
+  GH_AccessLogCommit(&s_log);
+}
+
+static void client_run(void *arg) {
+  struct BenchClient *client = (struct BenchClient *) arg;
+  char buf[sizeof(s_response)];
+  uint64_t rng = 0x9e3779b97f4a7c15ULL ^ (uint64_t) (size_t) client;
+  int fds[2] = {-1, -1};
+#if !defined(_WIN32)
+  if (client->io && socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+    exit(1);
+  }
+#endif
+
+  uint64_t start = BenchNowNs();
+  while (BenchNowNs() < s_deadline_ns) {
+    for (int batch = 0; batch < 64; batch++) {
+      uint64_t request_start = BenchNowNs();
+#if !defined(_WIN32)
+      if (client->io) {
+        // Client sends, server reads the request
+        if (write(fds[1], s_request, sizeof(s_request) - 1) < 0 || read(fds[0], buf, sizeof(buf)) <= 0) {
+          exit(1);
+        }
+      }
+#endif
+      // Handler: the prebuilt cached response, copied out
+      memcpy(buf, s_response, s_response_len);
+#if !defined(_WIN32)
+      if (client->io) {
+        // Server answers, client reads the response
+        size_t got = 0;
+        if (write(fds[0], buf, s_response_len) < 0) {
+          exit(1);
+        }
+        while (got < s_response_len) {
+          ssize_t n = read(fds[1], buf + got, sizeof(buf) - got);
+          if (n <= 0) {
+            exit(1);
+          }
+          got += (size_t) n;
+        }
+      }
+#endif
+      // The server reads the clock per request for its latency histograms either way
+      uint64_t elapsed = BenchNowNs() - request_start;
+      if (client->logging) {
+        capture(s_request + 4, 29, (uint32_t) BenchRand(&rng), request_start / 1000000, elapsed, s_response,
+                s_response_len);
+      }
+      client->requests++;
+    }
+  }
+  client->ns = BenchNowNs() - start;
+#if !defined(_WIN32)
+  if (client->io) {
+    close(fds[0]);
+    close(fds[1]);
+  }
+#endif
+}
+
+//! Struct for the outcome of one timed run
+struct BenchRun {
+  double rps;          //!< Requests per second per thread's share of the wall time
+  double ns;           //!< Nanoseconds per request
+  double cpu_ns;       //!< CPU time per request, every thread of the process (the writer too)
+  uint64_t written;    //!< Records written to the file
+  uint64_t dropped;    //!< Records dropped on full rings
+};
+
+// Run threads clients for BENCH_SECONDS
+static struct BenchRun run(bool logging, bool io, int threads) {
+  struct BenchClient clients[BENCH_MAX_THREADS];
+  struct MetricsShard before, after;
+  memset(clients, 0, sizeof(clients));
+  GH_MetricsCollect(&before);
+  if (logging && !GH_AccessLogInit(&s_log, BENCH_LOG, BENCH_ROTATE_BYTES)) {
+    fprintf(stderr, "cannot open %s\n", BENCH_LOG);
+    exit(1);
+  }
+
+  uint64_t cpu_start = cpu_now_ns();
+  s_deadline_ns = BenchNowNs() + (uint64_t) (BENCH_SECONDS * 1e9);
+  for (int t = 0; t < threads; t++) {
+    clients[t].logging = logging;
+    clients[t].io = io;
+    if (!GH_ThreadStart(&clients[t].thread, client_run, &clients[t])) {
+      exit(1);
+    }
+  }
+  uint64_t requests = 0, ns = 0;
+  for (int t = 0; t < threads; t++) {
+    GH_ThreadJoin(clients[t].thread);
+    requests += clients[t].requests;
+    ns += clients[t].ns;
+  }
+
+  // Cleanup drains what is still buffered, so every record is either written or dropped
+  struct BenchRun result = {0, 0, 0, 0, 0};
+  result.dropped = logging ? GH_AccessLogDropped(&s_log) : 0;
+  if (logging) {
+    GH_AccessLogCleanup(&s_log);
+  }
+  result.cpu_ns = (double) (cpu_now_ns() - cpu_start) / (double) (requests > 0 ? requests : 1);
+  GH_MetricsCollect(&after);
+  result.written = after.counters[MC_ACCESS_LOG_RECORDS] - before.counters[MC_ACCESS_LOG_RECORDS];
+  result.rps = (double) requests * 1e9 / ((double) ns / threads);
+  result.ns = (double) ns / (double) (requests > 0 ? requests : 1);
+  return result;
+}
+
+static int by_cpu(const void *a, const void *b) {
+  double x = ((const struct BenchRun *) a)->cpu_ns, y = ((const struct BenchRun *) b)->cpu_ns;
+  return (x > y) - (x < y);
+}
+
+// Logging off and on in alternating rounds, so drift in the machine hits
+// both alike; reports the median round of each by CPU time per request, the
+// overhead being the extra CPU logging costs
+static void compare(const char *bench, bool io, int threads) {
+  struct BenchRun runs[2][BENCH_ROUNDS];
+  for (int round = 0; round < BENCH_ROUNDS; round++) {
+    runs[0][round] = run(false, io, threads);
+    runs[1][round] = run(true, io, threads);
+  }
+  double baseline = 0;
+  for (int logging = 0; logging < 2; logging++) {
+    qsort(runs[logging], BENCH_ROUNDS, sizeof(runs[logging][0]), by_cpu);
+    struct BenchRun *median = &runs[logging][BENCH_ROUNDS / 2];
+    baseline = logging ? baseline : median->cpu_ns;
+    BENCH_REPORT(bench, "logging=%s threads=%d rounds=%d requests_per_sec=%.0f ns_per_request=%.1f "
+                 "cpu_ns_per_request=%.1f overhead_pct=%.1f written=%llu dropped=%llu",
+                 logging ? "on" : "off", threads, BENCH_ROUNDS, median->rps, median->ns, median->cpu_ns,
+                 (median->cpu_ns - baseline) * 100.0 / baseline, (unsigned long long) median->written,
+                 (unsigned long long) median->dropped);
+  }
+}
+
+// Request-path cost of one record, with the writer asleep while each block is captured
+static void capture_cost(void) {
+  if (!GH_AccessLogInit(&s_log, BENCH_LOG, BENCH_ROTATE_BYTES)) {
+    exit(1);
+  }
+  uint64_t ns = 0, captured = 0, rng = 1;
+  for (int block = 0; block < BENCH_CAPTURE_BLOCKS; block++) {
+    GH_SleepMs(4 * ACCESS_LOG_FLUSH_MS);  // Writer drains the previous block and goes back to sleep
+    uint64_t start = BenchNowNs();
+    for (int i = 0; i < ACCESS_LOG_RING_RECORDS / 2; i++) {
+      capture(s_request + 4, 29, (uint32_t) BenchRand(&rng), start / 1000000, 12000, s_response, s_response_len);
+    }
+    ns += BenchNowNs() - start;
+    captured += ACCESS_LOG_RING_RECORDS / 2;
+  }
+  uint64_t dropped = GH_AccessLogDropped(&s_log);
+  GH_AccessLogCleanup(&s_log);
+  BENCH_REPORT("access_log_capture", "records=%llu ns_per_record=%.1f dropped=%llu",
+               (unsigned long long) captured, (double) ns / (double) captured, (unsigned long long) dropped);
+}
+
+// Writer-side cost of one line: a ring of records formatted batch by batch, as log_drain does
+static void format_cost(void) {
+  struct AccessRecord *records = (struct AccessRecord *) calloc(ACCESS_LOG_RING_RECORDS, sizeof(*records));
+  char *batch = (char *) malloc(ACCESS_LOG_BATCH_SIZE);
+  if (records == NULL || batch == NULL) {
+    exit(1);
+  }
+  uint64_t rng = 1, now_ms = BenchNowNs() / 1000000;
+  for (size_t i = 0; i < ACCESS_LOG_RING_RECORDS; i++) {
+    struct AccessRecord *rec = &records[i];
+    uint32_t client = (uint32_t) BenchRand(&rng);
+    rec->status = 200;
+    rec->millis = now_ms + i / 64;  // Many lines per second, as under load
+    rec->bytes = s_response_len;
+    rec->duration_us = (uint32_t) (BenchRand(&rng) % 20000);
+    rec->ip[0] = 10;
+    memcpy(rec->ip + 1, &client, 3);
+    memcpy(rec->method, "GET", 3);
+    rec->uri_len = 29;
+    memcpy(rec->uri, s_request + 4, 29);
+  }
+
+  uint64_t lines = 0, bytes = 0, start = BenchNowNs();
+  for (int pass = 0; pass < BENCH_FORMAT_PASSES; pass++) {
+    size_t len = 0;
+    for (size_t i = 0; i < ACCESS_LOG_RING_RECORDS; i++) {
+      size_t n = GH_AccessLogFormat(&records[i], 0, batch + len, ACCESS_LOG_BATCH_SIZE - len);
+      if (n == 0) {
+        bytes += len;
+        len = 0;
+        n = GH_AccessLogFormat(&records[i], 0, batch, ACCESS_LOG_BATCH_SIZE);
+      }
+      len += n;
+      lines++;
+    }
+    bytes += len;
+  }
+  uint64_t ns = BenchNowNs() - start;
+  BENCH_REPORT("access_log_format", "lines=%llu ns_per_line=%.1f bytes_per_line=%.1f",
+               (unsigned long long) lines, (double) ns / (double) lines, (double) bytes / (double) lines);
+  free(records);
+  free(batch);
+}
+
+static void remove_logs(void) {
+  char name[64];
+  remove(BENCH_LOG);
+  for (int i = 1; i <= ACCESS_LOG_ROTATE_KEEP; i++) {
+    snprintf(name, sizeof(name), "%s.%d", BENCH_LOG, i);
+    remove(name);
+  }
+}
+
+int main(void) {
+  mg_log_set(MG_LL_NONE);
+  GH_MetricsInit();
+  s_response_len = (size_t) snprintf(s_response, sizeof(s_response), "HTTP/1.1 200 OK\r\n"
+                                     "Content-Type: application/octet-stream\r\n"
+                                     "Content-Length: 1024\r\n"
+                                     "ETag: \"5f3a9c-400\"\r\n"
+                                     "Connection: keep-alive\r\n"
+                                     "\r\n");
+  memset(s_response + s_response_len, 'x', 1024);
+  s_response_len += 1024;
+
+  capture_cost();
+  format_cost();
+  for (int threads = 1; threads <= BENCH_MAX_THREADS; threads *= 2) {
+    compare("access_log_requests", true, threads);
+  }
+  for (int threads = 1; threads <= BENCH_MAX_THREADS; threads *= 2) {
+    compare("access_log_flood", false, threads);
+  }
+  remove_logs();
+  return 0;
+}
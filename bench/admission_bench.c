@@ -0,0 +1,122 @@
+#include "Bench.h"
+#include "server/Admission.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Admission overhead under a flood: load threads play many clients that each
+// open a connection, send a few requests and close, while one abusive address
+// sends half of all traffic. Reports the cost of the checks per request next
+// to the same loop with every limit off, how much of the abuser's traffic got
+// through, and whether any well-behaved client was ever limited.
+
+#define BENCH_SECONDS 1.0
+#define BENCH_CLIENTS 20000
+#define BENCH_REQUESTS_PER_CONN 4
+#define BENCH_MAX_THREADS 4
+#define BENCH_RATE_LIMIT_RPS 200   // The limits are off by default; measure them as --rate-limit 200 --conn-limit 128
+#define BENCH_CONN_LIMIT_PER_IP 128
+
+//! Struct for one load thread and its tallies
+struct BenchFlood {
+  GH_Thread thread;         //!< Thread handle
+  uint64_t rng;             //!< Client selection PRNG
+  uint64_t requests;        //!< Requests checked
+  uint64_t abusive_allowed; //!< Abuser requests let through
+  uint64_t abusive_total;   //!< Abuser requests sent
+  uint64_t legit_limited;   //!< Well-behaved requests refused
+  uint64_t conns_rejected;  //!< Connections over the cap
+};
+
+static struct Admission s_admission;
+static uint64_t s_deadline_ns;
+
+static void client_addr(uint64_t client, struct mg_addr *addr) {
+  memset(addr, 0, sizeof(*addr));
+  if (client % 8 == 7) {
+    // Every eighth client is IPv6 (limited per /64)
+    addr->is_ip6 = true;
+    addr->ip[0] = 0x20;
+    addr->ip[1] = 0x01;
+    memcpy(addr->ip + 4, &client, 4);
+  } else {
+    addr->ip[0] = 10;
+    addr->ip[1] = (uint8_t) (client >> 16);
+    addr->ip[2] = (uint8_t) (client >> 8);
+    addr->ip[3] = (uint8_t) client;
+  }
+}
+
+static void flood_run(void *arg) {
+  struct BenchFlood *flood = (struct BenchFlood *) arg;
+  struct mg_addr abuser = {{192, 0, 2, 66}, 0, 0, false};
+  while (BenchNowNs() < s_deadline_ns) {
+    // Batches between clock reads, as an event loop reads it once per poll
+    uint64_t now = BenchNowNs() / 1000000;
+    for (int batch = 0; batch < 64; batch++) {
+      bool abusive = BenchRand(&flood->rng) & 1;
+      struct mg_addr addr;
+      if (abusive) {
+        addr = abuser;
+      } else {
+        client_addr(BenchRand(&flood->rng) % BENCH_CLIENTS, &addr);
+      }
+      if (!GH_AdmissionConnect(&s_admission, &addr, now)) {
+        flood->conns_rejected++;
+        continue;
+      }
+      for (int r = 0; r < BENCH_REQUESTS_PER_CONN; r++) {
+        bool allowed = GH_AdmissionRequest(&s_admission, &addr, now);
+        flood->requests++;
+        flood->abusive_total += abusive;
+        flood->abusive_allowed += abusive && allowed;
+        flood->legit_limited += !abusive && !allowed;
+      }
+      GH_AdmissionDisconnect(&s_admission, &addr);
+    }
+  }
+}
+
+static void flood(const char *limits, uint32_t rate, uint32_t max_conns, int threads) {
+  struct BenchFlood floods[BENCH_MAX_THREADS];
+  memset(floods, 0, sizeof(floods));
+  if (!GH_AdmissionInit(&s_admission, ADMISSION_TABLE_ENTRIES, rate, rate * 2, max_conns)) {
+    exit(1);
+  }
+
+  uint64_t start = BenchNowNs();
+  s_deadline_ns = start + (uint64_t) (BENCH_SECONDS * 1e9);
+  for (int t = 0; t < threads; t++) {
+    floods[t].rng = 0x9e3779b97f4a7c15ULL ^ ((uint64_t) t + 1) * 0xbf58476d1ce4e5b9ULL;
+    if (!GH_ThreadStart(&floods[t].thread, flood_run, &floods[t])) {
+      exit(1);
+    }
+  }
+  struct BenchFlood total;
+  memset(&total, 0, sizeof(total));
+  for (int t = 0; t < threads; t++) {
+    GH_ThreadJoin(floods[t].thread);
+    total.requests += floods[t].requests;
+    total.abusive_allowed += floods[t].abusive_allowed;
+    total.abusive_total += floods[t].abusive_total;
+    total.legit_limited += floods[t].legit_limited;
+    total.conns_rejected += floods[t].conns_rejected;
+  }
+  double seconds = (double) (BenchNowNs() - start) / 1e9;
+  GH_AdmissionCleanup(&s_admission);
+
+  // Each request also carries a quarter of its connection's connect and close checks
+  BENCH_REPORT("admission_flood", "limits=%s threads=%d requests_per_sec=%.0f ns_per_request=%.1f "
+               "abusive_sent=%llu abusive_allowed=%llu legit_limited=%llu conns_rejected=%llu",
+               limits, threads, (double) total.requests / seconds,
+               seconds * 1e9 * threads / (double) (total.requests > 0 ? total.requests : 1),
+               (unsigned long long) total.abusive_total, (unsigned long long) total.abusive_allowed,
+               (unsigned long long) total.legit_limited, (unsigned long long) total.conns_rejected);
+}
+
+int main(void) {
+  for (int threads = 1; threads <= BENCH_MAX_THREADS; threads *= 2) {
+    flood("off", 0, 0, threads);
+    flood("on", BENCH_RATE_LIMIT_RPS, BENCH_CONN_LIMIT_PER_IP, threads);
+  }
+  return 0;
+}
@@ -0,0 +1,209 @@
+#include "Bench.h"
+#include "plugins/CacheManager.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Satisfies the extern declared by CacheManager.h
+struct CacheBucket g_cache = {0};
+
+#define BENCH_LOOKUPS 1000000
+#define BENCH_PATH_LEN 48
+#define BENCH_CHURN_BODY 32768
+
+static char (*make_paths(size_t count))[BENCH_PATH_LEN] {
+  char (*paths)[BENCH_PATH_LEN] = malloc(count * BENCH_PATH_LEN);
+  if (paths == NULL) {
+    exit(1);
+  }
+  for (size_t i = 0; i < count; i++) {
+    snprintf(paths[i], BENCH_PATH_LEN, "./game/assets/file_%06zu.rttex", i);
+  }
+  return paths;
+}
+
+static void bench_lookup(size_t entries) {
+  static const char payload[64] = {0};
+  char (*paths)[BENCH_PATH_LEN] = make_paths(entries);
+  struct CacheBucket cache;
+  GH_CacheInit(&cache);
+
+  uint64_t start = BenchNowNs();
+  for (size_t i = 0; i < entries; i++) {
+    GH_CacheAdd(&cache, paths[i], payload, sizeof(payload), "\"etag\"", 0);
+  }
+  uint64_t add_ns = BenchNowNs() - start;
+
+  // Random hits
+  uint64_t rng = 0x9e3779b97f4a7c15ULL;
+  size_t found = 0;
+  start = BenchNowNs();
+  for (size_t i = 0; i < BENCH_LOOKUPS; i++) {
+    found += GH_CacheGetByPath(&cache, paths[BenchRand(&rng) % entries]) != NULL;
+  }
+  uint64_t hit_ns = BenchNowNs() - start;
+
+  // Misses
+  start = BenchNowNs();
+  for (size_t i = 0; i < BENCH_LOOKUPS; i++) {
+    found += GH_CacheGetByPath(&cache, "./game/assets/missing.rttex") != NULL;
+  }
+  uint64_t miss_ns = BenchNowNs() - start;
+
+  // Evict half of the cache, one entry at a time
+  size_t target = cache.size / 2;
+  start = BenchNowNs();
+  GH_CacheEvictOldest(&cache, target);
+  uint64_t evict_ns = BenchNowNs() - start;
+  size_t evicted = entries - cache.entry_count;
+
+  BENCH_REPORT("cache_lookup", "entries=%zu add_ns=%.1f hit_ns=%.1f miss_ns=%.1f evict_ns=%.1f found=%zu",
+               entries, (double)add_ns / entries, (double)hit_ns / BENCH_LOOKUPS,
+               (double)miss_ns / BENCH_LOOKUPS, evicted ? (double)evict_ns / evicted : 0.0, found);
+
+  GH_CacheCleanup(&cache);
+  free(paths);
+}
+
+// ETag generation, once per file version: one pass for cached files, the same
+// hash fed in pieces for files served from disk
+static void bench_etag(void) {
+  char etag[64];
+  size_t checksum = 0;
+
+  // Content ETags cost one pass over the file; hash a body bigger than the L2
+  size_t body_len = 4 * 1024 * 1024;
+  char *body = malloc(body_len);
+  if (body == NULL) {
+    exit(1);
+  }
+  uint64_t rng = 1;
+  for (size_t i = 0; i < body_len; i++) {
+    body[i] = (char) (BenchRand(&rng) >> 24);
+  }
+  size_t passes = 16;
+  uint64_t start = BenchNowNs();
+  for (size_t i = 0; i < passes; i++) {
+    GH_CacheMakeContentEtag(body, body_len, etag, sizeof(etag));
+    checksum += (unsigned char) etag[1];
+  }
+  uint64_t content_ns = BenchNowNs() - start;
+  char stream_etag[64];
+  start = BenchNowNs();
+  for (size_t i = 0; i < passes; i++) {
+    struct CacheContentHash ch;
+    GH_CacheContentHashInit(&ch);
+    for (size_t off = 0; off < body_len; off += 65536 - 5) {
+      GH_CacheContentHashUpdate(&ch, body + off, off + 65536 - 5 < body_len ? 65536 - 5 : body_len - off);
+    }
+    GH_CacheContentHashEtag(&ch, stream_etag, sizeof(stream_etag));
+    checksum += (unsigned char) stream_etag[1];
+  }
+  uint64_t stream_ns = BenchNowNs() - start;
+  if (strcmp(etag, stream_etag) != 0) {
+    fprintf(stderr, "cache_etag: streamed %s != one-pass %s\n", stream_etag, etag);
+    exit(1);
+  }
+  start = BenchNowNs();
+  for (size_t i = 0; i < BENCH_LOOKUPS; i++) {
+    GH_CacheMakeContentEtag(body + (i & 1023), 1024, etag, sizeof(etag));
+    checksum += (unsigned char) etag[1];
+  }
+  uint64_t small_ns = BenchNowNs() - start;
+
+  BENCH_REPORT("cache_etag", "content_1k_ns=%.1f content_mb_per_sec=%.0f stream_mb_per_sec=%.0f checksum=%zu",
+               (double)small_ns / BENCH_LOOKUPS,
+               (double)(passes * body_len) / (1024.0 * 1024.0) / ((double)content_ns / 1e9),
+               (double)(passes * body_len) / (1024.0 * 1024.0) / ((double)stream_ns / 1e9), checksum);
+  free(body);
+}
+
+// Steady state over budget: every add evicts, every replace drops the old copy
+static void bench_churn(size_t entries) {
+  char *payload = calloc(1, BENCH_CHURN_BODY);
+  char (*paths)[BENCH_PATH_LEN] = make_paths(entries);
+  if (payload == NULL) {
+    exit(1);
+  }
+  struct CacheBucket cache;
+  GH_CacheInit(&cache);
+
+  // Fill past the budget first so the timed adds all evict
+  size_t budget = (size_t)CACHE_MAX_SIZE_MB * 1024 * 1024;
+  size_t fill = budget / BENCH_CHURN_BODY + 1;
+  for (size_t i = 0; i < fill; i++) {
+    GH_CacheAdd(&cache, paths[i % entries], payload, BENCH_CHURN_BODY, "\"etag\"", 0);
+  }
+
+  size_t adds = entries < 20000 ? 20000 : entries;
+  uint64_t start = BenchNowNs();
+  for (size_t i = 0; i < adds; i++) {
+    GH_CacheAdd(&cache, paths[(fill + i) % entries], payload, BENCH_CHURN_BODY, "\"etag\"", 0);
+  }
+  uint64_t churn_ns = BenchNowNs() - start;
+
+  BENCH_REPORT("cache_churn", "paths=%zu body=%d add_evict_ns=%.1f resident=%zu size_mb=%zu",
+               entries, BENCH_CHURN_BODY, (double)churn_ns / adds, cache.entry_count,
+               cache.size / (1024 * 1024));
+
+  GH_CacheCleanup(&cache);
+  free(paths);
+  free(payload);
+}
+
+// Budget cut to a quarter of a full cache: the longest time any one caller
+// holds the eviction, all at once (GH_CacheEvictOldest) against GH_CacheShrink
+// steps as worker 0 takes them
+static void bench_shrink(void) {
+  char *payload = calloc(1, BENCH_CHURN_BODY);
+  size_t budget = (size_t)CACHE_MAX_SIZE_MB * 1024 * 1024;
+  size_t fill = budget / BENCH_CHURN_BODY;
+  char (*paths)[BENCH_PATH_LEN] = make_paths(fill);
+  if (payload == NULL) {
+    exit(1);
+  }
+
+  for (int incremental = 0; incremental < 2; incremental++) {
+    struct CacheBucket cache;
+    GH_CacheInit(&cache);
+    for (size_t i = 0; i < fill; i++) {
+      GH_CacheAdd(&cache, paths[i], payload, BENCH_CHURN_BODY, "\"etag\"", 0);
+    }
+    size_t before = cache.entry_count;
+
+    GH_CacheSetBudget(&cache, budget / 4);
+    uint64_t max_pause_ns = 0, total_ns = 0;
+    size_t steps = 0;
+    for (bool more = true; more; steps++) {
+      uint64_t start = BenchNowNs();
+      if (incremental) {
+        more = GH_CacheShrink(&cache, CACHE_SHRINK_STEP_BYTES) > 0;
+      } else {
+        GH_CacheEvictOldest(&cache, budget / 4);
+        more = false;
+      }
+      uint64_t pause_ns = BenchNowNs() - start;
+      max_pause_ns = pause_ns > max_pause_ns ? pause_ns : max_pause_ns;
+      total_ns += pause_ns;
+    }
+
+    BENCH_REPORT("cache_shrink", "mode=%s budget_mb=%zu->%zu evicted=%zu steps=%zu max_pause_us=%.1f total_ms=%.2f",
+                 incremental ? "steps" : "at_once", budget >> 20, (budget / 4) >> 20, before - cache.entry_count,
+                 steps, (double)max_pause_ns / 1e3, (double)total_ns / 1e6);
+    GH_CacheCleanup(&cache);
+  }
+  free(paths);
+  free(payload);
+}
+
+int main(void) {
+  static const size_t sizes[] = {100, 10000, 100000};
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    bench_lookup(sizes[i]);
+  }
+  bench_etag();
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    bench_churn(sizes[i]);
+  }
+  bench_shrink();
+  return 0;
+}
@@ -0,0 +1,51 @@
+#!/usr/bin/env bash
+# A file must have one ETag however it is served. The same file is fetched
+# from a server that caches it and from one whose budget is too small to take
+# it, so it is streamed from disk: whole, as the first range (hashed by the
+# loader) and as a later range (answered from disk with the remembered hash).
+# Every ETag has to equal the cached one, and revalidating with it on the
+# disk path has to answer 304.
+# Usage: bench/etag_paths.sh <path/to/GrowplusHttp>
+
+set -eu
+
+BIN="$(realpath "${1:?usage: $0 <GrowplusHttp binary>}")"
+FILE_MB="${FILE_MB:-2}"  # Above APP_RANGE_DISK_MIN_SIZE, below the default admission limit
+URL="http://127.0.0.1:8000/asset.bin"
+
+ROOT="$(mktemp -d)"
+PID=""
+trap 'kill $PID 2>/dev/null || true; rm -rf "$ROOT"' EXIT
+head -c "$((FILE_MB * 1024 * 1024))" /dev/urandom > "$ROOT/asset.bin"
+
+start() {
+  (cd "$ROOT" && exec "$BIN" "$@" > "$ROOT/.server.log" 2>&1) &
+  PID=$!
+  sleep 1
+}
+
+stop() {
+  kill "$PID"
+  wait "$PID" 2>/dev/null || true
+}
+
+etag() {
+  curl -s -o /dev/null -D - "$@" "$URL" | tr -d '\r' | awk 'tolower($1) == "etag:" { print $2 }'
+}
+
+start
+CACHED="$(etag)"
+CACHED_RANGE="$(etag -H 'Range: bytes=0-99')"
+stop
+
+start --cache-size-mb 1
+DISK_FIRST_RANGE="$(etag -H 'Range: bytes=0-99')"
+DISK="$(etag)"
+DISK_RANGE="$(etag -H 'Range: bytes=100-199')"
+REVALIDATE="$(curl -s -o /dev/null -w '%{http_code}' -H "If-None-Match: $CACHED" "$URL")"
+stop
+
+echo "bench=etag_paths cached=$CACHED cached_range=$CACHED_RANGE disk=$DISK" \
+     "disk_first_range=$DISK_FIRST_RANGE disk_range=$DISK_RANGE revalidate_status=$REVALIDATE"
+[ -n "$CACHED" ] && [ "$CACHED_RANGE" = "$CACHED" ] && [ "$DISK" = "$CACHED" ] &&
+  [ "$DISK_FIRST_RANGE" = "$CACHED" ] && [ "$DISK_RANGE" = "$CACHED" ] && [ "$REVALIDATE" = 304 ]
@@ -0,0 +1,73 @@
+#!/usr/bin/env bash
+# Replace a running server with a second copy of the binary under load:
+# the new one takes the listening sockets and a dump of the cache over the
+# --hot-restart socket, the old one drains and exits. Every request opens a
+# new connection, so loadgen reports any refused connect as an error; the run
+# fails unless there are none and the old process exits on its own.
+# Usage: bench/hot_restart.sh <path/to/GrowplusHttp> <path/to/loadgen>
+# Prints the new process's hit ratio over the requests it served right after
+# taking over (cache_hit against cache_miss and disk routes).
+
+set -eu
+
+BIN="$(realpath "${1:?usage: $0 <GrowplusHttp binary> <loadgen binary>}")"
+LOADGEN="$(realpath "${2:?usage: $0 <GrowplusHttp binary> <loadgen binary>}")"
+DURATION="${DURATION:-6}"
+RESTART_AFTER="${RESTART_AFTER:-2}"
+CONNECTIONS="${CONNECTIONS:-16}"
+WORKERS="${WORKERS:-2}"
+FILES="${FILES:-500}"
+SERVER_ARGS="${SERVER_ARGS:---rate-limit 0 --conn-limit 0}"  # All clients share 127.0.0.1
+URL="tcp://127.0.0.1:8000"
+
+ROOT="$(mktemp -d)"
+CONTROL="$(mktemp -d)"  # Socket and cache dump, kept out of the served root
+OLD=""
+NEW=""
+trap 'kill $OLD $NEW 2>/dev/null || true; rm -rf "$ROOT" "$CONTROL"' EXIT
+mkdir "$ROOT/files"
+head -c 16384 /dev/urandom > "$ROOT/files/template.bin"
+for i in $(seq 0 $((FILES - 1))); do
+  cp "$ROOT/files/template.bin" "$ROOT/files/f$i.bin"
+done
+
+start_server() {
+  (cd "$ROOT" && exec "$BIN" -w "$WORKERS" --hot-restart "$CONTROL/gh.sock" $SERVER_ARGS > "$CONTROL/$1.log" 2>&1) &
+}
+
+start_server old
+OLD=$!
+sleep 1
+
+# Warm: every file requested at least once
+"$LOADGEN" -u "$URL" -c "$CONNECTIONS" -d 2 -f "$FILES" -s hot_restart_warm -m "miss:/files/f%u.bin" > /dev/null
+
+"$LOADGEN" -u "$URL" -c "$CONNECTIONS" -k 0 -d "$DURATION" -f "$FILES" -s hot_restart \
+  -m "miss:/files/f%u.bin" > "$CONTROL/load.txt" &
+LOAD=$!
+sleep "$RESTART_AFTER"
+
+START="$(date +%s%N)"
+start_server new
+NEW=$!
+DRAINED=1
+wait "$OLD" || DRAINED=0
+OLD=""
+TAKEOVER_MS=$((($(date +%s%N) - START) / 1000000))
+
+wait "$LOAD" || true
+cat "$CONTROL/load.txt"
+ERRORS="$(grep ' kind=all ' "$CONTROL/load.txt" | grep -o 'errors=[0-9]*$' | grep -o '[0-9]*$' || echo 1)"
+
+STATS="$(curl -s "http://127.0.0.1:8000/api/cache/stats")"
+count() {
+  echo "$STATS" | grep -o "\"$1\":{\"count\":[0-9]*" | grep -o '[0-9]*$'
+}
+HITS="$(count cache_hit)"
+MISSES="$(count cache_miss)"
+DISK="$(count disk)"
+SNAPSHOT_FILES="$(echo "$STATS" | grep -o '"snapshot_files":[0-9]*' | grep -o '[0-9]*$')"
+RATIO="$(awk -v h="$HITS" -v m="$MISSES" -v d="$DISK" 'BEGIN { printf "%.4f", h + m + d > 0 ? h / (h + m + d) : 0 }')"
+echo "bench=hot_restart workers=$WORKERS files=$FILES handed_over=$SNAPSHOT_FILES takeover_and_drain_ms=$TAKEOVER_MS" \
+     "old_exited=$DRAINED errors=$ERRORS new_hits=$HITS new_misses=$((MISSES + DISK)) new_hit_ratio=$RATIO"
+[ "$DRAINED" = 1 ] && [ "$ERRORS" = 0 ]
@@ -0,0 +1,34 @@
+#!/usr/bin/env bash
+# Active-request latency on the cached /index.html path while the server holds
+# increasing numbers of idle keep-alive connections.
+# Usage: bench/idle_conns.sh <path/to/GrowplusHttp> <path/to/loadgen> [idle counts...]
+# Compare event backends by building a second server with -DGH_ENABLE_EPOLL=OFF.
+# Needs a hard open file limit above the largest count (ulimit -Hn).
+
+set -eu
+
+BIN="$(realpath "${1:?usage: $0 <GrowplusHttp binary> <loadgen binary> [idle counts...]}")"
+LOADGEN="$(realpath "${2:?usage: $0 <GrowplusHttp binary> <loadgen binary> [idle counts...]}")"
+shift 2
+COUNTS="${*:-0 10000 25000 50000}"
+DURATION="${DURATION:-10}"
+CONNECTIONS="${CONNECTIONS:-32}"
+THREADS="${THREADS:-1}"
+WORKERS="${WORKERS:-1}"
+# Idle connections must outlive the run: no idle timeout, no cap, no per-address limits
+SERVER_ARGS="${SERVER_ARGS:---rate-limit 0 --conn-limit 0 --max-connections 0 --keepalive-timeout 0}"
+URL="tcp://127.0.0.1:8000"
+
+ulimit -n "$(ulimit -Hn)"
+ROOT="$(mktemp -d)"
+trap 'kill "$PID" 2>/dev/null || true; rm -rf "$ROOT"' EXIT
+head -c 16384 /dev/urandom | base64 > "$ROOT/index.html"
+
+(cd "$ROOT" && exec "$BIN" -w "$WORKERS" $SERVER_ARGS > /dev/null 2>&1) &
+PID=$!
+sleep 1
+
+for IDLE in $COUNTS; do
+  "$LOADGEN" -u "$URL" -c "$CONNECTIONS" -t "$THREADS" -d "$DURATION" -i "$IDLE" -s "idle_$IDLE" \
+    -m "hit:/index.html" || true
+done
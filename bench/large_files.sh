@@ -0,0 +1,54 @@
+#!/usr/bin/env bash
+# Concurrent downloads of files far larger than the cache budget, with the
+# server's resident memory sampled throughout. Bodies are streamed from disk,
+# so the peak should not grow with the file size, and only by a small send
+# window per download with the number of downloads.
+# Usage: bench/large_files.sh <path/to/GrowplusHttp> <path/to/loadgen> [connection counts...]
+# The files are sparse (little disk needed); RSS is read from /proc, so Linux only.
+
+set -eu
+
+BIN="$(realpath "${1:?usage: $0 <GrowplusHttp binary> <loadgen binary> [connection counts...]}")"
+LOADGEN="$(realpath "${2:?usage: $0 <GrowplusHttp binary> <loadgen binary> [connection counts...]}")"
+shift 2
+COUNTS="${*:-1 16 64 256}"
+DURATION="${DURATION:-10}"
+FILE_MB="${FILE_MB:-512}"
+FILES="${FILES:-4}"
+THREADS="${THREADS:-2}"
+WORKERS="${WORKERS:-1}"
+SERVER_ARGS="${SERVER_ARGS:---rate-limit 0 --conn-limit 0}"  # All clients share 127.0.0.1
+URL="tcp://127.0.0.1:8000"
+
+ROOT="$(mktemp -d)"
+trap 'kill "$PID" 2>/dev/null || true; rm -rf "$ROOT"' EXIT
+MIX=""
+for i in $(seq 0 $((FILES - 1))); do
+  truncate -s "${FILE_MB}M" "$ROOT/big$i.bin"
+  MIX="${MIX:+$MIX,}large:/big$i.bin:1"
+done
+
+(cd "$ROOT" && exec "$BIN" -w "$WORKERS" $SERVER_ARGS > /dev/null 2>&1) &
+PID=$!
+sleep 1
+
+rss_kb() {
+  awk '/^VmRSS:/ { print $2 }' "/proc/$PID/status"
+}
+BASELINE="$(rss_kb)"
+
+for CONNECTIONS in $COUNTS; do
+  "$LOADGEN" -u "$URL" -c "$CONNECTIONS" -t "$THREADS" -d "$DURATION" -s "large_$CONNECTIONS" -m "$MIX" &
+  LOAD=$!
+  PEAK=0
+  while kill -0 "$LOAD" 2>/dev/null; do
+    RSS="$(rss_kb)"
+    if [ "$RSS" -gt "$PEAK" ]; then
+      PEAK="$RSS"
+    fi
+    sleep 0.1
+  done
+  wait "$LOAD" || true
+  echo "bench=large_files connections=$CONNECTIONS file_mb=$FILE_MB baseline_rss_kb=$BASELINE" \
+       "peak_rss_kb=$PEAK growth_per_connection_kb=$(((PEAK - BASELINE) / CONNECTIONS))"
+done
@@ -0,0 +1,56 @@
+#!/usr/bin/env bash
+# Run the standard request mixes against a fresh GrowplusHttp instance.
+# Usage: bench/load_mix.sh <path/to/GrowplusHttp> <path/to/loadgen> [scenarios...]
+# Prints one "bench=loadgen scenario=... kind=..." line per mix entry plus a
+# total per scenario; redirect to a file and diff across commits.
+
+set -eu
+
+BIN="$(realpath "${1:?usage: $0 <GrowplusHttp binary> <loadgen binary> [scenarios...]}")"
+LOADGEN="$(realpath "${2:?usage: $0 <GrowplusHttp binary> <loadgen binary> [scenarios...]}")"
+shift 2
+SCENARIOS="${*:-hit hit_new revalidate miss notfound large mixed login login_new}"
+DURATION="${DURATION:-10}"
+CONNECTIONS="${CONNECTIONS:-64}"
+THREADS="${THREADS:-2}"
+WORKERS="${WORKERS:-1}"
+MISS_FILES="${MISS_FILES:-4000}"   # 4000 x 32 KB exceeds the default 100 MB cache budget
+SERVER_ARGS="${SERVER_ARGS:---rate-limit 0 --conn-limit 0}"  # All clients share 127.0.0.1
+URL="tcp://127.0.0.1:8000"
+
+ROOT="$(mktemp -d)"
+trap 'kill "$PID" 2>/dev/null || true; rm -rf "$ROOT"' EXIT
+head -c 16384 /dev/urandom | base64 > "$ROOT/index.html"
+head -c $((8 * 1024 * 1024)) /dev/urandom > "$ROOT/large.bin"
+mkdir "$ROOT/miss"
+head -c 32768 /dev/urandom > "$ROOT/miss/template.bin"
+for i in $(seq 0 $((MISS_FILES - 1))); do
+  cp "$ROOT/miss/template.bin" "$ROOT/miss/f$i.bin"
+done
+printf 'server = 127.0.0.1\nport = 17091\ntype = 1\nmeta = localhost\n' > "$ROOT/server_data.cfg"
+
+(cd "$ROOT" && exec "$BIN" -w "$WORKERS" $SERVER_ARGS > /dev/null 2>&1) &
+PID=$!
+sleep 1
+
+run() {
+  local scenario="$1"
+  shift
+  "$LOADGEN" -u "$URL" -c "$CONNECTIONS" -t "$THREADS" -d "$DURATION" -s "$scenario" "$@" || true
+}
+
+for SCENARIO in $SCENARIOS; do
+  case "$SCENARIO" in
+    hit)        run hit -m "hit:/index.html" ;;
+    hit_new)    run hit_new -k 0 -m "hit:/index.html" ;;
+    revalidate) run revalidate -m "revalidate:/index.html" ;;
+    miss)       run miss -f "$MISS_FILES" -m "miss:/miss/f%u.bin" ;;
+    notfound)   run notfound -m "notfound:/missing.html" ;;
+    large)      run large -c 8 -m "large:/large.bin" ;;
+    login)      run login -m "login:/growtopia/server_data.php" ;;
+    login_new)  run login_new -k 0 -m "login:/growtopia/server_data.php" ;;
+    mixed)      run mixed -f "$MISS_FILES" \
+                  -m "hit:/index.html:70,revalidate:/index.html:15,miss:/miss/f%u.bin:5,notfound:/missing.html:5,large:/large.bin:5" ;;
+    *) echo "unknown scenario: $SCENARIO" >&2; exit 2 ;;
+  esac
+done
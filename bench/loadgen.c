@@ -0,0 +1,551 @@
+// HTTP load generator for a local GrowplusHttp instance.
+//
+// Drives a weighted mix of request kinds over raw mongoose TCP client
+// connections (bodies are counted and discarded, never buffered) and prints
+// RPS plus p50/p99/p999 latency per kind as BENCH_REPORT lines.
+//
+// Usage: loadgen [-u tcp://127.0.0.1:8000] [-c connections] [-t threads]
+//                [-d seconds] [-w warmup_seconds] [-k 0|1] [-f miss_files]
+//                [-m kind:path:weight[,kind:path:weight...]] [-s scenario]
+//                [-i idle_connections]
+//
+// Kinds: hit (200), revalidate (304 with the ETag learned during warmup),
+// miss (200, "%u" in the path cycles over -f files), notfound (404),
+// large (200), login (200, POSTs a client form as to server_data.php).
+// -k 0 opens a new connection per request. -i holds that many extra
+// connections open without sending anything, so latency can be measured
+// while the server carries a large idle population.
+
+#include "Bench.h"
+#include "server/Listener.h"
+#include "utils/Sync.h"
+#include <mongoose.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(_WIN32)
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#define LOADGEN_MAX_KINDS 16
+#define LOADGEN_ETAG_LEN 64
+#define LOADGEN_IDLE_PER_SOURCE 20000  //!< Idle connections per loopback source address, below the ephemeral port range
+
+//! Request kinds, each with the status a healthy server answers
+enum LoadKind {
+    KIND_HIT, //!< Cached file
+    KIND_REVALIDATE, //!< Conditional GET of a cached file
+    KIND_MISS, //!< File not in the cache
+    KIND_NOT_FOUND, //!< Missing file
+    KIND_LARGE, //!< Large file
+    KIND_LOGIN, //!< Client login form POST
+    KIND_COUNT //!< Number of kinds
+};
+
+static const char *s_kind_names[KIND_COUNT] = {"hit", "revalidate", "miss", "notfound", "large", "login"};
+static const int s_kind_status[KIND_COUNT] = {200, 304, 200, 404, 200, 200};
+
+// Form the game client posts before it connects
+static const char s_login_form[] = "version=4.62&platform=0&protocol=209";
+
+//! Struct for one entry of the request mix
+struct MixEntry {
+    enum LoadKind kind; //!< Request kind
+    char path[192]; //!< Request path, may hold "%u" for miss kinds
+    unsigned weight; //!< Relative weight
+};
+
+//! Struct for a growable set of latency samples
+struct Samples {
+    uint64_t *ns; //!< Latencies in nanoseconds
+    size_t count; //!< Number of samples
+    size_t capacity; //!< Allocated samples
+};
+
+//! Struct for per-mix-entry results of one thread
+struct MixStats {
+    struct Samples samples; //!< Latencies of measured requests
+    uint64_t bytes; //!< Body bytes received
+    uint64_t unexpected; //!< Responses with an unexpected status
+    uint64_t errors; //!< Failed connections or malformed responses
+    char etag[LOADGEN_ETAG_LEN]; //!< ETag learned for revalidate entries
+};
+
+struct LoadThread;
+
+//! Struct for one client connection slot
+struct Client {
+    struct LoadThread *thread; //!< Owning thread
+    struct mg_connection *c; //!< Current connection, NULL between connections
+    int entry; //!< Mix entry of the request in flight, -1 if idle
+    uint64_t start_ns; //!< Request start (connect start without keep-alive)
+    bool in_body; //!< Headers parsed, counting body bytes
+    uint64_t body_left; //!< Body bytes still expected
+    int status; //!< Status of the response being received
+};
+
+//! Struct for a load thread with its own event manager and results
+struct LoadThread {
+    struct mg_mgr mgr; //!< Event manager
+    GH_Thread handle; //!< Thread handle
+    struct Client *clients; //!< Connection slots
+    int client_count; //!< Number of connection slots
+    uint64_t rng; //!< Mix selection PRNG
+    unsigned miss_counter; //!< Next miss file index
+    uint64_t connect_errors; //!< Connections that failed before a request was sent
+    struct MixStats stats[LOADGEN_MAX_KINDS]; //!< Results per mix entry
+};
+
+// Options shared by every thread (read-only once started)
+static const char *s_url = "tcp://127.0.0.1:8000";
+static const char *s_scenario = "custom";
+static int s_connections = 64;
+static int s_threads = 1;
+static double s_duration = 10;
+static double s_warmup = 1;
+static bool s_keepalive = true;
+static int s_idle = 0;
+static unsigned s_miss_files = 10000;
+static struct MixEntry s_mix[LOADGEN_MAX_KINDS];
+static int s_mix_count = 0;
+static unsigned s_mix_total = 0;
+
+// Phase timestamps, set before threads start
+static uint64_t s_measure_start;
+static uint64_t s_measure_end;
+
+static void open_client(struct Client *client);
+
+static void samples_push(struct Samples *samples, uint64_t ns) {
+  if (samples->count == samples->capacity) {
+    size_t capacity = samples->capacity ? samples->capacity * 2 : 4096;
+    uint64_t *grown = realloc(samples->ns, capacity * sizeof(uint64_t));
+    if (grown == NULL) {
+      return;
+    }
+    samples->ns = grown;
+    samples->capacity = capacity;
+  }
+  samples->ns[samples->count++] = ns;
+}
+
+static bool running(void) {
+  return BenchNowNs() < s_measure_end;
+}
+
+static int pick_entry(struct LoadThread *thread) {
+  unsigned roll = (unsigned) (BenchRand(&thread->rng) % s_mix_total);
+  for (int i = 0; i < s_mix_count; i++) {
+    if (roll < s_mix[i].weight) {
+      return i;
+    }
+    roll -= s_mix[i].weight;
+  }
+  return s_mix_count - 1;
+}
+
+static void send_request(struct Client *client) {
+  struct LoadThread *thread = client->thread;
+  int entry = pick_entry(thread);
+  const struct MixEntry *mix = &s_mix[entry];
+  const char *etag = thread->stats[entry].etag;
+  char path[256];
+
+  if (mix->kind == KIND_MISS && strstr(mix->path, "%u") != NULL) {
+    // Walking files in order defeats an LRU cache smaller than the file set
+    snprintf(path, sizeof(path), mix->path, thread->miss_counter++ % s_miss_files);
+  } else {
+    snprintf(path, sizeof(path), "%s", mix->path);
+  }
+
+  client->entry = entry;
+  client->in_body = false;
+  if (s_keepalive) {
+    client->start_ns = BenchNowNs();
+  }
+  if (mix->kind == KIND_LOGIN) {
+    mg_printf(client->c, "POST %s HTTP/1.1\r\n"
+                         "Host: localhost\r\n"
+                         "Content-Type: application/x-www-form-urlencoded\r\n"
+                         "Content-Length: %d\r\n"
+                         "%s"
+                         "\r\n"
+                         "%s",
+              path, (int) sizeof(s_login_form) - 1,
+              s_keepalive ? "Connection: keep-alive\r\n" : "Connection: close\r\n", s_login_form);
+    return;
+  }
+  mg_printf(client->c, "GET %s HTTP/1.1\r\n"
+                       "Host: localhost\r\n"
+                       "%s%s%s"
+                       "%s"
+                       "\r\n",
+            path, mix->kind == KIND_REVALIDATE && etag[0] ? "If-None-Match: " : "",
+            mix->kind == KIND_REVALIDATE ? etag : "", mix->kind == KIND_REVALIDATE && etag[0] ? "\r\n" : "",
+            s_keepalive ? "Connection: keep-alive\r\n" : "Connection: close\r\n");
+}
+
+static void complete_request(struct Client *client) {
+  uint64_t now = BenchNowNs();
+  struct MixStats *stats = &client->thread->stats[client->entry];
+  if (client->start_ns >= s_measure_start && now < s_measure_end) {
+    samples_push(&stats->samples, now - client->start_ns);
+    if (client->status != s_kind_status[s_mix[client->entry].kind]) {
+      stats->unexpected++;
+    }
+  }
+  client->entry = -1;
+
+  if (s_keepalive && running()) {
+    send_request(client);
+  } else {
+    client->c->is_draining = 1;
+  }
+}
+
+// Parse the response incrementally, discarding body bytes as they arrive
+static void on_read(struct Client *client) {
+  struct mg_connection *c = client->c;
+  while (client->entry >= 0 && c->recv.len > 0) {
+    struct MixStats *stats = &client->thread->stats[client->entry];
+    if (!client->in_body) {
+      struct mg_http_message hm;
+      int n = mg_http_parse((const char *) c->recv.buf, c->recv.len, &hm);
+      if (n == 0) {
+        return;
+      }
+      if (n < 0) {
+        stats->errors++;
+        c->is_closing = 1;
+        return;
+      }
+      client->status = mg_http_status(&hm);
+      struct mg_str *length = mg_http_get_header(&hm, "Content-Length");
+      client->body_left = 0;
+      if (client->status != 304 && client->status != 204 && length != NULL) {
+        client->body_left = strtoull(length->buf, NULL, 10);
+      }
+      struct mg_str *etag = mg_http_get_header(&hm, "ETag");
+      if (s_mix[client->entry].kind == KIND_REVALIDATE && stats->etag[0] == '\0' && etag != NULL &&
+          etag->len < LOADGEN_ETAG_LEN) {
+        memcpy(stats->etag, etag->buf, etag->len);
+        stats->etag[etag->len] = '\0';
+      }
+      mg_iobuf_del(&c->recv, 0, (size_t) n);
+      client->in_body = true;
+    }
+
+    size_t take = c->recv.len < client->body_left ? c->recv.len : (size_t) client->body_left;
+    mg_iobuf_del(&c->recv, 0, take);
+    client->body_left -= take;
+    stats->bytes += take;
+    if (client->body_left == 0) {
+      complete_request(client);
+    }
+  }
+}
+
+static void client_handler(struct mg_connection *c, int ev, void *ev_data) {
+  struct Client *client = (struct Client *) c->fn_data;
+  (void) ev_data;
+
+  if (ev == MG_EV_CONNECT) {
+    send_request(client);
+  } else if (ev == MG_EV_ERROR) {
+    if (client->entry < 0 && running()) {
+      client->thread->connect_errors++;
+    }
+  } else if (ev == MG_EV_READ) {
+    on_read(client);
+  } else if (ev == MG_EV_CLOSE) {
+    if (client->entry >= 0 && running()) {
+      client->thread->stats[client->entry].errors++;
+    }
+    client->c = NULL;
+    client->entry = -1;
+    if (running()) {
+      open_client(client);
+    }
+  }
+}
+
+static void open_client(struct Client *client) {
+  client->entry = -1;
+  if (!s_keepalive) {
+    client->start_ns = BenchNowNs();  // New-connection latency includes the handshake
+  }
+  client->c = mg_connect(&client->thread->mgr, s_url, client_handler, client);
+}
+
+static void thread_run(void *arg) {
+  struct LoadThread *thread = (struct LoadThread *) arg;
+  for (int i = 0; i < thread->client_count; i++) {
+    open_client(&thread->clients[i]);
+  }
+
+  // Keep polling until the run is over and every connection has wound down
+  uint64_t deadline = s_measure_end + 2000000000ULL;
+  for (;;) {
+    bool open = false;
+    for (int i = 0; i < thread->client_count; i++) {
+      open |= thread->clients[i].c != NULL;
+    }
+    if (!open && !running()) {
+      break;
+    }
+    if (BenchNowNs() > deadline) {
+      break;
+    }
+    mg_mgr_poll(&thread->mgr, 10);
+  }
+}
+
+static int compare_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+  return x < y ? -1 : x > y;
+}
+
+static double percentile_us(const struct Samples *samples, double q) {
+  if (samples->count == 0) {
+    return 0;
+  }
+  size_t index = (size_t) (q * (double) (samples->count - 1) + 0.5);
+  return (double) samples->ns[index] / 1e3;
+}
+
+static void report(const char *kind, const char *path, struct Samples *samples, uint64_t bytes,
+                   uint64_t unexpected, uint64_t errors, double seconds) {
+  qsort(samples->ns, samples->count, sizeof(uint64_t), compare_u64);
+  BENCH_REPORT("loadgen", "scenario=%s kind=%s path=%s connections=%d idle=%d threads=%d keepalive=%d requests=%zu "
+               "rps=%.0f mbps=%.1f p50_us=%.1f p99_us=%.1f p999_us=%.1f max_us=%.1f "
+               "unexpected=%llu errors=%llu",
+               s_scenario, kind, path, s_connections, s_idle, s_threads, s_keepalive ? 1 : 0, samples->count,
+               (double) samples->count / seconds, (double) bytes * 8 / 1e6 / seconds,
+               percentile_us(samples, 0.50), percentile_us(samples, 0.99),
+               percentile_us(samples, 0.999),
+               samples->count ? (double) samples->ns[samples->count - 1] / 1e3 : 0.0,
+               (unsigned long long) unexpected, (unsigned long long) errors);
+}
+
+// Open count plain sockets to the target and leave them silent; returns how many connected.
+// Loopback targets are reached from 127.0.0.2, 127.0.0.3, ... so the ephemeral
+// port range of a single source address is not the limit.
+static int open_idle(int *fds, int count) {
+  int opened = 0;
+#if !defined(_WIN32)
+  struct mg_addr addr;
+  memset(&addr, 0, sizeof(addr));
+  if (!mg_aton(mg_url_host(s_url), &addr) || addr.is_ip6) {
+    fprintf(stderr, "-i needs an IPv4 target\n");
+    return 0;
+  }
+  struct sockaddr_in to;
+  memset(&to, 0, sizeof(to));
+  to.sin_family = AF_INET;
+  to.sin_port = mg_htons(mg_url_port(s_url));
+  memcpy(&to.sin_addr, addr.ip, 4);
+
+  for (int i = 0; i < count; i++) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+      break;
+    }
+    if (addr.ip[0] == 127) {
+      struct sockaddr_in from;
+      memset(&from, 0, sizeof(from));
+      from.sin_family = AF_INET;
+      from.sin_addr.s_addr = mg_htonl(0x7f000002 + (uint32_t) (i / LOADGEN_IDLE_PER_SOURCE));
+      bind(fd, (struct sockaddr *) &from, sizeof(from));
+    }
+    if (connect(fd, (struct sockaddr *) &to, sizeof(to)) != 0) {
+      close(fd);
+      break;
+    }
+    fds[opened++] = fd;
+  }
+#else
+  (void) fds;
+  (void) count;
+#endif
+  return opened;
+}
+
+// Close the idle sockets; returns how many the server had not closed meanwhile
+static int close_idle(int *fds, int count) {
+  int alive = 0;
+#if !defined(_WIN32)
+  for (int i = 0; i < count; i++) {
+    char byte;
+    ssize_t n = recv(fds[i], &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+    alive += n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+    close(fds[i]);
+  }
+#else
+  (void) fds;
+  (void) count;
+#endif
+  return alive;
+}
+
+static bool parse_kind(const char *name, size_t len, enum LoadKind *kind) {
+  for (int k = 0; k < KIND_COUNT; k++) {
+    if (strlen(s_kind_names[k]) == len && strncmp(s_kind_names[k], name, len) == 0) {
+      *kind = (enum LoadKind) k;
+      return true;
+    }
+  }
+  return false;
+}
+
+// "kind:path:weight,..." with the weight optional (default 1)
+static bool parse_mix(const char *spec) {
+  struct mg_str rest = mg_str(spec), item;
+  s_mix_count = 0;
+  s_mix_total = 0;
+  while (mg_span(rest, &item, &rest, ',')) {
+    struct mg_str kind, path, weight;
+    if (s_mix_count == LOADGEN_MAX_KINDS || !mg_span(item, &kind, &item, ':') ||
+        !mg_span(item, &path, &weight, ':') || path.len == 0 || path.len >= sizeof(s_mix[0].path)) {
+      return false;
+    }
+    struct MixEntry *entry = &s_mix[s_mix_count++];
+    if (!parse_kind(kind.buf, kind.len, &entry->kind)) {
+      return false;
+    }
+    memcpy(entry->path, path.buf, path.len);
+    entry->path[path.len] = '\0';
+    entry->weight = weight.len > 0 ? (unsigned) strtoul(weight.buf, NULL, 10) : 1;
+    s_mix_total += entry->weight;
+  }
+  return s_mix_count > 0 && s_mix_total > 0;
+}
+
+static int usage(const char *argv0) {
+  fprintf(stderr, "usage: %s [-u url] [-c connections] [-t threads] [-d seconds] [-w warmup]"
+                  " [-k 0|1] [-f miss_files] [-m kind:path:weight,...] [-s scenario] [-i idle]\n"
+                  "kinds: hit revalidate miss notfound large login\n", argv0);
+  return 2;
+}
+
+int main(int argc, char *argv[]) {
+  const char *mix = "hit:/index.html:1";
+  for (int i = 1; i + 1 < argc; i += 2) {
+    const char *value = argv[i + 1];
+    if (strcmp(argv[i], "-u") == 0) {
+      s_url = value;
+    } else if (strcmp(argv[i], "-c") == 0) {
+      s_connections = atoi(value);
+    } else if (strcmp(argv[i], "-t") == 0) {
+      s_threads = atoi(value);
+    } else if (strcmp(argv[i], "-d") == 0) {
+      s_duration = atof(value);
+    } else if (strcmp(argv[i], "-w") == 0) {
+      s_warmup = atof(value);
+    } else if (strcmp(argv[i], "-k") == 0) {
+      s_keepalive = atoi(value) != 0;
+    } else if (strcmp(argv[i], "-f") == 0) {
+      s_miss_files = (unsigned) strtoul(value, NULL, 10);
+    } else if (strcmp(argv[i], "-m") == 0) {
+      mix = value;
+    } else if (strcmp(argv[i], "-s") == 0) {
+      s_scenario = value;
+    } else if (strcmp(argv[i], "-i") == 0) {
+      s_idle = atoi(value);
+    } else {
+      return usage(argv[0]);
+    }
+  }
+  if (s_connections <= 0 || s_threads <= 0 || s_duration <= 0 || s_miss_files == 0 || s_idle < 0 ||
+      !parse_mix(mix)) {
+    return usage(argv[0]);
+  }
+  if (s_threads > s_connections) {
+    s_threads = s_connections;
+  }
+  mg_log_set(MG_LL_NONE);
+
+  struct LoadThread *threads = calloc((size_t) s_threads, sizeof(struct LoadThread));
+  struct Client *clients = calloc((size_t) s_connections, sizeof(struct Client));
+  int *idle_fds = calloc((size_t) s_idle + 1, sizeof(int));
+  if (threads == NULL || clients == NULL || idle_fds == NULL) {
+    return 1;
+  }
+
+  // Idle connections are all open before the clock starts
+  GH_ListenerRaiseFdLimit((size_t) s_idle + (size_t) s_connections + LISTENER_FD_RESERVE);
+  int idle_opened = open_idle(idle_fds, s_idle);
+  if (idle_opened < s_idle) {
+    fprintf(stderr, "opened %d of %d idle connections\n", idle_opened, s_idle);
+  }
+
+  s_measure_start = BenchNowNs() + (uint64_t) (s_warmup * 1e9);
+  s_measure_end = s_measure_start + (uint64_t) (s_duration * 1e9);
+
+  // Spread connections evenly; thread 0 runs on the main thread
+  int next_client = 0;
+  for (int t = 0; t < s_threads; t++) {
+    struct LoadThread *thread = &threads[t];
+    thread->client_count = s_connections / s_threads + (t < s_connections % s_threads);
+    thread->clients = &clients[next_client];
+    next_client += thread->client_count;
+    thread->rng = 0x9e3779b97f4a7c15ULL ^ ((uint64_t) t + 1) * 0xbf58476d1ce4e5b9ULL;
+    thread->miss_counter = (unsigned) t * (s_miss_files / (unsigned) s_threads);
+    for (int i = 0; i < thread->client_count; i++) {
+      thread->clients[i].thread = thread;
+    }
+    mg_mgr_init(&thread->mgr);
+  }
+  for (int t = 1; t < s_threads; t++) {
+    if (!GH_ThreadStart(&threads[t].handle, thread_run, &threads[t])) {
+      fprintf(stderr, "failed to start thread %d\n", t);
+      return 1;
+    }
+  }
+  thread_run(&threads[0]);
+  for (int t = 1; t < s_threads; t++) {
+    GH_ThreadJoin(threads[t].handle);
+  }
+
+  // Merge per-thread results, one line per mix entry plus the total
+  struct Samples all = {0};
+  uint64_t all_bytes = 0, all_unexpected = 0, all_errors = 0;
+  for (int e = 0; e < s_mix_count; e++) {
+    struct Samples merged = {0};
+    uint64_t bytes = 0, unexpected = 0, errors = 0;
+    for (int t = 0; t < s_threads; t++) {
+      struct MixStats *stats = &threads[t].stats[e];
+      for (size_t i = 0; i < stats->samples.count; i++) {
+        samples_push(&merged, stats->samples.ns[i]);
+        samples_push(&all, stats->samples.ns[i]);
+      }
+      bytes += stats->bytes;
+      unexpected += stats->unexpected;
+      errors += stats->errors;
+      free(stats->samples.ns);
+    }
+    report(s_kind_names[s_mix[e].kind], s_mix[e].path, &merged, bytes, unexpected, errors, s_duration);
+    all_bytes += bytes;
+    all_unexpected += unexpected;
+    all_errors += errors;
+    free(merged.ns);
+  }
+  for (int t = 0; t < s_threads; t++) {
+    all_errors += threads[t].connect_errors;
+  }
+  report("all", "*", &all, all_bytes, all_unexpected, all_errors, s_duration);
+  free(all.ns);
+  if (s_idle > 0) {
+    BENCH_REPORT("loadgen_idle", "scenario=%s idle=%d opened=%d open_at_end=%d", s_scenario, s_idle, idle_opened,
+                 close_idle(idle_fds, idle_opened));
+  }
+  free(idle_fds);
+
+  for (int t = 0; t < s_threads; t++) {
+    mg_mgr_free(&threads[t].mgr);
+  }
+  free(threads);
+  free(clients);
+  return all_errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,127 @@
+#include "Bench.h"
+#include "plugins/CacheManager.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__linux__)
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+// Satisfies the extern declared by CacheManager.h
+struct CacheBucket g_cache = {0};
+
+// Long add/evict churn over mixed entry sizes, reporting at checkpoints how the
+// process RSS compares to the bytes charged to the budget and to the bodies
+// actually cached. Each allocator runs in a fresh process so neither inherits
+// the other's heap (RSS is only measured on Linux).
+
+#define BENCH_PATHS 40000
+#define BENCH_ADDS 400000
+#define BENCH_CHECKPOINTS 8
+#define BENCH_MIN_BODY 128
+#define BENCH_MAX_BODY (192 * 1024)
+
+static double rss_mb(void) {
+#if defined(__linux__)
+  FILE *statm = fopen("/proc/self/statm", "r");
+  unsigned long pages = 0, resident = 0;
+  if (statm == NULL) {
+    return 0;
+  }
+  if (fscanf(statm, "%lu %lu", &pages, &resident) != 2) {
+    resident = 0;
+  }
+  fclose(statm);
+  return (double) resident * (double) sysconf(_SC_PAGESIZE) / (1024.0 * 1024.0);
+#else
+  return 0;
+#endif
+}
+
+// Body bytes of every live entry, i.e. what a perfect allocator would need
+static size_t body_bytes(struct CacheBucket *cache) {
+  size_t total = 0;
+  for (size_t i = 0; i < CACHE_SHARD_COUNT; i++) {
+    for (int segment = 0; segment < CACHE_SEG_COUNT; segment++) {
+      for (struct CacheEntry *e = cache->shards[i].lists[segment].head; e != NULL; e = e->lru_next) {
+        total += e->data_len;
+        for (int enc = 0; enc < CACHE_ENC_COUNT; enc++) {
+          total += e->encoded[enc].data_len;
+        }
+      }
+    }
+  }
+  return total;
+}
+
+static void report(const char *allocator, const char *phase, size_t adds, struct CacheBucket *cache,
+                   uint64_t elapsed_ns) {
+  double mb = 1024.0 * 1024.0;
+  double charged = (double) GH_AtomicLoadSize(&cache->size) / mb;
+  double rss = rss_mb();
+  BENCH_REPORT("cache_memory", "allocator=%s phase=%s adds=%zu entries=%zu body_mb=%.1f charged_mb=%.1f "
+               "reserved_mb=%.1f rss_mb=%.1f rss_per_charged=%.3f ns_per_add=%.0f",
+               allocator, phase, adds, GH_AtomicLoadSize(&cache->entry_count), (double) body_bytes(cache) / mb,
+               charged, (double) GH_AtomicLoadSize(&cache->arena.reserved) / mb, rss,
+               charged > 0 ? rss / charged : 0.0, adds > 0 ? (double) elapsed_ns / (double) adds : 0.0);
+}
+
+static void bench_churn(bool slabs) {
+  const char *allocator = slabs ? "slab" : "malloc";
+  struct CacheBucket cache;
+  GH_CacheInit(&cache);
+  GH_CacheArenaDestroy(&cache.arena);
+  GH_CacheArenaInit(&cache.arena, slabs);
+
+  char *payload = calloc(1, BENCH_MAX_BODY);
+  if (payload == NULL) {
+    exit(1);
+  }
+  report(allocator, "start", 0, &cache, 0);
+
+  // Log-uniform sizes: many small assets, a long tail of large ones
+  uint64_t rng = 0x9e3779b97f4a7c15ULL;
+  char path[64];
+  uint64_t start = BenchNowNs();
+  for (size_t i = 1; i <= BENCH_ADDS; i++) {
+    double u = (double) (BenchRand(&rng) >> 11) / 9007199254740992.0;
+    size_t size = (size_t) ((double) BENCH_MIN_BODY * pow((double) BENCH_MAX_BODY / BENCH_MIN_BODY, u));
+    snprintf(path, sizeof(path), "./assets/%06u.bin", (unsigned) (BenchRand(&rng) % BENCH_PATHS));
+    GH_CacheAdd(&cache, path, payload, size, "\"0123456789abcdef-0\"", 0);
+    if (i % (BENCH_ADDS / BENCH_CHECKPOINTS) == 0) {
+      report(allocator, "churn", i, &cache, BenchNowNs() - start);
+    }
+  }
+
+  GH_CacheArenaTrim(&cache.arena);
+  report(allocator, "trimmed", BENCH_ADDS, &cache, 0);
+  GH_CacheClear(&cache);
+  report(allocator, "cleared", BENCH_ADDS, &cache, 0);
+  free(payload);
+  GH_CacheCleanup(&cache);
+}
+
+static void run(bool slabs) {
+#if defined(__linux__)
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == 0) {
+    bench_churn(slabs);
+    fflush(stdout);
+    _exit(0);
+  }
+  if (pid > 0) {
+    waitpid(pid, NULL, 0);
+    return;
+  }
+#endif
+  bench_churn(slabs);
+}
+
+int main(void) {
+  run(false);
+  run(true);
+  return 0;
+}
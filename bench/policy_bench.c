@@ -0,0 +1,138 @@
+#include "Bench.h"
+#include "plugins/CacheManager.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Satisfies the extern declared by CacheManager.h
+struct CacheBucket g_cache = {0};
+
+// Hit ratio of each policy on a skewed workload: Zipf-distributed requests for
+// small assets, interleaved with one-off scans over large rarely used files.
+// Every miss is admitted the way the loader does it (GH_CacheAdd on miss).
+
+#define BENCH_PATH_LEN 48
+#define BENCH_REQUESTS 2000000
+#define BENCH_HOT_FILES 50000          // Zipf-popular assets, 2-32 KB
+#define BENCH_SCAN_FILES 20000         // Scanned once per pass, 64-512 KB
+#define BENCH_SCAN_EVERY 10            // One in this many requests belongs to a scan
+
+struct BenchObject {
+    char path[BENCH_PATH_LEN];
+    size_t size;
+};
+
+static struct BenchObject *make_objects(size_t count, const char *prefix, size_t min, size_t max,
+                                        uint64_t *rng) {
+  struct BenchObject *objects = malloc(count * sizeof(*objects));
+  if (objects == NULL) {
+    exit(1);
+  }
+  for (size_t i = 0; i < count; i++) {
+    snprintf(objects[i].path, BENCH_PATH_LEN, "./%s/file_%06zu.bin", prefix, i);
+    objects[i].size = min + (size_t)(BenchRand(rng) % (max - min + 1));
+  }
+  return objects;
+}
+
+// Cumulative Zipf(s) distribution over count ranks
+static double *make_zipf(size_t count, double s) {
+  double *cdf = malloc(count * sizeof(double));
+  if (cdf == NULL) {
+    exit(1);
+  }
+  double sum = 0;
+  for (size_t i = 0; i < count; i++) {
+    sum += 1.0 / pow((double)(i + 1), s);
+    cdf[i] = sum;
+  }
+  for (size_t i = 0; i < count; i++) {
+    cdf[i] /= sum;
+  }
+  return cdf;
+}
+
+static size_t zipf_pick(const double *cdf, size_t count, uint64_t *rng) {
+  double u = (double)(BenchRand(rng) >> 11) / 9007199254740992.0;
+  size_t lo = 0, hi = count - 1;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (cdf[mid] < u) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+static void bench_policy(const char *policy, double skew, const struct BenchObject *hot,
+                         const struct BenchObject *scan, const double *cdf, const char *payload) {
+  struct CacheBucket cache;
+  GH_CacheInit(&cache);
+  if (!GH_CacheSetPolicy(&cache, policy)) {
+    fprintf(stderr, "unknown policy %s\n", policy);
+    exit(1);
+  }
+
+  uint64_t rng = 0x9e3779b97f4a7c15ULL;
+  size_t scan_next = 0;
+  size_t requests = 0, hits = 0, hot_requests = 0, hot_hits = 0;
+  uint64_t bytes = 0, hit_bytes = 0;
+
+  uint64_t start = BenchNowNs();
+  for (size_t i = 0; i < BENCH_REQUESTS; i++) {
+    bool scanning = BenchRand(&rng) % BENCH_SCAN_EVERY == 0;
+    const struct BenchObject *object = scanning
+        ? &scan[scan_next++ % BENCH_SCAN_FILES]
+        : &hot[zipf_pick(cdf, BENCH_HOT_FILES, &rng)];
+
+    struct CacheEntry *entry = GH_CacheAcquire(&cache, object->path);
+    bool hit = entry != NULL;
+    GH_CacheRelease(entry);
+    if (!hit) {
+      GH_CacheAdd(&cache, object->path, payload, object->size, "\"etag\"", 0);
+    }
+
+    requests++;
+    hits += hit;
+    bytes += object->size;
+    hit_bytes += hit ? object->size : 0;
+    if (!scanning) {
+      hot_requests++;
+      hot_hits += hit;
+    }
+  }
+  uint64_t elapsed = BenchNowNs() - start;
+
+  BENCH_REPORT("cache_policy", "policy=%s skew=%.2f budget_mb=%d requests=%zu hit_ratio=%.4f "
+               "hot_hit_ratio=%.4f byte_hit_ratio=%.4f ns_per_request=%.1f",
+               policy, skew, CACHE_MAX_SIZE_MB, requests, (double)hits / requests,
+               (double)hot_hits / hot_requests, (double)hit_bytes / bytes, (double)elapsed / requests);
+  GH_CacheCleanup(&cache);
+}
+
+int main(void) {
+  static const char *policies[] = {"lru", "tinylfu"};
+  static const double skews[] = {0.7, 0.9, 1.1};
+  uint64_t rng = 0x2545f4914f6cdd1dULL;
+  struct BenchObject *hot = make_objects(BENCH_HOT_FILES, "assets", 2048, 32768, &rng);
+  struct BenchObject *scan = make_objects(BENCH_SCAN_FILES, "archive", 65536, 524288, &rng);
+  char *payload = calloc(1, 524288);
+  if (payload == NULL) {
+    return 1;
+  }
+
+  for (size_t s = 0; s < sizeof(skews) / sizeof(skews[0]); s++) {
+    double *cdf = make_zipf(BENCH_HOT_FILES, skews[s]);
+    for (size_t p = 0; p < sizeof(policies) / sizeof(policies[0]); p++) {
+      bench_policy(policies[p], skews[s], hot, scan, cdf, payload);
+    }
+    free(cdf);
+  }
+
+  free(payload);
+  free(scan);
+  free(hot);
+  return 0;
+}
@@ -0,0 +1,51 @@
+#!/usr/bin/env bash
+# Files the server reads or writes itself must not be served even when they
+# lie in the served root. The server is started on defaults, plus HTTPS so the
+# TLS files are loaded, a --config file and an access log, in a directory
+# holding them (rotated logs need not exist yet); every spelling of their
+# paths has to answer 404 over both listeners while a neighbouring file
+# answers 200.
+# Usage: bench/private_files.sh <path/to/GrowplusHttp>
+
+set -eu
+
+BIN="$(realpath "${1:?usage: $0 <GrowplusHttp binary>}")"
+SERVER_ARGS="${SERVER_ARGS:---https https://127.0.0.1:8443 --config growplus.cfg --access-log access.log}"
+URLS="http://127.0.0.1:8000 https://127.0.0.1:8443"
+
+ROOT="$(mktemp -d)"
+PID=""
+trap 'kill $PID 2>/dev/null || true; rm -rf "$ROOT"' EXIT
+echo "public" > "$ROOT/public.txt"
+printf 'server_name = test\n' > "$ROOT/server_data.cfg"
+openssl req -x509 -newkey rsa:2048 -nodes -subj /CN=localhost -days 1 \
+  -keyout "$ROOT/key.pem" -out "$ROOT/cert.pem" > /dev/null 2>&1
+printf 'admin-token = secret\n' > "$ROOT/growplus.cfg"
+PRIVATE="server_data.cfg key.pem cert.pem growplus.cfg access.log access.log.1"
+
+(cd "$ROOT" && exec "$BIN" $SERVER_ARGS > "$ROOT/.server.log" 2>&1) &
+PID=$!
+sleep 1
+
+status() {
+  curl -sk --path-as-is -o /dev/null -w '%{http_code}' "$1"
+}
+
+FAILED=0
+CHECKED=0
+for FILE in $PRIVATE; do
+  ESCAPED="%$(printf '%s' "${FILE:0:1}" | od -An -tx1 | tr -d ' \n')${FILE:1}"
+  for URL in $URLS; do
+    for SPELLING in "/$FILE" "/./$FILE" "//$FILE" "/nowhere/../$FILE" "/$ESCAPED" "/$FILE?x=1"; do
+      CODE="$(status "$URL$SPELLING")"
+      CHECKED=$((CHECKED + 1))
+      if [ "$CODE" != 404 ]; then
+        echo "served $URL$SPELLING: $CODE"
+        FAILED=$((FAILED + 1))
+      fi
+    done
+  done
+done
+PUBLIC="$(status http://127.0.0.1:8000/public.txt)"
+echo "bench=private_files checked=$CHECKED exposed=$FAILED public_status=$PUBLIC"
+[ "$FAILED" = 0 ] && [ "$PUBLIC" = 200 ]
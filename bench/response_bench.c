@@ -0,0 +1,89 @@
+#include "Bench.h"
+#include "plugins/CacheManager.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Satisfies the extern declared by CacheManager.h
+struct CacheBucket g_cache = {0};
+
+#define BENCH_HITS 2000000
+
+static const char *const s_paths[] = {
+  "./index.html", "./css/style.css", "./js/app.js", "./data/items.json",
+  "./img/logo.png", "./img/photo.jpeg", "./fonts/game.woff2", "./cache/items.rttex",
+};
+#define BENCH_PATH_COUNT (sizeof(s_paths) / sizeof(s_paths[0]))
+
+// Per-hit header work as serve_from_cache did it before prebuilt header blocks
+static size_t legacy_headers(const struct CacheEntry *entry, char *out, size_t out_len) {
+  const char *content_type = "application/octet-stream";
+  if (strstr(entry->path, ".html")) content_type = "text/html";
+  else if (strstr(entry->path, ".css")) content_type = "text/css";
+  else if (strstr(entry->path, ".js")) content_type = "application/javascript";
+  else if (strstr(entry->path, ".json")) content_type = "application/json";
+  else if (strstr(entry->path, ".png")) content_type = "image/png";
+  else if (strstr(entry->path, ".jpg") || strstr(entry->path, ".jpeg")) content_type = "image/jpeg";
+  else if (strstr(entry->path, ".gif")) content_type = "image/gif";
+  else if (strstr(entry->path, ".svg")) content_type = "image/svg+xml";
+  else if (strstr(entry->path, ".ico")) content_type = "image/x-icon";
+  else if (strstr(entry->path, ".woff")) content_type = "font/woff";
+  else if (strstr(entry->path, ".woff2")) content_type = "font/woff2";
+  else if (strstr(entry->path, ".ttf")) content_type = "font/ttf";
+
+  return mg_snprintf(out, out_len, "HTTP/1.1 200 OK\r\n"
+                     "Content-Type: %s\r\n"
+                     "Content-Length: %lu\r\n"
+                     "%s%s%s"
+                     "%s"
+                     "ETag: %s\r\n"
+                     "Cache-Control: public, max-age=300\r\n"
+                     "Connection: keep-alive\r\n"
+                     "Accept-Ranges: bytes\r\n"
+                     "\r\n",
+                     content_type, (unsigned long) entry->data_len, "", "", "", "",
+                     entry->etag ? entry->etag : "");
+}
+
+// Per-hit header work now: append the block serialized at GH_CacheAdd time
+static size_t prebuilt_headers(const struct CacheEntry *entry, char *out, size_t out_len) {
+  size_t len = entry->headers.ok_len < out_len ? entry->headers.ok_len : out_len;
+  memcpy(out, entry->headers.ok, len);
+  return len;
+}
+
+static void bench_headers(const char *name, struct CacheEntry **entries,
+                          size_t (*fn)(const struct CacheEntry *, char *, size_t)) {
+  char out[512];
+  uint64_t rng = 0x9e3779b97f4a7c15ULL;
+  size_t bytes = 0;
+  uint64_t start = BenchNowNs();
+  for (size_t i = 0; i < BENCH_HITS; i++) {
+    bytes += fn(entries[BenchRand(&rng) % BENCH_PATH_COUNT], out, sizeof(out));
+  }
+  uint64_t ns = BenchNowNs() - start;
+  BENCH_REPORT("response_headers", "mode=%s hit_ns=%.1f bytes=%zu",
+               name, (double) ns / BENCH_HITS, bytes);
+}
+
+int main(void) {
+  static const char payload[4096] = {0};
+  struct CacheBucket cache;
+  struct CacheEntry *entries[BENCH_PATH_COUNT];
+  GH_CacheInit(&cache);
+  for (size_t i = 0; i < BENCH_PATH_COUNT; i++) {
+    GH_CacheAdd(&cache, s_paths[i], payload, sizeof(payload), "\"1a2b3c4d-5e6f7a8b\"", 0);
+    entries[i] = GH_CacheAcquire(&cache, s_paths[i]);
+    if (entries[i] == NULL) {
+      return 1;
+    }
+  }
+
+  bench_headers("legacy", entries, legacy_headers);
+  bench_headers("prebuilt", entries, prebuilt_headers);
+
+  for (size_t i = 0; i < BENCH_PATH_COUNT; i++) {
+    GH_CacheRelease(entries[i]);
+  }
+  GH_CacheCleanup(&cache);
+  return 0;
+}
@@ -0,0 +1,126 @@
+#include "Bench.h"
+#include "server/Router.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Dispatch cost at 5, 50 and 500 routes: the compiled router against the
+// sequential mg_match chain it replaced, for requests that hit an exact route,
+// a "*" route, a "#" route, and for static file paths that match no route
+// (the common case, which walks the whole chain).
+
+#define BENCH_LOOKUPS 2000000
+#define BENCH_URIS 64
+
+static volatile size_t s_sink;
+
+static void route_noop(struct mg_connection *c, struct mg_http_message *hm, const struct RouteMatch *match) {
+  (void) c;
+  (void) hm;
+  (void) match;
+}
+
+//! Struct for one route table size under test
+struct BenchTable {
+    struct Router router; //!< Compiled table
+    char (*patterns)[64]; //!< Same routes, in registration order, for the chain
+    size_t count; //!< Number of routes
+};
+
+// Three of five routes are exact API paths, one "*" and one "#"
+static void table_build(struct BenchTable *table, size_t count) {
+  GH_RouterInit(&table->router);
+  table->patterns = calloc(count, sizeof(*table->patterns));
+  table->count = count;
+  if (table->patterns == NULL) {
+    exit(1);
+  }
+  for (size_t i = 0; i < count; i++) {
+    char *pattern = table->patterns[i];
+    if (i % 5 == 3) {
+      snprintf(pattern, sizeof(table->patterns[i]), "/files_%zu/*/meta", i);
+    } else if (i % 5 == 4) {
+      snprintf(pattern, sizeof(table->patterns[i]), "/static_%zu/#", i);
+    } else {
+      snprintf(pattern, sizeof(table->patterns[i]), "/api/v1/resource_%zu", i);
+    }
+    if (!GH_RouterAdd(&table->router, ROUTE_GET | ROUTE_HEAD, pattern, route_noop, NULL)) {
+      exit(1);
+    }
+  }
+  if (!GH_RouterBuild(&table->router)) {
+    exit(1);
+  }
+}
+
+static void table_free(struct BenchTable *table) {
+  free(table->patterns);
+  GH_RouterFree(&table->router);
+}
+
+// URIs of one kind, spread over the table so neither side benefits from a single hot route
+static void make_uris(const struct BenchTable *table, const char *kind, char uris[][96]) {
+  uint64_t rng = 0x9e3779b97f4a7c15ULL;
+  for (size_t i = 0; i < BENCH_URIS; i++) {
+    size_t route = (size_t) (BenchRand(&rng) % (table->count / 5)) * 5;
+    if (strcmp(kind, "exact") == 0) {
+      snprintf(uris[i], 96, "/api/v1/resource_%zu", route + 1);
+    } else if (strcmp(kind, "star") == 0) {
+      snprintf(uris[i], 96, "/files_%zu/item%zu/meta", route + 3, i);
+    } else if (strcmp(kind, "rest") == 0) {
+      snprintf(uris[i], 96, "/static_%zu/css/theme%zu.css", route + 4, i);
+    } else {
+      snprintf(uris[i], 96, "/assets/img/sprite_%zu.png", i);
+    }
+  }
+}
+
+static double bench_router(const struct BenchTable *table, char uris[][96]) {
+  struct mg_str method = mg_str("GET");
+  struct RouteMatch match;
+  size_t hits = 0;
+  uint64_t start = BenchNowNs();
+  for (size_t i = 0; i < BENCH_LOOKUPS; i++) {
+    hits += GH_RouterMatch(&table->router, method, mg_str(uris[i % BENCH_URIS]), &match);
+  }
+  uint64_t elapsed = BenchNowNs() - start;
+  s_sink += hits;
+  return (double) elapsed / BENCH_LOOKUPS;
+}
+
+static double bench_chain(const struct BenchTable *table, char uris[][96]) {
+  size_t hits = 0;
+  size_t lookups = BENCH_LOOKUPS / (table->count / 5);  // The chain is linear; keep large tables quick
+  uint64_t start = BenchNowNs();
+  for (size_t i = 0; i < lookups; i++) {
+    struct mg_str uri = mg_str(uris[i % BENCH_URIS]);
+    for (size_t r = 0; r < table->count; r++) {
+      if (mg_match(uri, mg_str(table->patterns[r]), NULL)) {
+        hits++;
+        break;
+      }
+    }
+  }
+  uint64_t elapsed = BenchNowNs() - start;
+  s_sink += hits;
+  return (double) elapsed / (double) lookups;
+}
+
+int main(void) {
+  static const size_t sizes[] = {5, 50, 500};
+  static const char *kinds[] = {"exact", "star", "rest", "miss"};
+  static char uris[BENCH_URIS][96];
+
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    struct BenchTable table;
+    table_build(&table, sizes[s]);
+    for (size_t k = 0; k < sizeof(kinds) / sizeof(kinds[0]); k++) {
+      make_uris(&table, kinds[k], uris);
+      double router_ns = bench_router(&table, uris);
+      double chain_ns = bench_chain(&table, uris);
+      BENCH_REPORT("router_dispatch", "routes=%zu kind=%s router_ns=%.1f chain_ns=%.1f speedup=%.1fx",
+                   sizes[s], kinds[k], router_ns, chain_ns, router_ns > 0 ? chain_ns / router_ns : 0.0);
+    }
+    table_free(&table);
+  }
+  return 0;
+}
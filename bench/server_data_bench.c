@@ -0,0 +1,159 @@
+#include "Bench.h"
+#include "plugins/CacheManager.h"
+#include "server/ServerData.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Satisfies the extern declared by CacheManager.h
+struct CacheBucket g_cache = {0};
+
+// Login storm against the server_data.php handler, in process: worker threads
+// answer client forms as fast as they can while a reloader swaps the config
+// every millisecond. "prebuilt" is the dedicated handler (parse the version,
+// pick the block, copy it out); "cached_file" is the static path it replaced
+// (build the path, look the file up in the cache, copy headers and body).
+// End-to-end storms over sockets: bench/load_mix.sh ... login login_new
+
+#define BENCH_REQUESTS 4000000
+#define BENCH_MAX_THREADS 8
+#define BENCH_CONFIG "server_data_bench.cfg"
+
+static const char *s_configs[2] = {
+  "# Growtopia server_data\n"
+  "server = 127.0.0.1\nport = 17091\ntype = 1\n"
+  "beta_server = 127.0.0.1\nbeta_port = 17091\nbeta_type = 1\nmeta = localhost\n"
+  "min_version = 4.61\noutdated = Please update your client\n",
+  "server = 10.0.0.2\nport = 17092\ntype = 1\nmeta = defined\n"
+  "min_version = 4.62\noutdated = A new version is out\n",
+};
+
+// Bodies as sent by clients of several versions and platforms
+static const char *s_forms[] = {
+  "version=4.61&platform=0&protocol=209",
+  "version=4.62&platform=4&protocol=209",
+  "version=4.58&platform=0&protocol=208",
+  "platform=2&protocol=209&version=4.62",
+};
+
+//! Struct for one load thread
+struct BenchWorker {
+  GH_Thread thread;   //!< Thread handle
+  bool prebuilt;      //!< Dedicated handler or cached file path
+  size_t requests;    //!< Requests to answer
+  size_t bytes;       //!< Response bytes copied, keeps the work observable
+};
+
+static struct ServerData s_server_data;
+static volatile int s_storming;
+
+static bool write_config(const char *text) {
+  FILE *fp = fopen(BENCH_CONFIG, "wb");
+  if (fp == NULL) {
+    return false;
+  }
+  fputs(text, fp);
+  fclose(fp);
+  return true;
+}
+
+static void worker_run(void *arg) {
+  struct BenchWorker *worker = (struct BenchWorker *) arg;
+  char send_buf[1024];
+  size_t forms = sizeof(s_forms) / sizeof(s_forms[0]);
+  for (size_t i = 0; i < worker->requests; i++) {
+    struct mg_str form = mg_str(s_forms[i % forms]);
+    if (worker->prebuilt) {
+      struct mg_str response = GH_ServerDataResponse(GH_ServerDataAcquire(&s_server_data), form);
+      memcpy(send_buf, response.buf, response.len);
+      worker->bytes += response.len;
+    } else {
+      char path[256];
+      snprintf(path, sizeof(path), ".%s", SERVER_DATA_PATH);
+      struct CacheEntry *entry = GH_CacheAcquire(&g_cache, path);
+      if (entry != NULL) {
+        memcpy(send_buf, entry->headers.ok, entry->headers.ok_len);
+        memcpy(send_buf + entry->headers.ok_len, entry->data, entry->data_len);
+        worker->bytes += entry->headers.ok_len + entry->data_len;
+        GH_CacheRelease(entry);
+      }
+    }
+  }
+  GH_ServerDataRelease(&s_server_data);
+}
+
+static void reloader_run(void *arg) {
+  size_t *reloads = (size_t *) arg;
+  for (int flip = 1; GH_AtomicLoadInt(&s_storming); flip ^= 1) {
+    write_config(s_configs[flip]);
+    *reloads += GH_ServerDataReload(&s_server_data);
+#if defined(_WIN32)
+    Sleep(1);
+#else
+    struct timespec pause = {0, 1000000};
+    nanosleep(&pause, NULL);
+#endif
+  }
+}
+
+static void storm(bool prebuilt, int threads) {
+  struct BenchWorker workers[BENCH_MAX_THREADS];
+  GH_Thread reloader;
+  size_t reloads = 0, bytes = 0;
+  memset(workers, 0, sizeof(workers));
+
+  GH_AtomicStoreInt(&s_storming, 1);
+  bool reloading = prebuilt && GH_ThreadStart(&reloader, reloader_run, &reloads);
+  uint64_t start = BenchNowNs();
+  for (int t = 0; t < threads; t++) {
+    workers[t].prebuilt = prebuilt;
+    workers[t].requests = BENCH_REQUESTS / (size_t) threads;
+    if (!GH_ThreadStart(&workers[t].thread, worker_run, &workers[t])) {
+      exit(1);
+    }
+  }
+  for (int t = 0; t < threads; t++) {
+    GH_ThreadJoin(workers[t].thread);
+    bytes += workers[t].bytes;
+  }
+  uint64_t elapsed = BenchNowNs() - start;
+  GH_AtomicStoreInt(&s_storming, 0);
+  if (reloading) {
+    GH_ThreadJoin(reloader);
+  }
+
+  double seconds = (double) elapsed / 1e9;
+  BENCH_REPORT("server_data", "path=%s threads=%d requests=%d rps=%.0f ns_per_request=%.1f reloads=%zu "
+               "avg_response_bytes=%.0f",
+               prebuilt ? "prebuilt" : "cached_file", threads, BENCH_REQUESTS, BENCH_REQUESTS / seconds,
+               (double) elapsed * threads / BENCH_REQUESTS, reloads, (double) bytes / BENCH_REQUESTS);
+}
+
+int main(void) {
+  mg_log_set(MG_LL_NONE);
+  if (!write_config(s_configs[0]) || !GH_ServerDataInit(&s_server_data, BENCH_CONFIG)) {
+    fprintf(stderr, "cannot render %s\n", BENCH_CONFIG);
+    return 1;
+  }
+
+  // The file the static path served: the same body, cached as a regular file
+  const struct ServerDataBlock *block = GH_ServerDataAcquire(&s_server_data);
+  struct mg_str response = mg_str_n(block->responses[SERVER_DATA_CURRENT], block->response_lens[SERVER_DATA_CURRENT]);
+  size_t head_len = 4;
+  while (head_len < response.len && memcmp(response.buf + head_len - 4, "\r\n\r\n", 4) != 0) {
+    head_len++;
+  }
+  const char *body = response.buf + head_len;
+  size_t body_len = response.len - head_len;
+  GH_CacheInit(&g_cache);
+  GH_CacheAdd(&g_cache, "." SERVER_DATA_PATH, body, body_len, "\"5f3a9c-0\"", 0);
+
+  for (int threads = 1; threads <= BENCH_MAX_THREADS; threads *= 2) {
+    storm(false, threads);
+    storm(true, threads);
+  }
+
+  GH_CacheCleanup(&g_cache);
+  GH_ServerDataCleanup(&s_server_data);
+  remove(BENCH_CONFIG);
+  return 0;
+}
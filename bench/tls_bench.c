@@ -0,0 +1,316 @@
+#include "Bench.h"
+#include "server/Tls.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+
+// TLS handshakes against the server context GH_TlsInit builds, run in memory
+// (a BIO pair per connection, no sockets) with self-signed certificates made
+// at start-up. "check" first verifies resumption: by ticket, by the session
+// cache with tickets off, and across ticket key rotation; "client_check" then
+// connects outgoing connections set up by mg_tls_init, which must accept the
+// server only for the right name and CA, or with skip_verification. A wrong
+// outcome fails the run. "handshake" then reports, per key type and protocol version, full
+// and resumed handshakes per second. server_per_sec counts only the server's
+// side of each handshake, which is what a worker's event loop pays.
+
+#define BENCH_FULL_HANDSHAKES 400
+#define BENCH_RESUMED_HANDSHAKES 4000
+#define BENCH_MAX_FLIGHTS 16
+
+static char s_dir[] = "/tmp/gh_tls_bench.XXXXXX";
+
+//! Struct for one server setup under test
+struct BenchServer {
+    const char *key_type; //!< "ec-p256" or "rsa-2048"
+    struct TlsContext tickets; //!< Stateless tickets on
+    struct TlsContext cache; //!< Tickets off: TLS 1.2 session IDs and TLS 1.3 stateful tickets
+};
+
+static bool write_pem(const char *path, X509 *x509, EVP_PKEY *pkey) {
+  FILE *fp = fopen(path, "w");
+  if (fp == NULL) {
+    return false;
+  }
+  bool ok = x509 != NULL ? PEM_write_X509(fp, x509) == 1 : PEM_write_PrivateKey(fp, pkey, NULL, NULL, 0, NULL, NULL) == 1;
+  return fclose(fp) == 0 && ok;
+}
+
+// Self-signed certificate for "localhost" with a fresh key, written as PEM files
+static bool make_certificate(int type, const char *cert_path, const char *key_path) {
+  EVP_PKEY *pkey = NULL;
+  X509 *x509 = NULL;
+  EVP_PKEY_CTX *kctx = EVP_PKEY_CTX_new_id(type, NULL);
+  bool ok = kctx != NULL && EVP_PKEY_keygen_init(kctx) == 1 &&
+            (type == EVP_PKEY_EC ? EVP_PKEY_CTX_set_ec_paramgen_curve_nid(kctx, NID_X9_62_prime256v1)
+                                 : EVP_PKEY_CTX_set_rsa_keygen_bits(kctx, 2048)) == 1 &&
+            EVP_PKEY_keygen(kctx, &pkey) == 1 && (x509 = X509_new()) != NULL;
+  if (ok) {
+    X509_NAME *name = X509_get_subject_name(x509);
+    ok = X509_set_version(x509, 2) == 1 && ASN1_INTEGER_set(X509_get_serialNumber(x509), 1) == 1 &&
+         X509_gmtime_adj(X509_getm_notBefore(x509), 0) != NULL &&
+         X509_gmtime_adj(X509_getm_notAfter(x509), 24 * 3600) != NULL && X509_set_pubkey(x509, pkey) == 1 &&
+         X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char *) "localhost", -1, -1, 0) == 1 &&
+         X509_set_issuer_name(x509, name) == 1 && X509_sign(x509, pkey, EVP_sha256()) > 0;
+  }
+  ok = ok && write_pem(cert_path, x509, NULL) && write_pem(key_path, NULL, pkey);
+  X509_free(x509);
+  EVP_PKEY_free(pkey);
+  EVP_PKEY_CTX_free(kctx);
+  return ok;
+}
+
+static bool setup_server(struct BenchServer *server, const char *key_type, int type) {
+  char cert[64], key[64];
+  snprintf(cert, sizeof(cert), "%s/%s.crt", s_dir, key_type);
+  snprintf(key, sizeof(key), "%s/%s.key", s_dir, key_type);
+  server->key_type = key_type;
+  bool ok = make_certificate(type, cert, key) &&
+            GH_TlsInit(&server->tickets, cert, key, APP_TLS_SESSION_CACHE_SIZE, APP_TLS_TICKET_ROTATE_S) &&
+            GH_TlsInit(&server->cache, cert, key, APP_TLS_SESSION_CACHE_SIZE, 0);
+  unlink(cert);
+  unlink(key);
+  return ok;
+}
+
+static bool wants_io(SSL *ssl, int rc) {
+  int err = SSL_get_error(ssl, rc);
+  return err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE;
+}
+
+// Exchange flights until both sides are done or one fails; adds the server's time to *server_ns
+static bool drive(SSL *client, SSL *server, uint64_t *server_ns) {
+  int client_rc = 0, server_rc = 0;
+  bool ok = true;
+  for (int i = 0; ok && i < BENCH_MAX_FLIGHTS && (client_rc != 1 || server_rc != 1); i++) {
+    client_rc = SSL_do_handshake(client);
+    ok = client_rc == 1 || wants_io(client, client_rc);
+    uint64_t start = BenchNowNs();
+    server_rc = SSL_do_handshake(server);
+    *server_ns += BenchNowNs() - start;
+    ok = ok && (server_rc == 1 || wants_io(server, server_rc));
+  }
+  return ok && client_rc == 1 && server_rc == 1;
+}
+
+// One handshake over a BIO pair, resuming *session if set; *session then holds
+// the session the client would resume next. Adds the server's time to *server_ns.
+static bool handshake(SSL_CTX *server_ctx, SSL_CTX *client_ctx, SSL_SESSION **session, bool *reused,
+                      uint64_t *server_ns) {
+  SSL *client = SSL_new(client_ctx), *server = SSL_new(server_ctx);
+  BIO *client_bio = NULL, *server_bio = NULL;
+  bool ok = client != NULL && server != NULL && BIO_new_bio_pair(&client_bio, 0, &server_bio, 0) == 1;
+  if (ok) {
+    SSL_set_bio(client, client_bio, client_bio);
+    SSL_set_bio(server, server_bio, server_bio);
+    SSL_set_connect_state(client);
+    SSL_set_accept_state(server);
+    ok = *session == NULL || SSL_set_session(client, *session) == 1;
+  }
+  ok = ok && drive(client, server, server_ns);
+
+  if (ok) {
+    // TLS 1.3 tickets arrive after the handshake; reading takes them in
+    char byte;
+    ok = SSL_read(client, &byte, 1) <= 0 && wants_io(client, -1);
+    *reused = SSL_session_reused(server) != 0;
+    SSL_SESSION_free(*session);
+    *session = SSL_get1_session(client);
+    // As mg_tls_free does: close quietly, or freeing marks the session unusable
+    SSL_set_quiet_shutdown(server, 1);
+    SSL_shutdown(server);
+    SSL_set_quiet_shutdown(client, 1);
+    SSL_shutdown(client);
+  }
+  ERR_clear_error();
+  SSL_free(client);
+  SSL_free(server);
+  return ok && *session != NULL;
+}
+
+static SSL_CTX *client_context(int max_version) {
+  SSL_CTX *ctx = SSL_CTX_new(TLS_client_method());
+  if (ctx != NULL) {
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, NULL);
+    SSL_CTX_set_max_proto_version(ctx, max_version);
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);  // Sessions are handed over explicitly
+  }
+  return ctx;
+}
+
+// Resume a copy of session: a client still holding that ticket
+static bool resumes(SSL_CTX *server_ctx, SSL_CTX *client_ctx, SSL_SESSION *session) {
+  SSL_SESSION *copy = session;
+  SSL_SESSION_up_ref(copy);
+  bool reused = false;
+  uint64_t ns = 0;
+  bool ok = handshake(server_ctx, client_ctx, &copy, &reused, &ns);
+  SSL_SESSION_free(copy);
+  return ok && reused;
+}
+
+static void check(struct BenchServer *server) {
+  SSL_CTX *tls13 = client_context(TLS1_3_VERSION), *tls12 = client_context(TLS1_2_VERSION);
+  int failures = 0;
+  bool reused = false;
+  uint64_t ns = 0;
+
+  // Session cache (tickets off), both versions
+  SSL_CTX *clients[] = {tls13, tls12};
+  for (int i = 0; i < 2; i++) {
+    SSL_SESSION *session = NULL;
+    failures += !handshake(server->cache.ctx, clients[i], &session, &reused, &ns) || reused;
+    failures += !handshake(server->cache.ctx, clients[i], &session, &reused, &ns) || !reused;
+    SSL_SESSION_free(session);
+  }
+
+  // Tickets: a ticket opens while its key is one of the TLS_TICKET_KEYS kept
+  SSL_SESSION *session = NULL;
+  failures += !handshake(server->tickets.ctx, tls13, &session, &reused, &ns) || reused;
+  failures += !resumes(server->tickets.ctx, tls13, session);
+  for (int i = 1; i < TLS_TICKET_KEYS; i++) {
+    GH_TlsRotateTicketKeys(&server->tickets, mg_millis());
+  }
+  bool after_rotation = resumes(server->tickets.ctx, tls13, session);
+  GH_TlsRotateTicketKeys(&server->tickets, mg_millis());
+  bool after_expiry = resumes(server->tickets.ctx, tls13, session);
+  failures += !after_rotation + after_expiry;
+  SSL_SESSION_free(session);
+
+  BENCH_REPORT("tls_check", "key=%s resumed_after_%d_rotations=%d resumed_after_%d_rotations=%d failures=%d", server->key_type,
+               TLS_TICKET_KEYS - 1, after_rotation, TLS_TICKET_KEYS, after_expiry, failures);
+  SSL_CTX_free(tls13);
+  SSL_CTX_free(tls12);
+  if (failures != 0) {
+    exit(1);
+  }
+}
+
+// An outgoing connection as mg_tls_init sets it up on tls, its socket BIO
+// swapped for a pair to server_ctx; true if the handshake completes
+static bool client_connects(struct TlsContext *tls, SSL_CTX *server_ctx, const struct mg_tls_opts *opts) {
+  struct mg_mgr mgr;
+  struct mg_connection c;
+  memset(&mgr, 0, sizeof(mgr));
+  memset(&c, 0, sizeof(c));
+  mgr.tls_ctx = tls;
+  c.mgr = &mgr;
+  c.is_client = 1;
+  mg_tls_init(&c, opts);
+
+  SSL *client = (SSL *) c.tls, *server = SSL_new(server_ctx);
+  BIO *client_bio = NULL, *server_bio = NULL;
+  bool ok = client != NULL && server != NULL && BIO_new_bio_pair(&client_bio, 0, &server_bio, 0) == 1;
+  if (ok) {
+    SSL_set_bio(client, client_bio, client_bio);
+    SSL_set_bio(server, server_bio, server_bio);
+    SSL_set_accept_state(server);
+    uint64_t ns = 0;
+    ok = drive(client, server, &ns);
+  }
+  ERR_clear_error();
+  SSL_free(client);
+  SSL_free(server);
+  return ok;
+}
+
+static void check_client(struct BenchServer *server) {
+  // The server's own certificate is the CA of a client that trusts it
+  BIO *pem = BIO_new(BIO_s_mem());
+  char *ca_buf = NULL;
+  long ca_len = pem != NULL && PEM_write_bio_X509(pem, SSL_CTX_get0_certificate(server->cache.ctx)) == 1
+                    ? BIO_get_mem_data(pem, &ca_buf) : 0;
+  if (ca_len <= 0) {
+    exit(1);
+  }
+
+  struct mg_tls_opts opts;
+  memset(&opts, 0, sizeof(opts));
+  opts.ca = mg_str_n(ca_buf, (size_t) ca_len);
+  opts.name = mg_str("localhost");
+  bool trusted = client_connects(&server->cache, server->cache.ctx, &opts);
+  opts.name = mg_str("example.com");
+  bool wrong_name = client_connects(&server->cache, server->cache.ctx, &opts);
+  opts.skip_verification = 1;
+  bool skipped = client_connects(&server->cache, server->cache.ctx, &opts);
+  opts.skip_verification = 0;
+  opts.ca = mg_str_n(NULL, 0);
+  opts.name = mg_str("localhost");
+  bool untrusted = client_connects(&server->cache, server->cache.ctx, &opts);  // Self-signed: not in the system store
+
+  int failures = !trusted + wrong_name + !skipped + untrusted;
+  BENCH_REPORT("tls_client_check", "key=%s trusted=%d wrong_name=%d skip_verification=%d system_store=%d failures=%d",
+               server->key_type, trusted, wrong_name, skipped, untrusted, failures);
+  BIO_free(pem);
+  if (failures != 0) {
+    exit(1);
+  }
+}
+
+// count handshakes: full (resume = false) or each resuming the session the last one left
+static void run(const char *mode, const char *version, struct BenchServer *server, SSL_CTX *server_ctx,
+                SSL_CTX *client_ctx, bool resume, int count) {
+  SSL_SESSION *session = NULL;
+  bool reused = false;
+  uint64_t server_ns = 0;
+  int resumed = 0;
+  if (resume && !handshake(server_ctx, client_ctx, &session, &reused, &server_ns)) {
+    exit(1);
+  }
+  server_ns = 0;
+  uint64_t start = BenchNowNs();
+  for (int i = 0; i < count; i++) {
+    if (!resume) {
+      SSL_SESSION_free(session);
+      session = NULL;
+    }
+    if (!handshake(server_ctx, client_ctx, &session, &reused, &server_ns)) {
+      exit(1);
+    }
+    resumed += reused;
+  }
+  double seconds = (double) (BenchNowNs() - start) / 1e9;
+  SSL_SESSION_free(session);
+  BENCH_REPORT("tls_handshake", "key=%s version=%s mode=%s resumed=%d/%d per_sec=%.0f server_per_sec=%.0f",
+               server->key_type, version, mode, resumed, count, count / seconds, count / ((double) server_ns / 1e9));
+}
+
+static void bench_handshakes(struct BenchServer *server) {
+  SSL_CTX *tls13 = client_context(TLS1_3_VERSION), *tls12 = client_context(TLS1_2_VERSION);
+  run("full", "1.3", server, server->tickets.ctx, tls13, false, BENCH_FULL_HANDSHAKES);
+  run("ticket", "1.3", server, server->tickets.ctx, tls13, true, BENCH_RESUMED_HANDSHAKES);
+  run("cache", "1.3", server, server->cache.ctx, tls13, true, BENCH_RESUMED_HANDSHAKES);
+  run("full", "1.2", server, server->tickets.ctx, tls12, false, BENCH_FULL_HANDSHAKES);
+  run("ticket", "1.2", server, server->tickets.ctx, tls12, true, BENCH_RESUMED_HANDSHAKES);
+  run("cache", "1.2", server, server->cache.ctx, tls12, true, BENCH_RESUMED_HANDSHAKES);
+  SSL_CTX_free(tls13);
+  SSL_CTX_free(tls12);
+}
+
+int main(void) {
+  if (mkdtemp(s_dir) == NULL) {
+    fprintf(stderr, "cannot create a directory for the test certificates\n");
+    return 1;
+  }
+  struct BenchServer servers[2];
+  bool ok = setup_server(&servers[0], "ec-p256", EVP_PKEY_EC) && setup_server(&servers[1], "rsa-2048", EVP_PKEY_RSA);
+  rmdir(s_dir);
+  if (!ok) {
+    fprintf(stderr, "cannot set up the test certificates\n");
+    return 1;
+  }
+
+  for (int i = 0; i < 2; i++) {
+    check(&servers[i]);
+    check_client(&servers[i]);
+    bench_handshakes(&servers[i]);
+    GH_TlsCleanup(&servers[i].tickets);
+    GH_TlsCleanup(&servers[i].cache);
+  }
+  return 0;
+}
@@ -0,0 +1,194 @@
+#include "Bench.h"
+#include "plugins/CacheManager.h"
+#include "server/Uri.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Request path canonicalization. "check" first runs a differential fuzz pass:
+// random targets built from the bytes that matter (separators, dots, escapes,
+// query and fragment marks, controls) go through GH_UriCanonicalize and a plain
+// reference written from RFC 3986 5.2.4; any difference in the verdict, the path
+// or the hash (against GH_CacheHash) fails the run. "canonicalize" then times
+// typical request targets against the old key building (mg_snprintf + hash).
+
+// Satisfies the extern declared by CacheManager.h
+struct CacheBucket g_cache = {0};
+
+#define BENCH_FUZZ_CASES 2000000
+#define BENCH_FUZZ_MAX_LEN 240
+#define BENCH_LOOKUPS 2000000
+
+static volatile size_t s_sink;
+
+static const char *const s_uris[] = {
+  "/",
+  "/index.html",
+  "/game/assets/textures/tiles_page3.rttex",
+  "/cache/items/sprites.rttex?v=4521",
+  "/audio/ogg/theme%20song.ogg",
+  "//game//assets/./../assets/interface/large/news_banner.rttex",
+  "/growtopia/cache/game/worlds/background_layers/sunset_city_blend_layer_0042.rttex",
+};
+
+// Pieces the fuzzer strings together, weighted towards the interesting ones;
+// the ones that get a target refused are rare, or few targets would pass
+static const char *const s_pieces[] = {
+  "/", "/", "/", ".", "..", "a", "bc", "file.png", "%2e", "%2E", "%2f", "%2F", "%25", "%41",
+  "?", "#", "\xc3\xa9", "x", "//", "/./", "/../",
+};
+static const char *const s_bad_pieces[] = {"%", "%4", "%zz", "%00", "%5c", "\\", "\x01", "\x7f"};
+
+static bool rejected_byte(unsigned char ch) {
+  return ch < 0x20 || ch == 0x7f || ch == '\\';
+}
+
+static int hex_digit(char ch) {
+  return ch >= '0' && ch <= '9' ? ch - '0'
+       : ch >= 'a' && ch <= 'f' ? ch - 'a' + 10
+       : ch >= 'A' && ch <= 'F' ? ch - 'A' + 10 : -1;
+}
+
+// Straightforward version: decode, split, resolve a segment stack, join
+static size_t reference(const char *uri, size_t len, char *out, size_t out_len) {
+  char decoded[BENCH_FUZZ_MAX_LEN + 1];
+  size_t n = 0;
+  for (size_t i = 0; i < len && uri[i] != '?' && uri[i] != '#'; i++) {
+    char ch = uri[i];
+    if (ch == '%') {
+      if (i + 2 >= len || hex_digit(uri[i + 1]) < 0 || hex_digit(uri[i + 2]) < 0) {
+        return 0;
+      }
+      ch = (char) (hex_digit(uri[i + 1]) << 4 | hex_digit(uri[i + 2]));
+      i += 2;
+    }
+    if (rejected_byte((unsigned char) ch)) {
+      return 0;
+    }
+    decoded[n++] = ch;
+  }
+
+  const char *segs[BENCH_FUZZ_MAX_LEN];
+  size_t lens[BENCH_FUZZ_MAX_LEN], depth = 0;
+  bool trailing = false;
+  for (size_t i = 0; i <= n;) {
+    size_t j = i;
+    while (j < n && decoded[j] != '/') j++;
+    size_t seg = j - i;
+    bool last = j >= n;
+    if (seg == 1 && decoded[i] == '.') {
+      trailing = last;
+    } else if (seg == 2 && decoded[i] == '.' && decoded[i + 1] == '.') {
+      depth -= depth > 0;
+      trailing = last;
+    } else if (seg > 0) {
+      segs[depth] = decoded + i;
+      lens[depth++] = seg;
+      trailing = false;
+    } else {
+      trailing = last && i > 0;
+    }
+    i = j + 1;
+  }
+
+  size_t o = (size_t) snprintf(out, out_len, "./");
+  for (size_t d = 0; d < depth; d++) {
+    memcpy(out + o, segs[d], lens[d]);
+    o += lens[d];
+    if (d + 1 < depth || trailing) {
+      out[o++] = '/';
+    }
+  }
+  if (o == 2) {
+    o += (size_t) snprintf(out + o, out_len - o, URI_INDEX_FILE);
+  }
+  out[o] = '\0';
+  return o;
+}
+
+static void check(void) {
+  uint64_t rng = 0x9e3779b97f4a7c15ULL;
+  char uri[BENCH_FUZZ_MAX_LEN + 16], got[URI_PATH_MAX], want[URI_PATH_MAX * 2];
+  size_t mismatches = 0, rejected = 0, npieces = sizeof(s_pieces) / sizeof(s_pieces[0]);
+  size_t nbad = sizeof(s_bad_pieces) / sizeof(s_bad_pieces[0]);
+
+  for (size_t i = 0; i < BENCH_FUZZ_CASES; i++) {
+    size_t len = 0, target = (size_t) (BenchRand(&rng) % BENCH_FUZZ_MAX_LEN);
+    while (len < target) {
+      uint64_t pick = BenchRand(&rng);
+      const char *piece = pick % 256 == 0 ? s_bad_pieces[(pick >> 8) % nbad] : s_pieces[(pick >> 8) % npieces];
+      size_t piece_len = strlen(piece);
+      if (len + piece_len > BENCH_FUZZ_MAX_LEN) {
+        break;
+      }
+      memcpy(uri + len, piece, piece_len);
+      len += piece_len;
+    }
+
+    uint64_t hash = 0;
+    size_t got_len = GH_UriCanonicalize(uri, len, got, sizeof(got), &hash);
+    size_t want_len = reference(uri, len, want, sizeof(want));
+    if (want_len > URI_PATH_MAX - 1) {
+      want_len = 0;  // Would not fit the buffer: rejected too
+    }
+    bool same = got_len == want_len && (got_len == 0 || (memcmp(got, want, got_len) == 0 &&
+                                                           hash == GH_CacheHash(got, got_len)));
+    if (!same && mismatches++ < 5) {
+      fprintf(stderr, "mismatch for \"%.*s\": got \"%s\" (%zu), want \"%s\" (%zu)\n", (int) len, uri,
+              got_len ? got : "", got_len, want_len ? want : "", want_len);
+    }
+    rejected += got_len == 0;
+  }
+
+  // Targets that cannot fit are refused, never truncated
+  char huge[URI_PATH_MAX + 8];
+  uint64_t hash = 0;
+  memset(huge, 'a', sizeof(huge));
+  huge[0] = '/';
+  mismatches += GH_UriCanonicalize(huge, URI_PATH_MAX - 2, got, sizeof(got), &hash) == 0;
+  mismatches += GH_UriCanonicalize(huge, URI_PATH_MAX - 1, got, sizeof(got), &hash) != 0;
+
+  BENCH_REPORT("uri_check", "cases=%d rejected=%zu mismatches=%zu", BENCH_FUZZ_CASES, rejected, mismatches);
+  if (mismatches != 0) {
+    exit(1);
+  }
+}
+
+static void bench_canonicalize(void) {
+  size_t count = sizeof(s_uris) / sizeof(s_uris[0]);
+  size_t lens[sizeof(s_uris) / sizeof(s_uris[0])];
+  for (size_t i = 0; i < count; i++) {
+    lens[i] = strlen(s_uris[i]);
+  }
+  char path[URI_PATH_MAX];
+
+  for (size_t i = 0; i < count; i++) {
+    uint64_t hash = 0;
+    uint64_t start = BenchNowNs();
+    for (size_t n = 0; n < BENCH_LOOKUPS; n++) {
+      s_sink += GH_UriCanonicalize(s_uris[i], lens[i], path, sizeof(path), &hash);
+      s_sink += (size_t) hash;
+    }
+    uint64_t new_ns = BenchNowNs() - start;
+
+    // What the request path did before: copy, then hash once per lookup
+    start = BenchNowNs();
+    for (size_t n = 0; n < BENCH_LOOKUPS; n++) {
+      mg_snprintf(path, sizeof(path), ".%.*s", (int) lens[i], s_uris[i]);
+      if (strcmp(path, "./") == 0) {
+        mg_snprintf(path, sizeof(path), "./index.html");
+      }
+      s_sink += (size_t) GH_CacheHash(path, strlen(path));
+    }
+    uint64_t old_ns = BenchNowNs() - start;
+
+    BENCH_REPORT("uri_canonicalize", "uri_len=%zu canonical_ns=%.1f snprintf_hash_ns=%.1f mb_per_sec=%.0f",
+                 lens[i], (double) new_ns / BENCH_LOOKUPS, (double) old_ns / BENCH_LOOKUPS,
+                 (double) lens[i] * BENCH_LOOKUPS / ((double) new_ns / 1e9) / (1024.0 * 1024.0));
+  }
+}
+
+int main(void) {
+  check();
+  bench_canonicalize();
+  return 0;
+}
@@ -0,0 +1,33 @@
+#!/usr/bin/env bash
+# Measure RPS on the cached /index.html path for increasing worker counts.
+# Usage: bench/worker_scaling.sh <path/to/GrowplusHttp> [worker counts...]
+# Requires wrk (https://github.com/wg/wrk).
+
+set -eu
+
+BIN="$(realpath "${1:?usage: $0 <GrowplusHttp binary> [workers...]}")"
+shift
+COUNTS="${*:-1 2 4 8}"
+DURATION="${DURATION:-10s}"
+CONNECTIONS="${CONNECTIONS:-256}"
+THREADS="${THREADS:-8}"
+URL="http://127.0.0.1:8000/index.html"
+
+ROOT="$(mktemp -d)"
+trap 'kill "$PID" 2>/dev/null || true; rm -rf "$ROOT"' EXIT
+head -c 16384 /dev/urandom | base64 > "$ROOT/index.html"
+
+for WORKERS in $COUNTS; do
+  (cd "$ROOT" && exec "$BIN" -w "$WORKERS" > /dev/null 2>&1) &
+  PID=$!
+  sleep 1
+
+  # Warm the cache so every measured request is a hit
+  curl -s -o /dev/null "$URL"
+
+  RPS="$(wrk -t"$THREADS" -c"$CONNECTIONS" -d"$DURATION" "$URL" | awk '/Requests\/sec/ { print $2 }')"
+  echo "bench=worker_scaling workers=$WORKERS connections=$CONNECTIONS rps=$RPS"
+
+  kill "$PID"
+  wait "$PID" 2>/dev/null || true
+done
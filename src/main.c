@@ -1,213 +1,1516 @@
 #include "mongoose.h"
 #include "server/config.h"
 #include "plugins/CacheManager.h"
+#include "plugins/Compression.h"
+#include "plugins/FileEtag.h"
+#include "plugins/Loader.h"
+#include "plugins/MemoryPressure.h"
+#include "plugins/NegativeCache.h"
+#include "plugins/Snapshot.h"
+#include "plugins/Warmup.h"
+#include "plugins/Watcher.h"
+#include "server/Conditional.h"
+#include "server/ConfigFile.h"
+#include "server/Connection.h"
+#include "server/HotRestart.h"
+#include "server/Listener.h"
+#include "server/Metrics.h"
+#include "server/Mime.h"
+#include "server/Range.h"
+#include "server/AccessLog.h"
+#include "server/Admission.h"
+#include "server/KeepAlive.h"
+#include "server/Response.h"
+#include "server/Router.h"
+#include "server/Tls.h"
+#include "server/Uri.h"
+#include "server/ServerData.h"
+#include "utils/Sync.h"
+#include "utils/Utils.h"
+#include <limits.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
-// Global cache instance
+// Global cache instance, shared by all workers
 struct CacheBucket g_cache = {0};
 
-// Generate ETag based on file path and modification time
-static void generate_etag(const char *path, time_t mtime, char *etag, size_t etag_len) {
-  mg_snprintf(etag, etag_len, "\"%lx-%lx\"", (unsigned long)mg_crc32(0, path, strlen(path)), 
-              (unsigned long)mtime);
+// Global disk loader, shared by all workers
+struct Loader g_loader;
+
+// Global packed snapshot, empty unless one is mapped
+struct Snapshot g_snapshot;
+
+// Global negative cache of paths that were not found, sized apart from g_cache
+struct NegativeCache g_negative;
+
+// Global memo of the content ETags of files served from disk
+struct FileEtags g_file_etags;
+
+// Startup options from "--config <file>"; the command line overrides them
+static struct ConfigFile s_config;
+
+// Event loop poll timeout of every worker (--poll-timeout-ms)
+static int s_poll_timeout_ms = APP_POLL_TIMEOUT_MS;
+
+// Bearer token of /api/admin/cache and its clear action ("" = no admin API, or --admin-token)
+static const char *s_admin_token = APP_ADMIN_TOKEN;
+
+// Cache budget bounds and the adaptive mode moving between them with the
+// memory readings; all guarded by s_budget_lock, changed by worker 0 and the admin API
+static GH_Mutex s_budget_lock;
+static size_t s_cache_ceiling = 0;
+static size_t s_cache_floor = 0;
+static bool s_cache_adaptive = false;
+static bool s_memory_available = false;
+static struct MemoryPressure s_memory;
+static uint64_t s_memory_next_check = 0;
+static bool s_cache_shrinking = false;
+
+// Watches the served root and invalidates changed files
+static struct Watcher s_watcher;
+
+// API routes, compiled before the workers start and only read afterwards
+static struct Router s_router;
+
+// Prebuilt /growtopia/server_data.php responses, re-rendered when the config changes
+static struct ServerData s_server_data;
+
+// Files the server itself reads that may lie under the served root (configs,
+// TLS key, access log), by canonical path: never served, whatever is on disk
+#define PRIVATE_FILES_MAX 32
+struct PrivateFile {
+  char path[URI_PATH_MAX];
+  size_t len;
+  uint64_t hash;
+};
+static struct PrivateFile s_private_files[PRIVATE_FILES_MAX];
+static size_t s_private_file_count = 0;
+
+// Per-address request rates and connection counts, shared by every worker
+static struct Admission s_admission;
+
+// Per-request log records, captured into per-thread rings and written by a background thread
+static struct AccessLog s_access_log;
+
+// Shared certificate, session cache and ticket keys of the HTTPS listeners (--https)
+static struct TlsContext s_tls;
+
+// Control socket a replacement binary asks for the listeners on (--hot-restart), and what it is handed
+static struct HotRestart s_hot_restart = {-1, ""};
+static struct HotRestartHandoff s_handoff;
+
+// Set once a replacement serves the listeners (atomic): workers drain, then stop
+static int s_draining = 0;
+static int s_stop = 0;
+static uint64_t s_drain_deadline = 0;
+
+// Open client connections across every worker (atomic), and the cap on them (0 = unlimited)
+static int s_open_connections = 0;
+static int s_max_connections = APP_MAX_CONNECTIONS;
+
+// Keep-alive limits every worker's wheel is set up with
+static uint32_t s_keepalive_timeout_ms = APP_KEEPALIVE_TIMEOUT_MS;
+static uint32_t s_keepalive_max_requests = APP_KEEPALIVE_MAX_REQUESTS;
+
+//! Struct for event-loop worker; each owns its own event manager and listeners
+struct Worker {
+  int id;                              //!< Worker index, 0 runs on the main thread
+  struct mg_mgr mgr;                   //!< Event manager owned by this worker
+  GH_Thread thread;                    //!< Thread handle (unused for worker 0)
+  struct mg_connection *listener;      //!< This worker's listening connection
+  struct mg_connection *tls_listener;  //!< This worker's HTTPS listening connection, NULL without --https
+  uint64_t accept_resume;              //!< mg_millis() at which a paused listener accepts again, 0 while accepting
+  unsigned accept_backoff_ms;          //!< Length of the last pause, doubled while the cap stays reached
+  struct KeepAlive keepalive;          //!< Idle timeouts and request counts of this worker's connections
+  bool draining;                       //!< Listeners paused for good after a hot restart
+};
+
+// Prebuilt 404, so answering a missing path formats nothing
+static const char s_not_found[] = "HTTP/1.1 404 Not Found\r\n"
+                                  "Content-Type: text/plain\r\n"
+                                  "Content-Length: 15\r\n"
+                                  "Connection: keep-alive\r\n"
+                                  "\r\n"
+                                  "File not found\n";
+
+// Prebuilt 429 for clients over their rate; the connection is closed once it is sent
+static const char s_too_many_requests[] = "HTTP/1.1 429 Too Many Requests\r\n"
+                                          "Retry-After: 1\r\n"
+                                          "Content-Type: text/plain\r\n"
+                                          "Content-Length: 18\r\n"
+                                          "Connection: close\r\n"
+                                          "\r\n"
+                                          "Too many requests\n";
+
+// Prebuilt 400 for request targets that do not canonicalize to a servable path
+static const char s_bad_request[] = "HTTP/1.1 400 Bad Request\r\n"
+                                    "Content-Type: text/plain\r\n"
+                                    "Content-Length: 12\r\n"
+                                    "Connection: keep-alive\r\n"
+                                    "\r\n"
+                                    "Bad request\n";
+
+// Prebuilt 412 for a failed If-Match / If-Unmodified-Since, or If-None-Match on an unsafe method
+static const char s_precondition_failed[] = "HTTP/1.1 412 Precondition Failed\r\n"
+                                            "Content-Length: 0\r\n"
+                                            "Connection: keep-alive\r\n"
+                                            "\r\n";
+
+static void send_not_found(struct mg_connection *c) {
+  mg_send(c, s_not_found, sizeof(s_not_found) - 1);
+  GH_ResponseDone(c);
+  GH_MetricsInc(MC_NOT_FOUND);
+}
+
+// Reply 416 for a Range that selects nothing in a representation of the given size
+static void send_range_not_satisfiable(struct mg_connection *c, uint64_t size) {
+  mg_printf(c, "HTTP/1.1 416 Range Not Satisfiable\r\n"
+               "Content-Range: bytes */%llu\r\n"
+               "Content-Length: 0\r\n"
+               "Connection: keep-alive\r\n"
+               "\r\n", (unsigned long long) size);
+  GH_ResponseDone(c);
+  GH_MetricsInc(MC_RANGE_NOT_SATISFIABLE);
+}
+
+// Send ranges of a cached representation: 416, a single 206 slice, or multipart/byteranges
+static void serve_ranges_from_cache(struct mg_connection *c, struct CacheEntry *entry,
+                                    const char *body, size_t body_len, const char *etag,
+                                    const char *content_type, const char *headers,
+                                    const struct ByteRange *ranges, int count) {
+  if (count == 0) {
+    send_range_not_satisfiable(c, body_len);
+    return;
+  }
+  GH_MetricsInc(MC_PARTIAL);
+
+  char head[640];
+  size_t head_len;
+  if (count == 1) {
+    uint64_t len = ranges[0].last - ranges[0].first + 1;
+    head_len = mg_snprintf(head, sizeof(head), "HTTP/1.1 206 Partial Content\r\n"
+                 "Content-Type: %s\r\n"
+                 "Content-Length: %llu\r\n"
+                 "Content-Range: bytes %llu-%llu/%llu\r\n"
+                 "%s"
+                 "ETag: %s\r\n"
+                 "Cache-Control: " CACHE_CONTROL_VALUE "\r\n"
+                 "Connection: keep-alive\r\n"
+                 "\r\n",
+                 content_type, (unsigned long long) len, (unsigned long long) ranges[0].first,
+                 (unsigned long long) ranges[0].last, (unsigned long long) body_len, headers,
+                 etag ? etag : "");
+    GH_ResponseSendEntry(c, head, head_len, entry, body + ranges[0].first, (size_t) len);
+    return;
+  }
+
+  // Several ranges: every part carries its own Content-Range behind a random boundary
+  char boundary[21], trailer[64];
+  struct ResponsePart parts[APP_RANGE_MAX_PARTS];
+  mg_random_str(boundary, sizeof(boundary));
+  uint64_t total = 0;
+  for (int i = 0; i < count; i++) {
+    parts[i].head_len = mg_snprintf(parts[i].head, sizeof(parts[i].head), "\r\n--%s\r\n"
+                          "Content-Type: %s\r\n"
+                          "Content-Range: bytes %llu-%llu/%llu\r\n"
+                          "\r\n",
+                          boundary, content_type, (unsigned long long) ranges[i].first,
+                          (unsigned long long) ranges[i].last, (unsigned long long) body_len);
+    parts[i].body = body + ranges[i].first;
+    parts[i].body_len = (size_t) (ranges[i].last - ranges[i].first + 1);
+    total += parts[i].head_len + parts[i].body_len;
+  }
+  total += mg_snprintf(trailer, sizeof(trailer), "\r\n--%s--\r\n", boundary);
+
+  head_len = mg_snprintf(head, sizeof(head), "HTTP/1.1 206 Partial Content\r\n"
+               "Content-Type: multipart/byteranges; boundary=%s\r\n"
+               "Content-Length: %llu\r\n"
+               "%s"
+               "ETag: %s\r\n"
+               "Cache-Control: " CACHE_CONTROL_VALUE "\r\n"
+               "Connection: keep-alive\r\n"
+               "\r\n",
+               boundary, (unsigned long long) total, headers, etag ? etag : "");
+  if (!GH_ResponseSendEntryParts(c, head, head_len, entry, parts, count, trailer)) {
+    mg_http_reply(c, 500, "Connection: keep-alive\r\n", "Out of memory\n");
+  }
 }
 
 // Serve file from cache with proper HTTP headers
 static void serve_from_cache(struct mg_connection *c, struct CacheEntry *entry, 
                              struct mg_http_message *hm) {
-  // Check If-None-Match header for ETag validation
-  struct mg_str *if_none_match = mg_http_get_header(hm, "If-None-Match");
-  if (if_none_match != NULL && entry->etag != NULL) {
-    if (mg_strcmp(*if_none_match, mg_str(entry->etag)) == 0) {
-      // ETag matches, return 304 Not Modified
+  // Pick the representation: precompressed variant or identity body
+  bool negotiable = GH_CacheHasVariants(entry);
+  int enc = negotiable ? GH_CompressionNegotiate(mg_http_get_header(hm, "Accept-Encoding"), entry) : -1;
+  const char *etag = enc >= 0 ? entry->encoded[enc].etag : entry->etag;
+  const char *body = enc >= 0 ? entry->encoded[enc].data : entry->data;
+  size_t body_len = enc >= 0 ? entry->encoded[enc].data_len : entry->data_len;
+  const struct CacheHeaders *prebuilt = enc >= 0 ? &entry->encoded[enc].headers : &entry->headers;
+
+  // Preconditions against the selected representation: the prebuilt 304, or 412
+  switch (GH_ConditionalEvaluate(hm, etag, entry->mtime)) {
+    case PRECONDITION_NOT_MODIFIED:
+      mg_send(c, prebuilt->not_modified, prebuilt->not_modified_len);
+      GH_ResponseDone(c);
+      GH_MetricsInc(MC_NOT_MODIFIED);
+      return;
+    case PRECONDITION_FAILED:
+      mg_send(c, s_precondition_failed, sizeof(s_precondition_failed) - 1);
+      GH_ResponseDone(c);
+      GH_MetricsInc(MC_PRECONDITION_FAILED);
+      return;
+    case PRECONDITION_PASS:
+      break;
+  }
+
+  // Honour Range on GET (never HEAD) unless If-Range says the client holds another
+  // version; ranges address the selected (possibly compressed) representation
+  struct mg_str *range = mg_http_get_header(hm, "Range");
+  if (range != NULL && mg_strcmp(hm->method, mg_str("GET")) == 0 &&
+      GH_RangeIfRangeAllows(mg_http_get_header(hm, "If-Range"), etag, entry->mtime)) {
+    struct ByteRange ranges[APP_RANGE_MAX_PARTS];
+    int count = GH_RangeParse(range, body_len, ranges, APP_RANGE_MAX_PARTS);
+    if (count >= 0) {
+      char headers[160], modified[32] = "";
+      if (entry->mtime > 0) {
+        FormatHttpDate(entry->mtime, modified, sizeof(modified));
+      }
+      mg_snprintf(headers, sizeof(headers), "%s%s%s%s%s%s%s",
+                  enc >= 0 ? "Content-Encoding: " : "",
+                  enc >= 0 ? GH_CompressionName((enum CacheEncoding) enc) : "",
+                  enc >= 0 ? "\r\n" : "", negotiable ? "Vary: Accept-Encoding\r\n" : "",
+                  modified[0] ? "Last-Modified: " : "", modified, modified[0] ? "\r\n" : "");
+      serve_ranges_from_cache(c, entry, body, body_len, etag, entry->content_type, headers, ranges, count);
+      return;
+    }
+  }
+
+  // Headers were serialized when the entry was cached; the body goes out without copying
+  if (enc >= 0) {
+    GH_MetricsInc(MC_ENCODED);
+  }
+  if (mg_strcmp(hm->method, mg_str("HEAD")) == 0) {
+    mg_send(c, prebuilt->ok, prebuilt->ok_len);
+    GH_ResponseDone(c);
+  } else {
+    GH_ResponseSendEntry(c, prebuilt->ok, prebuilt->ok_len, entry, body, body_len);
+  }
+}
+
+// Answer If-Match / If-None-Match / If-Modified-Since / If-Unmodified-Since
+// for a file served from disk; returns true if a 304 or 412 was sent
+static bool answer_disk_preconditions(struct mg_connection *c, struct mg_http_message *hm,
+                                      const char *etag, time_t mtime) {
+  switch (GH_ConditionalEvaluate(hm, etag, mtime)) {
+    case PRECONDITION_NOT_MODIFIED:
       mg_printf(c, "HTTP/1.1 304 Not Modified\r\n"
-                   "ETag: %s\r\n"
-                   "Cache-Control: public, max-age=300\r\n"
+                   "%s%s%s"
+                   "Cache-Control: " CACHE_CONTROL_VALUE "\r\n"
                    "Connection: keep-alive\r\n"
-                   "\r\n", entry->etag);
+                   "\r\n", etag[0] ? "ETag: " : "", etag, etag[0] ? "\r\n" : "");
+      GH_ResponseDone(c);
+      GH_MetricsInc(MC_NOT_MODIFIED);
+      return true;
+    case PRECONDITION_FAILED:
+      mg_send(c, s_precondition_failed, sizeof(s_precondition_failed) - 1);
+      GH_ResponseDone(c);
+      GH_MetricsInc(MC_PRECONDITION_FAILED);
+      return true;
+    case PRECONDITION_PASS:
+      break;
+  }
+  return false;
+}
+
+// Send one byte range of a file as a 206; false if the file cannot be opened
+static bool send_file_range(struct mg_connection *c, const char *path, uint64_t file_size, time_t mtime,
+                            const char *etag, const struct ByteRange *range) {
+  char head[512], modified[32];
+  uint64_t len = range->last - range->first + 1;
+  FormatHttpDate(mtime, modified, sizeof(modified));
+  size_t head_len = mg_snprintf(head, sizeof(head), "HTTP/1.1 206 Partial Content\r\n"
+               "Content-Type: %s\r\n"
+               "Content-Length: %llu\r\n"
+               "Content-Range: bytes %llu-%llu/%llu\r\n"
+               "%s%s%s"
+               "Last-Modified: %s\r\n"
+               "Cache-Control: " CACHE_CONTROL_VALUE "\r\n"
+               "Connection: keep-alive\r\n"
+               "\r\n",
+               GH_MimeType(path, strlen(path)), (unsigned long long) len,
+               (unsigned long long) range->first, (unsigned long long) range->last,
+               (unsigned long long) file_size, etag[0] ? "ETag: " : "", etag, etag[0] ? "\r\n" : "", modified);
+  if (!GH_ResponseSendFile(c, head, head_len, path, range->first, len)) {
+    return false;
+  }
+  GH_MetricsInc(MC_PARTIAL);
+  return true;
+}
+
+// Serve a file the cache does not hold straight from disk. The body is never
+// read whole: it goes out by sendfile on plain TCP, or through a window of
+// APP_ZEROCOPY_WINDOW bytes in c->send, as fast as the client takes it. The
+// ETag is the content hash the cache would use ("" = none, the file kept changing).
+static void serve_file_from_disk(struct mg_connection *c, const char *path, struct mg_http_message *hm,
+                                 uint64_t file_size, time_t mtime, const char *etag) {
+  char modified[32];
+  GH_MetricsInc(MC_SERVED_DISK);
+  if (answer_disk_preconditions(c, hm, etag, mtime)) {
+    return;
+  }
+
+  // A single range is sliced from the file; several get the whole body, as RFC 9110 allows
+  struct mg_str *range = mg_http_get_header(hm, "Range");
+  if (range != NULL && mg_strcmp(hm->method, mg_str("GET")) == 0 &&
+      GH_RangeIfRangeAllows(mg_http_get_header(hm, "If-Range"), etag, mtime)) {
+    struct ByteRange ranges[APP_RANGE_MAX_PARTS];
+    int count = GH_RangeParse(range, file_size, ranges, APP_RANGE_MAX_PARTS);
+    if (count == 0) {
+      send_range_not_satisfiable(c, file_size);
+      return;
+    }
+    if (count == 1) {
+      if (!send_file_range(c, path, file_size, mtime, etag, &ranges[0])) {
+        send_not_found(c);
+      }
       return;
     }
   }
 
-  // Determine content type based on file extension
-  const char *content_type = "application/octet-stream";
-  if (strstr(entry->path, ".html")) content_type = "text/html";
-  else if (strstr(entry->path, ".css")) content_type = "text/css";
-  else if (strstr(entry->path, ".js")) content_type = "application/javascript";
-  else if (strstr(entry->path, ".json")) content_type = "application/json";
-  else if (strstr(entry->path, ".png")) content_type = "image/png";
-  else if (strstr(entry->path, ".jpg") || strstr(entry->path, ".jpeg")) content_type = "image/jpeg";
-  else if (strstr(entry->path, ".gif")) content_type = "image/gif";
-  else if (strstr(entry->path, ".svg")) content_type = "image/svg+xml";
-  else if (strstr(entry->path, ".ico")) content_type = "image/x-icon";
-  else if (strstr(entry->path, ".woff")) content_type = "font/woff";
-  else if (strstr(entry->path, ".woff2")) content_type = "font/woff2";
-  else if (strstr(entry->path, ".ttf")) content_type = "font/ttf";
-
-  // Send response with caching headers
-  mg_printf(c, "HTTP/1.1 200 OK\r\n"
+  char head[512];
+  FormatHttpDate(mtime, modified, sizeof(modified));
+  size_t head_len = mg_snprintf(head, sizeof(head), "HTTP/1.1 200 OK\r\n"
                "Content-Type: %s\r\n"
-               "Content-Length: %lu\r\n"
-               "ETag: %s\r\n"
-               "Cache-Control: public, max-age=300\r\n"
+               "Content-Length: %llu\r\n"
+               "%s%s%s"
+               "Last-Modified: %s\r\n"
+               "Cache-Control: " CACHE_CONTROL_VALUE "\r\n"
                "Connection: keep-alive\r\n"
                "Accept-Ranges: bytes\r\n"
                "\r\n",
-               content_type, (unsigned long)entry->data_len, 
-               entry->etag ? entry->etag : "");
-  
-  mg_send(c, entry->data, entry->data_len);
+               GH_MimeType(path, strlen(path)), (unsigned long long) file_size,
+               etag[0] ? "ETag: " : "", etag, etag[0] ? "\r\n" : "", modified);
+  if (mg_strcmp(hm->method, mg_str("HEAD")) == 0) {
+    mg_send(c, head, head_len);
+    GH_ResponseDone(c);
+  } else if (!GH_ResponseSendFile(c, head, head_len, path, 0, file_size)) {
+    send_not_found(c);  // Gone since it was stat'ed
+  }
 }
 
-// Try to load file and add to cache
-static bool load_and_cache_file(struct mg_connection *c, const char *path, 
+// Serve a file the cache could not take, streaming it from disk; without the
+// loader, a version not hashed yet is hashed here, on the event loop
+static void serve_uncached_file(struct mg_connection *c, const char *path,
                                 struct mg_http_message *hm) {
-  // Read file from filesystem
-  struct mg_str file_data = mg_file_read(&mg_fs_posix, path);
-  if (file_data.buf == NULL) {
-    return false;
+  struct FileStamp stamp;
+  char etag[CACHE_ETAG_SIZE];
+  if (!GH_FileStampRead(path, &stamp)) {
+    send_not_found(c);
+    return;
+  }
+  GH_FileEtagCompute(&g_file_etags, path, &stamp, etag, sizeof(etag));
+  serve_file_from_disk(c, path, hm, stamp.size, stamp.mtime, etag);
+}
+
+// Answer a request once the loader has finished with its file
+static void serve_loaded_file(struct mg_connection *c, const char *path,
+                              struct mg_http_message *hm, const struct LoadResult *result) {
+  if (result->status == LOAD_NOT_FOUND) {
+    send_not_found(c);
+    return;
+  }
+
+  // Serve from the newly cached entry, unless it was already evicted
+  struct CacheEntry *entry = result->status == LOAD_CACHED ? GH_CacheAcquire(&g_cache, path) : NULL;
+  if (entry != NULL) {
+    serve_from_cache(c, entry, hm);
+    GH_CacheRelease(entry);
+    GH_MetricsInc(MC_SERVED_CACHE);
+  } else if (result->status == LOAD_UNCACHED) {
+    serve_file_from_disk(c, path, hm, result->size, (time_t) result->mtime, result->etag);  // Hashed by the loader
+  } else {
+    serve_uncached_file(c, path, hm);
+  }
+}
+
+// Build the canonical file path for a request URI; returns its length, 0 if
+// the URI is malformed, with the GH_CacheHash every lookup reuses in *hash
+static size_t build_path(struct mg_http_message *hm, char *path, size_t path_len, uint64_t *hash) {
+  return GH_UriCanonicalize(hm->uri.buf, hm->uri.len, path, path_len, hash);
+}
+
+// Keep one canonical path of a private file
+static void add_private_path(const char *path, size_t len, uint64_t hash) {
+  if (s_private_file_count == PRIVATE_FILES_MAX) {
+    MG_ERROR(("More than %d private files, %s is served", PRIVATE_FILES_MAX, path));
+    return;
   }
+  struct PrivateFile *file = &s_private_files[s_private_file_count++];
+  memcpy(file->path, path, len + 1);
+  file->len = len;
+  file->hash = hash;
+}
 
-  // Get file metadata
-  size_t file_size = 0;
-  time_t mtime = 0;
-  mg_fs_posix.st(path, &file_size, &mtime);
+// True if a canonical request path names a private file
+static bool is_private_file(const char *path, size_t len, uint64_t hash) {
+  for (size_t i = 0; i < s_private_file_count; i++) {
+    const struct PrivateFile *file = &s_private_files[i];
+    if (file->hash == hash && file->len == len && memcmp(file->path, path, len) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
 
-  // Generate ETag
-  char etag[64];
-  generate_etag(path, mtime, etag, sizeof(etag));
+// Refuse to serve a file the server reads itself; a no-op unless it is under
+// the served root. Both its spelling and its resolved path are kept, so a
+// symlinked directory on the way does not expose it, and it need not exist yet.
+static void hide_file(const char *file) {
+  char root[PATH_MAX], full[PATH_MAX], key[URI_PATH_MAX];
+  uint64_t hash;
+  if (file == NULL || file[0] == '\0' || realpath(".", root) == NULL) {
+    return;
+  }
+  if (file[0] != '/') {
+    mg_snprintf(full, sizeof(full), "/%s", file);
+    size_t len = GH_UriCanonicalize(full, strlen(full), key, sizeof(key), &hash);
+    if (len > 0 && !is_private_file(key, len, hash)) {
+      add_private_path(key, len, hash);
+    }
+  }
 
-  // Add to cache
-  if (GH_CacheAdd(&g_cache, path, file_data.buf, file_data.len, etag, mtime)) {
-    MG_INFO(("Cached file: %s (%lu bytes)", path, (unsigned long)file_data.len));
-    
-    // Serve from newly cached entry
-    struct CacheEntry *entry = GH_CacheGetByPath(&g_cache, path);
-    if (entry != NULL) {
-      serve_from_cache(c, entry, hm);
+  // Resolved: through its directory if the file itself is not there yet
+  if (realpath(file, full) == NULL) {
+    char dir[PATH_MAX];
+    mg_snprintf(dir, sizeof(dir), "%s", file);
+    char *slash = strrchr(dir, '/');
+    const char *base = slash != NULL ? file + (slash - dir) + 1 : file;
+    if (slash != NULL) {
+      slash[slash == dir] = '\0';  // Keep "/" itself
+    }
+    if (base[0] == '\0' || realpath(slash != NULL ? dir : ".", full) == NULL) {
+      return;
     }
+    size_t n = strlen(full);
+    mg_snprintf(full + n, sizeof(full) - n, "%s%s", full[n - 1] == '/' ? "" : "/", base);
+  }
+  size_t root_len = strlen(root);
+  if (root_len == 1) {
+    root_len = 0;  // Served from "/": every path is under it
+  } else if (strncmp(full, root, root_len) != 0 || full[root_len] != '/') {
+    return;
+  }
+  size_t len = GH_UriCanonicalize(full + root_len, strlen(full + root_len), key, sizeof(key), &hash);
+  if (len > 0 && !is_private_file(key, len, hash)) {
+    add_private_path(key, len, hash);
+  }
+}
+
+// Record a handled request in the access log; mark is c->send.len before its response was queued,
+// now_ms the mg_millis() the request arrived at
+static void log_access(struct mg_connection *c, struct mg_http_message *hm, size_t mark, uint64_t now_ms,
+                       uint64_t elapsed_ns) {
+  struct AccessRecord *rec = GH_AccessLogReserve(&s_access_log);
+  struct ConnState *state = GH_ConnState(c);
+  if (rec == NULL) {
+    state->sent_status = 0;
+    return;
+  }
+
+  // Heads written straight to the socket were summarized on the way out; any
+  // other response was queued whole, so its size is what was queued
+  uint16_t status = state->sent_status;
+  uint64_t bytes = state->sent_bytes;
+  state->sent_status = 0;
+  if (status == 0) {
+    status = GH_ResponseStatus((const char *) c->send.buf + mark, c->send.len - mark);
+    bytes = status != 0 ? c->send.len - mark : 0;
+  }
+
+  rec->millis = now_ms;
+  rec->bytes = bytes;
+  rec->duration_us = (uint32_t) (elapsed_ns / 1000);
+  rec->status = status;
+  memcpy(rec->ip, c->rem.ip, sizeof(rec->ip));
+  rec->is_ip6 = c->rem.is_ip6 ? 1 : 0;
+  memset(rec->method, 0, sizeof(rec->method));
+  memcpy(rec->method, hm->method.buf, hm->method.len < sizeof(rec->method) ? hm->method.len : sizeof(rec->method));
+  rec->uri_truncated = hm->uri.len > ACCESS_LOG_URI_MAX;
+  rec->uri_len = (uint8_t) (rec->uri_truncated ? ACCESS_LOG_URI_MAX : hm->uri.len);
+  memcpy(rec->uri, hm->uri.buf, rec->uri_len);
+  GH_AccessLogCommit(&s_access_log);
+}
+
+// Keep a copy of the request while its file loads; mongoose drops hm once we return
+static bool park_request(struct mg_connection *c, struct mg_http_message *hm) {
+  struct PendingRequest *pending = malloc(sizeof(*pending) + hm->message.len);
+  if (pending == NULL) {
+    return false;
+  }
+  pending->start_ns = GH_MetricsNow();
+  pending->len = hm->message.len;
+  memcpy(pending->buf, hm->message.buf, hm->message.len);
+  GH_ConnState(c)->pending = pending;
+  c->is_resp = 1;  // Hold pipelined requests until the load completes
+  return true;
+}
+
+static void drop_pending(struct mg_connection *c) {
+  free(GH_ConnState(c)->pending);
+  GH_ConnState(c)->pending = NULL;
+}
+
+// MG_EV_WAKEUP from the loader: re-parse the parked request and answer it
+static void resume_request(struct mg_connection *c, const struct LoadResult *result) {
+  struct PendingRequest *pending = GH_ConnState(c)->pending;
+  if (pending == NULL) {
+    return;
+  }
+
+  struct mg_http_message hm;
+  if (mg_http_parse(pending->buf, pending->len, &hm) <= 0) {
+    drop_pending(c);
+    mg_http_reply(c, 500, "Connection: keep-alive\r\n", "Bad parked request\n");
+    return;
+  }
+
+  char path[URI_PATH_MAX];
+  uint64_t hash;
+  build_path(&hm, path, sizeof(path), &hash);  // Accepted once already, when it was parked
+  GH_ResponseDone(c);
+  size_t mark = c->send.len;
+  serve_loaded_file(c, path, &hm, result);
+  uint64_t elapsed = GH_MetricsNow() - pending->start_ns;
+  GH_MetricsObserveNs(MH_CACHE_MISS, elapsed);
+  log_access(c, &hm, mark, mg_millis() - elapsed / 1000000, elapsed);
+  drop_pending(c);
+}
+
+// Answer a single Range of a large uncached file straight from disk instead of
+// caching the whole file first; returns false if the request needs the normal
+// path, which also hashes a version whose ETag is not known yet
+static bool serve_range_from_disk(struct mg_connection *c, const char *path,
+                                  struct mg_http_message *hm) {
+  struct mg_str *range = mg_http_get_header(hm, "Range");
+  if (range == NULL || mg_strcmp(hm->method, mg_str("GET")) != 0) {
+    return false;
+  }
+
+  struct FileStamp stamp;
+  char etag[CACHE_ETAG_SIZE];
+  if (!GH_FileStampRead(path, &stamp) || stamp.size < APP_RANGE_DISK_MIN_SIZE ||
+      !GH_FileEtagLookup(&g_file_etags, &stamp, etag, sizeof(etag))) {
+    return false;
+  }
+  uint64_t file_size = stamp.size;
+  time_t mtime = stamp.mtime;
+  if (answer_disk_preconditions(c, hm, etag, mtime)) {
+    return true;
+  }
+  if (!GH_RangeIfRangeAllows(mg_http_get_header(hm, "If-Range"), etag, mtime)) {
+    return false;
+  }
+
+  struct ByteRange ranges[APP_RANGE_MAX_PARTS];
+  int count = GH_RangeParse(range, file_size, ranges, APP_RANGE_MAX_PARTS);
+  if (count == 0) {
+    send_range_not_satisfiable(c, file_size);
+    return true;
+  }
+  if (count != 1) {
+    return false;  // Multipart is served from the cache
+  }
+  if (!send_file_range(c, path, file_size, mtime, etag, &ranges[0])) {
+    return false;
+  }
+  GH_MetricsInc(MC_SERVED_DISK);
+  return true;
+}
+
+// Gauges reported next to the counters
+static void collect_gauges(struct MetricsGauges *gauges) {
+  gauges->cache_entries = GH_AtomicLoadSize(&g_cache.entry_count);
+  gauges->cache_bytes = GH_AtomicLoadSize(&g_cache.size);
+  gauges->cache_budget = GH_CacheBudget(&g_cache);
+  gauges->cache_reserved = GH_AtomicLoadSize(&g_cache.arena.reserved);
+  gauges->snapshot_files = g_snapshot.count;
+  gauges->connections = (size_t) GH_AtomicLoadInt(&s_open_connections);
+  gauges->connections_max = (size_t) s_max_connections;
+}
+
+// Reply with every metric, as JSON or in the Prometheus text format
+static void send_metrics(struct mg_connection *c, bool json) {
+  struct MetricsGauges gauges;
+  struct mg_iobuf buf = {NULL, 0, 0, 4096};
+  collect_gauges(&gauges);
+  if (json) {
+    GH_MetricsRenderJson(&buf, &gauges);
   } else {
-    // Cache failed, serve directly
-    MG_ERROR(("Failed to cache file: %s", path));
-    struct mg_http_serve_opts opts = {
-      .root_dir = ".",
-      .fs = &mg_fs_posix,
-      .extra_headers = "Cache-Control: public, max-age=300\r\nConnection: keep-alive\r\n"
-    };
-    mg_http_serve_file(c, hm, path, &opts);
+    GH_MetricsRenderPrometheus(&buf, &gauges);
+  }
+  mg_http_reply(c, 200, json ? "Content-Type: application/json\r\nConnection: keep-alive\r\n"
+                             : "Content-Type: text/plain; version=0.0.4\r\nConnection: keep-alive\r\n",
+                "%.*s%s", (int) buf.len, buf.buf != NULL ? (char *) buf.buf : "", json ? "\n" : "");
+  mg_iobuf_free(&buf);
+}
+
+// Liveness probe
+static void route_hello(struct mg_connection *c, struct mg_http_message *hm, const struct RouteMatch *match) {
+  (void) hm;
+  (void) match;
+  mg_http_reply(c, 200, "Content-Type: application/json\r\nConnection: keep-alive\r\n", 
+                "{%m:%d}\n", MG_ESC("status"), 1);
+}
+
+// Cache statistics (sizes plus counters and latency percentiles)
+static void route_cache_stats(struct mg_connection *c, struct mg_http_message *hm, const struct RouteMatch *match) {
+  (void) hm;
+  (void) match;
+  send_metrics(c, true);
+}
+
+// Prometheus scrape endpoint
+static void route_metrics(struct mg_connection *c, struct mg_http_message *hm, const struct RouteMatch *match) {
+  (void) hm;
+  (void) match;
+  send_metrics(c, false);
+}
+
+// Constant-time check of "Authorization: Bearer <token>" against --admin-token
+static bool admin_authorized(struct mg_http_message *hm) {
+  struct mg_str *auth = mg_http_get_header(hm, "Authorization");
+  size_t token_len = strlen(s_admin_token);
+  if (auth == NULL || token_len == 0 || auth->len != 7 + token_len || mg_ncasecmp(auth->buf, "Bearer ", 7) != 0) {
+    return false;
+  }
+  unsigned char diff = 0;
+  for (size_t i = 0; i < token_len; i++) {
+    diff |= (unsigned char) (auth->buf[7 + i] ^ s_admin_token[i]);
+  }
+  return diff == 0;
+}
+
+// Apply "budget_mb", "ttl_ms" and "adaptive" from an admin request, all or
+// nothing; replies 400 and returns false if one is malformed
+static bool apply_cache_settings(struct mg_connection *c, struct mg_str params) {
+  struct mg_str budget = mg_http_var(params, mg_str("budget_mb"));
+  struct mg_str ttl = mg_http_var(params, mg_str("ttl_ms"));
+  struct mg_str adaptive = mg_http_var(params, mg_str("adaptive"));
+  uint64_t budget_mb = 0, ttl_ms = 0;
+  bool ok = (budget.buf == NULL || (mg_str_to_num(budget, 10, &budget_mb, sizeof(budget_mb)) && budget_mb > 0 &&
+                                    budget_mb <= SIZE_MAX / (1024 * 1024))) &&
+            (ttl.buf == NULL || mg_str_to_num(ttl, 10, &ttl_ms, sizeof(ttl_ms))) &&
+            (adaptive.buf == NULL || mg_strcmp(adaptive, mg_str("0")) == 0 ||
+             (mg_strcmp(adaptive, mg_str("1")) == 0 && s_memory_available));
+  if (!ok) {
+    mg_http_reply(c, 400, "Content-Type: application/json\r\nConnection: keep-alive\r\n", "{%m:%m}\n", MG_ESC("error"),
+                  MG_ESC("expected budget_mb > 0, ttl_ms >= 0, adaptive 0 or 1 (1 needs a cgroup limit or PSI)"));
+    return false;
   }
 
-  free((void *)file_data.buf);
+  GH_MutexLock(&s_budget_lock);
+  if (budget.buf != NULL) {
+    s_cache_ceiling = (size_t) budget_mb * 1024 * 1024;
+  }
+  if (adaptive.buf != NULL) {
+    s_cache_adaptive = adaptive.buf[0] == '1';
+  }
+  // A fixed budget is the ceiling; an adaptive one only takes a cut at once, and grows back on its own
+  size_t current = GH_CacheBudget(&g_cache);
+  size_t target = !s_cache_adaptive || current > s_cache_ceiling ? s_cache_ceiling : current;
+  if (target != current) {
+    GH_CacheSetBudget(&g_cache, target);
+  }
+  if (ttl.buf != NULL) {
+    GH_CacheSetTtl(&g_cache, ttl_ms);
+  }
+  MG_INFO(("Admin: cache budget %luMB (ceiling %luMB, adaptive %s), TTL %llums", (unsigned long) (target >> 20),
+           (unsigned long) (s_cache_ceiling >> 20), s_cache_adaptive ? "on" : "off",
+           (unsigned long long) GH_CacheTtl(&g_cache)));
+  GH_MutexUnlock(&s_budget_lock);
+  GH_MetricsInc(MC_CACHE_BUDGET_ADMIN);
   return true;
 }
 
+// Reply 401 unless the request carries the --admin-token as a Bearer token
+static bool check_admin(struct mg_connection *c, struct mg_http_message *hm) {
+  if (admin_authorized(hm)) {
+    return true;
+  }
+  mg_http_reply(c, 401, "WWW-Authenticate: Bearer\r\nContent-Type: text/plain\r\nConnection: keep-alive\r\n",
+                "Unauthorized\n");
+  return false;
+}
+
+// Runtime cache settings: GET shows them, POST/PUT change them (form body or
+// query, see apply_cache_settings); needs the --admin-token as a Bearer token
+static void route_admin_cache(struct mg_connection *c, struct mg_http_message *hm, const struct RouteMatch *match) {
+  (void) match;
+  if (!check_admin(c, hm)) {
+    return;
+  }
+  if (mg_strcmp(hm->method, mg_str("GET")) != 0 && !apply_cache_settings(c, hm->body.len > 0 ? hm->body : hm->query)) {
+    return;
+  }
+
+  GH_MutexLock(&s_budget_lock);
+  mg_http_reply(c, 200, "Content-Type: application/json\r\nCache-Control: no-store\r\nConnection: keep-alive\r\n",
+                "{%m:%lu,%m:%lu,%m:%lu,%m:%lu,%m:%llu,%m:%s,%m:%llu,%m:%llu,%m:%g}\n",
+                MG_ESC("budget_bytes"), (unsigned long) GH_CacheBudget(&g_cache),
+                MG_ESC("ceiling_bytes"), (unsigned long) s_cache_ceiling,
+                MG_ESC("floor_bytes"), (unsigned long) s_cache_floor,
+                MG_ESC("size_bytes"), (unsigned long) GH_AtomicLoadSize(&g_cache.size),
+                MG_ESC("ttl_ms"), (unsigned long long) GH_CacheTtl(&g_cache),
+                MG_ESC("adaptive"), s_cache_adaptive ? "true" : "false",
+                MG_ESC("memory_limit_bytes"), (unsigned long long) s_memory.limit,
+                MG_ESC("working_set_bytes"), (unsigned long long) s_memory.working_set,
+                MG_ESC("pressure_some_avg10"), s_memory.some_avg10);
+  GH_MutexUnlock(&s_budget_lock);
+}
+
+// Drop every cached file and remembered 404; POST only, with the --admin-token
+static void route_admin_cache_clear(struct mg_connection *c, struct mg_http_message *hm,
+                                    const struct RouteMatch *match) {
+  (void) match;
+  if (!check_admin(c, hm)) {
+    return;
+  }
+  GH_CacheClear(&g_cache);
+  GH_NegativeCacheClear(&g_negative);
+  MG_INFO(("Admin: cache cleared"));
+  mg_http_reply(c, 200, "Content-Type: application/json\r\nCache-Control: no-store\r\nConnection: keep-alive\r\n",
+                "{%m:%m}\n", MG_ESC("status"), MG_ESC("cleared"));
+}
+
+// Growtopia client login: the prebuilt block for its version, no file lookup
+static void route_server_data(struct mg_connection *c, struct mg_http_message *hm, const struct RouteMatch *match) {
+  (void) match;
+  struct mg_str response = GH_ServerDataResponse(GH_ServerDataAcquire(&s_server_data),
+                                                 hm->body.len > 0 ? hm->body : hm->query);
+  mg_send(c, response.buf, response.len);
+  GH_ResponseDone(c);
+}
+
+// Reply 405 for a routed path that does not accept the request's method
+static void send_method_not_allowed(struct mg_connection *c, unsigned allowed) {
+  char allow[64], headers[128];
+  GH_RouterFormatAllow(allowed, allow, sizeof(allow));
+  mg_snprintf(headers, sizeof(headers), "Allow: %s\r\nContent-Type: text/plain\r\nConnection: keep-alive\r\n", allow);
+  mg_http_reply(c, 405, headers, "Method not allowed\n");
+}
+
+// HEAD: cut the body an API reply wrote behind its head at mark; the
+// Content-Length stays the one a GET would get
+static void drop_reply_body(struct mg_connection *c, size_t mark) {
+  for (size_t i = mark; i + 4 <= c->send.len; i++) {
+    if (memcmp(c->send.buf + i, "\r\n\r\n", 4) == 0) {
+      c->send.len = i + 4;
+      return;
+    }
+  }
+}
+
+// Register every API endpoint; paths not routed here are served as static files
+// (server_data.php too while no config was rendered, and the admin API without a token)
+static bool build_routes(struct Router *router, bool server_data, bool admin) {
+  GH_RouterInit(router);
+  if (server_data && !GH_RouterAdd(router, ROUTE_POST | ROUTE_GET, SERVER_DATA_PATH, route_server_data, NULL)) {
+    return false;
+  }
+  if (admin && (!GH_RouterAdd(router, ROUTE_GET | ROUTE_POST | ROUTE_PUT, "/api/admin/cache", route_admin_cache, NULL) ||
+                !GH_RouterAdd(router, ROUTE_POST, "/api/admin/cache/clear", route_admin_cache_clear, NULL))) {
+    return false;
+  }
+  return GH_RouterAdd(router, ROUTE_GET | ROUTE_HEAD, "/api/hello", route_hello, NULL) &&
+         GH_RouterAdd(router, ROUTE_GET | ROUTE_HEAD, "/api/cache/stats", route_cache_stats, NULL) &&
+         GH_RouterAdd(router, ROUTE_GET | ROUTE_HEAD, "/metrics", route_metrics, NULL) &&
+         GH_RouterBuild(router);
+}
+
+// Route one request; returns the histogram its handling time belongs to, or
+// MH_COUNT if it was parked for an async load and is timed on completion
+static enum MetricsHistogram handle_request(struct mg_connection *c, struct mg_http_message *hm) {
+  // API endpoints: one table lookup, whatever the number of routes
+  struct RouteMatch match;
+  if (GH_RouterMatch(&s_router, hm->method, hm->uri, &match)) {
+    size_t mark = c->send.len;
+    if (match.target != NULL) {
+      match.target->handler(c, hm, &match);
+    } else {
+      send_method_not_allowed(c, match.allowed);
+    }
+    // Handlers answer through mg_http_reply, which always writes the body
+    if (mg_strcmp(hm->method, mg_str("HEAD")) == 0) {
+      drop_reply_body(c, mark);
+    }
+    return MH_API;
+  }
+
+  // Canonical file path, hashed once for every lookup below
+  char path[URI_PATH_MAX];
+  uint64_t hash;
+  size_t path_len = build_path(hm, path, sizeof(path), &hash);
+  if (path_len == 0) {
+    mg_send(c, s_bad_request, sizeof(s_bad_request) - 1);
+    GH_ResponseDone(c);
+    GH_MetricsInc(MC_BAD_REQUEST);
+    return MH_ERROR;
+  }
+  if (is_private_file(path, path_len, hash)) {
+    send_not_found(c);
+    return MH_ERROR;
+  }
+
+  // Try the mapped snapshot, then the cache (cache-first strategy)
+  struct CacheEntry *cached = GH_SnapshotAcquireHashed(&g_snapshot, path, path_len, hash);
+  bool from_snapshot = cached != NULL;
+  if (cached == NULL) {
+    cached = GH_CacheAcquireHashed(&g_cache, path, path_len, hash);
+  }
+  if (cached != NULL) {
+    // The watcher drops changed files as they change; without it, stat at most once per TTL
+    uint64_t interval = GH_WatcherActive(&s_watcher) ? CACHE_REVALIDATE_MS : GH_CacheTtl(&g_cache);
+    if (GH_CacheRevalidate(cached, mg_millis(), interval)) {
+      // Serve from cache
+      MG_DEBUG(("Serving from cache: %s", path));
+      serve_from_cache(c, cached, hm);
+      GH_CacheRelease(cached);
+      GH_MetricsInc(from_snapshot ? MC_SERVED_SNAPSHOT : MC_SERVED_CACHE);
+      return MH_CACHE_HIT;
+    } else {
+      // Changed on disk, remove entry
+      MG_DEBUG(("Cache stale: %s", path));
+      GH_CacheRelease(cached);
+      GH_SnapshotInvalidate(&g_snapshot, path);
+      GH_CacheRemove(&g_cache, path);
+    }
+  }
+
+  // Recently missing paths are answered without touching the filesystem
+  if (GH_NegativeCacheContainsHashed(&g_negative, path, path_len, hash, mg_millis())) {
+    send_not_found(c);
+    GH_MetricsInc(MC_NEGATIVE_HITS);
+    return MH_NEGATIVE;
+  }
+
+  // Large files asked for by range are streamed from disk without caching them
+  if (serve_range_from_disk(c, path, hm)) {
+    MG_DEBUG(("Serving range from disk: %s", path));
+    return MH_DISK;
+  }
+
+  // Not in cache or expired: a loader thread reads it while this loop keeps
+  // serving; MG_EV_WAKEUP brings the result back to this connection
+  MG_DEBUG(("Loading from disk: %s", path));
+  if (!park_request(c, hm)) {
+    serve_uncached_file(c, path, hm);
+    return MH_DISK;
+  }
+  if (!GH_LoaderRequest(&g_loader, path, c->mgr, c->id)) {
+    drop_pending(c);
+    GH_ResponseDone(c);
+    serve_uncached_file(c, path, hm);
+    return MH_DISK;
+  }
+  return MH_COUNT;
+}
+
+// Stop accepting on this worker for a while: connections arriving meanwhile
+// wait in the kernel backlog instead of being accepted only to be closed
+static void pause_accepting(struct Worker *worker, uint64_t now) {
+  if (worker->accept_resume != 0) {
+    return;  // Already paused; this one was accepted in the same batch
+  }
+  worker->accept_backoff_ms = worker->accept_backoff_ms == 0 ? ACCEPT_BACKOFF_MIN_MS
+                              : worker->accept_backoff_ms * 2 > ACCEPT_BACKOFF_MAX_MS ? ACCEPT_BACKOFF_MAX_MS
+                              : worker->accept_backoff_ms * 2;
+  worker->accept_resume = now + worker->accept_backoff_ms;
+  GH_ListenerPause(worker->listener, true);
+  if (worker->tls_listener != NULL) {
+    GH_ListenerPause(worker->tls_listener, true);
+  }
+  GH_MetricsInc(MC_ACCEPT_PAUSES);
+}
+
+// Count a new connection against the global cap and arm its idle timer;
+// returns false if it was refused and is being closed
+static bool accept_connection(struct mg_connection *c, struct Worker *worker, uint64_t now) {
+  int open = GH_AtomicIncInt(&s_open_connections);
+  if (s_max_connections > 0 && open > s_max_connections) {
+    GH_AtomicDecInt(&s_open_connections);
+    c->is_closing = 1;
+    GH_MetricsInc(MC_CONNS_OVER_CAPACITY);
+    pause_accepting(worker, now);
+    return false;
+  }
+  worker->accept_backoff_ms = 0;
+  GH_ConnState(c)->counted = true;
+  GH_KeepAliveAdd(&worker->keepalive, c, now);
+  return true;
+}
+
+// Close a connection once its last allowed response is fully queued; earlier,
+// is_draining could cut a body that is still being streamed
+static void drain_if_exhausted(struct mg_connection *c, struct Worker *worker) {
+  if (!c->is_resp && !c->is_draining && GH_KeepAliveExhausted(&worker->keepalive, c)) {
+    c->is_draining = 1;
+    GH_MetricsInc(MC_CONNS_MAX_REQUESTS);
+  }
+}
+
+// A replacement serves the listeners now: stop accepting for good (closing
+// them would not stop the kernel queueing on sockets it shares), and close
+// each connection after its current response, or right away if it is idle
+static void start_draining(struct Worker *worker) {
+  worker->draining = true;
+  GH_ListenerPause(worker->listener, true);
+  if (worker->tls_listener != NULL) {
+    GH_ListenerPause(worker->tls_listener, true);
+  }
+  worker->keepalive.max_requests = 1;
+}
+
+// Worker 0: hand the listeners and a dump of the cache to a replacement asking
+// for them, then stop once every connection closed or the drain time ran out.
+// The dump and the wait block this worker only; its new connections queue.
+static void poll_hot_restart(uint64_t now) {
+  if (GH_AtomicLoadInt(&s_draining)) {
+    if (GH_AtomicLoadInt(&s_open_connections) == 0 || now >= s_drain_deadline) {
+      GH_AtomicStoreInt(&s_stop, 1);
+    }
+    return;
+  }
+  int peer = GH_HotRestartAccept(&s_hot_restart);
+  if (peer < 0) {
+    return;
+  }
+
+  struct HotRestartHandoff handoff = s_handoff;
+  size_t files = 0;
+  if (GH_SnapshotDump(handoff.snapshot, &g_cache, &g_snapshot, &files)) {
+    MG_INFO(("Hot restart: %lu cached files written to %s", (unsigned long) files, handoff.snapshot));
+  } else {
+    MG_ERROR(("Hot restart: cannot write %s, the new process starts with an empty cache", handoff.snapshot));
+    handoff.snapshot[0] = '\0';
+  }
+  if (!GH_HotRestartOffer(peer, &handoff, APP_HOT_RESTART_TIMEOUT_MS)) {
+    MG_ERROR(("Hot restart: the new process did not take over, still serving"));
+    return;
+  }
+  MG_INFO(("Hot restart: listeners handed over, draining %d connections",
+           GH_AtomicLoadInt(&s_open_connections)));
+  GH_HotRestartClose(&s_hot_restart, false);  // The new process listens on the path now
+  s_drain_deadline = mg_millis() + APP_HOT_RESTART_DRAIN_MS;
+  GH_AtomicStoreInt(&s_draining, 1);
+}
+
+// Worker 0: evict toward a lowered budget one bounded step per poll, so no
+// request pays for the whole cut, and in adaptive mode follow the memory readings
+static void poll_cache_budget(uint64_t now) {
+  size_t freed = GH_CacheShrink(&g_cache, CACHE_SHRINK_STEP_BYTES);
+  if (freed == 0 && s_cache_shrinking) {
+    GH_CacheArenaTrim(&g_cache.arena);  // Within budget again: hand the emptied slabs back
+  }
+  s_cache_shrinking = freed > 0;
+
+  if (now < s_memory_next_check) {
+    return;
+  }
+  s_memory_next_check = now + CACHE_ADAPTIVE_INTERVAL_MS;
+  GH_MutexLock(&s_budget_lock);
+  if (s_cache_adaptive && GH_MemoryPressureSample(&s_memory)) {
+    size_t budget = GH_CacheBudget(&g_cache);
+    size_t next = GH_MemoryPressureBudget(&s_memory, budget, GH_AtomicLoadSize(&g_cache.size), s_cache_floor,
+                                          s_cache_ceiling);
+    if (next != budget) {
+      GH_CacheSetBudget(&g_cache, next);
+      GH_MetricsInc(next < budget ? MC_CACHE_BUDGET_SHRINKS : MC_CACHE_BUDGET_GROWS);
+      MG_DEBUG(("Cache budget %luMB -> %luMB (working set %lluMB of %lluMB, pressure %.2f)",
+                (unsigned long) (budget >> 20), (unsigned long) (next >> 20),
+                (unsigned long long) (s_memory.working_set >> 20), (unsigned long long) (s_memory.limit >> 20),
+                s_memory.some_avg10));
+    }
+  }
+  GH_MutexUnlock(&s_budget_lock);
+}
+
 // Connection event handler function with optimized static file serving
 static void ev_handler(struct mg_connection *c, int ev, void *ev_data) {
-  if (ev == MG_EV_HTTP_MSG) {
-    struct mg_http_message *hm = (struct mg_http_message *) ev_data;
+  struct Worker *worker = (struct Worker *) c->fn_data;
+
+  // Keep in-flight zero-copy bodies moving and release their pins on close
+  if (ev == MG_EV_WRITE || ev == MG_EV_POLL || ev == MG_EV_CLOSE) {
+    GH_ResponseOnEvent(c, ev);
+  }
+  if (ev == MG_EV_WRITE) {
+    GH_MetricsAdd(MC_BYTES_SENT, (uint64_t) *(long *) ev_data);
+    GH_KeepAliveTouch(c, mg_millis());
+  }
 
-    // Handle API endpoints
-    if (mg_match(hm->uri, mg_str("/api/hello"), NULL)) {
-      mg_http_reply(c, 200, "Content-Type: application/json\r\nConnection: keep-alive\r\n", 
-                    "{%m:%d}\n", MG_ESC("status"), 1);
+  if (ev == MG_EV_ACCEPT) {
+    // Over the global cap, or over its address's: close before reading a byte
+    uint64_t now = mg_millis();
+    if (!accept_connection(c, worker, now)) {
       return;
     }
+    if (GH_AdmissionConnect(&s_admission, &c->rem, now)) {
+      GH_ConnState(c)->admitted = true;
+    } else {
+      c->is_closing = 1;
+      GH_MetricsInc(MC_ADMISSION_CONN_REJECTED);
+    }
+    // Accepted connections inherit their listener's address; the handshake
+    // runs as the client's first bytes arrive, then HTTP is served as usual
+    if (!c->is_closing && worker->tls_listener != NULL && c->loc.port == worker->tls_listener->loc.port) {
+      struct mg_tls_opts opts;
+      memset(&opts, 0, sizeof(opts));
+      mg_tls_init(c, &opts);
+    }
 
-    // Handle cache statistics endpoint
-    if (mg_match(hm->uri, mg_str("/api/cache/stats"), NULL)) {
-      mg_http_reply(c, 200, "Content-Type: application/json\r\nConnection: keep-alive\r\n",
-                    "{%m:%lu,%m:%lu,%m:%lu}\n",
-                    MG_ESC("entries"), (unsigned long)g_cache.entry_count,
-                    MG_ESC("size_bytes"), (unsigned long)g_cache.size,
-                    MG_ESC("size_mb"), (unsigned long)(g_cache.size / (1024 * 1024)));
+  } else if (ev == MG_EV_HTTP_MSG) {
+    struct mg_http_message *hm = (struct mg_http_message *) ev_data;
+    if (c->is_draining) {
+      return;  // Pipelined behind the last allowed request; the client retries elsewhere
+    }
+    uint64_t start = GH_MetricsNow();
+    uint64_t now = mg_millis();
+    size_t mark = c->send.len;
+    GH_MetricsInc(MC_REQUESTS);
+    GH_KeepAliveRequest(c, now);
+    if (!GH_AdmissionRequest(&s_admission, &c->rem, now)) {
+      mg_send(c, s_too_many_requests, sizeof(s_too_many_requests) - 1);
+      c->is_draining = 1;
+      GH_MetricsInc(MC_ADMISSION_RATE_LIMITED);
+      log_access(c, hm, mark, now, GH_MetricsNow() - start);
       return;
     }
+    enum MetricsHistogram route = handle_request(c, hm);
+    if (route != MH_COUNT) {
+      uint64_t elapsed = GH_MetricsNow() - start;
+      GH_MetricsObserveNs(route, elapsed);
+      log_access(c, hm, mark, now, elapsed);  // Parked requests are logged when they are answered
+    }
+    drain_if_exhausted(c, worker);
 
-    // Handle cache clear endpoint
-    if (mg_match(hm->uri, mg_str("/api/cache/clear"), NULL)) {
-      GH_CacheCleanup(&g_cache);
-      GH_CacheInit(&g_cache);
-      mg_http_reply(c, 200, "Content-Type: application/json\r\nConnection: keep-alive\r\n",
-                    "{%m:%m}\n", MG_ESC("status"), MG_ESC("cleared"));
-      return;
+  } else if (ev == MG_EV_WAKEUP) {
+    struct mg_str *data = (struct mg_str *) ev_data;
+    if (data->len == sizeof(struct LoadResult)) {
+      resume_request(c, (const struct LoadResult *) data->buf);
     }
 
-    // Build file path
-    char path[256];
-    mg_snprintf(path, sizeof(path), ".%.*s", (int)hm->uri.len, hm->uri.buf);
-    
-    // Default to index.html for root
-    if (strcmp(path, "./") == 0 || strcmp(path, ".") == 0) {
-      strcpy(path, "./index.html");
-    }
-
-    // Try to serve from cache first (cache-first strategy)
-    struct CacheEntry *cached = GH_CacheGetByPath(&g_cache, path);
-    if (cached != NULL) {
-      // Check if cache entry is still valid
-      uint64_t current_time = mg_millis();
-      if (current_time - cached->timestamp <= CACHE_TTL_MS) {
-        // Serve from cache
-        MG_DEBUG(("Serving from cache: %s", path));
-        serve_from_cache(c, cached, hm);
-        return;
-      } else {
-        // Cache expired, remove entry
-        MG_DEBUG(("Cache expired: %s", path));
-        GH_CacheRemove(&g_cache, path);
+  } else if (ev == MG_EV_CLOSE) {
+    drop_pending(c);
+    if (GH_ConnState(c)->admitted) {
+      GH_AdmissionDisconnect(&s_admission, &c->rem);
+    }
+    if (GH_ConnState(c)->counted) {
+      GH_KeepAliveRemove(c);
+      GH_AtomicDecInt(&s_open_connections);
+    }
+
+  } else if (ev == MG_EV_POLL && !c->is_listening) {
+    drain_if_exhausted(c, worker);  // Streamed or parked responses finish after MG_EV_HTTP_MSG
+
+  } else if (ev == MG_EV_POLL && c == worker->listener) {
+    // Each worker's plain listener runs its wheel and ends its accept pause
+    uint64_t now = mg_millis();
+    GH_MetricsAdd(MC_CONNS_IDLE_CLOSED, GH_KeepAliveExpire(&worker->keepalive, now));
+    if (!worker->draining && GH_AtomicLoadInt(&s_draining)) {
+      start_draining(worker);
+    } else if (!worker->draining && worker->accept_resume != 0 && now >= worker->accept_resume) {
+      worker->accept_resume = 0;
+      GH_ListenerPause(c, false);
+      if (worker->tls_listener != NULL) {
+        GH_ListenerPause(worker->tls_listener, false);
       }
     }
 
-    // Not in cache or expired, load from disk
-    MG_DEBUG(("Loading from disk: %s", path));
-    if (!load_and_cache_file(c, path, hm)) {
-      // File not found, serve 404
-      mg_http_reply(c, 404, "Connection: keep-alive\r\n", "File not found\n");
+    // Apply file change events; the cache is shared, so only the first
+    // worker's listener does it. Unchanged entries never expire.
+    if (worker->id == 0) {
+      GH_WatcherPoll(&s_watcher);
+      GH_ServerDataPoll(&s_server_data, now);
+      poll_cache_budget(now);
+      poll_hot_restart(now);
     }
+  }
+}
 
-  } else if (ev == MG_EV_POLL) {
-    // Periodically evict expired cache entries (every poll)
-    static uint64_t last_cleanup = 0;
-    uint64_t now = mg_millis();
-    if (now - last_cleanup > 60000) {  // Cleanup every minute
-      GH_CacheEvictExpired(&g_cache, now);
-      last_cleanup = now;
+// Run a worker's event loop until a hot restart replaced this process
+static void worker_run(void *arg) {
+  struct Worker *worker = (struct Worker *) arg;
+  while (!GH_AtomicLoadInt(&s_stop)) {
+    mg_mgr_poll(&worker->mgr, s_poll_timeout_ms);
+  }
+  if (worker->id != 0) {
+    GH_ServerDataRelease(&s_server_data);  // Worker 0's goes with GH_ServerDataCleanup
+  }
+}
+
+// Value following "<name>" on the command line (last one wins), else the
+// config file's "<name without dashes> = <value>", else fallback
+static const char *parse_option(int argc, char *argv[], const char *name, const char *fallback) {
+  const char *value = GH_ConfigFileGet(&s_config, name, fallback);
+  for (int i = 1; i + 1 < argc; i++) {
+    if (strcmp(argv[i], name) == 0) {
+      value = argv[++i];
     }
   }
+  return value;
 }
 
-int main(void) {
-  struct mg_mgr mgr;
-  
+// Per-address limits from "--rate-limit <rps>[:<burst>]" and "--conn-limit <count>" (0 = off, the
+// default: players behind one NAT or CGNAT address would share a single budget)
+static bool init_admission(int argc, char *argv[]) {
+  const char *rate = parse_option(argc, argv, "--rate-limit", NULL);
+  const char *conns = parse_option(argc, argv, "--conn-limit", NULL);
+  uint32_t rps = APP_RATE_LIMIT_RPS, burst = APP_RATE_LIMIT_BURST;
+  if (rate != NULL) {
+    char *end;
+    rps = (uint32_t) strtoul(rate, &end, 10);
+    burst = *end == ':' ? (uint32_t) strtoul(end + 1, NULL, 10) : 0;
+  }
+  burst = burst > 0 ? burst : 2 * rps;
+  uint32_t max_conns = conns != NULL ? (uint32_t) strtoul(conns, NULL, 10) : APP_CONN_LIMIT_PER_IP;
+  MG_INFO(("Per-address limits: %u req/s (burst %u), %u connections (0 = unlimited)", rps, burst, max_conns));
+  return GH_AdmissionInit(&s_admission, ADMISSION_TABLE_ENTRIES, rps, burst, max_conns);
+}
+
+// Connection limits from "--max-connections <count>", "--keepalive-timeout <ms>"
+// and "--keepalive-requests <count>" (0 = unlimited); the cap is kept within
+// the open file limit, raised as far as the hard limit allows
+static void init_connection_limits(int argc, char *argv[]) {
+  const char *max = parse_option(argc, argv, "--max-connections", NULL);
+  const char *timeout = parse_option(argc, argv, "--keepalive-timeout", NULL);
+  const char *requests = parse_option(argc, argv, "--keepalive-requests", NULL);
+  s_max_connections = max != NULL ? atoi(max) : APP_MAX_CONNECTIONS;
+  s_keepalive_timeout_ms = timeout != NULL ? (uint32_t) strtoul(timeout, NULL, 10) : APP_KEEPALIVE_TIMEOUT_MS;
+  s_keepalive_max_requests = requests != NULL ? (uint32_t) strtoul(requests, NULL, 10) : APP_KEEPALIVE_MAX_REQUESTS;
+  if (s_max_connections < 0) {
+    s_max_connections = 0;
+  }
+
+  size_t wanted = s_max_connections > 0 ? (size_t) s_max_connections + LISTENER_FD_RESERVE : SIZE_MAX;
+  size_t fds = GH_ListenerRaiseFdLimit(wanted);
+  if (fds < wanted && s_max_connections > 0) {
+    s_max_connections = fds > 2 * LISTENER_FD_RESERVE ? (int) (fds - LISTENER_FD_RESERVE) : LISTENER_FD_RESERVE;
+    MG_ERROR(("Open file limit is %lu, capping connections at %d", (unsigned long) fds, s_max_connections));
+  }
+  MG_INFO(("Connections: at most %d, closed after %ums idle or %u requests (0 = unlimited)", s_max_connections,
+           s_keepalive_timeout_ms, s_keepalive_max_requests));
+}
+
+// HTTPS listener from "--https <url>", served with "--tls-cert" / "--tls-key"
+// PEM files and ticket keys rotated every "--tls-ticket-rotate <seconds>"
+// (0 = no tickets). Sets *url to NULL if HTTPS is off; false if it cannot start.
+static bool init_tls(int argc, char *argv[], const char **url) {
+  // Never served, with HTTPS off too: a key left in the root from another setup stays private
+  const char *cert = parse_option(argc, argv, "--tls-cert", APP_TLS_CERT);
+  const char *key = parse_option(argc, argv, "--tls-key", APP_TLS_KEY);
+  hide_file(cert);
+  hide_file(key);
+  *url = parse_option(argc, argv, "--https", APP_HTTPS_LISTEN_URL);
+  if ((*url)[0] == '\0') {
+    *url = NULL;
+    return true;
+  }
+  const char *rotate = parse_option(argc, argv, "--tls-ticket-rotate", NULL);
+  uint32_t rotate_s = rotate != NULL ? (uint32_t) strtoul(rotate, NULL, 10) : APP_TLS_TICKET_ROTATE_S;
+  if (!GH_TlsInit(&s_tls, cert, key, APP_TLS_SESSION_CACHE_SIZE, rotate_s)) {
+    MG_ERROR(("Cannot load TLS certificate %s with key %s", cert, key));
+    return false;
+  }
+  MG_INFO(("TLS: %s, session cache of %d, ticket keys rotated every %us (0 = no tickets)", cert,
+           APP_TLS_SESSION_CACHE_SIZE, rotate_s));
+  return true;
+}
+
+// Listen on url: a single worker keeps the plain listener; several share the port via SO_REUSEPORT
+static struct mg_connection *listen_on(struct Worker *worker, const char *url, int worker_count) {
+  struct mg_connection *c = worker_count == 1 ? mg_http_listen(&worker->mgr, url, ev_handler, worker)
+                                              : GH_ListenerHttpReusePort(&worker->mgr, url, ev_handler, worker);
+  if (c == NULL) {
+    MG_ERROR(("Failed to create listener on %s", url));
+  }
+  return c;
+}
+
+// Serve a listening socket handed over by the process this one replaces
+static struct mg_connection *adopt_listener(struct Worker *worker, int fd) {
+  struct mg_connection *c = GH_ListenerHttpAdopt(&worker->mgr, fd, ev_handler, worker);
+  if (c == NULL) {
+    MG_ERROR(("Failed to serve handed-over listener %d", fd));
+  }
+  return c;
+}
+
+// Fill in what a replacement started with the same --hot-restart socket is
+// handed, and listen for it; false if there are more listeners than it takes
+static bool init_hot_restart(const char *path, struct Worker *workers, int worker_count) {
+  bool tls = workers[0].tls_listener != NULL;
+  if (worker_count * (tls ? 2 : 1) > HOT_RESTART_MAX_FDS) {
+    MG_ERROR(("Hot restart hands over at most %d listeners", HOT_RESTART_MAX_FDS));
+    return false;
+  }
+  s_handoff.fd_count = worker_count;
+  s_handoff.tls_fd_count = tls ? worker_count : 0;
+  for (int i = 0; i < worker_count; i++) {
+    s_handoff.fds[i] = (int) (size_t) workers[i].listener->fd;
+    if (tls) {
+      s_handoff.fds[worker_count + i] = (int) (size_t) workers[i].tls_listener->fd;
+    }
+  }
+  mg_snprintf(s_handoff.snapshot, sizeof(s_handoff.snapshot), "%s%s", path, GH_SNAPSHOT_EXTENSION);
+  return GH_HotRestartListen(&s_hot_restart, path);
+}
+
+// Cache size from "--cache-size-mb", TTL from "--cache-ttl-ms", and the
+// adaptive mode ("--cache-adaptive 1") moving the budget between
+// "--cache-min-mb" and that size as the cgroup limit and PSI allow
+static void init_cache_settings(int argc, char *argv[]) {
+  const char *size = parse_option(argc, argv, "--cache-size-mb", NULL);
+  const char *min = parse_option(argc, argv, "--cache-min-mb", NULL);
+  const char *ttl = parse_option(argc, argv, "--cache-ttl-ms", NULL);
+  const char *adaptive = parse_option(argc, argv, "--cache-adaptive", NULL);
+  GH_MutexInit(&s_budget_lock);
+  s_cache_ceiling = (size_t) (size != NULL ? strtoull(size, NULL, 10) : CACHE_MAX_SIZE_MB) * 1024 * 1024;
+  s_cache_floor = (size_t) (min != NULL ? strtoull(min, NULL, 10) : CACHE_MIN_SIZE_MB) * 1024 * 1024;
+  GH_CacheSetBudget(&g_cache, s_cache_ceiling);
+  GH_CacheSetTtl(&g_cache, ttl != NULL ? strtoull(ttl, NULL, 10) : CACHE_TTL_MS);
+
+  s_memory_available = GH_MemoryPressureInit(&s_memory);
+  s_cache_adaptive = (adaptive != NULL ? atoi(adaptive) : CACHE_ADAPTIVE) != 0;
+  if (s_cache_adaptive && !s_memory_available) {
+    MG_ERROR(("No cgroup memory limit or PSI to follow, the cache budget stays fixed"));
+    s_cache_adaptive = false;
+  } else if (s_cache_adaptive) {
+    MG_INFO(("Adaptive cache budget: %lu-%luMB, limit %s, pressure %s", (unsigned long) (s_cache_floor >> 20),
+             (unsigned long) (s_cache_ceiling >> 20), s_memory.limit > 0 ? s_memory.max_path : "none",
+             s_memory.pressure_path[0] != '\0' ? s_memory.pressure_path : "none"));
+  }
+}
+
+// Resolve the worker count from "-w <count>" (or "--workers") or APP_WORKER_COUNT
+static int parse_worker_count(int argc, char *argv[]) {
+  const char *option = parse_option(argc, argv, "-w", parse_option(argc, argv, "--workers", NULL));
+  int count = option != NULL ? atoi(option) : APP_WORKER_COUNT;
+  if (count <= 0) {
+    count = GH_CpuCount();
+  }
+  if (count > 1 && !GH_ListenerReusePortSupported()) {
+    MG_ERROR(("SO_REUSEPORT unavailable, falling back to a single worker"));
+    count = 1;
+  }
+  return count;
+}
+
+int main(int argc, char *argv[]) {
   // Initialize logging
   mg_log_set(MG_LL_INFO);
+  GH_MetricsInit();
   
+  // Options from "--config <file>"; any given on the command line override them
+  const char *config = parse_option(argc, argv, "--config", APP_CONFIG_FILE);
+  if (config[0] != '\0') {
+    if (!GH_ConfigFileLoad(&s_config, config)) {
+      MG_ERROR(("Cannot read config file %s", config));
+      return 1;
+    }
+    MG_INFO(("Config file %s: %lu options", config, (unsigned long) s_config.count));
+    hide_file(config);  // May hold the admin token
+  }
+  const char *poll_timeout = parse_option(argc, argv, "--poll-timeout-ms", NULL);
+  s_poll_timeout_ms = poll_timeout != NULL ? atoi(poll_timeout) : APP_POLL_TIMEOUT_MS;
+  s_admin_token = parse_option(argc, argv, "--admin-token", APP_ADMIN_TOKEN);
+
   // Initialize cache
   GH_CacheInit(&g_cache);
-  MG_INFO(("Cache initialized: TTL=%dms, MaxSize=%dMB", CACHE_TTL_MS, CACHE_MAX_SIZE_MB));
+  init_cache_settings(argc, argv);
+  const char *policy = parse_option(argc, argv, "--cache-policy", CACHE_POLICY);
+  if (!GH_CacheSetPolicy(&g_cache, policy)) {
+    MG_ERROR(("Unknown cache policy %s, using %s", policy, g_cache.policy->name));
+  }
+  MG_INFO(("Cache initialized: TTL=%llums, MaxSize=%luMB, policy=%s", (unsigned long long) GH_CacheTtl(&g_cache),
+           (unsigned long) (GH_CacheBudget(&g_cache) >> 20), g_cache.policy->name));
+  if (!GH_NegativeCacheInit(&g_negative, NEGATIVE_CACHE_ENTRIES, NEGATIVE_CACHE_TTL_MS)) {
+    MG_ERROR(("Failed to allocate the negative cache, 404s always hit the disk"));
+  }
+  if (!GH_FileEtagInit(&g_file_etags, FILE_ETAG_ENTRIES)) {
+    MG_ERROR(("Failed to allocate the ETag memo, files served from disk are hashed on every load"));
+  }
+  const char *server_data = parse_option(argc, argv, "--server-data", APP_SERVER_DATA_CONFIG);
+  bool has_server_data = GH_ServerDataInit(&s_server_data, server_data);
+  hide_file(server_data);
+  if (has_server_data) {
+    MG_INFO(("Serving %s from %s", SERVER_DATA_PATH, server_data));
+  } else {
+    MG_INFO(("No server_data config at %s, serving %s from disk", server_data, SERVER_DATA_PATH));
+  }
+  if (!init_admission(argc, argv)) {
+    MG_ERROR(("Failed to allocate the admission table, clients are not limited"));
+  }
+  init_connection_limits(argc, argv);
+  const char *access_log = parse_option(argc, argv, "--access-log", APP_ACCESS_LOG);
+  hide_file(access_log);  // Client addresses; rotated files too
+  for (int i = 1; access_log[0] != '\0' && i <= ACCESS_LOG_ROTATE_KEEP; i++) {
+    char rotated[PATH_MAX];
+    mg_snprintf(rotated, sizeof(rotated), "%s.%d", access_log, i);
+    hide_file(rotated);
+  }
+  if (GH_AccessLogInit(&s_access_log, access_log, (uint64_t) APP_ACCESS_LOG_ROTATE_MB * 1024 * 1024)) {
+    MG_INFO(("Access log: %s (rotated at %dMB)", access_log, APP_ACCESS_LOG_ROTATE_MB));
+  } else if (access_log[0] != '\0') {
+    MG_ERROR(("Cannot open access log %s, requests are not logged", access_log));
+  }
+  if (s_admin_token[0] != '\0') {
+    MG_INFO(("Admin API on /api/admin/cache and /api/admin/cache/clear"));
+  }
+  if (!build_routes(&s_router, has_server_data, s_admin_token[0] != '\0')) {
+    MG_ERROR(("Failed to build the route table"));
+    return 1;
+  }
 
-  // Initialize event manager
-  mg_mgr_init(&mgr);
-  
-  // Create HTTP listener with optimized settings
-  struct mg_connection *listener = mg_http_listen(&mgr, APP_LISTEN_URL, ev_handler, NULL);
-  if (listener == NULL) {
-    MG_ERROR(("Failed to create listener on %s", APP_LISTEN_URL));
+  // Start the disk loader; misses are read and compressed off the event loops
+  if (!GH_LoaderInit(&g_loader, APP_LOADER_THREADS)) {
+    MG_ERROR(("Failed to start loader threads, loading inline"));
+  }
+
+  // Take the listeners and the cache over from the server answering on
+  // "--hot-restart <socket>", if one does; else this is a cold start
+  const char *hot_restart = parse_option(argc, argv, "--hot-restart", APP_HOT_RESTART_SOCKET);
+  struct HotRestartHandoff handoff;
+  int hot_restart_peer = -1;
+  if (hot_restart[0] != '\0') {
+    hot_restart_peer = GH_HotRestartConnect(hot_restart, &handoff, APP_HOT_RESTART_TIMEOUT_MS);
+  }
+  if (hot_restart_peer >= 0) {
+    MG_INFO(("Hot restart: took over %d listener(s) from %s", handoff.fd_count + handoff.tls_fd_count, hot_restart));
+  }
+
+  // Map the packed snapshot ("--snapshot <file>", or the cache handed over);
+  // its files are served without loading
+  const char *snapshot = hot_restart_peer >= 0 ? handoff.snapshot
+                                               : parse_option(argc, argv, "--snapshot", APP_SNAPSHOT_PATH);
+  if (snapshot[0] != '\0') {
+    if (GH_SnapshotOpen(&g_snapshot, snapshot)) {
+      MG_INFO(("Snapshot %s mapped: %lu files", snapshot, (unsigned long) g_snapshot.count));
+    } else {
+      MG_ERROR(("Failed to map snapshot %s, serving from disk", snapshot));
+    }
+  }
+
+  // Invalidate on change where inotify is available, else revalidate by mtime every TTL
+  if (GH_WatcherInit(&s_watcher, ".")) {
+    MG_INFO(("Watching %d directories for changes", s_watcher.dir_count));
+  } else {
+    MG_INFO(("File watcher unavailable, revalidating entries every %llums", (unsigned long long) GH_CacheTtl(&g_cache)));
+  }
+  if (hot_restart_peer >= 0) {
+    // Files changed between the dump and the watcher starting
+    MG_INFO(("Hot restart: %lu handed-over files changed meanwhile",
+             (unsigned long) GH_SnapshotRevalidate(&g_snapshot)));
+  }
+
+  // Preload "--warmup <dirs,manifests>" in the background while listeners come up
+  const char *warmup = parse_option(argc, argv, "--warmup", APP_WARMUP_PATHS);
+  if (warmup[0] != '\0') {
+    MG_INFO(("Warmup queued %lu files", (unsigned long) GH_WarmupPreload(warmup)));
+  }
+
+  const char *https_url = NULL;
+  if (!init_tls(argc, argv, &https_url)) {
+    return 1;
+  }
+
+  // A replacement runs as many workers as there are listeners to serve
+  int worker_count = parse_worker_count(argc, argv);
+  if (hot_restart_peer >= 0) {
+    worker_count = handoff.fd_count;
+  }
+  GH_ConfigFileReportUnused(&s_config);
+  if (hot_restart_peer >= 0 && https_url == NULL) {
+    GH_HotRestartDropTls(&handoff);  // HTTPS turned off: its port closes with the old process
+  }
+  struct Worker *workers = calloc((size_t) worker_count, sizeof(struct Worker));
+  if (workers == NULL) {
     return 1;
   }
+
+  // Initialize one event manager and listener per worker
+  for (int i = 0; i < worker_count; i++) {
+    struct Worker *worker = &workers[i];
+    worker->id = i;
+    GH_KeepAliveInit(&worker->keepalive, s_keepalive_timeout_ms, s_keepalive_max_requests, mg_millis());
+    mg_mgr_init(&worker->mgr);
+    mg_wakeup_init(&worker->mgr);  // Loader threads answer through mg_wakeup
+
+    worker->listener = hot_restart_peer >= 0 ? adopt_listener(worker, handoff.fds[i])
+                                             : listen_on(worker, APP_LISTEN_URL, worker_count);
+    if (worker->listener == NULL) {
+      return 1;
+    }
+    if (https_url != NULL) {
+      worker->mgr.tls_ctx = &s_tls;  // mg_tls_init() sets accepted HTTPS connections up on it
+      worker->tls_listener = hot_restart_peer >= 0 && handoff.tls_fd_count > 0
+                               ? adopt_listener(worker, handoff.fds[handoff.fd_count + i])
+                               : listen_on(worker, https_url, worker_count);
+      if (worker->tls_listener == NULL) {
+        return 1;
+      }
+    }
+  }
   
-  MG_INFO(("HTTP server started on %s", APP_LISTEN_URL));
-  MG_INFO(("Optimizations enabled: keep-alive, ETags, caching, compression hints"));
+  MG_INFO(("HTTP server started on %s with %d worker(s)", APP_LISTEN_URL, worker_count));
+  if (https_url != NULL) {
+    MG_INFO(("HTTPS server started on %s", https_url));
+  }
+  MG_INFO(("Optimizations enabled: keep-alive, ETags, caching, precompressed br/gzip variants"));
+
+  // The old process stops accepting once told; whatever queued meanwhile is served here
+  if (hot_restart_peer >= 0 && !GH_HotRestartConfirm(hot_restart_peer)) {
+    MG_ERROR(("Hot restart: the old process went away before the handoff completed"));
+  }
+  if (hot_restart[0] != '\0' && init_hot_restart(hot_restart, workers, worker_count)) {
+    MG_INFO(("Hot restart: a new binary started with --hot-restart %s takes over", hot_restart));
+  }
 
-  // Event loop with optimized poll timeout
-  for (;;) {
-    mg_mgr_poll(&mgr, APP_POLL_TIMEOUT_MS);
+  // Worker 0 runs on the main thread, the rest get their own
+  for (int i = 1; i < worker_count; i++) {
+    if (!GH_ThreadStart(&workers[i].thread, worker_run, &workers[i])) {
+      MG_ERROR(("Failed to start worker %d", i));
+      return 1;
+    }
   }
+  worker_run(&workers[0]);
 
-  // Cleanup (unreachable in this implementation)
+  // Cleanup, once a replacement took over and the connections drained. The
+  // loaders go first: they wake the event managers freed next.
+  for (int i = 1; i < worker_count; i++) {
+    GH_ThreadJoin(workers[i].thread);
+  }
+  GH_LoaderShutdown(&g_loader);
+  for (int i = 0; i < worker_count; i++) {
+    mg_mgr_free(&workers[i].mgr);
+  }
+  free(workers);
+  GH_HotRestartClose(&s_hot_restart, true);
+  GH_WatcherCleanup(&s_watcher);
+  GH_SnapshotClose(&g_snapshot);
   GH_CacheCleanup(&g_cache);
-  mg_mgr_free(&mgr);
+  GH_NegativeCacheCleanup(&g_negative);
+  GH_FileEtagCleanup(&g_file_etags);
+  GH_RouterFree(&s_router);
+  GH_ServerDataCleanup(&s_server_data);
+  GH_AdmissionCleanup(&s_admission);
+  GH_AccessLogCleanup(&s_access_log);
+  if (https_url != NULL) {
+    GH_TlsCleanup(&s_tls);
+  }
+  GH_MutexDestroy(&s_budget_lock);
+  GH_ConfigFileFree(&s_config);  // Last: option values point into it
   
   return 0;
-}
\ No newline at end of file
+}
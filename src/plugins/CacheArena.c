@@ -0,0 +1,305 @@
+#include "CacheArena.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+// ==============================================================================
+// Internal helpers
+// ==============================================================================
+
+// Approximate malloc bookkeeping per block (glibc: one size word, 16-byte rounding)
+#define ARENA_MALLOC_OVERHEAD 16
+
+static size_t round_up(size_t size, size_t granularity) {
+  return (size + granularity - 1) / granularity * granularity;
+}
+
+// Whole pages straight from the OS, so releasing them really shrinks the process
+static void *map_pages(size_t size) {
+#if defined(_WIN32)
+  return VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+  void *pages = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  return pages != MAP_FAILED ? pages : NULL;
+#endif
+}
+
+static void unmap_pages(void *pages, size_t size) {
+#if defined(_WIN32)
+  (void) size;
+  VirtualFree(pages, 0, MEM_RELEASE);
+#else
+  munmap(pages, size);
+#endif
+}
+
+// Let the OS reclaim the whole pages inside a free chunk; the mapping stays, so
+// reuse only costs page faults. The first word holds the free-list link.
+static void purge_chunk(char *chunk, size_t chunk_size) {
+  char *from = (char *) round_up((size_t) chunk + sizeof(void *), CACHE_ARENA_PAGE);
+  char *to = (char *) (((size_t) chunk + chunk_size) / CACHE_ARENA_PAGE * CACHE_ARENA_PAGE);
+  if (to <= from) {
+    return;
+  }
+#if defined(_WIN32)
+  VirtualAlloc(from, (size_t) (to - from), MEM_RESET, PAGE_READWRITE);
+#else
+  madvise(from, (size_t) (to - from), MADV_DONTNEED);
+#endif
+}
+
+// Smallest class whose chunks hold size bytes (size <= CACHE_ARENA_MAX_CHUNK)
+static size_t class_for(const struct CacheArena *arena, size_t size) {
+  size_t lo = 0, hi = arena->class_count - 1;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (arena->classes[mid].chunk_size < size) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+static void slab_unlink(struct CacheSizeClass *cls, struct CacheSlab *slab) {
+  if (slab->prev != NULL) {
+    slab->prev->next = slab->next;
+  } else {
+    cls->head = slab->next;
+  }
+  if (slab->next != NULL) {
+    slab->next->prev = slab->prev;
+  } else {
+    cls->tail = slab->prev;
+  }
+  slab->prev = slab->next = NULL;
+}
+
+static void slab_push_front(struct CacheSizeClass *cls, struct CacheSlab *slab) {
+  slab->prev = NULL;
+  slab->next = cls->head;
+  if (cls->head != NULL) {
+    cls->head->prev = slab;
+  } else {
+    cls->tail = slab;
+  }
+  cls->head = slab;
+}
+
+static void slab_push_back(struct CacheSizeClass *cls, struct CacheSlab *slab) {
+  slab->next = NULL;
+  slab->prev = cls->tail;
+  if (cls->tail != NULL) {
+    cls->tail->next = slab;
+  } else {
+    cls->head = slab;
+  }
+  cls->tail = slab;
+}
+
+static bool slab_full(const struct CacheSlab *slab) {
+  return slab->free_list == NULL && slab->fresh + slab->chunk_size > slab->base + CACHE_SLAB_SIZE;
+}
+
+static struct CacheSlab *slab_create(struct CacheArena *arena, size_t class_index) {
+  struct CacheSlab *slab = calloc(1, sizeof(struct CacheSlab));
+  if (slab == NULL) {
+    return NULL;
+  }
+  slab->base = map_pages(CACHE_SLAB_SIZE);
+  if (slab->base == NULL) {
+    free(slab);
+    return NULL;
+  }
+  slab->fresh = slab->base;
+  slab->chunk_size = arena->classes[class_index].chunk_size;
+  slab->class_index = (uint32_t) class_index;
+  GH_AtomicAddSize(&arena->reserved, CACHE_SLAB_SIZE);
+  return slab;
+}
+
+static void slab_destroy(struct CacheArena *arena, struct CacheSlab *slab) {
+  unmap_pages(slab->base, CACHE_SLAB_SIZE);
+  free(slab);
+  GH_AtomicSubSize(&arena->reserved, CACHE_SLAB_SIZE);
+}
+
+// Carve a chunk from a class, taking the spare or mapping a slab when all are full.
+// Caller holds the class lock.
+static void *class_alloc(struct CacheArena *arena, struct CacheSizeClass *cls, size_t class_index,
+                         struct CacheSlab **out_slab) {
+  struct CacheSlab *slab = cls->head;
+  if (slab == NULL || slab_full(slab)) {
+    slab = cls->spare != NULL ? cls->spare : slab_create(arena, class_index);
+    if (slab == NULL) {
+      return NULL;
+    }
+    cls->spare = NULL;
+    slab_push_front(cls, slab);
+  }
+
+  void *chunk;
+  if (slab->free_list != NULL) {
+    chunk = slab->free_list;
+    slab->free_list = *(void **) chunk;
+  } else {
+    chunk = slab->fresh;
+    slab->fresh += slab->chunk_size;
+  }
+  slab->used++;
+
+  // Keep slabs with room in front so the next allocation finds one at the head
+  if (slab_full(slab) && cls->tail != slab) {
+    slab_unlink(cls, slab);
+    slab_push_back(cls, slab);
+  }
+  *out_slab = slab;
+  return chunk;
+}
+
+// ==============================================================================
+// Public API
+// ==============================================================================
+
+void GH_CacheArenaInit(struct CacheArena *arena, bool slabs) {
+  memset(arena, 0, sizeof(*arena));
+  arena->slabs = slabs;
+
+  // CACHE_ARENA_CLASS_STEPS classes per power of two: 256, 320, 384, 448, 512, 640, ... CACHE_ARENA_MAX_CHUNK
+  size_t count = 0;
+  for (size_t base = CACHE_ARENA_MIN_CHUNK; base <= CACHE_ARENA_MAX_CHUNK; base *= 2) {
+    for (size_t step = 0; step < CACHE_ARENA_CLASS_STEPS && count < CACHE_ARENA_MAX_CLASSES; step++) {
+      size_t chunk_size = base + step * (base / CACHE_ARENA_CLASS_STEPS);
+      if (chunk_size > CACHE_ARENA_MAX_CHUNK) {
+        break;
+      }
+      struct CacheSizeClass *cls = &arena->classes[count++];
+      GH_MutexInit(&cls->lock);
+      cls->chunk_size = chunk_size;
+    }
+  }
+  arena->class_count = count;
+}
+
+void GH_CacheArenaDestroy(struct CacheArena *arena) {
+  for (size_t i = 0; i < arena->class_count; i++) {
+    struct CacheSizeClass *cls = &arena->classes[i];
+    while (cls->head != NULL) {
+      struct CacheSlab *slab = cls->head;
+      slab_unlink(cls, slab);
+      slab_destroy(arena, slab);
+    }
+    if (cls->spare != NULL) {
+      slab_destroy(arena, cls->spare);
+      cls->spare = NULL;
+    }
+    GH_MutexDestroy(&cls->lock);
+  }
+  arena->class_count = 0;
+}
+
+void *GH_CacheArenaAlloc(struct CacheArena *arena, size_t size, struct CacheSlab **slab, size_t *charged) {
+  *slab = NULL;
+  if (!arena->slabs) {
+    *charged = round_up(size, 16) + ARENA_MALLOC_OVERHEAD;
+    void *block = malloc(size);
+    if (block != NULL) {
+      GH_AtomicAddSize(&arena->reserved, *charged);
+      GH_AtomicAddSize(&arena->in_use, *charged);
+    }
+    return block;
+  }
+
+  if (size > CACHE_ARENA_MAX_CHUNK) {
+    *charged = round_up(size, CACHE_ARENA_PAGE);
+    void *block = map_pages(*charged);
+    if (block != NULL) {
+      GH_AtomicAddSize(&arena->reserved, *charged);
+      GH_AtomicAddSize(&arena->in_use, *charged);
+    }
+    return block;
+  }
+
+  size_t class_index = class_for(arena, size);
+  struct CacheSizeClass *cls = &arena->classes[class_index];
+  GH_MutexLock(&cls->lock);
+  void *block = class_alloc(arena, cls, class_index, slab);
+  GH_MutexUnlock(&cls->lock);
+  if (block != NULL) {
+    *charged = cls->chunk_size;
+    GH_AtomicAddSize(&arena->in_use, *charged);
+  }
+  return block;
+}
+
+void GH_CacheArenaFree(struct CacheArena *arena, void *block, struct CacheSlab *slab, size_t charged) {
+  if (block == NULL) {
+    return;
+  }
+  GH_AtomicSubSize(&arena->in_use, charged);
+  if (slab == NULL) {
+    GH_AtomicSubSize(&arena->reserved, charged);
+    if (arena->slabs) {
+      unmap_pages(block, charged);
+    } else {
+      free(block);
+    }
+    return;
+  }
+
+  struct CacheSizeClass *cls = &arena->classes[slab->class_index];
+  struct CacheSlab *release = NULL;
+  GH_MutexLock(&cls->lock);
+  bool was_full = slab_full(slab);
+  *(void **) block = slab->free_list;
+  slab->free_list = block;
+  if (--slab->used == 0) {
+    // Empty: keep one per class for the next burst, unmap the rest
+    slab_unlink(cls, slab);
+    slab->free_list = NULL;
+    slab->fresh = slab->base;
+    if (cls->spare == NULL) {
+      cls->spare = slab;
+    } else {
+      release = slab;
+    }
+  } else if (was_full) {
+    slab_unlink(cls, slab);
+    slab_push_front(cls, slab);
+  }
+  GH_MutexUnlock(&cls->lock);
+
+  if (release != NULL) {
+    slab_destroy(arena, release);
+  }
+}
+
+size_t GH_CacheArenaTrim(struct CacheArena *arena) {
+  size_t released = 0;
+  for (size_t i = 0; i < arena->class_count; i++) {
+    struct CacheSizeClass *cls = &arena->classes[i];
+    GH_MutexLock(&cls->lock);
+    struct CacheSlab *spare = cls->spare;
+    cls->spare = NULL;
+    // Chunks freed inside partly used slabs keep their pages until purged
+    if (cls->chunk_size >= 2 * CACHE_ARENA_PAGE) {
+      for (struct CacheSlab *slab = cls->head; slab != NULL && slab->free_list != NULL; slab = slab->next) {
+        for (void *chunk = slab->free_list; chunk != NULL; chunk = *(void **) chunk) {
+          purge_chunk(chunk, cls->chunk_size);
+        }
+      }
+    }
+    GH_MutexUnlock(&cls->lock);
+    if (spare != NULL) {
+      slab_destroy(arena, spare);
+      released += CACHE_SLAB_SIZE;
+    }
+  }
+  return released;
+}
@@ -0,0 +1,110 @@
+#pragma once
+#include <server/config.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <utils/Sync.h>
+
+#ifndef CACHE_ARENA_ENABLED
+#define CACHE_ARENA_ENABLED 1         //!< Carve entries from size-classed slabs (0 = one malloc per entry)
+#endif
+#ifndef CACHE_SLAB_SIZE
+#define CACHE_SLAB_SIZE (1024 * 1024) //!< Bytes mapped per slab (power of two, multiple of the page size)
+#endif
+
+#ifndef CACHE_ARENA_MAX_CHUNK
+#define CACHE_ARENA_MAX_CHUNK (CACHE_SLAB_SIZE / 4)  //!< Largest size class; larger blocks get pages of their own
+#endif
+
+#define CACHE_ARENA_MIN_CHUNK 256     //!< Smallest size class
+#define CACHE_ARENA_CLASS_STEPS 4     //!< Size classes per power of two (rounding wastes under 1/5 of a block)
+#define CACHE_ARENA_MAX_CLASSES 128   //!< Upper bound on size classes
+#define CACHE_ARENA_PAGE 4096         //!< Granularity blocks mapped on their own are charged at
+
+struct CacheArena;
+
+//! Struct for one slab: CACHE_SLAB_SIZE bytes of mapped memory cut into equal chunks
+struct CacheSlab {
+    struct CacheSlab *prev; //!< Previous slab of the same class
+    struct CacheSlab *next; //!< Next slab of the same class
+    char *base; //!< Mapped chunk memory
+    char *fresh; //!< Next chunk never handed out yet
+    void *free_list; //!< Released chunks, linked through their first word
+    size_t chunk_size; //!< Size of every chunk
+    uint32_t used; //!< Chunks currently handed out
+    uint32_t class_index; //!< Index into the arena's size classes
+};
+
+//! Struct for one size class; slabs with a free chunk come first, full ones after
+struct CacheSizeClass {
+    GH_Mutex lock; //!< Protects the slab list, the spare and every slab on them
+    size_t chunk_size; //!< Chunk size of this class
+    struct CacheSlab *head; //!< First slab (has a free chunk unless all are full)
+    struct CacheSlab *tail; //!< Last slab
+    struct CacheSlab *spare; //!< One empty slab kept mapped so churn does not remap
+};
+
+//! Struct for the allocator every cache entry block is drawn from
+struct CacheArena {
+    struct CacheSizeClass classes[CACHE_ARENA_MAX_CLASSES]; //!< Size classes by ascending chunk size
+    size_t class_count; //!< Number of classes in use
+    bool slabs; //!< false: every block is a plain malloc
+    size_t reserved; //!< Bytes mapped for slabs and large blocks (atomic)
+    size_t in_use; //!< Bytes charged for blocks currently handed out (atomic)
+};
+
+/**
+ * @brief Initialize an arena; no memory is mapped until the first allocation
+ * 
+ * @param arena Arena to initialize
+ * @param slabs true to use size-classed slabs, false for plain malloc
+ */
+void GH_CacheArenaInit(struct CacheArena *arena, bool slabs);
+
+/**
+ * @brief Release every slab and lock of an arena
+ * 
+ * Blocks still handed out become invalid; call only once nothing uses them.
+ * 
+ * @param arena Arena to destroy
+ */
+void GH_CacheArenaDestroy(struct CacheArena *arena);
+
+/**
+ * @brief Allocate one block
+ * 
+ * Blocks up to CACHE_ARENA_MAX_CHUNK come from the smallest class that fits
+ * (under 20% of the block lost to rounding, e.g. 257 bytes take 320);
+ * larger ones are mapped on their own.
+ * 
+ * @param arena Arena
+ * @param size Bytes needed
+ * @param slab Receives the slab the block belongs to, NULL if it has its own mapping
+ * @param charged Receives the bytes the block really occupies, to charge to a budget
+ * @return void* Block aligned for any object, NULL on failure
+ */
+void *GH_CacheArenaAlloc(struct CacheArena *arena, size_t size, struct CacheSlab **slab, size_t *charged);
+
+/**
+ * @brief Return a block to its slab, or unmap it
+ * 
+ * A slab that empties is kept as its class's spare or unmapped at once.
+ * 
+ * @param arena Arena the block came from
+ * @param block Block returned by GH_CacheArenaAlloc
+ * @param slab Slab reported by GH_CacheArenaAlloc
+ * @param charged Charge reported by GH_CacheArenaAlloc
+ */
+void GH_CacheArenaFree(struct CacheArena *arena, void *block, struct CacheSlab *slab, size_t charged);
+
+/**
+ * @brief Give idle memory back to the OS in bulk
+ * 
+ * Spare slabs are unmapped; the pages of free chunks inside partly used slabs
+ * are released too, while staying mapped for reuse.
+ * 
+ * @param arena Arena
+ * @return size_t Bytes unmapped
+ */
+size_t GH_CacheArenaTrim(struct CacheArena *arena);
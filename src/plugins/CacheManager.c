@@ -1,16 +1,475 @@
 #include "CacheManager.h"
+#include "server/Metrics.h"
+#include "server/Mime.h"
+#include "utils/Utils.h"
 #include <string.h>
 #include <stdlib.h>
 
+// ==============================================================================
+// Internal helpers
+// ==============================================================================
+
+// Table is grown once it is more than 3/4 full, keeping linear probe runs short
+#define CACHE_MAX_LOAD_NUM 3
+#define CACHE_MAX_LOAD_DEN 4
+
+// Shards use the high hash bits, slots the low ones, so both stay well spread
+static struct CacheShard *shard_for(struct CacheBucket *cache, uint64_t hash) {
+  return &cache->shards[(size_t)(hash >> 40) & (CACHE_SHARD_COUNT - 1)];
+}
+
+static void cache_free_entry(struct CacheEntry *entry) {
+  GH_CacheArenaFree(entry->arena, entry, entry->slab, entry->size);
+}
+
+// Content-Encoding token per encoding
+static const char *const s_content_encoding[CACHE_ENC_COUNT] = {"br", "gzip"};
+
+// XXH64 (seed 0) of file contents for strong ETags. The digest is part of every
+// ETag a client holds, so it must never change: byte order is fixed to little
+// endian and the output matches the reference implementation
+#define XXH_PRIME1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME3 0x165667B19E3779F9ULL
+#define XXH_PRIME4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME5 0x27D4EB2F165667C5ULL
+
+static uint64_t xxh_rotl(uint64_t x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t xxh_read64(const unsigned char *p) {
+  return (uint64_t) p[0] | (uint64_t) p[1] << 8 | (uint64_t) p[2] << 16 | (uint64_t) p[3] << 24 |
+         (uint64_t) p[4] << 32 | (uint64_t) p[5] << 40 | (uint64_t) p[6] << 48 | (uint64_t) p[7] << 56;
+}
+
+static uint64_t xxh_read32(const unsigned char *p) {
+  return (uint64_t) p[0] | (uint64_t) p[1] << 8 | (uint64_t) p[2] << 16 | (uint64_t) p[3] << 24;
+}
+
+static uint64_t xxh_round(uint64_t acc, uint64_t input) {
+  acc += input * XXH_PRIME2;
+  return xxh_rotl(acc, 31) * XXH_PRIME1;
+}
+
+static uint64_t xxh_merge(uint64_t acc, uint64_t val) {
+  acc ^= xxh_round(0, val);
+  return acc * XXH_PRIME1 + XXH_PRIME4;
+}
+
+// Lane accumulators before the first stripe
+static void xxh_lanes_init(uint64_t lanes[4]) {
+  lanes[0] = XXH_PRIME1 + XXH_PRIME2;
+  lanes[1] = XXH_PRIME2;
+  lanes[2] = 0;
+  lanes[3] = 0 - XXH_PRIME1;
+}
+
+// Feed every whole 32-byte stripe of [p, end) to the four independent lanes;
+// returns where the unconsumed tail starts
+static const unsigned char *xxh_stripes(uint64_t lanes[4], const unsigned char *p, const unsigned char *end) {
+  uint64_t v1 = lanes[0], v2 = lanes[1], v3 = lanes[2], v4 = lanes[3];
+  for (; end - p >= 32; p += 32) {
+    v1 = xxh_round(v1, xxh_read64(p));
+    v2 = xxh_round(v2, xxh_read64(p + 8));
+    v3 = xxh_round(v3, xxh_read64(p + 16));
+    v4 = xxh_round(v4, xxh_read64(p + 24));
+  }
+  lanes[0] = v1, lanes[1] = v2, lanes[2] = v3, lanes[3] = v4;
+  return p;
+}
+
+// Digest of total bytes whose last (total % 32) are [p, end) and the rest went through the lanes
+static uint64_t xxh_finish(const uint64_t lanes[4], uint64_t total, const unsigned char *p,
+                           const unsigned char *end) {
+  uint64_t h;
+  if (total >= 32) {
+    h = xxh_rotl(lanes[0], 1) + xxh_rotl(lanes[1], 7) + xxh_rotl(lanes[2], 12) + xxh_rotl(lanes[3], 18);
+    h = xxh_merge(xxh_merge(xxh_merge(xxh_merge(h, lanes[0]), lanes[1]), lanes[2]), lanes[3]);
+  } else {
+    h = XXH_PRIME5;
+  }
+  h += total;
+
+  for (; end - p >= 8; p += 8) {
+    h ^= xxh_round(0, xxh_read64(p));
+    h = xxh_rotl(h, 27) * XXH_PRIME1 + XXH_PRIME4;
+  }
+  if (end - p >= 4) {
+    h ^= xxh_read32(p) * XXH_PRIME1;
+    h = xxh_rotl(h, 23) * XXH_PRIME2 + XXH_PRIME3;
+    p += 4;
+  }
+  for (; p < end; p++) {
+    h ^= *p * XXH_PRIME5;
+    h = xxh_rotl(h, 11) * XXH_PRIME1;
+  }
+
+  h ^= h >> 33;
+  h *= XXH_PRIME2;
+  h ^= h >> 29;
+  h *= XXH_PRIME3;
+  h ^= h >> 32;
+  return h;
+}
+
+static uint64_t content_hash(const void *data, size_t len) {
+  const unsigned char *p = (const unsigned char *) data, *end = p + len;
+  uint64_t lanes[4];
+  xxh_lanes_init(lanes);
+  p = xxh_stripes(lanes, p, end);
+  return xxh_finish(lanes, (uint64_t) len, p, end);
+}
+
+// Header blocks of one representation, serialized before the entry block is sized
+struct HeaderDraft {
+  char ok[512];
+  size_t ok_len;
+  char not_modified[512];
+  size_t not_modified_len;
+};
+
+// Serialize the 200 and 304 header blocks of one representation
+static bool headers_build(struct HeaderDraft *draft, const char *content_type, size_t body_len,
+                          int enc, const char *etag, time_t mtime, bool vary) {
+  char encoding[40] = "";
+  if (enc >= 0) {
+    mg_snprintf(encoding, sizeof(encoding), "Content-Encoding: %s\r\n", s_content_encoding[enc]);
+  }
+  const char *vary_line = vary ? "Vary: Accept-Encoding\r\n" : "";
+  char etag_line[96] = "";
+  if (etag != NULL) {
+    mg_snprintf(etag_line, sizeof(etag_line), "ETag: %s\r\n", etag);
+  }
+  // The 304 leaves it out: with an ETag present it does not help caches (RFC 9110, 15.4.5)
+  char modified_line[48] = "";
+  if (mtime > 0) {
+    char date[32];
+    if (FormatHttpDate(mtime, date, sizeof(date)) > 0) {
+      mg_snprintf(modified_line, sizeof(modified_line), "Last-Modified: %s\r\n", date);
+    }
+  }
+
+  draft->ok_len = mg_snprintf(draft->ok, sizeof(draft->ok), "HTTP/1.1 200 OK\r\n"
+                              "Content-Type: %s\r\n"
+                              "Content-Length: %lu\r\n"
+                              "%s%s%s%s"
+                              "Cache-Control: " CACHE_CONTROL_VALUE "\r\n"
+                              "Connection: keep-alive\r\n"
+                              "Accept-Ranges: bytes\r\n"
+                              "\r\n",
+                              content_type, (unsigned long) body_len, encoding, vary_line, etag_line,
+                              modified_line);
+  draft->not_modified_len = mg_snprintf(draft->not_modified, sizeof(draft->not_modified),
+                                        "HTTP/1.1 304 Not Modified\r\n"
+                                        "%s%s"
+                                        "Cache-Control: " CACHE_CONTROL_VALUE "\r\n"
+                                        "Connection: keep-alive\r\n"
+                                        "\r\n",
+                                        etag_line, vary_line);
+  return draft->ok_len < sizeof(draft->ok) && draft->not_modified_len < sizeof(draft->not_modified);
+}
+
+// Suffix appended inside the quotes of the identity ETag, per encoding
+static const char *const s_variant_etag_suffix[CACHE_ENC_COUNT] = {"-br", "-gz"};
+
+// Derive a variant ETag: "abc" -> "abc-gz" (weak prefix and quotes preserved)
+static bool variant_etag(const char *etag, enum CacheEncoding enc, char *out, size_t out_len) {
+  const char *suffix = s_variant_etag_suffix[enc];
+  size_t etag_len = strlen(etag), suffix_len = strlen(suffix);
+  if (etag_len + suffix_len + 1 > out_len) {
+    return false;
+  }
+
+  size_t split = etag_len > 0 && etag[etag_len - 1] == '"' ? etag_len - 1 : etag_len;
+  memcpy(out, etag, split);
+  memcpy(out + split, suffix, suffix_len);
+  memcpy(out + split + suffix_len, etag + split, etag_len - split + 1);
+  return true;
+}
+
+// Copy len bytes to the block cursor, NUL-terminating strings, and advance it
+static char *block_put(char **cursor, const void *src, size_t len, bool terminate) {
+  char *out = *cursor;
+  memcpy(out, src, len);
+  if (terminate) {
+    out[len] = '\0';
+  }
+  *cursor += len + (terminate ? 1 : 0);
+  return out;
+}
+
+static void block_put_headers(char **cursor, const struct HeaderDraft *draft, struct CacheHeaders *headers) {
+  headers->ok = block_put(cursor, draft->ok, draft->ok_len, true);
+  headers->ok_len = draft->ok_len;
+  headers->not_modified = block_put(cursor, draft->not_modified, draft->not_modified_len, true);
+  headers->not_modified_len = draft->not_modified_len;
+}
+
+static size_t draft_bytes(const struct HeaderDraft *draft) {
+  return draft->ok_len + 1 + draft->not_modified_len + 1;
+}
+
+static void cache_unref(struct CacheEntry *entry) {
+  if (GH_AtomicDecInt(&entry->refs) == 0) {
+    cache_free_entry(entry);
+  }
+}
+
+// Find the slot index holding path, or SIZE_MAX if absent
+static size_t table_find(const struct CacheShard *shard, const char *path,
+                         size_t path_len, uint64_t hash) {
+  if (shard->slots == NULL) {
+    return SIZE_MAX;
+  }
+
+  size_t mask = shard->capacity - 1;
+  for (size_t i = (size_t)hash & mask;; i = (i + 1) & mask) {
+    const struct CacheSlot *slot = &shard->slots[i];
+    if (slot->entry == NULL) {
+      return SIZE_MAX;
+    }
+    if (slot->hash == hash && slot->entry->path_len == path_len &&
+        memcmp(slot->entry->path, path, path_len) == 0) {
+      return i;
+    }
+  }
+}
+
+// Place entry into the first free slot of its probe sequence (no duplicate check)
+static void table_place(struct CacheSlot *slots, size_t capacity, struct CacheEntry *entry) {
+  size_t mask = capacity - 1;
+  size_t i = (size_t)entry->hash & mask;
+  while (slots[i].entry != NULL) {
+    i = (i + 1) & mask;
+  }
+  slots[i].hash = entry->hash;
+  slots[i].entry = entry;
+}
+
+// Make room for one more entry, growing the table if needed
+static bool table_reserve(struct CacheShard *shard) {
+  if (shard->slots != NULL &&
+      (shard->entry_count + 1) * CACHE_MAX_LOAD_DEN <= shard->capacity * CACHE_MAX_LOAD_NUM) {
+    return true;
+  }
+
+  size_t new_capacity = shard->capacity ? shard->capacity * 2 : CACHE_INITIAL_SLOTS;
+  struct CacheSlot *new_slots = calloc(new_capacity, sizeof(struct CacheSlot));
+  if (new_slots == NULL) {
+    return false;
+  }
+
+  // Rehash live entries; stored hashes make this a pure memory walk
+  for (size_t i = 0; i < shard->capacity; i++) {
+    if (shard->slots[i].entry != NULL) {
+      table_place(new_slots, new_capacity, shard->slots[i].entry);
+    }
+  }
+
+  free(shard->slots);
+  shard->slots = new_slots;
+  shard->capacity = new_capacity;
+  return true;
+}
+
+// Remove slot at index using backward-shift deletion, so no tombstones are needed
+static void table_erase(struct CacheShard *shard, size_t index) {
+  size_t mask = shard->capacity - 1;
+  size_t hole = index;
+  size_t i = index;
+
+  for (;;) {
+    i = (i + 1) & mask;
+    struct CacheSlot *slot = &shard->slots[i];
+    if (slot->entry == NULL) {
+      break;
+    }
+
+    // Move the entry back into the hole unless its home slot lies in (hole, i]
+    size_t home = (size_t)slot->hash & mask;
+    if (((i - home) & mask) >= ((i - hole) & mask)) {
+      shard->slots[hole] = *slot;
+      hole = i;
+    }
+  }
+
+  shard->slots[hole].entry = NULL;
+  shard->slots[hole].hash = 0;
+}
+
+// Detach entry stored in slot at index and drop the cache's reference.
+// Caller holds the shard lock.
+static void cache_drop_at(struct CacheBucket *cache, struct CacheShard *shard, size_t index) {
+  struct CacheEntry *entry = shard->slots[index].entry;
+  table_erase(shard, index);
+  GH_CacheListUnlink(shard, entry);
+  shard->size -= entry->size;
+  shard->entry_count--;
+  GH_AtomicSubSize(&cache->size, entry->size);
+  GH_AtomicSubSize(&cache->entry_count, 1);
+  cache_unref(entry);
+}
+
+// Detach entry, locating its slot by its stored hash. Caller holds the shard lock.
+static void cache_drop(struct CacheBucket *cache, struct CacheShard *shard, struct CacheEntry *entry) {
+  size_t index = table_find(shard, entry->path, entry->path_len, entry->hash);
+  if (index != SIZE_MAX) {
+    cache_drop_at(cache, shard, index);
+  }
+}
+
+// Drop every entry of a shard and release its table. Caller holds the shard lock.
+static void shard_clear(struct CacheBucket *cache, struct CacheShard *shard) {
+  for (int segment = 0; segment < CACHE_SEG_COUNT; segment++) {
+    struct CacheEntry *entry = shard->lists[segment].head;
+    while (entry != NULL) {
+      struct CacheEntry *next = entry->lru_next;
+      GH_AtomicSubSize(&cache->size, entry->size);
+      GH_AtomicSubSize(&cache->entry_count, 1);
+      cache_unref(entry);
+      entry = next;
+    }
+  }
+  free(shard->slots);
+
+  shard->slots = NULL;
+  shard->capacity = 0;
+  memset(shard->lists, 0, sizeof(shard->lists));
+  shard->size = 0;
+  shard->entry_count = 0;
+}
+
+// Find entry under the shard lock, optionally pinning it
+static struct CacheEntry *cache_lookup(struct CacheBucket *cache, const char *file_path, size_t len,
+                                       uint64_t hash, bool pin) {
+  struct CacheShard *shard = shard_for(cache, hash);
+  struct CacheEntry *entry = NULL;
+
+  GH_MutexLock(&shard->lock);
+  size_t index = table_find(shard, file_path, len, hash);
+  if (index != SIZE_MAX) {
+    entry = shard->slots[index].entry;
+    if (pin) {
+      GH_AtomicIncInt(&entry->refs);
+    }
+  }
+  // Let the policy record the access (recency, and frequency of hits and misses)
+  cache->policy->on_access(shard, hash, entry);
+  GH_MutexUnlock(&shard->lock);
+
+  return entry;
+}
+
+// Pop the policy's victims until the cache fits max_size or limit bytes were
+// freed, rotating over shards so eviction pressure spreads evenly; with
+// uniformly hashed paths this approximates a global policy
+static size_t evict_until(struct CacheBucket *cache, size_t max_size, size_t limit) {
+  size_t freed = 0;
+  size_t empty_in_a_row = 0;
+  while (freed < limit && GH_AtomicLoadSize(&cache->size) > max_size && empty_in_a_row < CACHE_SHARD_COUNT) {
+    size_t cursor = GH_AtomicAddSize(&cache->evict_cursor, 1);
+    struct CacheShard *shard = &cache->shards[cursor & (CACHE_SHARD_COUNT - 1)];
+
+    GH_MutexLock(&shard->lock);
+    struct CacheEntry *victim = cache->policy->victim(shard);
+    if (victim != NULL) {
+      freed += victim->size;
+      cache_drop(cache, shard, victim);
+      GH_MetricsInc(MC_CACHE_EVICTIONS);
+      empty_in_a_row = 0;
+    } else {
+      empty_in_a_row++;
+    }
+    GH_MutexUnlock(&shard->lock);
+  }
+  return freed;
+}
+
+// ==============================================================================
+// Public API
+// ==============================================================================
+
 void GH_CacheInit(struct CacheBucket *cache) {
   if (cache == NULL) {
     return;
   }
 
-  // Initialize cache bucket
-  cache->entries = NULL;
+  // Initialize shards; their tables are allocated on first insert
+  for (size_t i = 0; i < CACHE_SHARD_COUNT; i++) {
+    struct CacheShard *shard = &cache->shards[i];
+    GH_MutexInit(&shard->lock);
+    shard->slots = NULL;
+    shard->capacity = 0;
+    memset(shard->lists, 0, sizeof(shard->lists));
+    shard->sketch = NULL;
+    shard->size = 0;
+    shard->budget = (size_t)CACHE_MAX_SIZE_MB * 1024 * 1024 / CACHE_SHARD_COUNT;
+    shard->entry_count = 0;
+  }
   cache->size = 0;
   cache->entry_count = 0;
+  cache->evict_cursor = 0;
+  cache->max_size = (size_t)CACHE_MAX_SIZE_MB * 1024 * 1024;
+  cache->max_entry_size = cache->max_size / 100 * CACHE_ADMIT_MAX_PERCENT;
+  cache->ttl_ms = CACHE_TTL_MS;
+  cache->policy = GH_CachePolicyFind("lru");
+  GH_CacheArenaInit(&cache->arena, CACHE_ARENA_ENABLED);
+  if (!GH_CacheSetPolicy(cache, CACHE_POLICY)) {
+    MG_ERROR(("Cache policy %s unavailable, using lru", CACHE_POLICY));
+  }
+}
+
+bool GH_CacheSetPolicy(struct CacheBucket *cache, const char *name) {
+  const struct CachePolicy *policy = GH_CachePolicyFind(name);
+  if (cache == NULL || policy == NULL) {
+    return false;
+  }
+
+  for (size_t i = 0; i < CACHE_SHARD_COUNT; i++) {
+    struct CacheShard *shard = &cache->shards[i];
+    if (policy->uses_sketch && shard->sketch == NULL) {
+      shard->sketch = calloc(1, sizeof(struct CacheSketch));
+      if (shard->sketch == NULL) {
+        return false;
+      }
+    }
+  }
+  cache->policy = policy;
+  return true;
+}
+
+bool GH_CacheAdmits(const struct CacheBucket *cache, size_t size) {
+  return cache != NULL && size <= GH_AtomicLoadSize(&cache->max_entry_size);
+}
+
+void GH_CacheSetBudget(struct CacheBucket *cache, size_t max_size) {
+  if (cache == NULL) {
+    return;
+  }
+
+  // The policy sizes its segments from each shard's share; a smaller share
+  // makes its next victims come from the right segments
+  for (size_t i = 0; i < CACHE_SHARD_COUNT; i++) {
+    struct CacheShard *shard = &cache->shards[i];
+    GH_MutexLock(&shard->lock);
+    shard->budget = max_size / CACHE_SHARD_COUNT;
+    GH_MutexUnlock(&shard->lock);
+  }
+  GH_AtomicStoreReleaseSize(&cache->max_entry_size, max_size / 100 * CACHE_ADMIT_MAX_PERCENT);
+  GH_AtomicStoreReleaseSize(&cache->max_size, max_size);
+}
+
+size_t GH_CacheBudget(const struct CacheBucket *cache) {
+  return GH_AtomicLoadSize(&cache->max_size);
+}
+
+void GH_CacheSetTtl(struct CacheBucket *cache, uint64_t ttl_ms) {
+  GH_AtomicStoreU64(&cache->ttl_ms, ttl_ms);
+}
+
+uint64_t GH_CacheTtl(const struct CacheBucket *cache) {
+  return GH_AtomicLoadU64(&cache->ttl_ms);
 }
 
 void GH_CacheCleanup(struct CacheBucket *cache) {
@@ -18,21 +477,106 @@ void GH_CacheCleanup(struct CacheBucket *cache) {
     return;
   }
 
-  struct CacheEntry *entry = cache->entries;
-  while (entry != NULL) {
-    // Free each cache entry
-    struct CacheEntry *next = entry->next;
-    free(entry->path);
-    free(entry->data);
-    free(entry->etag);
-    free(entry);
-    entry = next;
+  GH_CacheClear(cache);
+  for (size_t i = 0; i < CACHE_SHARD_COUNT; i++) {
+    free(cache->shards[i].sketch);
+    cache->shards[i].sketch = NULL;
+    GH_MutexDestroy(&cache->shards[i].lock);
   }
+  GH_CacheArenaDestroy(&cache->arena);
+}
 
-  // Reset cache bucket
-  cache->entries = NULL;
-  cache->size = 0;
-  cache->entry_count = 0;
+void GH_CacheClear(struct CacheBucket *cache) {
+  if (cache == NULL) {
+    return;
+  }
+
+  for (size_t i = 0; i < CACHE_SHARD_COUNT; i++) {
+    struct CacheShard *shard = &cache->shards[i];
+    GH_MutexLock(&shard->lock);
+    shard_clear(cache, shard);
+    GH_MutexUnlock(&shard->lock);
+  }
+  // Entries just freed left their slabs empty; hand them back to the OS at once
+  GH_CacheArenaTrim(&cache->arena);
+}
+
+size_t GH_CacheForEach(struct CacheBucket *cache, bool (*fn)(struct CacheEntry *entry, void *arg), void *arg) {
+  size_t visited = 0;
+  bool more = true;
+  for (size_t i = 0; more && i < CACHE_SHARD_COUNT; i++) {
+    // Pin the shard's entries under its lock, visit them without it
+    struct CacheShard *shard = &cache->shards[i];
+    GH_MutexLock(&shard->lock);
+    size_t count = 0;
+    struct CacheEntry **entries = malloc((shard->entry_count ? shard->entry_count : 1) * sizeof(*entries));
+    for (int segment = 0; entries != NULL && segment < CACHE_SEG_COUNT; segment++) {
+      for (struct CacheEntry *entry = shard->lists[segment].head; entry != NULL; entry = entry->lru_next) {
+        GH_AtomicIncInt(&entry->refs);
+        entries[count++] = entry;
+      }
+    }
+    GH_MutexUnlock(&shard->lock);
+    if (entries == NULL) {
+      return visited;
+    }
+
+    for (size_t n = 0; n < count; n++) {
+      more = more && fn(entries[n], arg);
+      visited += more;
+      cache_unref(entries[n]);
+    }
+    free(entries);
+  }
+  return visited;
+}
+
+uint64_t GH_CacheHash(const char *path, size_t len) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < len; i++) {
+    hash ^= (unsigned char)path[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+void GH_CacheMakeContentEtag(const void *data, size_t len, char *etag, size_t etag_len) {
+  mg_snprintf(etag, etag_len, "\"%016llx\"", (unsigned long long) content_hash(data, len));
+}
+
+void GH_CacheContentHashInit(struct CacheContentHash *ch) {
+  xxh_lanes_init(ch->lanes);
+  ch->total = 0;
+  ch->stripe_len = 0;
+}
+
+void GH_CacheContentHashUpdate(struct CacheContentHash *ch, const void *data, size_t len) {
+  const unsigned char *p = (const unsigned char *) data, *end = p + len;
+  if (len == 0) {
+    return;
+  }
+  ch->total += len;
+
+  // Complete a stripe left over from the previous piece first
+  if (ch->stripe_len > 0) {
+    size_t take = sizeof(ch->stripe) - ch->stripe_len < len ? sizeof(ch->stripe) - ch->stripe_len : len;
+    memcpy(ch->stripe + ch->stripe_len, p, take);
+    ch->stripe_len += take;
+    p += take;
+    if (ch->stripe_len < sizeof(ch->stripe)) {
+      return;
+    }
+    xxh_stripes(ch->lanes, ch->stripe, ch->stripe + sizeof(ch->stripe));
+    ch->stripe_len = 0;
+  }
+  p = xxh_stripes(ch->lanes, p, end);
+  ch->stripe_len = (size_t) (end - p);
+  memcpy(ch->stripe, p, ch->stripe_len);
+}
+
+void GH_CacheContentHashEtag(const struct CacheContentHash *ch, char *etag, size_t etag_len) {
+  uint64_t hash = xxh_finish(ch->lanes, ch->total, ch->stripe, ch->stripe + ch->stripe_len);
+  mg_snprintf(etag, etag_len, "\"%016llx\"", (unsigned long long) hash);
 }
 
 bool GH_CacheExists(struct CacheBucket *cache, const char *file_path) {
@@ -40,15 +584,14 @@ bool GH_CacheExists(struct CacheBucket *cache, const char *file_path) {
     return false;
   }
 
-  struct CacheEntry *entry = cache->entries;
-  while (entry != NULL) {
-    // Compare paths
-    if (strcmp(entry->path, file_path) == 0) {
-      return true;
-    }
-    entry = entry->next;
-  }
-  return false;
+  size_t len = strlen(file_path);
+  uint64_t hash = GH_CacheHash(file_path, len);
+  struct CacheShard *shard = shard_for(cache, hash);
+
+  GH_MutexLock(&shard->lock);
+  bool found = table_find(shard, file_path, len, hash) != SIZE_MAX;
+  GH_MutexUnlock(&shard->lock);
+  return found;
 }
 
 struct CacheEntry* GH_CacheGetByPath(struct CacheBucket *cache, const char *file_path) {
@@ -56,71 +599,191 @@ struct CacheEntry* GH_CacheGetByPath(struct CacheBucket *cache, const char *file
     return NULL;
   }
 
-  struct CacheEntry *entry = cache->entries;
-  while (entry != NULL) {
-    if (strcmp(entry->path, file_path) == 0) {
-      return entry;
-    }
-    entry = entry->next;
+  size_t len = strlen(file_path);
+  return cache_lookup(cache, file_path, len, GH_CacheHash(file_path, len), false);
+}
+
+struct CacheEntry* GH_CacheAcquire(struct CacheBucket *cache, const char *file_path) {
+  if (cache == NULL || file_path == NULL) {
+    return NULL;
+  }
+
+  size_t len = strlen(file_path);
+  return GH_CacheAcquireHashed(cache, file_path, len, GH_CacheHash(file_path, len));
+}
+
+struct CacheEntry* GH_CacheAcquireHashed(struct CacheBucket *cache, const char *file_path, size_t len,
+                                         uint64_t hash) {
+  if (cache == NULL || file_path == NULL) {
+    return NULL;
+  }
+
+  struct CacheEntry *entry = cache_lookup(cache, file_path, len, hash, true);
+  GH_MetricsInc(entry != NULL ? MC_CACHE_HITS : MC_CACHE_MISSES);
+  return entry;
+}
+
+void GH_CacheRetain(struct CacheEntry *entry) {
+  if (entry != NULL) {
+    GH_AtomicIncInt(&entry->refs);
+  }
+}
+
+void GH_CacheRelease(struct CacheEntry *entry) {
+  if (entry != NULL) {
+    cache_unref(entry);
   }
-  return NULL;
 }
 
-bool GH_CacheAdd(struct CacheBucket *cache, const char *path, const char *data, 
+bool GH_CacheAdd(struct CacheBucket *cache, const char *path, const char *data,
                  size_t data_len, const char *etag, time_t mtime) {
+  return GH_CacheAddEncoded(cache, path, data, data_len, etag, mtime, NULL);
+}
+
+bool GH_CacheHasVariants(const struct CacheEntry *entry) {
+  for (size_t i = 0; i < CACHE_ENC_COUNT; i++) {
+    if (entry->encoded[i].data != NULL) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool GH_CacheAddEncoded(struct CacheBucket *cache, const char *path, const char *data,
+                        size_t data_len, const char *etag, time_t mtime,
+                        const struct CacheVariant *encoded) {
   if (cache == NULL || path == NULL || data == NULL) {
     return false;
   }
 
-  // Check if entry already exists and remove it
-  GH_CacheRemove(cache, path);
-
-  struct CacheEntry *new_entry = malloc(sizeof(struct CacheEntry));
-  if (new_entry == NULL) {
+  // Size-aware admission: one large file must not flush many small hot ones
+  size_t body_bytes = data_len;
+  for (size_t i = 0; encoded != NULL && i < CACHE_ENC_COUNT; i++) {
+    body_bytes += encoded[i].data != NULL ? encoded[i].data_len : 0;
+  }
+  if (!GH_CacheAdmits(cache, body_bytes)) {
+    GH_MetricsInc(MC_CACHE_REJECTED);
     return false;
   }
 
-  // Allocate and copy path
-  new_entry->path = strdup(path);
-  if (new_entry->path == NULL) {
-    free(new_entry);
+  size_t path_len = strlen(path);
+  uint64_t hash = GH_CacheHash(path, path_len);
+  size_t etag_len = etag != NULL ? strlen(etag) : 0;
+
+  // Serialize every representation's headers now so hits only copy bytes
+  bool vary = false;
+  for (size_t i = 0; encoded != NULL && i < CACHE_ENC_COUNT; i++) {
+    vary = vary || encoded[i].data != NULL;
+  }
+  const char *content_type = GH_MimeType(path, path_len);
+  char variant_etags[CACHE_ENC_COUNT][96];
+  struct HeaderDraft drafts[1 + CACHE_ENC_COUNT];
+  if (!headers_build(&drafts[0], content_type, data_len, -1, etag, mtime, vary)) {
     return false;
   }
 
-  // Allocate and copy data
-  new_entry->data = malloc(data_len);
-  if (new_entry->data == NULL) {
-    free(new_entry->path);
-    free(new_entry);
+  // Size one block for everything: entry, path, ETags, header blocks, bodies
+  size_t block_len = sizeof(struct CacheEntry) + path_len + 1 + (etag != NULL ? etag_len + 1 : 0) +
+                     draft_bytes(&drafts[0]) + data_len;
+  for (int i = 0; i < CACHE_ENC_COUNT && vary; i++) {
+    if (encoded[i].data == NULL) {
+      continue;
+    }
+    const char *venc = NULL;
+    if (etag != NULL) {
+      if (!variant_etag(etag, (enum CacheEncoding) i, variant_etags[i], sizeof(variant_etags[i]))) {
+        return false;
+      }
+      venc = variant_etags[i];
+      block_len += strlen(venc) + 1;
+    }
+    if (!headers_build(&drafts[1 + i], content_type, encoded[i].data_len, i, venc, mtime, vary)) {
+      return false;
+    }
+    block_len += draft_bytes(&drafts[1 + i]) + encoded[i].data_len;
+  }
+
+  // Build the entry outside the lock so large copies never block readers
+  struct CacheSlab *slab = NULL;
+  size_t charged = 0;
+  struct CacheEntry *new_entry = GH_CacheArenaAlloc(&cache->arena, block_len, &slab, &charged);
+  if (new_entry == NULL) {
     return false;
   }
-  memcpy(new_entry->data, data, data_len);
-  new_entry->data_len = data_len;
+  memset(new_entry, 0, sizeof(*new_entry));
+  new_entry->arena = &cache->arena;
+  new_entry->slab = slab;
+  new_entry->size = charged;
 
-  // Copy ETag if provided
+  char *cursor = (char *) (new_entry + 1);
+  new_entry->path = block_put(&cursor, path, path_len, true);
+  new_entry->path_len = path_len;
+  new_entry->hash = hash;
+  new_entry->content_type = content_type;
   if (etag != NULL) {
-    new_entry->etag = strdup(etag);
-    if (new_entry->etag == NULL) {
-      free(new_entry->data);
-      free(new_entry->path);
-      free(new_entry);
-      return false;
+    new_entry->etag = block_put(&cursor, etag, etag_len, true);
+  }
+  block_put_headers(&cursor, &drafts[0], &new_entry->headers);
+  for (int i = 0; i < CACHE_ENC_COUNT && vary; i++) {
+    if (encoded[i].data == NULL) {
+      continue;
+    }
+    struct CacheVariant *variant = &new_entry->encoded[i];
+    if (etag != NULL) {
+      variant->etag = block_put(&cursor, variant_etags[i], strlen(variant_etags[i]), true);
+    }
+    block_put_headers(&cursor, &drafts[1 + i], &variant->headers);
+  }
+
+  // Bodies last, so the small hot fields above share cache lines with the entry
+  new_entry->data = block_put(&cursor, data, data_len, false);
+  new_entry->data_len = data_len;
+  for (int i = 0; i < CACHE_ENC_COUNT && vary; i++) {
+    if (encoded[i].data != NULL) {
+      new_entry->encoded[i].data = block_put(&cursor, encoded[i].data, encoded[i].data_len, false);
+      new_entry->encoded[i].data_len = encoded[i].data_len;
     }
-  } else {
-    new_entry->etag = NULL;
   }
 
   new_entry->timestamp = mg_millis();
+  new_entry->validated = new_entry->timestamp;
   new_entry->mtime = mtime;
-  new_entry->next = cache->entries;
-  cache->entries = new_entry;
-  cache->size += data_len;
-  cache->entry_count++;
+  new_entry->refs = 1;
+  size_t entry_size = new_entry->size;
 
-  // Evict if cache is too large
-  size_t max_cache_bytes = (size_t)CACHE_MAX_SIZE_MB * 1024 * 1024;
-  if (cache->size > max_cache_bytes) {
-    GH_CacheEvictOldest(cache, max_cache_bytes);
+  struct CacheShard *shard = shard_for(cache, hash);
+  GH_MutexLock(&shard->lock);
+
+  // Check if entry already exists and replace it
+  size_t existing = table_find(shard, path, path_len, hash);
+  if (existing != SIZE_MAX) {
+    cache_drop_at(cache, shard, existing);
+    GH_MetricsInc(MC_CACHE_REMOVALS);
+  }
+
+  if (!table_reserve(shard)) {
+    GH_MutexUnlock(&shard->lock);
+    cache_free_entry(new_entry);
+    return false;
+  }
+
+  table_place(shard->slots, shard->capacity, new_entry);
+  shard->size += entry_size;
+  cache->policy->on_insert(shard, new_entry);
+  shard->entry_count++;
+  // Account while locked so a concurrent eviction never subtracts first
+  size_t total = GH_AtomicAddSize(&cache->size, entry_size);
+  GH_AtomicAddSize(&cache->entry_count, 1);
+  GH_MutexUnlock(&shard->lock);
+  GH_MetricsInc(MC_CACHE_ADDS);
+  GH_MetricsAdd(MC_CACHE_ADDED_BYTES, entry_size);
+
+  // Evict if cache is too large. Freeing up to twice the entry's size keeps
+  // an add from growing the cache and helps work off a budget cut, without
+  // making this request pay for all of it (GH_CacheShrink does the rest)
+  size_t max_cache_bytes = GH_AtomicLoadSize(&cache->max_size);
+  if (total > max_cache_bytes) {
+    evict_until(cache, max_cache_bytes, 2 * entry_size);
   }
 
   return true;
@@ -131,25 +794,35 @@ bool GH_CacheRemove(struct CacheBucket *cache, const char *file_path) {
     return false;
   }
 
-  struct CacheEntry **prev = &cache->entries;
-  struct CacheEntry *entry = cache->entries;
+  size_t len = strlen(file_path);
+  uint64_t hash = GH_CacheHash(file_path, len);
+  struct CacheShard *shard = shard_for(cache, hash);
 
-  while (entry != NULL) {
-    if (strcmp(entry->path, file_path) == 0) {
-      *prev = entry->next;
-      cache->size -= entry->data_len;
-      cache->entry_count--;
-      
-      free(entry->path);
-      free(entry->data);
-      free(entry->etag);
-      free(entry);
-      return true;
-    }
-    prev = &entry->next;
-    entry = entry->next;
+  GH_MutexLock(&shard->lock);
+  size_t index = table_find(shard, file_path, len, hash);
+  if (index != SIZE_MAX) {
+    cache_drop_at(cache, shard, index);
+    GH_MetricsInc(MC_CACHE_REMOVALS);
   }
-  return false;
+  GH_MutexUnlock(&shard->lock);
+
+  return index != SIZE_MAX;
+}
+
+bool GH_CacheRevalidate(struct CacheEntry *entry, uint64_t now, uint64_t interval) {
+  if (interval == 0 || now - GH_AtomicLoadU64(&entry->validated) <= interval) {
+    return true;
+  }
+
+  size_t size = 0;
+  time_t mtime = 0;
+  GH_MetricsInc(MC_CACHE_REVALIDATIONS);
+  if (mg_fs_posix.st(entry->path, &size, &mtime) == 0 || mtime != entry->mtime || size != entry->data_len) {
+    GH_MetricsInc(MC_CACHE_STALE);
+    return false;
+  }
+  GH_AtomicStoreU64(&entry->validated, now);
+  return true;
 }
 
 void GH_CacheEvictExpired(struct CacheBucket *cache, uint64_t current_time) {
@@ -157,28 +830,26 @@ void GH_CacheEvictExpired(struct CacheBucket *cache, uint64_t current_time) {
     return;
   }
 
-  struct CacheEntry **prev = &cache->entries;
-  struct CacheEntry *entry = cache->entries;
-
-  while (entry != NULL) {
-    struct CacheEntry *next = entry->next;
-    
-    // Check if entry has expired
-    if (current_time - entry->timestamp > CACHE_TTL_MS) {
-      *prev = next;
-      cache->size -= entry->data_len;
-      cache->entry_count--;
-      
-      free(entry->path);
-      free(entry->data);
-      free(entry->etag);
-      free(entry);
-      
-      entry = next;
-    } else {
-      prev = &entry->next;
-      entry = next;
+  uint64_t ttl_ms = GH_AtomicLoadU64(&cache->ttl_ms);
+  for (size_t i = 0; i < CACHE_SHARD_COUNT; i++) {
+    struct CacheShard *shard = &cache->shards[i];
+    GH_MutexLock(&shard->lock);
+
+    for (int segment = 0; segment < CACHE_SEG_COUNT; segment++) {
+      struct CacheEntry *entry = shard->lists[segment].head;
+      while (entry != NULL) {
+        struct CacheEntry *next = entry->lru_next;
+
+        // Check if entry has expired
+        if (current_time - entry->timestamp > ttl_ms) {
+          cache_drop(cache, shard, entry);
+          GH_MetricsInc(MC_CACHE_EXPIRATIONS);
+        }
+        entry = next;
+      }
     }
+
+    GH_MutexUnlock(&shard->lock);
   }
 }
 
@@ -186,32 +857,12 @@ void GH_CacheEvictOldest(struct CacheBucket *cache, size_t max_size) {
   if (cache == NULL) {
     return;
   }
+  evict_until(cache, max_size, SIZE_MAX);
+}
 
-  // Keep removing oldest (last in list) entries until under limit
-  while (cache->size > max_size && cache->entries != NULL) {
-    struct CacheEntry **prev = &cache->entries;
-    struct CacheEntry *entry = cache->entries;
-    struct CacheEntry **oldest_prev = prev;
-    struct CacheEntry *oldest = entry;
-
-    // Find the oldest entry (smallest timestamp)
-    while (entry != NULL) {
-      if (entry->timestamp < oldest->timestamp) {
-        oldest = entry;
-        oldest_prev = prev;
-      }
-      prev = &entry->next;
-      entry = entry->next;
-    }
-
-    // Remove oldest entry
-    *oldest_prev = oldest->next;
-    cache->size -= oldest->data_len;
-    cache->entry_count--;
-    
-    free(oldest->path);
-    free(oldest->data);
-    free(oldest->etag);
-    free(oldest);
+size_t GH_CacheShrink(struct CacheBucket *cache, size_t max_bytes) {
+  if (cache == NULL) {
+    return 0;
   }
+  return evict_until(cache, GH_AtomicLoadSize(&cache->max_size), max_bytes);
 }
@@ -4,30 +4,117 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <mongoose.h>
+#include <utils/Sync.h>
+#include "CacheArena.h"
+#include "CachePolicy.h"
 
 #ifndef CACHE_TTL_MS
-#define CACHE_TTL_MS (5 * 60 * 1000)  //!< Default cache TTL: 5 minutes
+#define CACHE_TTL_MS (5 * 60 * 1000)  //!< Default revalidation interval without a file watcher: 5 minutes
 #endif
 #ifndef CACHE_MAX_SIZE_MB
 #define CACHE_MAX_SIZE_MB 50          //!< Default max cache size: 50 MB
 #endif
+#ifndef CACHE_INITIAL_SLOTS
+#define CACHE_INITIAL_SLOTS 64        //!< Initial hash table capacity per shard (power of two)
+#endif
+#ifndef CACHE_CONTROL_VALUE
+#define CACHE_CONTROL_VALUE "public, max-age=300"  //!< Default Cache-Control sent with cached files
+#endif
+#ifndef CACHE_ADMIT_MAX_PERCENT
+#define CACHE_ADMIT_MAX_PERCENT 10    //!< Default: entries above this share of the budget are never cached
+#endif
+#ifndef CACHE_SHARD_COUNT
+#define CACHE_SHARD_COUNT 16          //!< Number of independently locked shards (power of two)
+#endif
+#ifndef CACHE_SHRINK_STEP_BYTES
+#define CACHE_SHRINK_STEP_BYTES (4 * 1024 * 1024)  //!< Default bytes evicted per GH_CacheShrink step after a budget cut
+#endif
+
+#define CACHE_ETAG_SIZE 24            //!< Holds any content ETag, quotes and terminator included
+
+//! Struct for a content hash (XXH64) fed in pieces
+struct CacheContentHash {
+    uint64_t lanes[4]; //!< Accumulators of the four stripe lanes
+    uint64_t total; //!< Bytes fed so far
+    unsigned char stripe[32]; //!< Bytes of the stripe not yet complete
+    size_t stripe_len; //!< Number of bytes in stripe
+};
 
-//! Struct for cache entry
+//! Content encodings a cache entry can hold besides the identity body
+enum CacheEncoding {
+    CACHE_ENC_BR, //!< Brotli
+    CACHE_ENC_GZIP, //!< gzip
+    CACHE_ENC_COUNT //!< Number of encodings
+};
+
+//! Struct for the serialized response headers of one representation, built once per entry
+struct CacheHeaders {
+    char *ok; //!< "200 OK" status line and headers, ready to send as is
+    size_t ok_len; //!< Length of ok
+    char *not_modified; //!< "304 Not Modified" status line and headers
+    size_t not_modified_len; //!< Length of not_modified
+};
+
+//! Struct for an encoded representation of a cache entry
+struct CacheVariant {
+    char *data; //!< Encoded body, NULL if this encoding is not available
+    size_t data_len; //!< Length of encoded body
+    char *etag; //!< ETag of this representation (distinct from the identity ETag)
+    struct CacheHeaders headers; //!< Prebuilt response headers of this representation
+};
+
+//! Struct for cache entry, sharing one arena block with its path, ETags, headers and bodies
 struct CacheEntry {
     char *path; //!< File path
+    size_t path_len; //!< Length of file path
+    uint64_t hash; //!< Precomputed hash of the file path
     char *data; //!< Cached data (owned by this entry)
     size_t data_len; //!< Length of cached data
     uint64_t timestamp; //!< Timestamp when the entry was cached (in milliseconds)
+    uint64_t validated; //!< Last time the file was seen unchanged (in milliseconds, atomic)
     char *etag; //!< ETag for this entry
     time_t mtime; //!< File modification time
-    struct CacheEntry *next; //!< Pointer to the next cache entry
+    const char *content_type; //!< Static Content-Type looked up from the path
+    struct CacheHeaders headers; //!< Prebuilt response headers of the identity body
+    struct CacheVariant encoded[CACHE_ENC_COUNT]; //!< Precompressed variants, indexed by enum CacheEncoding
+    size_t size; //!< Bytes charged to the cache budget: the whole block, rounding included
+    struct CacheArena *arena; //!< Arena the block came from, NULL if the entry does not own its memory
+    struct CacheSlab *slab; //!< Slab holding the block, NULL if it has its own mapping
+    int refs; //!< Reference count: one for the cache, one per GH_CacheAcquire holder
+    int segment; //!< enum CacheSegment of the list holding this entry
+    struct CacheEntry *lru_prev; //!< More recently used neighbour in its segment list
+    struct CacheEntry *lru_next; //!< Less recently used neighbour in its segment list
+};
+
+//! Struct for hash table slot
+struct CacheSlot {
+    uint64_t hash; //!< Cached path hash, avoids dereferencing entry on probe
+    struct CacheEntry *entry; //!< Entry stored in this slot, NULL if empty
+};
+
+//! Struct for cache shard, owning a slice of the key space behind its own lock
+struct GH_CACHELINE_ALIGNED CacheShard {
+    GH_Mutex lock; //!< Protects every field of this shard
+    struct CacheSlot *slots; //!< Open-addressing hash table (linear probing)
+    size_t capacity; //!< Number of slots, always a power of two
+    struct CacheList lists[CACHE_SEG_COUNT]; //!< Recency lists, indexed by enum CacheSegment
+    struct CacheSketch *sketch; //!< Access frequency estimate, NULL unless the policy uses one
+    size_t size; //!< Total size of this shard
+    size_t budget; //!< This shard's share of the cache budget, sizes the policy's segments
+    size_t entry_count; //!< Number of entries in this shard
 };
 
 //! Struct for cache bucket
 struct CacheBucket {
-    struct CacheEntry *entries; //!< Pointer to the first cache entry
-    size_t size; //!< Total size of the cache
-    size_t entry_count; //!< Number of entries in the cache
+    struct CacheShard shards[CACHE_SHARD_COUNT]; //!< Shards selected by the high bits of the path hash
+    size_t size; //!< Total size of the cache (atomic)
+    size_t entry_count; //!< Number of entries in the cache (atomic)
+    size_t evict_cursor; //!< Next shard to evict from (atomic)
+    size_t max_size; //!< Budget in bytes (atomic), see GH_CacheSetBudget
+    size_t max_entry_size; //!< Entries charging more than this are rejected (size-aware admission, atomic)
+    uint64_t ttl_ms; //!< Revalidation interval without a file watcher, and GH_CacheEvictExpired's TTL (atomic)
+    const struct CachePolicy *policy; //!< Admission/eviction policy
+    struct CacheArena arena; //!< Allocator of every entry block
 };
 
 // ==============================================================================
@@ -40,12 +127,130 @@ struct CacheBucket {
  * @param cache Pointer to the cache bucket to initialize
  */
 void GH_CacheInit(struct CacheBucket *cache);
+/**
+ * @brief Select the admission/eviction policy
+ * 
+ * Call before the cache is shared between threads; entries already cached
+ * keep their segment until the new policy touches them.
+ * 
+ * @param cache Pointer to the cache bucket
+ * @param name Policy name ("lru" or "tinylfu")
+ * @return bool true on success, false if the name is unknown or the sketch allocation failed
+ */
+bool GH_CacheSetPolicy(struct CacheBucket *cache, const char *name);
+/**
+ * @brief Check whether an entry of the given size would be admitted
+ * 
+ * @param cache Pointer to the cache bucket
+ * @param size Bytes the entry would charge (at least its body length)
+ * @return bool true if it is small enough to cache
+ */
+bool GH_CacheAdmits(const struct CacheBucket *cache, size_t size);
+/**
+ * @brief Change the cache budget while the cache is in use
+ * 
+ * Admission and the policy's segment sizes follow at once. Nothing is evicted
+ * here: after a cut, adds stop growing the cache and GH_CacheShrink() brings
+ * it down in bounded steps, so no caller stalls on one long eviction.
+ * 
+ * @param cache Pointer to the cache bucket
+ * @param max_size New budget in bytes
+ */
+void GH_CacheSetBudget(struct CacheBucket *cache, size_t max_size);
+/**
+ * @brief Current cache budget
+ * 
+ * @param cache Pointer to the cache bucket
+ * @return size_t Budget in bytes
+ */
+size_t GH_CacheBudget(const struct CacheBucket *cache);
+/**
+ * @brief Change the TTL while the cache is in use
+ * 
+ * @param cache Pointer to the cache bucket
+ * @param ttl_ms Revalidation interval without a file watcher, in milliseconds
+ */
+void GH_CacheSetTtl(struct CacheBucket *cache, uint64_t ttl_ms);
+/**
+ * @brief Current TTL
+ * 
+ * @param cache Pointer to the cache bucket
+ * @return uint64_t TTL in milliseconds
+ */
+uint64_t GH_CacheTtl(const struct CacheBucket *cache);
 /**
  * @brief Clean up the cache and free resources
  * 
+ * Must not run concurrently with other cache calls; use GH_CacheClear at runtime.
+ * 
  * @param cache Pointer to the cache bucket to clean up
  */
 void GH_CacheCleanup(struct CacheBucket *cache);
+/**
+ * @brief Drop every entry while keeping the cache usable from other threads
+ * 
+ * Entries still pinned by GH_CacheAcquire are freed on their last release.
+ * Slabs left empty are unmapped in bulk, so the memory goes back to the OS.
+ * 
+ * @param cache Pointer to the cache bucket to clear
+ */
+void GH_CacheClear(struct CacheBucket *cache);
+/**
+ * @brief Call fn on every entry, shard by shard, until it returns false
+ * 
+ * Each shard's entries are pinned under its lock and visited after it is
+ * released, so fn may take its time (write them out, say) without stalling
+ * requests. Entries added meanwhile may be missed.
+ * 
+ * @param cache Pointer to the cache bucket
+ * @param fn Visitor, given a pinned entry; return false to stop
+ * @param arg Visitor argument
+ * @return size_t Entries fn accepted (returned true for)
+ */
+size_t GH_CacheForEach(struct CacheBucket *cache, bool (*fn)(struct CacheEntry *entry, void *arg), void *arg);
+
+/**
+ * @brief Hash a file path the same way the cache index does (64-bit FNV-1a)
+ * 
+ * @param path File path
+ * @param len Length of file path
+ * @return uint64_t Path hash
+ */
+uint64_t GH_CacheHash(const char *path, size_t len);
+/**
+ * @brief Generate the strong ETag of a file from its contents (XXH64)
+ * 
+ * Identical files get identical ETags on every node and across deploys,
+ * whatever their path or modification time.
+ * 
+ * @param data File contents
+ * @param len Length of data
+ * @param etag Output buffer for the quoted ETag (CACHE_ETAG_SIZE bytes)
+ * @param etag_len Size of output buffer
+ */
+void GH_CacheMakeContentEtag(const void *data, size_t len, char *etag, size_t etag_len);
+/**
+ * @brief Start a content hash fed in pieces, for files too large to read whole
+ * 
+ * @param ch Hash state
+ */
+void GH_CacheContentHashInit(struct CacheContentHash *ch);
+/**
+ * @brief Feed the next piece of a file to a content hash
+ * 
+ * @param ch Hash state
+ * @param data Next bytes of the file
+ * @param len Length of data
+ */
+void GH_CacheContentHashUpdate(struct CacheContentHash *ch, const void *data, size_t len);
+/**
+ * @brief ETag of everything fed so far, the same GH_CacheMakeContentEtag gives for it in one piece
+ * 
+ * @param ch Hash state
+ * @param etag Output buffer for the quoted ETag (CACHE_ETAG_SIZE bytes)
+ * @param etag_len Size of output buffer
+ */
+void GH_CacheContentHashEtag(const struct CacheContentHash *ch, char *etag, size_t etag_len);
 /**
  * @brief Check if a cache entry exists for the given file path
  * 
@@ -55,13 +260,50 @@ void GH_CacheCleanup(struct CacheBucket *cache);
  */
 bool GH_CacheExists(struct CacheBucket *cache, const char *file_path);
 /**
- * @brief Retrieve a cache entry by file path
+ * @brief Retrieve a cache entry by file path and mark it as most recently used
+ * 
+ * The entry is not pinned, so the pointer is only valid while no other thread
+ * mutates the cache. Worker threads must use GH_CacheAcquire instead.
  * 
  * @param cache Pointer to the cache bucket
  * @param file_path File path to retrieve
  * @return Pointer to the cache entry if found, NULL otherwise
  */
 struct CacheEntry* GH_CacheGetByPath(struct CacheBucket *cache, const char *file_path);
+/**
+ * @brief Retrieve and pin a cache entry by file path
+ * 
+ * Only the owning shard is locked. The entry stays valid, even if it is
+ * removed or evicted meanwhile, until GH_CacheRelease is called.
+ * 
+ * @param cache Pointer to the cache bucket
+ * @param file_path File path to retrieve
+ * @return Pointer to the pinned cache entry if found, NULL otherwise
+ */
+struct CacheEntry* GH_CacheAcquire(struct CacheBucket *cache, const char *file_path);
+/**
+ * @brief GH_CacheAcquire with the path's length and GH_CacheHash already known
+ * 
+ * @param cache Pointer to the cache bucket
+ * @param file_path File path to retrieve
+ * @param len Length of file_path
+ * @param hash GH_CacheHash(file_path, len)
+ * @return Pointer to the pinned cache entry if found, NULL otherwise
+ */
+struct CacheEntry* GH_CacheAcquireHashed(struct CacheBucket *cache, const char *file_path, size_t len,
+                                         uint64_t hash);
+/**
+ * @brief Take an additional pin on an entry that is already pinned
+ * 
+ * @param entry Pinned cache entry
+ */
+void GH_CacheRetain(struct CacheEntry *entry);
+/**
+ * @brief Release an entry pinned by GH_CacheAcquire or GH_CacheRetain
+ * 
+ * @param entry Pinned cache entry (may be NULL)
+ */
+void GH_CacheRelease(struct CacheEntry *entry);
 /**
  * @brief Add a new cache entry
  * 
@@ -75,6 +317,32 @@ struct CacheEntry* GH_CacheGetByPath(struct CacheBucket *cache, const char *file
  */
 bool GH_CacheAdd(struct CacheBucket *cache, const char *path, const char *data, 
                  size_t data_len, const char *etag, time_t mtime);
+/**
+ * @brief Add a new cache entry together with its precompressed variants
+ * 
+ * Variant data is copied; variant ETags and headers are derived and ignored if set.
+ * The 200 and 304 header blocks of every representation are serialized here,
+ * so serving a hit needs no formatting.
+ * 
+ * @param cache Pointer to the cache bucket
+ * @param path File path
+ * @param data File data to cache
+ * @param data_len Length of data
+ * @param etag ETag string
+ * @param mtime File modification time
+ * @param encoded Array of CACHE_ENC_COUNT variants (entries with NULL data are skipped), or NULL
+ * @return bool true on success, false on failure
+ */
+bool GH_CacheAddEncoded(struct CacheBucket *cache, const char *path, const char *data,
+                        size_t data_len, const char *etag, time_t mtime,
+                        const struct CacheVariant *encoded);
+/**
+ * @brief Check whether an entry holds any precompressed variant
+ * 
+ * @param entry Cache entry
+ * @return bool true if at least one encoded variant exists
+ */
+bool GH_CacheHasVariants(const struct CacheEntry *entry);
 
 /**
  * @brief Remove a cache entry by path
@@ -85,6 +353,19 @@ bool GH_CacheAdd(struct CacheBucket *cache, const char *path, const char *data,
  */
 bool GH_CacheRemove(struct CacheBucket *cache, const char *file_path);
 
+/**
+ * @brief Check that a cached file is unchanged on disk, at most once per interval
+ * 
+ * Within interval of the last check this is a single atomic load; otherwise
+ * the file is stat'ed and compared against the cached mtime and size.
+ * 
+ * @param entry Pinned cache entry
+ * @param now Current timestamp in milliseconds
+ * @param interval Minimum time between checks in milliseconds, 0 to never check
+ * @return bool true if the entry may be served, false if the file changed or vanished
+ */
+bool GH_CacheRevalidate(struct CacheEntry *entry, uint64_t now, uint64_t interval);
+
 /**
  * @brief Evict expired entries based on TTL
  * 
@@ -94,12 +375,24 @@ bool GH_CacheRemove(struct CacheBucket *cache, const char *file_path);
 void GH_CacheEvictExpired(struct CacheBucket *cache, uint64_t current_time);
 
 /**
- * @brief Evict oldest entries to fit within size limit
+ * @brief Evict entries chosen by the cache policy to fit within size limit
  * 
  * @param cache Pointer to the cache bucket
  * @param max_size Maximum cache size in bytes
  */
 void GH_CacheEvictOldest(struct CacheBucket *cache, size_t max_size);
 
+/**
+ * @brief Evict toward the budget, at most max_bytes per call
+ * 
+ * Call periodically after GH_CacheSetBudget() lowered the budget; each call
+ * holds one shard lock per victim, as an add's eviction does.
+ * 
+ * @param cache Pointer to the cache bucket
+ * @param max_bytes Bytes to free at most in this step
+ * @return size_t Bytes freed, 0 once the cache is within its budget
+ */
+size_t GH_CacheShrink(struct CacheBucket *cache, size_t max_bytes);
+
 // global
 extern struct CacheBucket g_cache; //!< Global cache bucket instance
\ No newline at end of file
@@ -0,0 +1,206 @@
+#include "CachePolicy.h"
+#include "CacheManager.h"
+#include <string.h>
+
+// ==============================================================================
+// Segment lists
+// ==============================================================================
+
+static void list_push_front(struct CacheShard *shard, enum CacheSegment segment, struct CacheEntry *entry) {
+  struct CacheList *list = &shard->lists[segment];
+  entry->segment = (int) segment;
+  entry->lru_prev = NULL;
+  entry->lru_next = list->head;
+  if (list->head != NULL) {
+    list->head->lru_prev = entry;
+  } else {
+    list->tail = entry;
+  }
+  list->head = entry;
+  list->bytes += entry->size;
+}
+
+void GH_CacheListUnlink(struct CacheShard *shard, struct CacheEntry *entry) {
+  struct CacheList *list = &shard->lists[entry->segment];
+  if (entry->lru_prev != NULL) {
+    entry->lru_prev->lru_next = entry->lru_next;
+  } else {
+    list->head = entry->lru_next;
+  }
+  if (entry->lru_next != NULL) {
+    entry->lru_next->lru_prev = entry->lru_prev;
+  } else {
+    list->tail = entry->lru_prev;
+  }
+  entry->lru_prev = entry->lru_next = NULL;
+  list->bytes -= entry->size;
+}
+
+static void list_move_front(struct CacheShard *shard, enum CacheSegment segment, struct CacheEntry *entry) {
+  if (shard->lists[segment].head != entry) {
+    GH_CacheListUnlink(shard, entry);
+    list_push_front(shard, segment, entry);
+  }
+}
+
+// ==============================================================================
+// Count-min sketch
+// ==============================================================================
+
+// Age the sketch after this many increments so old popularity fades
+#define SKETCH_SAMPLE (10 * CACHE_SKETCH_WIDTH)
+
+static const uint64_t s_sketch_seeds[CACHE_SKETCH_DEPTH] = {
+  0x9e3779b97f4a7c15ULL, 0xbf58476d1ce4e5b9ULL, 0x94d049bb133111ebULL, 0xd6e8feb86659fd93ULL
+};
+
+static size_t sketch_index(uint64_t hash, int row) {
+  return (size_t) (((hash ^ s_sketch_seeds[row]) * 0x9e3779b97f4a7c15ULL) >> 32) & (CACHE_SKETCH_WIDTH - 1);
+}
+
+int GH_CacheSketchEstimate(const struct CacheSketch *sketch, uint64_t hash) {
+  int estimate = CACHE_SKETCH_MAX;
+  for (int row = 0; row < CACHE_SKETCH_DEPTH; row++) {
+    int count = sketch->counters[row][sketch_index(hash, row)];
+    if (count < estimate) {
+      estimate = count;
+    }
+  }
+  return estimate;
+}
+
+// Conservative update: only the counters at the current minimum grow
+static void sketch_increment(struct CacheSketch *sketch, uint64_t hash) {
+  int estimate = GH_CacheSketchEstimate(sketch, hash);
+  if (estimate < CACHE_SKETCH_MAX) {
+    for (int row = 0; row < CACHE_SKETCH_DEPTH; row++) {
+      uint8_t *counter = &sketch->counters[row][sketch_index(hash, row)];
+      if (*counter == estimate) {
+        (*counter)++;
+      }
+    }
+  }
+
+  if (++sketch->additions >= SKETCH_SAMPLE) {
+    for (int row = 0; row < CACHE_SKETCH_DEPTH; row++) {
+      for (size_t i = 0; i < CACHE_SKETCH_WIDTH; i++) {
+        sketch->counters[row][i] >>= 1;
+      }
+    }
+    sketch->additions /= 2;
+  }
+}
+
+// ==============================================================================
+// LRU: one list, evict the least recently used entry
+// ==============================================================================
+
+static void lru_on_access(struct CacheShard *shard, uint64_t hash, struct CacheEntry *entry) {
+  (void) hash;
+  if (entry != NULL) {
+    list_move_front(shard, CACHE_SEG_WINDOW, entry);
+  }
+}
+
+static void lru_on_insert(struct CacheShard *shard, struct CacheEntry *entry) {
+  list_push_front(shard, CACHE_SEG_WINDOW, entry);
+}
+
+// Entries left in other segments by a policy switch go after the window drains
+static struct CacheEntry *lru_victim(struct CacheShard *shard) {
+  for (int segment = 0; segment < CACHE_SEG_COUNT; segment++) {
+    if (shard->lists[segment].tail != NULL) {
+      return shard->lists[segment].tail;
+    }
+  }
+  return NULL;
+}
+
+// ==============================================================================
+// W-TinyLFU: new entries age in a small LRU window; leaving it, they only
+// displace the main segment's victim if the sketch says they are used more often.
+// The main segment is an SLRU, so a second hit protects an entry from scans.
+// ==============================================================================
+
+static void tinylfu_on_access(struct CacheShard *shard, uint64_t hash, struct CacheEntry *entry) {
+  if (shard->sketch != NULL) {
+    sketch_increment(shard->sketch, hash);  // Misses count too: that is what admission compares
+  }
+  if (entry == NULL) {
+    return;
+  }
+
+  if (entry->segment != CACHE_SEG_PROBATION) {
+    list_move_front(shard, (enum CacheSegment) entry->segment, entry);
+    return;
+  }
+
+  // Second hit: promote, demoting the protected tail back to probation while it is over target
+  GH_CacheListUnlink(shard, entry);
+  list_push_front(shard, CACHE_SEG_PROTECTED, entry);
+  size_t protected_target = shard->budget / 100 * CACHE_PROTECTED_PERCENT;
+  struct CacheList *protected_list = &shard->lists[CACHE_SEG_PROTECTED];
+  while (protected_list->bytes > protected_target && protected_list->tail != entry) {
+    struct CacheEntry *demoted = protected_list->tail;
+    GH_CacheListUnlink(shard, demoted);
+    list_push_front(shard, CACHE_SEG_PROBATION, demoted);
+  }
+}
+
+static struct CacheEntry *tinylfu_victim(struct CacheShard *shard) {
+  size_t window_target = shard->budget / 100 * CACHE_WINDOW_PERCENT;
+  size_t main_target = shard->budget - window_target;
+  for (;;) {
+    struct CacheList *window = &shard->lists[CACHE_SEG_WINDOW];
+    struct CacheEntry *candidate = window->bytes > window_target ? window->tail : NULL;
+    size_t main_bytes = shard->lists[CACHE_SEG_PROBATION].bytes + shard->lists[CACHE_SEG_PROTECTED].bytes;
+    if (candidate != NULL && main_bytes + candidate->size <= main_target) {
+      // Main segment has room: admit without a duel
+      GH_CacheListUnlink(shard, candidate);
+      list_push_front(shard, CACHE_SEG_PROBATION, candidate);
+      continue;
+    }
+
+    struct CacheEntry *victim = shard->lists[CACHE_SEG_PROBATION].tail;
+    if (victim == NULL) {
+      victim = shard->lists[CACHE_SEG_PROTECTED].tail;
+    }
+
+    if (candidate == NULL) {
+      return victim != NULL ? victim : window->tail;
+    }
+    if (victim == NULL) {
+      // Candidate alone exceeds the main segment: let it in and evict it later
+      GH_CacheListUnlink(shard, candidate);
+      list_push_front(shard, CACHE_SEG_PROBATION, candidate);
+      continue;
+    }
+
+    // Duel: the window's oldest entry replaces the main victim only if it is more popular
+    if (shard->sketch != NULL &&
+        GH_CacheSketchEstimate(shard->sketch, candidate->hash) > GH_CacheSketchEstimate(shard->sketch, victim->hash)) {
+      GH_CacheListUnlink(shard, candidate);
+      list_push_front(shard, CACHE_SEG_PROBATION, candidate);
+      return victim;
+    }
+    return candidate;
+  }
+}
+
+// ==============================================================================
+// Registry
+// ==============================================================================
+
+static const struct CachePolicy s_policies[] = {
+  {"lru", false, lru_on_access, lru_on_insert, lru_victim},
+  {"tinylfu", true, tinylfu_on_access, lru_on_insert, tinylfu_victim},
+};
+
+const struct CachePolicy *GH_CachePolicyFind(const char *name) {
+  for (size_t i = 0; i < sizeof(s_policies) / sizeof(s_policies[0]); i++) {
+    if (strcmp(s_policies[i].name, name) == 0) {
+      return &s_policies[i];
+    }
+  }
+  return NULL;
+}
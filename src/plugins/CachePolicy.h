@@ -0,0 +1,80 @@
+#pragma once
+#include <server/config.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef CACHE_POLICY
+#define CACHE_POLICY "tinylfu"        //!< Default admission/eviction policy: "lru" or "tinylfu"
+#endif
+#ifndef CACHE_SKETCH_WIDTH
+#define CACHE_SKETCH_WIDTH 4096       //!< Count-min sketch counters per row and shard (power of two)
+#endif
+#ifndef CACHE_WINDOW_PERCENT
+#define CACHE_WINDOW_PERCENT 1        //!< TinyLFU: share of a shard's bytes kept in the admission window
+#endif
+#ifndef CACHE_PROTECTED_PERCENT
+#define CACHE_PROTECTED_PERCENT 80    //!< TinyLFU: share of a shard's bytes kept in the protected segment
+#endif
+
+#define CACHE_SKETCH_DEPTH 4          //!< Count-min sketch rows
+#define CACHE_SKETCH_MAX 15           //!< Counters saturate here (4-bit TinyLFU counters)
+
+struct CacheEntry;
+struct CacheShard;
+
+//! LRU segments of a shard; plain LRU only uses the window
+enum CacheSegment {
+    CACHE_SEG_WINDOW, //!< New entries (the whole cache under plain LRU)
+    CACHE_SEG_PROBATION, //!< Admitted from the window, not yet hit again
+    CACHE_SEG_PROTECTED, //!< Hit while in probation
+    CACHE_SEG_COUNT //!< Number of segments
+};
+
+//! Struct for one LRU list of a shard
+struct CacheList {
+    struct CacheEntry *head; //!< Most recently used entry
+    struct CacheEntry *tail; //!< Least recently used entry
+    size_t bytes; //!< Bytes charged by the entries on this list
+};
+
+//! Struct for an aging count-min sketch estimating access frequency per path hash
+struct CacheSketch {
+    uint8_t counters[CACHE_SKETCH_DEPTH][CACHE_SKETCH_WIDTH]; //!< Saturating counters
+    uint32_t additions; //!< Increments since the last halving
+};
+
+//! Struct for an admission/eviction policy; every hook runs under the shard lock
+struct CachePolicy {
+    const char *name; //!< Name selected at startup
+    bool uses_sketch; //!< Shards need a frequency sketch
+    void (*on_access)(struct CacheShard *shard, uint64_t hash, struct CacheEntry *entry); //!< Record a lookup (entry NULL on a miss)
+    void (*on_insert)(struct CacheShard *shard, struct CacheEntry *entry); //!< Place a new entry on the shard's lists
+    struct CacheEntry *(*victim)(struct CacheShard *shard); //!< Next entry to evict, rebalancing segments on the way; NULL if empty
+};
+
+/**
+ * @brief Look up a policy by name
+ * 
+ * @param name "lru" or "tinylfu"
+ * @return const struct CachePolicy* Policy, NULL if unknown
+ */
+const struct CachePolicy *GH_CachePolicyFind(const char *name);
+
+/**
+ * @brief Unlink an entry from whichever segment list holds it
+ * 
+ * @param shard Shard owning the entry
+ * @param entry Entry to unlink
+ */
+void GH_CacheListUnlink(struct CacheShard *shard, struct CacheEntry *entry);
+
+/**
+ * @brief Estimated access frequency of a path hash
+ * 
+ * @param sketch Frequency sketch
+ * @param hash Path hash
+ * @return int Estimate in [0, CACHE_SKETCH_MAX]
+ */
+int GH_CacheSketchEstimate(const struct CacheSketch *sketch, uint64_t hash);
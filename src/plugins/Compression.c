@@ -0,0 +1,213 @@
+#include "Compression.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(GH_HAVE_ZLIB)
+#include <zlib.h>
+#endif
+#if defined(GH_HAVE_BROTLI)
+#include <brotli/encode.h>
+#endif
+
+static const char *const s_encoding_names[CACHE_ENC_COUNT] = {"br", "gzip"};
+static const char *const s_sibling_suffix[CACHE_ENC_COUNT] = {".br", ".gz"};
+
+// Return the extension of the last path component (without the dot)
+static struct mg_str path_extension(const char *path) {
+  const char *slash = strrchr(path, '/');
+  const char *dot = strrchr(path, '.');
+  if (dot == NULL || (slash != NULL && dot < slash)) {
+    return mg_str_n("", 0);
+  }
+  return mg_str(dot + 1);
+}
+
+// Load a precompressed sibling if it is at least as new as the original
+static bool load_sibling(const char *path, time_t mtime, enum CacheEncoding enc,
+                         struct CacheVariant *out) {
+  char sibling[512];
+  mg_snprintf(sibling, sizeof(sibling), "%s%s", path, s_sibling_suffix[enc]);
+
+  size_t size = 0;
+  time_t sibling_mtime = 0;
+  if (mg_fs_posix.st(sibling, &size, &sibling_mtime) == 0 || sibling_mtime < mtime) {
+    return false;
+  }
+
+  struct mg_str data = mg_file_read(&mg_fs_posix, sibling);
+  if (data.buf == NULL) {
+    return false;
+  }
+  out->data = data.buf;
+  out->data_len = data.len;
+  return true;
+}
+
+static bool compress_in_memory(enum CacheEncoding enc, const char *data, size_t data_len,
+                               struct CacheVariant *out) {
+#if defined(GH_HAVE_BROTLI)
+  if (enc == CACHE_ENC_BR) {
+    size_t out_len = BrotliEncoderMaxCompressedSize(data_len);
+    char *buf = out_len ? malloc(out_len) : NULL;
+    if (buf == NULL) {
+      return false;
+    }
+    if (!BrotliEncoderCompress(CACHE_COMPRESS_BROTLI_QUALITY, BROTLI_DEFAULT_WINDOW,
+                               BROTLI_MODE_TEXT, data_len, (const uint8_t *) data,
+                               &out_len, (uint8_t *) buf)) {
+      free(buf);
+      return false;
+    }
+    out->data = buf;
+    out->data_len = out_len;
+    return true;
+  }
+#endif
+#if defined(GH_HAVE_ZLIB)
+  if (enc == CACHE_ENC_GZIP) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    // 15 + 16: maximum window with a gzip wrapper
+    if (deflateInit2(&zs, CACHE_COMPRESS_GZIP_LEVEL, Z_DEFLATED, 15 + 16, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+      return false;
+    }
+    size_t bound = deflateBound(&zs, (uLong) data_len);
+    char *buf = malloc(bound);
+    if (buf == NULL) {
+      deflateEnd(&zs);
+      return false;
+    }
+    zs.next_in = (Bytef *) data;
+    zs.avail_in = (uInt) data_len;
+    zs.next_out = (Bytef *) buf;
+    zs.avail_out = (uInt) bound;
+    int rc = deflate(&zs, Z_FINISH);
+    out->data_len = zs.total_out;
+    deflateEnd(&zs);
+    if (rc != Z_STREAM_END) {
+      free(buf);
+      return false;
+    }
+    out->data = buf;
+    return true;
+  }
+#endif
+  (void) enc;
+  (void) data;
+  (void) data_len;
+  (void) out;
+  return false;
+}
+
+bool GH_CompressionEligible(const char *path, size_t data_len) {
+  if (path == NULL || data_len < CACHE_COMPRESS_MIN_SIZE) {
+    return false;
+  }
+
+  struct mg_str ext = path_extension(path);
+  struct mg_str list = mg_str(CACHE_COMPRESS_EXTENSIONS), item;
+  while (ext.len > 0 && mg_span(list, &item, &list, ',')) {
+    if (mg_strcasecmp(item, ext) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool GH_CompressionBuildVariants(const char *path, time_t mtime, const char *data,
+                                 size_t data_len, struct CacheVariant out[CACHE_ENC_COUNT]) {
+  bool any = false;
+  memset(out, 0, sizeof(struct CacheVariant) * CACHE_ENC_COUNT);
+
+  for (int i = 0; i < CACHE_ENC_COUNT; i++) {
+    struct CacheVariant *variant = &out[i];
+    if (!load_sibling(path, mtime, (enum CacheEncoding) i, variant) &&
+        !compress_in_memory((enum CacheEncoding) i, data, data_len, variant)) {
+      continue;
+    }
+
+    // Only keep variants that actually save bytes
+    if (variant->data_len >= data_len) {
+      free(variant->data);
+      variant->data = NULL;
+      variant->data_len = 0;
+      continue;
+    }
+    any = true;
+  }
+  return any;
+}
+
+void GH_CompressionFreeVariants(struct CacheVariant variants[CACHE_ENC_COUNT]) {
+  for (int i = 0; i < CACHE_ENC_COUNT; i++) {
+    free(variants[i].data);
+    variants[i].data = NULL;
+    variants[i].data_len = 0;
+  }
+}
+
+int GH_CompressionNegotiate(const struct mg_str *accept_encoding, const struct CacheEntry *entry) {
+  if (accept_encoding == NULL || entry == NULL) {
+    return -1;
+  }
+
+  // q-values in thousandths; -1 means "not mentioned"
+  int q[CACHE_ENC_COUNT], q_any = -1;
+  for (int i = 0; i < CACHE_ENC_COUNT; i++) {
+    q[i] = -1;
+  }
+
+  struct mg_str list = *accept_encoding, item;
+  while (mg_span(list, &item, &list, ',')) {
+    struct mg_str coding = item, params = mg_str_n("", 0);
+    mg_span(item, &coding, &params, ';');
+    while (coding.len > 0 && (coding.buf[0] == ' ' || coding.buf[0] == '\t')) coding.buf++, coding.len--;
+    while (coding.len > 0 && (coding.buf[coding.len - 1] == ' ' || coding.buf[coding.len - 1] == '\t')) coding.len--;
+
+    // Parse "q=0.xyz"; anything unparsable counts as q=1
+    int value = 1000;
+    const char *qp = NULL;
+    for (size_t k = 0; k + 1 < params.len; k++) {
+      if ((params.buf[k] == 'q' || params.buf[k] == 'Q') && params.buf[k + 1] == '=') {
+        qp = params.buf + k + 2;
+        break;
+      }
+    }
+    if (qp != NULL && qp < params.buf + params.len && *qp == '0') {
+      value = 0;
+      const char *end = params.buf + params.len;
+      if (qp + 1 < end && qp[1] == '.') {
+        int scale = 100;
+        for (const char *d = qp + 2; d < end && scale > 0 && *d >= '0' && *d <= '9'; d++, scale /= 10) {
+          value += (*d - '0') * scale;
+        }
+      }
+    }
+
+    if (mg_strcasecmp(coding, mg_str("*")) == 0) {
+      q_any = value;
+    } else {
+      for (int i = 0; i < CACHE_ENC_COUNT; i++) {
+        if (mg_strcasecmp(coding, mg_str(s_encoding_names[i])) == 0) {
+          q[i] = value;
+        }
+      }
+    }
+  }
+
+  // Highest q wins; ties go to the better ratio (enum order: br first)
+  int best = -1, best_q = 0;
+  for (int i = 0; i < CACHE_ENC_COUNT; i++) {
+    int qi = q[i] >= 0 ? q[i] : q_any;
+    if (entry->encoded[i].data != NULL && qi > best_q) {
+      best = i;
+      best_q = qi;
+    }
+  }
+  return best;
+}
+
+const char *GH_CompressionName(enum CacheEncoding enc) {
+  return enc < CACHE_ENC_COUNT ? s_encoding_names[enc] : "identity";
+}
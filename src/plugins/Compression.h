@@ -0,0 +1,74 @@
+#pragma once
+#include <server/config.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <mongoose.h>
+#include "CacheManager.h"
+
+#ifndef CACHE_COMPRESS_MIN_SIZE
+#define CACHE_COMPRESS_MIN_SIZE 1024  //!< Default minimum body size worth compressing
+#endif
+#ifndef CACHE_COMPRESS_EXTENSIONS
+#define CACHE_COMPRESS_EXTENSIONS "html,htm,css,js,json,txt,xml,svg,php"  //!< Default compressible extensions
+#endif
+#ifndef CACHE_COMPRESS_GZIP_LEVEL
+#define CACHE_COMPRESS_GZIP_LEVEL 6   //!< Default zlib level for load-time gzip
+#endif
+#ifndef CACHE_COMPRESS_BROTLI_QUALITY
+#define CACHE_COMPRESS_BROTLI_QUALITY 5  //!< Default brotli quality for load-time compression
+#endif
+
+// ==============================================================================
+// Precompressed variants and Accept-Encoding negotiation
+// ==============================================================================
+
+/**
+ * @brief Check whether a file is worth storing compressed variants for
+ * 
+ * @param path File path (extension is matched against CACHE_COMPRESS_EXTENSIONS)
+ * @param data_len Uncompressed size
+ * @return bool true if compressible
+ */
+bool GH_CompressionEligible(const char *path, size_t data_len);
+
+/**
+ * @brief Build compressed variants for a file
+ * 
+ * Fresh ".br"/".gz" siblings on disk are preferred; missing encodings are
+ * compressed in memory when the build has zlib/brotli. Variants that do not
+ * shrink the body are dropped.
+ * 
+ * @param path File path
+ * @param mtime File modification time (older siblings are ignored)
+ * @param data Uncompressed body
+ * @param data_len Uncompressed size
+ * @param out Receives CACHE_ENC_COUNT variants; free with GH_CompressionFreeVariants
+ * @return bool true if at least one variant was built
+ */
+bool GH_CompressionBuildVariants(const char *path, time_t mtime, const char *data,
+                                 size_t data_len, struct CacheVariant out[CACHE_ENC_COUNT]);
+
+/**
+ * @brief Free variants returned by GH_CompressionBuildVariants
+ * 
+ * @param variants Array of CACHE_ENC_COUNT variants
+ */
+void GH_CompressionFreeVariants(struct CacheVariant variants[CACHE_ENC_COUNT]);
+
+/**
+ * @brief Pick the best available encoding for a request
+ * 
+ * @param accept_encoding Accept-Encoding header value, or NULL
+ * @param entry Cache entry
+ * @return int enum CacheEncoding to send, or -1 for the identity body
+ */
+int GH_CompressionNegotiate(const struct mg_str *accept_encoding, const struct CacheEntry *entry);
+
+/**
+ * @brief Content-Encoding token for an encoding
+ * 
+ * @param enc Encoding
+ * @return const char* "br" or "gzip"
+ */
+const char *GH_CompressionName(enum CacheEncoding enc);
@@ -0,0 +1,140 @@
+#include "FileEtag.h"
+#include <mongoose.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+// ==============================================================================
+// Internal helpers
+// ==============================================================================
+
+static struct FileEtagSlot *etag_slot(struct FileEtags *fe, const struct FileStamp *stamp) {
+  uint64_t mixed = (stamp->ino ^ (stamp->dev << 32) ^ stamp->size ^ (uint64_t) stamp->mtime) * 0xff51afd7ed558ccdULL;
+  return &fe->slots[(size_t) (mixed ^ (mixed >> 33)) & fe->mask];
+}
+
+// One pass over the file; false if it cannot be read whole
+static bool hash_file(const char *path, char *etag, size_t etag_len) {
+  FILE *fp = fopen(path, "rb");
+  unsigned char *buf = fp != NULL ? malloc(FILE_ETAG_CHUNK) : NULL;
+  if (buf == NULL) {
+    if (fp != NULL) {
+      fclose(fp);
+    }
+    return false;
+  }
+  struct CacheContentHash ch;
+  GH_CacheContentHashInit(&ch);
+  size_t n;
+  while ((n = fread(buf, 1, FILE_ETAG_CHUNK, fp)) > 0) {
+    GH_CacheContentHashUpdate(&ch, buf, n);
+  }
+  bool ok = ferror(fp) == 0;
+  fclose(fp);
+  free(buf);
+  if (ok) {
+    GH_CacheContentHashEtag(&ch, etag, etag_len);
+  }
+  return ok;
+}
+
+// ==============================================================================
+// Public API
+// ==============================================================================
+
+bool GH_FileStampRead(const char *path, struct FileStamp *stamp) {
+  struct stat st;
+  if (stat(path, &st) != 0 || (st.st_mode & S_IFMT) != S_IFREG) {
+    return false;
+  }
+  stamp->dev = (uint64_t) st.st_dev;
+  stamp->ino = (uint64_t) st.st_ino;
+  stamp->size = (uint64_t) st.st_size;
+  stamp->mtime = st.st_mtime;
+#if defined(__linux__)
+  stamp->mtime_nsec = st.st_mtim.tv_nsec;
+#else
+  stamp->mtime_nsec = 0;
+#endif
+  return true;
+}
+
+bool GH_FileStampEqual(const struct FileStamp *a, const struct FileStamp *b) {
+  return a->dev == b->dev && a->ino == b->ino && a->size == b->size && a->mtime == b->mtime &&
+         a->mtime_nsec == b->mtime_nsec;
+}
+
+bool GH_FileEtagInit(struct FileEtags *fe, size_t entries) {
+  memset(fe, 0, sizeof(*fe));
+  GH_MutexInit(&fe->lock);
+  if (entries == 0) {
+    return true;
+  }
+
+  size_t slots = 1;
+  while (slots * 2 <= entries) {
+    slots *= 2;
+  }
+  fe->slots = calloc(slots, sizeof(struct FileEtagSlot));
+  if (fe->slots == NULL) {
+    return false;
+  }
+  fe->mask = slots - 1;
+  return true;
+}
+
+void GH_FileEtagCleanup(struct FileEtags *fe) {
+  free(fe->slots);
+  fe->slots = NULL;
+  GH_MutexDestroy(&fe->lock);
+}
+
+bool GH_FileEtagLookup(struct FileEtags *fe, const struct FileStamp *stamp, char *etag, size_t etag_len) {
+  if (fe->slots == NULL) {
+    return false;
+  }
+  bool found = false;
+  GH_MutexLock(&fe->lock);
+  const struct FileEtagSlot *slot = etag_slot(fe, stamp);
+  if (slot->etag[0] != '\0' && GH_FileStampEqual(&slot->stamp, stamp)) {
+    mg_snprintf(etag, etag_len, "%s", slot->etag);
+    found = true;
+  }
+  GH_MutexUnlock(&fe->lock);
+  return found;
+}
+
+void GH_FileEtagStore(struct FileEtags *fe, const struct FileStamp *stamp, const char *etag) {
+  if (fe->slots == NULL) {
+    return;
+  }
+  GH_MutexLock(&fe->lock);
+  struct FileEtagSlot *slot = etag_slot(fe, stamp);
+  slot->stamp = *stamp;
+  mg_snprintf(slot->etag, sizeof(slot->etag), "%s", etag);
+  GH_MutexUnlock(&fe->lock);
+}
+
+bool GH_FileEtagCompute(struct FileEtags *fe, const char *path, struct FileStamp *stamp, char *etag,
+                        size_t etag_len) {
+  if (GH_FileEtagLookup(fe, stamp, etag, etag_len)) {
+    return true;
+  }
+
+  // The hash only belongs to this version if nothing changed while the file was read
+  for (int attempt = 0; attempt < FILE_ETAG_ATTEMPTS; attempt++) {
+    struct FileStamp after;
+    if (!hash_file(path, etag, etag_len) || !GH_FileStampRead(path, &after)) {
+      break;
+    }
+    if (GH_FileStampEqual(&after, stamp)) {
+      GH_FileEtagStore(fe, stamp, etag);
+      return true;
+    }
+    *stamp = after;
+  }
+  MG_DEBUG(("No ETag for %s: unreadable or changing while it was hashed", path));
+  etag[0] = '\0';
+  return false;
+}
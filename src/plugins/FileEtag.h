@@ -0,0 +1,116 @@
+#pragma once
+#include <server/config.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <utils/Sync.h>
+#include "CacheManager.h"
+
+#ifndef FILE_ETAG_ENTRIES
+#define FILE_ETAG_ENTRIES 1024        //!< Default content ETags remembered for files served from disk (power of two)
+#endif
+
+#define FILE_ETAG_CHUNK (256 * 1024)  //!< Bytes read per step while hashing a file
+#define FILE_ETAG_ATTEMPTS 3          //!< Hashes of a file that keeps changing before it is served without an ETag
+
+//! Struct for one version of a file as stat reports it; writing the file changes at least one field
+struct FileStamp {
+    uint64_t dev; //!< Device
+    uint64_t ino; //!< Inode, 0 where there is none
+    uint64_t size; //!< Size in bytes
+    time_t mtime; //!< Modification time in seconds
+    long mtime_nsec; //!< Nanoseconds of the modification time, 0 where unknown
+};
+
+//! Struct for one remembered content ETag
+struct FileEtagSlot {
+    struct FileStamp stamp; //!< Version of the file the ETag was computed for
+    char etag[CACHE_ETAG_SIZE]; //!< Quoted content ETag, "" if the slot is free
+};
+
+//! Struct for a direct-mapped memo of the content ETags of files served from disk
+struct FileEtags {
+    struct FileEtagSlot *slots; //!< Slots, NULL if disabled
+    size_t mask; //!< Number of slots minus one
+    GH_Mutex lock; //!< Protects the slots
+};
+
+// ============================================================================
+// Content ETags of files served from disk, hashed once per version
+// ============================================================================
+
+/**
+ * @brief Stat a file
+ * 
+ * @param path File path
+ * @param stamp Version of the file
+ * @return bool true if path is a regular file
+ */
+bool GH_FileStampRead(const char *path, struct FileStamp *stamp);
+
+/**
+ * @brief Check whether two stamps are the same version of a file
+ * 
+ * @param a First stamp
+ * @param b Second stamp
+ * @return bool true if every field matches
+ */
+bool GH_FileStampEqual(const struct FileStamp *a, const struct FileStamp *b);
+
+/**
+ * @brief Initialize a memo
+ * 
+ * @param fe Memo to initialize
+ * @param entries Capacity in files (rounded down to a power of two), 0 to disable
+ * @return bool true on success, false if the slots could not be allocated
+ */
+bool GH_FileEtagInit(struct FileEtags *fe, size_t entries);
+
+/**
+ * @brief Free the slots and the lock of a memo
+ * 
+ * @param fe Memo
+ */
+void GH_FileEtagCleanup(struct FileEtags *fe);
+
+/**
+ * @brief Look up the ETag of a file version without reading the file
+ * 
+ * @param fe Memo
+ * @param stamp Version from GH_FileStampRead()
+ * @param etag Output buffer for the quoted ETag (CACHE_ETAG_SIZE bytes)
+ * @param etag_len Size of output buffer
+ * @return bool true if it is remembered
+ */
+bool GH_FileEtagLookup(struct FileEtags *fe, const struct FileStamp *stamp, char *etag, size_t etag_len);
+
+/**
+ * @brief Remember the ETag of a file version, e.g. hashed when it was cached
+ * 
+ * @param fe Memo
+ * @param stamp Version the contents were read at, checked unchanged after reading
+ * @param etag Quoted content ETag (GH_CacheMakeContentEtag)
+ */
+void GH_FileEtagStore(struct FileEtags *fe, const struct FileStamp *stamp, const char *etag);
+
+/**
+ * @brief ETag of a file version, hashing the file in FILE_ETAG_CHUNK pieces if it is not remembered
+ * 
+ * The result equals GH_CacheMakeContentEtag over the whole file, so a file
+ * has one ETag whether it is served from the cache or from disk. Blocks for
+ * one read of the file on a miss: call it off the event loop where possible.
+ * 
+ * @param fe Memo
+ * @param path File path
+ * @param stamp Version from GH_FileStampRead(); updated if the file changed meanwhile
+ * @param etag Output buffer for the quoted ETag (CACHE_ETAG_SIZE bytes), "" on failure
+ * @param etag_len Size of output buffer
+ * @return bool false if the file cannot be read or kept changing while it was hashed
+ */
+bool GH_FileEtagCompute(struct FileEtags *fe, const char *path, struct FileStamp *stamp, char *etag,
+                        size_t etag_len);
+
+// global
+extern struct FileEtags g_file_etags; //!< Global memo of disk file ETags
@@ -0,0 +1,280 @@
+#include "Loader.h"
+#include "CacheManager.h"
+#include "Compression.h"
+#include "FileEtag.h"
+#include "NegativeCache.h"
+#include "server/Metrics.h"
+#include <stdlib.h>
+#include <string.h>
+
+// ==============================================================================
+// Internal helpers
+// ==============================================================================
+
+static struct LoadJob **inflight_bucket(struct Loader *loader, uint64_t hash) {
+  return &loader->inflight[(size_t) hash & (LOADER_INFLIGHT_BUCKETS - 1)];
+}
+
+static void job_free(struct LoadJob *job) {
+  while (job->waiters != NULL) {
+    struct LoadWaiter *next = job->waiters->next;
+    free(job->waiters);
+    job->waiters = next;
+  }
+  free(job->path);
+  free(job);
+}
+
+// Fill in how to stream a file the cache does not take: its latest version and
+// the content ETag it would have had in the cache
+static int uncached_result(const char *path, struct FileStamp *stamp, struct LoadResult *result) {
+  GH_FileEtagCompute(&g_file_etags, path, stamp, result->etag, sizeof(result->etag));
+  result->size = stamp->size;
+  result->mtime = (int64_t) stamp->mtime;
+  return LOAD_UNCACHED;
+}
+
+// Read, stat, compress and cache one file; runs on a loader thread. Files the
+// cache would not take are only hashed: *result says how to stream them.
+static int load_file(const char *path, struct LoadResult *result) {
+  struct FileStamp stamp;
+  size_t generation = GH_NegativeCacheGeneration(&g_negative);
+  if (!GH_FileStampRead(path, &stamp)) {
+    // Remember the miss so repeated requests skip the loader and the stat
+    if (GH_NegativeCacheInsert(&g_negative, path, generation, mg_millis())) {
+      GH_MetricsInc(MC_NEGATIVE_ADDS);
+    }
+    return LOAD_NOT_FOUND;
+  }
+  if (stamp.size >= APP_STREAM_MIN_SIZE || !GH_CacheAdmits(&g_cache, (size_t) stamp.size)) {
+    MG_DEBUG(("Not caching %s (%llu bytes): streamed from disk", path, (unsigned long long) stamp.size));
+    return uncached_result(path, &stamp, result);  // Too large to buffer or cache; stream it instead
+  }
+
+  // Read file from filesystem
+  struct mg_str file_data = mg_file_read(&mg_fs_posix, path);
+  if (file_data.buf == NULL) {
+    MG_ERROR(("Failed to read file: %s", path));
+    return LOAD_NOT_FOUND;
+  }
+  GH_MetricsAdd(MC_LOAD_BYTES, file_data.len);
+
+  char etag[CACHE_ETAG_SIZE];
+  GH_CacheMakeContentEtag(file_data.buf, file_data.len, etag, sizeof(etag));
+  time_t mtime = stamp.mtime;
+
+  // Build compressed variants for text assets (from .br/.gz siblings or in memory)
+  struct CacheVariant variants[CACHE_ENC_COUNT];
+  bool has_variants = GH_CompressionEligible(path, file_data.len) &&
+                      GH_CompressionBuildVariants(path, mtime, file_data.buf, file_data.len, variants);
+
+  bool cached = GH_CacheAddEncoded(&g_cache, path, file_data.buf, file_data.len, etag, mtime,
+                                   has_variants ? variants : NULL);
+  // The variants count against the admission limit too; a refusal is routine, not an error
+  size_t body_bytes = file_data.len;
+  for (int i = 0; has_variants && i < CACHE_ENC_COUNT; i++) {
+    body_bytes += variants[i].data != NULL ? variants[i].data_len : 0;
+  }
+  bool admitted = cached || GH_CacheAdmits(&g_cache, body_bytes);
+  if (has_variants) {
+    GH_CompressionFreeVariants(variants);
+  }
+  // A write racing with the read leaves a new version behind; do not keep the torn copy
+  struct FileStamp check;
+  bool exists = GH_FileStampRead(path, &check);
+  bool torn = !exists || !GH_FileStampEqual(&check, &stamp) || check.size != file_data.len;
+  if (!torn) {
+    GH_FileEtagStore(&g_file_etags, &stamp, etag);  // Served from disk later, it keeps this ETag
+  } else if (cached) {
+    GH_CacheRemove(&g_cache, path);
+    cached = false;
+  }
+  if (cached) {
+    MG_INFO(("Cached file: %s (%lu bytes)", path, (unsigned long) file_data.len));
+  } else if (!admitted) {
+    MG_DEBUG(("Not caching %s: %lu bytes with its variants exceed the admission limit", path,
+              (unsigned long) body_bytes));
+  } else if (torn) {
+    MG_DEBUG(("Not caching %s: changed while it was read", path));
+  } else {
+    MG_ERROR(("Failed to cache file: %s", path));
+  }
+  free((void *) file_data.buf);
+  if (cached) {
+    return LOAD_CACHED;
+  }
+  return exists ? uncached_result(path, &check, result) : LOAD_NOT_FOUND;
+}
+
+// Run a job, unpublish it and wake everybody who joined it meanwhile
+static void run_job(struct Loader *loader, struct LoadJob *job) {
+  uint64_t start = GH_MetricsNow();
+  struct LoadResult result = {LOAD_NOT_FOUND, 0, 0, ""};
+  result.status = load_file(job->path, &result);
+  GH_MetricsObserve(MH_LOAD, start);
+  GH_MetricsInc(MC_LOADS);
+  if (result.status != LOAD_CACHED) {
+    GH_MetricsInc(MC_LOADS_FAILED);
+  }
+
+  GH_MutexLock(&loader->lock);
+  struct LoadJob **link = inflight_bucket(loader, job->hash);
+  while (*link != job) {
+    link = &(*link)->next_inflight;
+  }
+  *link = job->next_inflight;
+  GH_MutexUnlock(&loader->lock);
+
+  // No new waiter can attach once the job is unpublished
+  for (struct LoadWaiter *w = job->waiters; w != NULL; w = w->next) {
+    mg_wakeup(w->mgr, w->conn_id, &result, sizeof(result));
+  }
+  job_free(job);
+}
+
+static void loader_thread(void *arg) {
+  struct Loader *loader = (struct Loader *) arg;
+  GH_MutexLock(&loader->lock);
+  for (;;) {
+    while (loader->queue_head == NULL && !loader->stopping) {
+      GH_CondWait(&loader->cond, &loader->lock);
+    }
+    if (loader->stopping) {
+      break;
+    }
+    struct LoadJob *job = loader->queue_head;
+    loader->queue_head = job->next_queued;
+    if (loader->queue_head == NULL) {
+      loader->queue_tail = NULL;
+    }
+    GH_MutexUnlock(&loader->lock);
+    run_job(loader, job);
+    GH_MutexLock(&loader->lock);
+  }
+  GH_MutexUnlock(&loader->lock);
+}
+
+// ==============================================================================
+// Public API
+// ==============================================================================
+
+bool GH_LoaderInit(struct Loader *loader, int threads) {
+  memset(loader, 0, sizeof(*loader));
+  GH_MutexInit(&loader->lock);
+  GH_CondInit(&loader->cond);
+  if (threads <= 0) {
+    return true;
+  }
+
+  loader->threads = calloc((size_t) threads, sizeof(GH_Thread));
+  if (loader->threads == NULL) {
+    return false;
+  }
+  for (int i = 0; i < threads; i++) {
+    if (!GH_ThreadStart(&loader->threads[i], loader_thread, loader)) {
+      MG_ERROR(("Failed to start loader thread %d", i));
+      break;
+    }
+    loader->thread_count++;
+  }
+  return loader->thread_count > 0;
+}
+
+void GH_LoaderShutdown(struct Loader *loader) {
+  GH_MutexLock(&loader->lock);
+  loader->stopping = true;
+  GH_CondBroadcast(&loader->cond);
+  GH_MutexUnlock(&loader->lock);
+
+  for (int i = 0; i < loader->thread_count; i++) {
+    GH_ThreadJoin(loader->threads[i]);
+  }
+  free(loader->threads);
+
+  // Threads are gone; whatever is still queued never started
+  while (loader->queue_head != NULL) {
+    struct LoadJob *next = loader->queue_head->next_queued;
+    job_free(loader->queue_head);
+    loader->queue_head = next;
+  }
+  GH_CondDestroy(&loader->cond);
+  GH_MutexDestroy(&loader->lock);
+}
+
+// Queue a load of path, or join the one in flight; waiter may be NULL
+static bool loader_submit(struct Loader *loader, const char *path, struct LoadWaiter *waiter) {
+  size_t path_len = strlen(path);
+  uint64_t hash = GH_CacheHash(path, path_len);
+
+  GH_MutexLock(&loader->lock);
+
+  // Join a load of the same path that is already queued or running
+  for (struct LoadJob *job = *inflight_bucket(loader, hash); job != NULL; job = job->next_inflight) {
+    if (job->hash == hash && strcmp(job->path, path) == 0) {
+      if (waiter != NULL) {
+        waiter->next = job->waiters;
+        job->waiters = waiter;
+      }
+      GH_MutexUnlock(&loader->lock);
+      GH_MetricsInc(MC_LOADS_COALESCED);
+      return true;
+    }
+  }
+
+  struct LoadJob *job = calloc(1, sizeof(*job));
+  char *job_path = malloc(path_len + 1);
+  if (job == NULL || job_path == NULL) {
+    GH_MutexUnlock(&loader->lock);
+    free(job);
+    free(job_path);
+    return false;
+  }
+  memcpy(job_path, path, path_len + 1);
+  job->path = job_path;
+  job->hash = hash;
+  if (waiter != NULL) {
+    waiter->next = NULL;
+    job->waiters = waiter;
+  }
+
+  // Publish first so later misses for this path coalesce onto it
+  struct LoadJob **bucket = inflight_bucket(loader, hash);
+  job->next_inflight = *bucket;
+  *bucket = job;
+
+  if (loader->thread_count == 0) {
+    GH_MutexUnlock(&loader->lock);
+    run_job(loader, job);
+    return true;
+  }
+
+  if (loader->queue_tail != NULL) {
+    loader->queue_tail->next_queued = job;
+  } else {
+    loader->queue_head = job;
+  }
+  loader->queue_tail = job;
+  GH_CondSignal(&loader->cond);
+  GH_MutexUnlock(&loader->lock);
+  return true;
+}
+
+bool GH_LoaderRequest(struct Loader *loader, const char *path, struct mg_mgr *mgr,
+                      unsigned long conn_id) {
+  struct LoadWaiter *waiter = malloc(sizeof(*waiter));
+  if (waiter == NULL) {
+    return false;
+  }
+  waiter->mgr = mgr;
+  waiter->conn_id = conn_id;
+
+  if (!loader_submit(loader, path, waiter)) {
+    free(waiter);
+    return false;
+  }
+  return true;
+}
+
+bool GH_LoaderPrefetch(struct Loader *loader, const char *path) {
+  return loader_submit(loader, path, NULL);
+}
@@ -0,0 +1,114 @@
+#pragma once
+#include <server/config.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <mongoose.h>
+#include <utils/Sync.h>
+#include "CacheManager.h"
+
+#ifndef APP_LOADER_THREADS
+#define APP_LOADER_THREADS 4          //!< Default disk loader threads, 0 = load inline on the event loop
+#endif
+#ifndef APP_STREAM_MIN_SIZE
+#define APP_STREAM_MIN_SIZE (64 * 1024 * 1024) //!< Default size from which files are streamed, never read whole
+#endif
+#ifndef LOADER_INFLIGHT_BUCKETS
+#define LOADER_INFLIGHT_BUCKETS 256   //!< Buckets of the in-flight load index (power of two)
+#endif
+
+//! Outcome of an asynchronous load, delivered as MG_EV_WAKEUP data (struct LoadResult)
+enum LoadStatus {
+    LOAD_CACHED, //!< File is now in the cache (it may still be evicted before it is served)
+    LOAD_NOT_FOUND, //!< File does not exist or is not a regular file
+    LOAD_UNCACHED //!< File exists but was not cached (too large or out of memory); stream it from disk
+};
+
+//! Struct for the MG_EV_WAKEUP payload sent to each waiting connection
+struct LoadResult {
+    int status; //!< enum LoadStatus
+    uint64_t size; //!< File size as last stat'ed, for LOAD_UNCACHED
+    int64_t mtime; //!< Modification time as last stat'ed, for LOAD_UNCACHED
+    char etag[CACHE_ETAG_SIZE]; //!< Content ETag of that version, for LOAD_UNCACHED ("" if it kept changing)
+};
+
+//! Struct for a connection waiting on a load
+struct LoadWaiter {
+    struct mg_mgr *mgr; //!< Event manager owning the connection
+    unsigned long conn_id; //!< Connection ID, looked up by mg_wakeup
+    struct LoadWaiter *next; //!< Next waiter of the same job
+};
+
+//! Struct for one in-flight load, shared by every request for the same path
+struct LoadJob {
+    char *path; //!< File path
+    uint64_t hash; //!< Path hash (GH_CacheHash)
+    struct LoadWaiter *waiters; //!< Connections to wake when done
+    struct LoadJob *next_inflight; //!< Next job in the same in-flight bucket
+    struct LoadJob *next_queued; //!< Next job in the work queue
+};
+
+//! Struct for the disk loader pool
+struct Loader {
+    GH_Mutex lock; //!< Protects every field below
+    GH_Cond cond; //!< Signalled when work is queued or on shutdown
+    struct LoadJob *inflight[LOADER_INFLIGHT_BUCKETS]; //!< Jobs queued or running, by path hash
+    struct LoadJob *queue_head; //!< Next job to run
+    struct LoadJob *queue_tail; //!< Last queued job
+    GH_Thread *threads; //!< Loader threads
+    int thread_count; //!< Number of loader threads, 0 if loads run inline
+    bool stopping; //!< Set by GH_LoaderShutdown
+};
+
+// ============================================================================
+// Asynchronous, single-flight file loading
+// ============================================================================
+
+/**
+ * @brief Start the loader pool
+ * 
+ * @param loader Loader to initialize
+ * @param threads Number of loader threads; 0 loads inline on the requesting thread
+ * @return bool true on success, false if no thread could be started
+ */
+bool GH_LoaderInit(struct Loader *loader, int threads);
+
+/**
+ * @brief Stop the loader threads and drop queued jobs without waking their waiters
+ * 
+ * @param loader Loader to shut down
+ */
+void GH_LoaderShutdown(struct Loader *loader);
+
+/**
+ * @brief Load a file into the cache without blocking the event loop
+ * 
+ * Reads, stats, compresses and caches the file on a loader thread (files
+ * that stay uncached are hashed for their ETag there instead), then
+ * sends MG_EV_WAKEUP with a struct LoadResult to the connection. Requests for
+ * a path that is already being loaded join that load instead of reading the
+ * file again. The manager must have been set up with mg_wakeup_init.
+ * 
+ * @param loader Loader
+ * @param path File path
+ * @param mgr Event manager owning the connection
+ * @param conn_id Connection ID to wake
+ * @return bool true if the connection will be woken, false on allocation failure
+ */
+bool GH_LoaderRequest(struct Loader *loader, const char *path, struct mg_mgr *mgr,
+                      unsigned long conn_id);
+
+/**
+ * @brief Load a file into the cache in the background, with nobody waiting on it
+ * 
+ * Used to refresh changed files and to warm the cache. Joins an in-flight
+ * load of the same path if there is one.
+ * 
+ * @param loader Loader
+ * @param path File path
+ * @return bool true if a load is queued or running, false on allocation failure
+ */
+bool GH_LoaderPrefetch(struct Loader *loader, const char *path);
+
+// global
+extern struct Loader g_loader; //!< Global loader instance
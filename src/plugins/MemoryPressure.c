@@ -0,0 +1,174 @@
+#include "MemoryPressure.h"
+#include <mongoose.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ==============================================================================
+// Internal helpers
+// ==============================================================================
+
+#if defined(__linux__)
+#include <unistd.h>
+
+// cgroup v1 reports "no limit" as a page-rounded LONG_MAX; anything this large is unlimited
+#define MEMORY_UNLIMITED (1ULL << 62)
+
+// Read a small file into buf, NUL-terminated; false if it cannot be read
+static bool read_small(const char *path, char *buf, size_t len) {
+  FILE *fp = path[0] != '\0' ? fopen(path, "r") : NULL;
+  if (fp == NULL) {
+    return false;
+  }
+  size_t n = fread(buf, 1, len - 1, fp);
+  fclose(fp);
+  buf[n] = '\0';
+  return n > 0;
+}
+
+// Directory of this process's memory cgroup, v2 ("0::/path") preferred over v1
+// ("N:memory:/path"). Inside a cgroup namespace the path may not exist under
+// the mount, which then is the cgroup itself.
+static bool find_cgroup(char *dir, size_t len, bool *v2) {
+  char lines[4096];
+  if (!read_small("/proc/self/cgroup", lines, sizeof(lines))) {
+    return false;
+  }
+  const char *candidates[2][2] = {{"0::", "/sys/fs/cgroup"}, {":memory:", "/sys/fs/cgroup/memory"}};
+  for (int i = 0; i < 2; i++) {
+    const char *line = strstr(lines, candidates[i][0]);
+    if (line == NULL || (i == 0 && line != lines && line[-1] != '\n')) {
+      continue;
+    }
+    line += strlen(candidates[i][0]);
+    int path_len = (int) strcspn(line, "\n");
+    const char *probe = i == 0 ? "memory.max" : "memory.limit_in_bytes";
+    char file[MEMORY_PRESSURE_PATH_MAX];
+    mg_snprintf(dir, len, "%s%.*s", candidates[i][1], path_len, line);
+    mg_snprintf(file, sizeof(file), "%s/%s", dir, probe);
+    if (access(file, R_OK) != 0) {
+      mg_snprintf(dir, len, "%s", candidates[i][1]);
+      mg_snprintf(file, sizeof(file), "%s/%s", dir, probe);
+    }
+    if (access(file, R_OK) == 0) {
+      *v2 = i == 0;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Number in a cgroup file; "max" (v2) and huge values (v1) read as 0, unlimited
+static uint64_t read_bytes(const char *path, bool *ok) {
+  char buf[64];
+  *ok = read_small(path, buf, sizeof(buf));
+  if (!*ok || strncmp(buf, "max", 3) == 0) {
+    return 0;
+  }
+  uint64_t value = strtoull(buf, NULL, 10);
+  return value >= MEMORY_UNLIMITED ? 0 : value;
+}
+
+// Value of "<key> <number>" in memory.stat, 0 if absent
+static uint64_t stat_value(const char *stat, const char *key) {
+  size_t key_len = strlen(key);
+  for (const char *line = stat; line != NULL; line = strchr(line, '\n')) {
+    line += *line == '\n';
+    if (strncmp(line, key, key_len) == 0 && line[key_len] == ' ') {
+      return strtoull(line + key_len + 1, NULL, 10);
+    }
+  }
+  return 0;
+}
+
+// ==============================================================================
+// Public API
+// ==============================================================================
+
+bool GH_MemoryPressureInit(struct MemoryPressure *mp) {
+  memset(mp, 0, sizeof(*mp));
+  mp->some_avg10 = -1;
+
+  char dir[MEMORY_PRESSURE_PATH_MAX - 32];
+  bool v2 = false;
+  if (find_cgroup(dir, sizeof(dir), &v2)) {
+    mg_snprintf(mp->max_path, sizeof(mp->max_path), "%s/%s", dir, v2 ? "memory.max" : "memory.limit_in_bytes");
+    mg_snprintf(mp->current_path, sizeof(mp->current_path), "%s/%s", dir, v2 ? "memory.current" : "memory.usage_in_bytes");
+    mg_snprintf(mp->stat_path, sizeof(mp->stat_path), "%s/memory.stat", dir);
+    if (v2) {
+      mg_snprintf(mp->pressure_path, sizeof(mp->pressure_path), "%s/memory.pressure", dir);
+    }
+  }
+  // The cgroup's own pressure if it has one, else the whole system's
+  if (access(mp->pressure_path, R_OK) != 0) {
+    mg_snprintf(mp->pressure_path, sizeof(mp->pressure_path), "%s",
+                access("/proc/pressure/memory", R_OK) == 0 ? "/proc/pressure/memory" : "");
+  }
+  return GH_MemoryPressureSample(mp) && (mp->limit > 0 || mp->some_avg10 >= 0);
+}
+
+bool GH_MemoryPressureSample(struct MemoryPressure *mp) {
+  bool limit_ok = false, current_ok = false;
+  mp->limit = read_bytes(mp->max_path, &limit_ok);
+  uint64_t current = read_bytes(mp->current_path, &current_ok);
+
+  // Inactive page cache is reclaimed before anything else: not part of the working set
+  char stat[8192];
+  uint64_t inactive = 0;
+  if (read_small(mp->stat_path, stat, sizeof(stat))) {
+    inactive = stat_value(stat, "total_inactive_file");
+    inactive = inactive != 0 ? inactive : stat_value(stat, "inactive_file");
+  }
+  mp->working_set = current > inactive ? current - inactive : 0;
+
+  char pressure[256];
+  const char *avg10 = read_small(mp->pressure_path, pressure, sizeof(pressure)) ? strstr(pressure, "some avg10=") : NULL;
+  mp->some_avg10 = avg10 != NULL ? strtod(avg10 + strlen("some avg10="), NULL) : -1;
+  return (limit_ok && current_ok) || avg10 != NULL;
+}
+
+#else
+
+bool GH_MemoryPressureInit(struct MemoryPressure *mp) {
+  memset(mp, 0, sizeof(*mp));
+  mp->some_avg10 = -1;
+  return false;
+}
+
+bool GH_MemoryPressureSample(struct MemoryPressure *mp) {
+  (void) mp;
+  return false;
+}
+
+#endif
+
+size_t GH_MemoryPressureBudget(const struct MemoryPressure *mp, size_t budget, size_t cache_size, size_t min_size,
+                               size_t max_size) {
+  uint64_t high = mp->limit / 100 * CACHE_ADAPTIVE_HIGH_PERCENT;
+  uint64_t low = mp->limit / 100 * CACHE_ADAPTIVE_LOW_PERCENT;
+  size_t next = budget;
+
+  if ((mp->limit > 0 && mp->working_set > high) || mp->some_avg10 >= CACHE_ADAPTIVE_PSI_HIGH) {
+    // Short: back off multiplicatively, and at least by what the working set is over
+    next = budget - budget / 4;
+    uint64_t excess = mp->limit > 0 && mp->working_set > high ? mp->working_set - high : 0;
+    if (excess > 0 && cache_size > excess && cache_size - excess < next) {
+      next = (size_t) (cache_size - excess);
+    } else if (excess >= cache_size && excess > 0) {
+      next = min_size;
+    }
+  } else if ((mp->limit == 0 || mp->working_set < low) && mp->some_avg10 < CACHE_ADAPTIVE_PSI_LOW &&
+             cache_size >= budget / 100 * CACHE_ADAPTIVE_HIGH_PERCENT) {
+    // Calm and the cache uses what it has: grow additively, within the headroom left
+    uint64_t step = CACHE_ADAPTIVE_GROW_STEP;
+    if (mp->limit > 0 && low - mp->working_set < step) {
+      step = low - mp->working_set;
+    }
+    next = budget + (size_t) step;
+  }
+
+  if (next < min_size) {
+    next = min_size;
+  }
+  return next > max_size ? max_size : next;
+}
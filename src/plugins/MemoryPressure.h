@@ -0,0 +1,80 @@
+#pragma once
+#include <server/config.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef CACHE_ADAPTIVE_INTERVAL_MS
+#define CACHE_ADAPTIVE_INTERVAL_MS 1000  //!< Default time between memory readings in adaptive mode
+#endif
+#ifndef CACHE_ADAPTIVE_HIGH_PERCENT
+#define CACHE_ADAPTIVE_HIGH_PERCENT 90   //!< Default: the budget shrinks while the working set is above this share of the limit
+#endif
+#ifndef CACHE_ADAPTIVE_LOW_PERCENT
+#define CACHE_ADAPTIVE_LOW_PERCENT 75    //!< Default: the budget may grow while the working set stays below this share
+#endif
+#ifndef CACHE_ADAPTIVE_PSI_HIGH
+#define CACHE_ADAPTIVE_PSI_HIGH 10.0     //!< Default "some avg10" memory pressure (percent stalled) that shrinks the budget
+#endif
+#ifndef CACHE_ADAPTIVE_PSI_LOW
+#define CACHE_ADAPTIVE_PSI_LOW 1.0       //!< Default pressure below which the budget may grow
+#endif
+#ifndef CACHE_ADAPTIVE_GROW_STEP
+#define CACHE_ADAPTIVE_GROW_STEP (8 * 1024 * 1024)  //!< Default bytes the budget grows by per calm reading
+#endif
+
+#define MEMORY_PRESSURE_PATH_MAX 256     //!< Size of the cgroup file paths, terminator included
+
+//! Struct for the memory readings the adaptive cache budget follows
+struct MemoryPressure {
+    char max_path[MEMORY_PRESSURE_PATH_MAX]; //!< memory.max (v2) or memory.limit_in_bytes (v1), "" without a memory cgroup
+    char current_path[MEMORY_PRESSURE_PATH_MAX]; //!< memory.current (v2) or memory.usage_in_bytes (v1)
+    char stat_path[MEMORY_PRESSURE_PATH_MAX]; //!< memory.stat, for the reclaimable page cache
+    char pressure_path[MEMORY_PRESSURE_PATH_MAX]; //!< The cgroup's memory.pressure, else /proc/pressure/memory, "" without PSI
+    uint64_t limit; //!< Last memory.max read, 0 if unlimited or unknown
+    uint64_t working_set; //!< Last memory.current minus inactive file pages
+    double some_avg10; //!< Last PSI "some avg10": percent of the last 10s some task stalled on memory, -1 if unknown
+};
+
+// ============================================================================
+// Memory pressure: cgroup limits and PSI readings for the cache budget
+// ============================================================================
+
+/**
+ * @brief Find the cgroup and PSI files of this process
+ * 
+ * @param mp Readings to initialize
+ * @return bool true if there is a memory limit or PSI to follow; false
+ *              elsewhere (no memory cgroup, no PSI, not Linux)
+ */
+bool GH_MemoryPressureInit(struct MemoryPressure *mp);
+
+/**
+ * @brief Read the limit, the working set and the pressure again
+ * 
+ * A few small reads from cgroupfs/procfs; meant to run about once a second.
+ * 
+ * @param mp Readings to update
+ * @return bool true if at least one source could be read
+ */
+bool GH_MemoryPressureSample(struct MemoryPressure *mp);
+
+/**
+ * @brief Next cache budget for the last readings
+ * 
+ * Shrinks by a quarter while memory is short (working set over
+ * CACHE_ADAPTIVE_HIGH_PERCENT of the limit, or pressure over
+ * CACHE_ADAPTIVE_PSI_HIGH), at least to give the excess back; grows by
+ * CACHE_ADAPTIVE_GROW_STEP while it is plentiful and the cache fills its
+ * budget; else keeps it. The result stays within [min_size, max_size].
+ * 
+ * @param mp Readings from GH_MemoryPressureSample()
+ * @param budget Current budget in bytes
+ * @param cache_size Bytes the cache holds
+ * @param min_size Smallest budget
+ * @param max_size Largest budget
+ * @return size_t Budget to set, equal to budget if nothing changes
+ */
+size_t GH_MemoryPressureBudget(const struct MemoryPressure *mp, size_t budget, size_t cache_size, size_t min_size,
+                               size_t max_size);
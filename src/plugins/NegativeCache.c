@@ -0,0 +1,167 @@
+#include "NegativeCache.h"
+#include "CacheManager.h"
+#include <stdlib.h>
+#include <string.h>
+
+// ==============================================================================
+// Internal helpers
+// ==============================================================================
+
+//! Struct for a path's identity within the negative cache
+struct NegativeKey {
+  uint64_t hash;  //!< Path hash, never 0
+  uint32_t check; //!< CRC32 of the path
+  size_t set;     //!< Set the path maps to
+};
+
+static struct NegativeKey negative_key(const struct NegativeCache *neg, const char *path, size_t len,
+                                       uint64_t hash) {
+  struct NegativeKey key;
+  key.hash = hash;
+  key.hash += key.hash == 0;  // 0 marks a free slot
+  key.check = mg_crc32(0, path, len);
+  // FNV-1a leaves short, similar paths clustered in a few bit ranges; mix before picking a set
+  uint64_t mixed = (key.hash ^ (key.hash >> 33)) * 0xff51afd7ed558ccdULL;
+  key.set = (size_t) (mixed ^ (mixed >> 33)) & neg->set_mask;
+  return key;
+}
+
+static GH_Mutex *negative_lock(struct NegativeCache *neg, size_t set) {
+  return &neg->locks[set & (NEGATIVE_CACHE_LOCKS - 1)];
+}
+
+static struct NegativeSlot *negative_set(struct NegativeCache *neg, size_t set) {
+  return &neg->slots[set * NEGATIVE_CACHE_WAYS];
+}
+
+static bool slot_matches(const struct NegativeSlot *slot, const struct NegativeKey *key) {
+  return slot->hash == key->hash && slot->check == key->check;
+}
+
+// ==============================================================================
+// Public API
+// ==============================================================================
+
+bool GH_NegativeCacheInit(struct NegativeCache *neg, size_t entries, uint64_t ttl_ms) {
+  memset(neg, 0, sizeof(*neg));
+  for (size_t i = 0; i < NEGATIVE_CACHE_LOCKS; i++) {
+    GH_MutexInit(&neg->locks[i]);
+  }
+  neg->ttl_ms = ttl_ms;
+  if (entries == 0 || ttl_ms == 0) {
+    return true;
+  }
+
+  size_t sets = 1;
+  while (sets * 2 * NEGATIVE_CACHE_WAYS <= entries) {
+    sets *= 2;
+  }
+  neg->slots = calloc(sets * NEGATIVE_CACHE_WAYS, sizeof(struct NegativeSlot));
+  if (neg->slots == NULL) {
+    return false;
+  }
+  neg->set_mask = sets - 1;
+  return true;
+}
+
+void GH_NegativeCacheCleanup(struct NegativeCache *neg) {
+  free(neg->slots);
+  neg->slots = NULL;
+  for (size_t i = 0; i < NEGATIVE_CACHE_LOCKS; i++) {
+    GH_MutexDestroy(&neg->locks[i]);
+  }
+}
+
+bool GH_NegativeCacheContains(struct NegativeCache *neg, const char *path, uint64_t now) {
+  size_t len = strlen(path);
+  return GH_NegativeCacheContainsHashed(neg, path, len, GH_CacheHash(path, len), now);
+}
+
+bool GH_NegativeCacheContainsHashed(struct NegativeCache *neg, const char *path, size_t len, uint64_t hash,
+                                    uint64_t now) {
+  if (neg->slots == NULL) {
+    return false;
+  }
+
+  struct NegativeKey key = negative_key(neg, path, len, hash);
+  struct NegativeSlot *set = negative_set(neg, key.set);
+  bool found = false;
+  GH_MutexLock(negative_lock(neg, key.set));
+  for (size_t i = 0; i < NEGATIVE_CACHE_WAYS; i++) {
+    if (slot_matches(&set[i], &key)) {
+      found = now < set[i].expires;
+      break;
+    }
+  }
+  GH_MutexUnlock(negative_lock(neg, key.set));
+  return found;
+}
+
+size_t GH_NegativeCacheGeneration(struct NegativeCache *neg) {
+  return GH_AtomicLoadSize(&neg->generation);
+}
+
+bool GH_NegativeCacheInsert(struct NegativeCache *neg, const char *path, size_t generation, uint64_t now) {
+  if (neg->slots == NULL) {
+    return false;
+  }
+
+  size_t len = strlen(path);
+  struct NegativeKey key = negative_key(neg, path, len, GH_CacheHash(path, len));
+  struct NegativeSlot *set = negative_set(neg, key.set);
+  bool inserted = false;
+  GH_MutexLock(negative_lock(neg, key.set));
+  if (GH_AtomicLoadSize(&neg->generation) == generation) {
+    // Refresh the path's slot, else take a free or expired one, else the soonest to expire
+    struct NegativeSlot *target = &set[0];
+    for (size_t i = 0; i < NEGATIVE_CACHE_WAYS; i++) {
+      if (slot_matches(&set[i], &key)) {
+        target = &set[i];
+        break;
+      }
+      if (set[i].expires < target->expires) {
+        target = &set[i];
+      }
+    }
+    target->hash = key.hash;
+    target->check = key.check;
+    target->expires = now + neg->ttl_ms;
+    inserted = true;
+  }
+  GH_MutexUnlock(negative_lock(neg, key.set));
+  return inserted;
+}
+
+void GH_NegativeCacheRemove(struct NegativeCache *neg, const char *path) {
+  GH_AtomicAddSize(&neg->generation, 1);
+  if (neg->slots == NULL) {
+    return;
+  }
+
+  size_t len = strlen(path);
+  struct NegativeKey key = negative_key(neg, path, len, GH_CacheHash(path, len));
+  struct NegativeSlot *set = negative_set(neg, key.set);
+  GH_MutexLock(negative_lock(neg, key.set));
+  for (size_t i = 0; i < NEGATIVE_CACHE_WAYS; i++) {
+    if (slot_matches(&set[i], &key)) {
+      memset(&set[i], 0, sizeof(set[i]));
+    }
+  }
+  GH_MutexUnlock(negative_lock(neg, key.set));
+}
+
+void GH_NegativeCacheClear(struct NegativeCache *neg) {
+  GH_AtomicAddSize(&neg->generation, 1);
+  if (neg->slots == NULL) {
+    return;
+  }
+
+  // Sets are striped over the locks, so each stripe is cleared under its own lock
+  for (size_t stripe = 0; stripe < NEGATIVE_CACHE_LOCKS; stripe++) {
+    GH_MutexLock(&neg->locks[stripe]);
+    for (size_t set = stripe; set <= neg->set_mask; set += NEGATIVE_CACHE_LOCKS) {
+      memset(negative_set(neg, set), 0, NEGATIVE_CACHE_WAYS * sizeof(struct NegativeSlot));
+    }
+    GH_MutexUnlock(&neg->locks[stripe]);
+  }
+}
@@ -0,0 +1,113 @@
+#pragma once
+#include <server/config.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <utils/Sync.h>
+
+#ifndef NEGATIVE_CACHE_ENTRIES
+#define NEGATIVE_CACHE_ENTRIES 8192   //!< Default capacity in missing paths (power of two)
+#endif
+#ifndef NEGATIVE_CACHE_TTL_MS
+#define NEGATIVE_CACHE_TTL_MS 2000    //!< Default lifetime of a negative entry: 2 seconds
+#endif
+
+#define NEGATIVE_CACHE_WAYS 4         //!< Slots per set; a full set replaces its soonest-expiring slot
+#define NEGATIVE_CACHE_LOCKS 16       //!< Lock stripes over the sets (power of two)
+
+//! Struct for one remembered missing path (identified by two independent hashes)
+struct NegativeSlot {
+    uint64_t hash; //!< Path hash (GH_CacheHash), 0 if the slot is free
+    uint32_t check; //!< CRC32 of the path, guards against hash collisions
+    uint64_t expires; //!< Expiry timestamp in milliseconds
+};
+
+//! Struct for a bounded, set-associative cache of paths known not to exist
+struct NegativeCache {
+    struct NegativeSlot *slots; //!< Sets of NEGATIVE_CACHE_WAYS slots, NULL if disabled
+    size_t set_mask; //!< Number of sets minus one
+    uint64_t ttl_ms; //!< Lifetime of an entry
+    GH_Mutex locks[NEGATIVE_CACHE_LOCKS]; //!< Lock stripes, chosen by set index
+    size_t generation; //!< Bumped by every invalidation (atomic)
+};
+
+/**
+ * @brief Initialize a negative cache
+ * 
+ * @param neg Negative cache to initialize
+ * @param entries Capacity in paths (rounded down to a power of two), 0 to disable
+ * @param ttl_ms Lifetime of an entry in milliseconds
+ * @return bool true on success, false if the slots could not be allocated
+ */
+bool GH_NegativeCacheInit(struct NegativeCache *neg, size_t entries, uint64_t ttl_ms);
+
+/**
+ * @brief Free the slots and locks of a negative cache
+ * 
+ * @param neg Negative cache
+ */
+void GH_NegativeCacheCleanup(struct NegativeCache *neg);
+
+/**
+ * @brief Check whether a path is remembered as missing
+ * 
+ * @param neg Negative cache
+ * @param path File path
+ * @param now Current timestamp in milliseconds
+ * @return bool true if the path was missing less than the TTL ago
+ */
+bool GH_NegativeCacheContains(struct NegativeCache *neg, const char *path, uint64_t now);
+
+/**
+ * @brief GH_NegativeCacheContains with the path's length and GH_CacheHash already known
+ * 
+ * @param neg Negative cache
+ * @param path File path
+ * @param len Length of path
+ * @param hash GH_CacheHash(path, len)
+ * @param now Current timestamp in milliseconds
+ * @return bool true if the path was missing less than the TTL ago
+ */
+bool GH_NegativeCacheContainsHashed(struct NegativeCache *neg, const char *path, size_t len, uint64_t hash,
+                                    uint64_t now);
+
+/**
+ * @brief Current invalidation generation, to read before looking for a file
+ * 
+ * @param neg Negative cache
+ * @return size_t Generation to pass to GH_NegativeCacheInsert
+ */
+size_t GH_NegativeCacheGeneration(struct NegativeCache *neg);
+
+/**
+ * @brief Remember a path as missing
+ * 
+ * Dropped if any invalidation happened since generation was read, so a file
+ * created while it was being looked for is never hidden.
+ * 
+ * @param neg Negative cache
+ * @param path File path that was not found
+ * @param generation Value of GH_NegativeCacheGeneration from before the lookup
+ * @param now Current timestamp in milliseconds
+ * @return bool true if remembered
+ */
+bool GH_NegativeCacheInsert(struct NegativeCache *neg, const char *path, size_t generation, uint64_t now);
+
+/**
+ * @brief Forget a path, e.g. because the file appeared
+ * 
+ * @param neg Negative cache
+ * @param path File path
+ */
+void GH_NegativeCacheRemove(struct NegativeCache *neg, const char *path);
+
+/**
+ * @brief Forget every path
+ * 
+ * @param neg Negative cache
+ */
+void GH_NegativeCacheClear(struct NegativeCache *neg);
+
+// global
+extern struct NegativeCache g_negative; //!< Global negative cache instance
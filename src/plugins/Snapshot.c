@@ -0,0 +1,411 @@
+#include "Snapshot.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Bodies start on this boundary so they can be handed to the kernel efficiently
+#define SNAPSHOT_ALIGN 16
+
+// ==============================================================================
+// Internal helpers
+// ==============================================================================
+
+static bool map_file(struct Snapshot *snap, const char *file) {
+#if defined(_WIN32)
+  HANDLE fh = CreateFileA(file, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                          FILE_ATTRIBUTE_NORMAL, NULL);
+  if (fh == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+  LARGE_INTEGER size;
+  HANDLE mapping = GetFileSizeEx(fh, &size) && size.QuadPart > 0
+                       ? CreateFileMappingA(fh, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+  CloseHandle(fh);
+  if (mapping == NULL) {
+    return false;
+  }
+  snap->base = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if (snap->base == NULL) {
+    CloseHandle(mapping);
+    return false;
+  }
+  snap->mapping = mapping;
+  snap->size = (size_t) size.QuadPart;
+#else
+  int fd = open(file, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+    close(fd);
+    return false;
+  }
+  void *base = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);  // The mapping keeps the file alive
+  if (base == MAP_FAILED) {
+    return false;
+  }
+  snap->base = base;
+  snap->size = (size_t) st.st_size;
+#endif
+  return true;
+}
+
+static void unmap_file(struct Snapshot *snap) {
+#if defined(_WIN32)
+  UnmapViewOfFile(snap->base);
+  CloseHandle(snap->mapping);
+#else
+  munmap((void *) snap->base, snap->size);
+#endif
+}
+
+// A blob must lie inside the file; strings must also be followed by their NUL
+static bool blob_ok(const struct Snapshot *snap, const struct SnapshotBlob *blob, bool string) {
+  uint64_t end = blob->offset + blob->len + (string ? 1 : 0);
+  if (end < blob->offset || end > snap->size) {
+    return false;
+  }
+  return !string || snap->base[blob->offset + blob->len] == '\0';
+}
+
+static bool blob_zero(const struct SnapshotBlob *blob) {
+  return blob->offset == 0 && blob->len == 0;
+}
+
+// A present representation has every blob inside the file; an absent one (an
+// encoding that was not packed) is all zero, and the identity one is required.
+// Offset 0 is the header, never a blob.
+static bool repr_ok(const struct Snapshot *snap, const struct SnapshotRepr *repr, bool required) {
+  if (repr->data.offset == 0) {
+    return !required && blob_zero(&repr->data) && blob_zero(&repr->etag) && blob_zero(&repr->ok) &&
+           blob_zero(&repr->not_modified);
+  }
+  return blob_ok(snap, &repr->data, false) && blob_ok(snap, &repr->etag, true) &&
+         blob_ok(snap, &repr->ok, true) && blob_ok(snap, &repr->not_modified, true);
+}
+
+static char *blob_ptr(const struct Snapshot *snap, const struct SnapshotBlob *blob) {
+  return (char *) snap->base + blob->offset;
+}
+
+static void repr_to_headers(const struct Snapshot *snap, const struct SnapshotRepr *repr,
+                            struct CacheHeaders *headers) {
+  headers->ok = blob_ptr(snap, &repr->ok);
+  headers->ok_len = (size_t) repr->ok.len;
+  headers->not_modified = blob_ptr(snap, &repr->not_modified);
+  headers->not_modified_len = (size_t) repr->not_modified.len;
+}
+
+// Point an entry at a record's data; nothing is copied
+static void entry_from_record(const struct Snapshot *snap, const struct SnapshotRecord *rec,
+                              struct CacheEntry *entry, uint64_t now) {
+  entry->path = blob_ptr(snap, &rec->path);
+  entry->path_len = (size_t) rec->path.len;
+  entry->hash = rec->hash;
+  entry->data = blob_ptr(snap, &rec->identity.data);
+  entry->data_len = (size_t) rec->identity.data.len;
+  entry->etag = rec->identity.etag.len ? blob_ptr(snap, &rec->identity.etag) : NULL;
+  entry->mtime = (time_t) rec->mtime;
+  entry->content_type = blob_ptr(snap, &rec->content_type);
+  repr_to_headers(snap, &rec->identity, &entry->headers);
+  for (int i = 0; i < CACHE_ENC_COUNT; i++) {
+    const struct SnapshotRepr *repr = &rec->encoded[i];
+    if (repr->data.offset == 0) {
+      continue;
+    }
+    entry->encoded[i].data = blob_ptr(snap, &repr->data);
+    entry->encoded[i].data_len = (size_t) repr->data.len;
+    entry->encoded[i].etag = repr->etag.len ? blob_ptr(snap, &repr->etag) : NULL;
+    repr_to_headers(snap, repr, &entry->encoded[i].headers);
+  }
+  entry->timestamp = now;
+  entry->validated = now;
+  entry->refs = 1;  // Held by the snapshot, so GH_CacheRelease never frees it
+}
+
+// Index of the current record for path, or SIZE_MAX
+static size_t snapshot_find(const struct Snapshot *snap, const char *path, size_t path_len, uint64_t hash) {
+  if (snap->base == NULL) {
+    return SIZE_MAX;
+  }
+
+  // Lower bound on the hash-sorted index
+  size_t lo = 0, hi = snap->count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (snap->records[mid].hash < hash) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  for (size_t i = lo; i < snap->count && snap->records[i].hash == hash; i++) {
+    const struct SnapshotRecord *rec = &snap->records[i];
+    if (rec->path.len == path_len && memcmp(snap->base + rec->path.offset, path, path_len) == 0) {
+      return GH_AtomicLoadInt(&snap->stale[i]) ? SIZE_MAX : i;
+    }
+  }
+  return SIZE_MAX;
+}
+
+// ==============================================================================
+// Serving
+// ==============================================================================
+
+bool GH_SnapshotOpen(struct Snapshot *snap, const char *file) {
+  memset(snap, 0, sizeof(*snap));
+  if (file == NULL || file[0] == '\0' || !map_file(snap, file)) {
+    return false;
+  }
+
+  const struct SnapshotHeader *header = (const struct SnapshotHeader *) snap->base;
+  if (snap->size < sizeof(*header) || memcmp(header->magic, GH_SNAPSHOT_MAGIC, 8) != 0 ||
+      header->version != GH_SNAPSHOT_VERSION || header->byte_order != GH_SNAPSHOT_BYTE_ORDER ||
+      header->file_size != snap->size || header->index_offset % sizeof(uint64_t) != 0 ||
+      header->index_offset > snap->size ||
+      header->record_count > (snap->size - header->index_offset) / sizeof(struct SnapshotRecord)) {
+    MG_ERROR(("%s: not a valid snapshot", file));
+    GH_SnapshotClose(snap);
+    return false;
+  }
+  snap->records = (const struct SnapshotRecord *) (snap->base + header->index_offset);
+  snap->count = (size_t) header->record_count;
+
+  snap->entries = calloc(snap->count ? snap->count : 1, sizeof(struct CacheEntry));
+  snap->stale = calloc(snap->count ? snap->count : 1, sizeof(int));
+  if (snap->entries == NULL || snap->stale == NULL) {
+    GH_SnapshotClose(snap);
+    return false;
+  }
+
+  uint64_t now = mg_millis();
+  for (size_t i = 0; i < snap->count; i++) {
+    const struct SnapshotRecord *rec = &snap->records[i];
+    bool ok = blob_ok(snap, &rec->path, true) && blob_ok(snap, &rec->content_type, true) &&
+              repr_ok(snap, &rec->identity, true) && (i == 0 || rec->hash >= snap->records[i - 1].hash);
+    for (int e = 0; ok && e < CACHE_ENC_COUNT; e++) {
+      ok = repr_ok(snap, &rec->encoded[e], false);
+    }
+    if (!ok) {
+      MG_ERROR(("%s: corrupt record %lu", file, (unsigned long) i));
+      GH_SnapshotClose(snap);
+      return false;
+    }
+    entry_from_record(snap, rec, &snap->entries[i], now);
+  }
+  return true;
+}
+
+void GH_SnapshotClose(struct Snapshot *snap) {
+  if (snap->base != NULL) {
+    unmap_file(snap);
+  }
+  free(snap->entries);
+  free(snap->stale);
+  memset(snap, 0, sizeof(*snap));
+}
+
+struct CacheEntry* GH_SnapshotAcquire(struct Snapshot *snap, const char *path) {
+  size_t path_len = strlen(path);
+  return GH_SnapshotAcquireHashed(snap, path, path_len, GH_CacheHash(path, path_len));
+}
+
+struct CacheEntry* GH_SnapshotAcquireHashed(struct Snapshot *snap, const char *path, size_t path_len,
+                                            uint64_t hash) {
+  size_t index = snapshot_find(snap, path, path_len, hash);
+  if (index == SIZE_MAX) {
+    return NULL;
+  }
+  GH_CacheRetain(&snap->entries[index]);
+  return &snap->entries[index];
+}
+
+bool GH_SnapshotContains(struct Snapshot *snap, const char *path) {
+  size_t path_len = strlen(path);
+  return snapshot_find(snap, path, path_len, GH_CacheHash(path, path_len)) != SIZE_MAX;
+}
+
+bool GH_SnapshotInvalidate(struct Snapshot *snap, const char *path) {
+  size_t path_len = strlen(path);
+  size_t index = snapshot_find(snap, path, path_len, GH_CacheHash(path, path_len));
+  if (index == SIZE_MAX) {
+    return false;
+  }
+  GH_AtomicStoreInt(&snap->stale[index], 1);
+  return true;
+}
+
+size_t GH_SnapshotRevalidate(struct Snapshot *snap) {
+  size_t stale = 0;
+  for (size_t i = 0; i < snap->count; i++) {
+    const struct CacheEntry *entry = &snap->entries[i];
+    size_t size = 0;
+    time_t mtime = 0;
+    if (mg_fs_posix.st(entry->path, &size, &mtime) == 0 || mtime != entry->mtime || size != entry->data_len) {
+      GH_AtomicStoreInt(&snap->stale[i], 1);
+      stale++;
+    }
+  }
+  return stale;
+}
+
+// ==============================================================================
+// Building
+// ==============================================================================
+
+static bool writer_put(struct SnapshotWriter *writer, const void *data, size_t len) {
+  if (len > 0 && fwrite(data, 1, len, writer->fp) != len) {
+    return false;
+  }
+  writer->offset += len;
+  return true;
+}
+
+static bool writer_align(struct SnapshotWriter *writer, size_t align) {
+  static const char zeros[SNAPSHOT_ALIGN] = {0};
+  size_t pad = (size_t) ((align - writer->offset % align) % align);
+  return writer_put(writer, zeros, pad);
+}
+
+// Write bytes, NUL-terminated for strings; a NULL string yields an empty one
+static bool writer_blob(struct SnapshotWriter *writer, const char *data, size_t len, bool string,
+                        struct SnapshotBlob *out) {
+  if (!string && !writer_align(writer, SNAPSHOT_ALIGN)) {
+    return false;
+  }
+  out->offset = writer->offset;
+  out->len = len;
+  return writer_put(writer, data != NULL ? data : "", len) && (!string || writer_put(writer, "", 1));
+}
+
+static bool writer_repr(struct SnapshotWriter *writer, const char *data, size_t data_len,
+                        const char *etag, const struct CacheHeaders *headers,
+                        struct SnapshotRepr *out) {
+  return writer_blob(writer, data, data_len, false, &out->data) &&
+         writer_blob(writer, etag, etag ? strlen(etag) : 0, true, &out->etag) &&
+         writer_blob(writer, headers->ok, headers->ok_len, true, &out->ok) &&
+         writer_blob(writer, headers->not_modified, headers->not_modified_len, true, &out->not_modified);
+}
+
+static int compare_records(const void *a, const void *b) {
+  const struct SnapshotRecord *x = a, *y = b;
+  return x->hash < y->hash ? -1 : x->hash > y->hash;
+}
+
+bool GH_SnapshotWriterOpen(struct SnapshotWriter *writer, const char *file) {
+  memset(writer, 0, sizeof(*writer));
+  writer->fp = fopen(file, "wb");
+  if (writer->fp == NULL) {
+    return false;
+  }
+
+  // Placeholder header, rewritten by GH_SnapshotWriterFinish
+  struct SnapshotHeader header;
+  memset(&header, 0, sizeof(header));
+  return writer_put(writer, &header, sizeof(header));
+}
+
+bool GH_SnapshotWriterAdd(struct SnapshotWriter *writer, const struct CacheEntry *entry) {
+  if (writer->count == writer->capacity) {
+    size_t capacity = writer->capacity ? writer->capacity * 2 : 256;
+    struct SnapshotRecord *records = realloc(writer->records, capacity * sizeof(*records));
+    if (records == NULL) {
+      return false;
+    }
+    writer->records = records;
+    writer->capacity = capacity;
+  }
+
+  struct SnapshotRecord *rec = &writer->records[writer->count];
+  memset(rec, 0, sizeof(*rec));
+  rec->hash = entry->hash;
+  rec->mtime = (int64_t) entry->mtime;
+  const char *content_type = entry->content_type ? entry->content_type : "application/octet-stream";
+  if (!writer_blob(writer, entry->path, entry->path_len, true, &rec->path) ||
+      !writer_blob(writer, content_type, strlen(content_type), true, &rec->content_type) ||
+      !writer_repr(writer, entry->data, entry->data_len, entry->etag, &entry->headers, &rec->identity)) {
+    return false;
+  }
+  for (int i = 0; i < CACHE_ENC_COUNT; i++) {
+    const struct CacheVariant *variant = &entry->encoded[i];
+    if (variant->data != NULL &&
+        !writer_repr(writer, variant->data, variant->data_len, variant->etag, &variant->headers,
+                     &rec->encoded[i])) {
+      return false;
+    }
+  }
+  writer->count++;
+  return true;
+}
+
+bool GH_SnapshotWriterFinish(struct SnapshotWriter *writer) {
+  qsort(writer->records, writer->count, sizeof(*writer->records), compare_records);
+
+  struct SnapshotHeader header;
+  memset(&header, 0, sizeof(header));
+  bool ok = writer_align(writer, sizeof(uint64_t));
+  header.index_offset = writer->offset;
+  ok = ok && writer_put(writer, writer->records, writer->count * sizeof(*writer->records));
+
+  memcpy(header.magic, GH_SNAPSHOT_MAGIC, 8);
+  header.version = GH_SNAPSHOT_VERSION;
+  header.byte_order = GH_SNAPSHOT_BYTE_ORDER;
+  header.record_count = writer->count;
+  header.file_size = writer->offset;
+  ok = ok && fseek(writer->fp, 0, SEEK_SET) == 0 &&
+       fwrite(&header, 1, sizeof(header), writer->fp) == sizeof(header);
+  ok = fclose(writer->fp) == 0 && ok;
+
+  free(writer->records);
+  memset(writer, 0, sizeof(*writer));
+  return ok;
+}
+
+//! Struct for GH_SnapshotDump progress
+struct DumpState {
+    struct SnapshotWriter *writer; //!< Output
+    bool ok; //!< Cleared on the first write error
+};
+
+static bool dump_entry(struct CacheEntry *entry, void *arg) {
+  struct DumpState *state = (struct DumpState *) arg;
+  state->ok = GH_SnapshotWriterAdd(state->writer, entry);
+  return state->ok;
+}
+
+bool GH_SnapshotDump(const char *file, struct CacheBucket *cache, struct Snapshot *snap, size_t *count) {
+  char tmp[512];
+  struct SnapshotWriter writer;
+  struct DumpState state = {&writer, true};
+  mg_snprintf(tmp, sizeof(tmp), "%s.tmp", file);
+  if (!GH_SnapshotWriterOpen(&writer, tmp)) {
+    return false;
+  }
+
+  GH_CacheForEach(cache, dump_entry, &state);
+  for (size_t i = 0; state.ok && i < snap->count; i++) {
+    // Files the cache holds were written above, as last loaded
+    struct CacheEntry *entry = &snap->entries[i];
+    if (!GH_AtomicLoadInt(&snap->stale[i]) && !GH_CacheExists(cache, entry->path)) {
+      state.ok = GH_SnapshotWriterAdd(&writer, entry);
+    }
+  }
+  *count = writer.count;
+
+  // Renamed over the old file, whose inode lives on in whoever still maps it
+  bool ok = GH_SnapshotWriterFinish(&writer) && state.ok && rename(tmp, file) == 0;
+  if (!ok) {
+    remove(tmp);
+  }
+  return ok;
+}
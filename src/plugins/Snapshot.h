@@ -0,0 +1,201 @@
+#pragma once
+#include <server/config.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <mongoose.h>
+#include "CacheManager.h"
+
+#ifndef APP_SNAPSHOT_PATH
+#define APP_SNAPSHOT_PATH ""          //!< Default packed snapshot to map at startup, "" for none
+#endif
+
+#define GH_SNAPSHOT_MAGIC "GHSNAP01"  //!< File magic, 8 bytes without NUL
+#define GH_SNAPSHOT_VERSION 1         //!< Format version
+#define GH_SNAPSHOT_BYTE_ORDER 0x01020304u  //!< Written natively; a mismatch means another endianness
+#define GH_SNAPSHOT_EXTENSION ".ghsnap"     //!< Snapshot files are never packed into snapshots
+
+// ============================================================================
+// On-disk format: header, blobs, then the record index sorted by path hash.
+// All offsets are from the start of the file; strings are NUL-terminated and
+// their length excludes the NUL.
+// ============================================================================
+
+//! Struct for a byte range inside the snapshot file
+struct SnapshotBlob {
+    uint64_t offset; //!< Offset from the start of the file
+    uint64_t len; //!< Length in bytes
+};
+
+//! Struct for one stored representation of a file
+struct SnapshotRepr {
+    struct SnapshotBlob data; //!< Body, len 0 and offset 0 if the representation is absent
+    struct SnapshotBlob etag; //!< ETag string
+    struct SnapshotBlob ok; //!< Prebuilt 200 header block
+    struct SnapshotBlob not_modified; //!< Prebuilt 304 header block
+};
+
+//! Struct for one file in the index
+struct SnapshotRecord {
+    uint64_t hash; //!< GH_CacheHash of the path
+    int64_t mtime; //!< File modification time when packed
+    struct SnapshotBlob path; //!< Cache path ("./dir/file")
+    struct SnapshotBlob content_type; //!< Content-Type string
+    struct SnapshotRepr identity; //!< Uncompressed representation
+    struct SnapshotRepr encoded[CACHE_ENC_COUNT]; //!< Precompressed variants, by enum CacheEncoding
+};
+
+//! Struct for the file header
+struct SnapshotHeader {
+    char magic[8]; //!< GH_SNAPSHOT_MAGIC
+    uint32_t version; //!< GH_SNAPSHOT_VERSION
+    uint32_t byte_order; //!< GH_SNAPSHOT_BYTE_ORDER
+    uint64_t record_count; //!< Number of records in the index
+    uint64_t index_offset; //!< Offset of the record index
+    uint64_t file_size; //!< Total file size, guards against truncation
+};
+
+//! Struct for a mapped snapshot
+struct Snapshot {
+    const char *base; //!< Mapped file, NULL if no snapshot is loaded
+    size_t size; //!< Mapped size
+    const struct SnapshotRecord *records; //!< Record index inside the mapping
+    size_t count; //!< Number of records
+    struct CacheEntry *entries; //!< One pinned entry per record, bodies point into the mapping
+    int *stale; //!< Per record: set once the file changed on disk (atomic)
+#if defined(_WIN32)
+    void *mapping; //!< File mapping handle
+#endif
+};
+
+//! Struct for building a snapshot file
+struct SnapshotWriter {
+    FILE *fp; //!< Output file
+    uint64_t offset; //!< Current write offset
+    struct SnapshotRecord *records; //!< Records written so far
+    size_t count; //!< Number of records
+    size_t capacity; //!< Capacity of records
+};
+
+// ============================================================================
+// Serving from a mapped snapshot
+// ============================================================================
+
+/**
+ * @brief Map a snapshot file and index it
+ * 
+ * Only the index is validated and one entry struct per file allocated; file
+ * bodies and headers stay in the mapping and are paged in on first use.
+ * 
+ * @param snap Snapshot to open
+ * @param file Snapshot file path
+ * @return bool true on success, false if the file is missing or malformed
+ */
+bool GH_SnapshotOpen(struct Snapshot *snap, const char *file);
+
+/**
+ * @brief Unmap a snapshot; no entry of it may be pinned anymore
+ * 
+ * @param snap Snapshot to close
+ */
+void GH_SnapshotClose(struct Snapshot *snap);
+
+/**
+ * @brief Retrieve and pin the entry for a path
+ * 
+ * @param snap Snapshot
+ * @param path Cache path
+ * @return Pinned entry (release with GH_CacheRelease), NULL if absent or stale
+ */
+struct CacheEntry* GH_SnapshotAcquire(struct Snapshot *snap, const char *path);
+
+/**
+ * @brief GH_SnapshotAcquire with the path's length and GH_CacheHash already known
+ * 
+ * @param snap Snapshot
+ * @param path Cache path
+ * @param path_len Length of path
+ * @param hash GH_CacheHash(path, path_len)
+ * @return Pinned entry (release with GH_CacheRelease), NULL if absent or stale
+ */
+struct CacheEntry* GH_SnapshotAcquireHashed(struct Snapshot *snap, const char *path, size_t path_len,
+                                            uint64_t hash);
+
+/**
+ * @brief Check whether a path is served from the snapshot
+ * 
+ * @param snap Snapshot
+ * @param path Cache path
+ * @return bool true if the snapshot holds a current entry for path
+ */
+bool GH_SnapshotContains(struct Snapshot *snap, const char *path);
+
+/**
+ * @brief Stop serving a path from the snapshot because the file changed on disk
+ * 
+ * @param snap Snapshot
+ * @param path Cache path
+ * @return bool true if the snapshot held a current entry for path
+ */
+bool GH_SnapshotInvalidate(struct Snapshot *snap, const char *path);
+
+/**
+ * @brief Stop serving records whose file changed or vanished since they were written
+ * 
+ * One stat per record, comparing mtime and size; meant for snapshots written
+ * by a running server (GH_SnapshotDump), right after the file watcher started.
+ * 
+ * @param snap Snapshot
+ * @return size_t Records marked stale
+ */
+size_t GH_SnapshotRevalidate(struct Snapshot *snap);
+
+// ============================================================================
+// Building snapshots (offline packer, hot restart)
+// ============================================================================
+
+/**
+ * @brief Start writing a snapshot file
+ * 
+ * @param writer Writer to initialize
+ * @param file Output path
+ * @return bool true on success
+ */
+bool GH_SnapshotWriterOpen(struct SnapshotWriter *writer, const char *file);
+
+/**
+ * @brief Append a cache entry (body, variants, ETags and prebuilt headers)
+ * 
+ * @param writer Writer
+ * @param entry Pinned cache entry
+ * @return bool true on success, false on write error
+ */
+bool GH_SnapshotWriterAdd(struct SnapshotWriter *writer, const struct CacheEntry *entry);
+
+/**
+ * @brief Write the index and header, then close the file
+ * 
+ * @param writer Writer
+ * @return bool true on success
+ */
+bool GH_SnapshotWriterFinish(struct SnapshotWriter *writer);
+
+/**
+ * @brief Write a live cache to a snapshot file, so another process can map it
+ * 
+ * Every cache entry is written, then the current records of snap that the
+ * cache does not hold. The file is written under "<file>.tmp" and renamed into
+ * place: a process still mapping an earlier file keeps serving from it.
+ * 
+ * @param file Output path
+ * @param cache Cache to write; it stays in use meanwhile
+ * @param snap Snapshot mapped by this process (may be empty)
+ * @param count Receives the number of files written
+ * @return bool true on success
+ */
+bool GH_SnapshotDump(const char *file, struct CacheBucket *cache, struct Snapshot *snap, size_t *count);
+
+// global
+extern struct Snapshot g_snapshot; //!< Global snapshot instance, empty if none is loaded
@@ -0,0 +1,92 @@
+#include "Warmup.h"
+#include "CacheManager.h"
+#include "Loader.h"
+#include "Snapshot.h"
+#include "utils/Utils.h"
+#include <stdlib.h>
+#include <string.h>
+
+//! Struct for warmup progress against the cache budget
+struct WarmupState {
+    size_t budget; //!< Bytes that may still be queued
+    size_t queued; //!< Files queued
+};
+
+static struct mg_str trim_spaces(struct mg_str s) {
+  while (s.len > 0 && (s.buf[0] == ' ' || s.buf[0] == '\t')) s.buf++, s.len--;
+  while (s.len > 0 && (s.buf[s.len - 1] == ' ' || s.buf[s.len - 1] == '\t' || s.buf[s.len - 1] == '\r')) s.len--;
+  return s;
+}
+
+// Turn "dir/file", "/dir/file" or "./dir/file" into the cache key "./dir/file"
+static bool make_key(struct mg_str item, char *key, size_t key_len) {
+  if (item.len >= 2 && item.buf[0] == '.' && item.buf[1] == '/') {
+    item.buf += 2, item.len -= 2;
+  }
+  while (item.len > 0 && item.buf[0] == '/') {
+    item.buf++, item.len--;
+  }
+  if (item.len == 0 || (item.len == 1 && item.buf[0] == '.')) {
+    return mg_snprintf(key, key_len, ".") < key_len;  // The served root itself
+  }
+  size_t n = mg_snprintf(key, key_len, "./%.*s", (int) item.len, item.buf);
+  return n < key_len;
+}
+
+static void warmup_file(const char *path, size_t size, time_t mtime, void *arg) {
+  struct WarmupState *state = (struct WarmupState *) arg;
+  (void) mtime;
+  if (size > state->budget || !GH_CacheAdmits(&g_cache, size) || GH_SnapshotContains(&g_snapshot, path) || GH_CacheExists(&g_cache, path)) {
+    return;
+  }
+  if (GH_LoaderPrefetch(&g_loader, path)) {
+    state->budget -= size;
+    state->queued++;
+  }
+}
+
+static void warmup_manifest(const char *manifest, struct WarmupState *state) {
+  struct mg_str data = mg_file_read(&mg_fs_posix, manifest);
+  if (data.buf == NULL) {
+    MG_ERROR(("Cannot read warmup manifest %s", manifest));
+    return;
+  }
+
+  struct mg_str rest = data, line;
+  while (mg_span(rest, &line, &rest, '\n')) {
+    line = trim_spaces(line);
+    char key[256];
+    size_t size = 0;
+    time_t mtime = 0;
+    if (line.len == 0 || line.buf[0] == '#' || !make_key(line, key, sizeof(key))) {
+      continue;
+    }
+    int flags = mg_fs_posix.st(key, &size, &mtime);
+    if (flags != 0 && !(flags & MG_FS_DIR)) {
+      warmup_file(key, size, mtime, state);
+    }
+  }
+  free((void *) data.buf);
+}
+
+size_t GH_WarmupPreload(const char *spec) {
+  struct WarmupState state = {GH_CacheBudget(&g_cache), 0};
+  struct mg_str rest = mg_str(spec != NULL ? spec : ""), item;
+  while (mg_span(rest, &item, &rest, ',')) {
+    item = trim_spaces(item);
+    char key[256];
+    if (item.len == 0 || !make_key(item, key, sizeof(key))) {
+      continue;
+    }
+
+    int flags = mg_fs_posix.st(key, NULL, NULL);
+    if (flags & MG_FS_DIR) {
+      WalkFiles(key, warmup_file, &state);
+    } else if (flags != 0) {
+      warmup_manifest(key, &state);
+    } else {
+      MG_ERROR(("Warmup path not found: %s", key));
+    }
+  }
+  return state.queued;
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <server/config.h>
+
+#include <stddef.h>
+
+#ifndef APP_WARMUP_PATHS
+#define APP_WARMUP_PATHS ""           //!< Default comma-separated directories or manifests to preload, "" for none
+#endif
+
+// ============================================================================
+// Startup cache warmup
+// ============================================================================
+
+/**
+ * @brief Queue files for background loading into the cache
+ * 
+ * Each comma-separated item is a directory below the served root (preloaded
+ * recursively) or a manifest file listing one path or URI per line ('#'
+ * starts a comment). Loads run on the loader pool, so the server accepts
+ * connections meanwhile; files the snapshot already serves are skipped and
+ * queueing stops once the cache budget is reached.
+ * 
+ * @param spec Comma-separated directories and manifests
+ * @return size_t Number of files queued
+ */
+size_t GH_WarmupPreload(const char *spec);
@@ -0,0 +1,245 @@
+#include "Watcher.h"
+#include "CacheManager.h"
+#include "Loader.h"
+#include "NegativeCache.h"
+#include "Snapshot.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__linux__)
+#include <dirent.h>
+#include <errno.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+// Events that mean a file's contents, or its presence, may have changed
+#define WATCH_MASK (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_CREATE | \
+                    IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+static char *join_path(const char *dir, const char *name) {
+  size_t dir_len = strlen(dir), name_len = strlen(name);
+  char *out = malloc(dir_len + 1 + name_len + 1);
+  if (out != NULL) {
+    memcpy(out, dir, dir_len);
+    out[dir_len] = '/';
+    memcpy(out + dir_len + 1, name, name_len + 1);
+  }
+  return out;
+}
+
+static void forget_dirs(struct Watcher *watcher) {
+  for (int i = 0; i < watcher->dir_capacity; i++) {
+    free(watcher->dirs[i]);
+  }
+  free(watcher->dirs);
+  watcher->dirs = NULL;
+  watcher->dir_capacity = 0;
+  watcher->dir_count = 0;
+}
+
+// Watch dir and everything below it; false once the directory cap is hit
+static bool watch_tree(struct Watcher *watcher, const char *dir) {
+  if (watcher->dir_count >= CACHE_WATCH_MAX_DIRS) {
+    return false;
+  }
+  int wd = inotify_add_watch(watcher->fd, dir, WATCH_MASK);
+  if (wd < 0) {
+    return errno == ENOENT || errno == ENOTDIR || errno == EACCES;  // Gone or private, not fatal
+  }
+
+  if (wd >= watcher->dir_capacity) {
+    int capacity = watcher->dir_capacity ? watcher->dir_capacity : 64;
+    while (capacity <= wd) {
+      capacity *= 2;
+    }
+    char **dirs = realloc(watcher->dirs, (size_t) capacity * sizeof(char *));
+    if (dirs == NULL) {
+      return false;
+    }
+    memset(dirs + watcher->dir_capacity, 0, (size_t) (capacity - watcher->dir_capacity) * sizeof(char *));
+    watcher->dirs = dirs;
+    watcher->dir_capacity = capacity;
+  }
+  if (watcher->dirs[wd] == NULL) {
+    watcher->dirs[wd] = strdup(dir);
+    if (watcher->dirs[wd] == NULL) {
+      return false;
+    }
+    watcher->dir_count++;
+  }
+
+  DIR *handle = opendir(dir);
+  if (handle == NULL) {
+    return true;
+  }
+  bool ok = true;
+  struct dirent *ent;
+  while (ok && (ent = readdir(handle)) != NULL) {
+    if (ent->d_type != DT_DIR || strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) {
+      continue;
+    }
+    char *child = join_path(dir, ent->d_name);
+    ok = child != NULL && watch_tree(watcher, child);
+    free(child);
+  }
+  closedir(handle);
+  return ok;
+}
+
+// (Re)build every watch from scratch
+static bool watch_all(struct Watcher *watcher) {
+  if (watcher->fd >= 0) {
+    close(watcher->fd);
+  }
+  forget_dirs(watcher);
+  watcher->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (watcher->fd < 0) {
+    return false;
+  }
+  if (!watch_tree(watcher, watcher->root)) {
+    MG_ERROR(("Cannot watch %s (over %d directories?), revalidating by mtime instead",
+              watcher->root, CACHE_WATCH_MAX_DIRS));
+    close(watcher->fd);
+    watcher->fd = -1;
+    forget_dirs(watcher);
+    return false;
+  }
+  return true;
+}
+
+// Drop everything known about the tree, positive and negative
+static void invalidate_all(void) {
+  GH_CacheClear(&g_cache);
+  GH_NegativeCacheClear(&g_negative);
+}
+
+// Drop path from the snapshot and the cache, and reload it if it was served from either.
+// A file that appeared stops being answered with a cached 404.
+static void invalidate(struct Watcher *watcher, const char *path) {
+  GH_NegativeCacheRemove(&g_negative, path);
+  bool in_snapshot = GH_SnapshotInvalidate(&g_snapshot, path);
+  if (GH_CacheRemove(&g_cache, path) || in_snapshot) {
+    watcher->invalidations++;
+    MG_DEBUG(("Changed on disk: %s", path));
+    if (CACHE_WATCH_REFRESH) {
+      GH_LoaderPrefetch(&g_loader, path);
+    }
+  }
+}
+
+static void handle_event(struct Watcher *watcher, const struct inotify_event *ev, bool *rebuild) {
+  if (ev->mask & IN_Q_OVERFLOW) {
+    // Events were lost; nothing cached can be trusted
+    invalidate_all();
+    return;
+  }
+  if (ev->wd < 0 || ev->wd >= watcher->dir_capacity || watcher->dirs[ev->wd] == NULL) {
+    return;
+  }
+  if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+    // The directory itself went away or moved: paths below it changed
+    *rebuild = true;
+    return;
+  }
+  if (ev->len == 0) {
+    return;
+  }
+
+  if (ev->mask & IN_ISDIR) {
+    if (ev->mask & (IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE)) {
+      *rebuild = true;  // A whole subtree was renamed or removed
+    } else if (ev->mask & IN_CREATE) {
+      // Files may land in the new directory before it is watched
+      GH_NegativeCacheClear(&g_negative);
+      char *dir = join_path(watcher->dirs[ev->wd], ev->name);
+      if (dir == NULL || !watch_tree(watcher, dir)) {
+        *rebuild = true;
+      }
+      free(dir);
+    }
+    return;
+  }
+
+  char *path = join_path(watcher->dirs[ev->wd], ev->name);
+  if (path == NULL) {
+    invalidate_all();
+    return;
+  }
+  invalidate(watcher, path);
+
+  // A new or changed .br/.gz sibling changes the variants of its base file
+  size_t len = strlen(path);
+  if (len > 3 && (strcmp(path + len - 3, ".br") == 0 || strcmp(path + len - 3, ".gz") == 0)) {
+    path[len - 3] = '\0';
+    invalidate(watcher, path);
+  }
+  free(path);
+}
+
+bool GH_WatcherInit(struct Watcher *watcher, const char *root) {
+  memset(watcher, 0, sizeof(*watcher));
+  watcher->fd = -1;
+  if (!CACHE_WATCH_ENABLED || (watcher->root = strdup(root)) == NULL) {
+    return false;
+  }
+  return watch_all(watcher);
+}
+
+void GH_WatcherPoll(struct Watcher *watcher) {
+  if (watcher->fd < 0) {
+    return;
+  }
+
+  char buf[16384] __attribute__((aligned(__alignof__(struct inotify_event))));
+  bool rebuild = false;
+  for (;;) {
+    ssize_t n = read(watcher->fd, buf, sizeof(buf));
+    if (n <= 0) {
+      break;  // EAGAIN: drained
+    }
+    for (char *p = buf; p < buf + n;) {
+      const struct inotify_event *ev = (const struct inotify_event *) p;
+      handle_event(watcher, ev, &rebuild);
+      p += sizeof(struct inotify_event) + ev->len;
+    }
+  }
+
+  if (rebuild) {
+    // Rare (directory renamed or removed): start over with a clean slate
+    invalidate_all();
+    watch_all(watcher);
+  }
+}
+
+void GH_WatcherCleanup(struct Watcher *watcher) {
+  if (watcher->fd >= 0) {
+    close(watcher->fd);
+  }
+  forget_dirs(watcher);
+  free(watcher->root);
+  watcher->root = NULL;
+  watcher->fd = -1;
+}
+
+#else
+
+bool GH_WatcherInit(struct Watcher *watcher, const char *root) {
+  (void) root;
+  memset(watcher, 0, sizeof(*watcher));
+  watcher->fd = -1;
+  return false;
+}
+
+void GH_WatcherPoll(struct Watcher *watcher) {
+  (void) watcher;
+}
+
+void GH_WatcherCleanup(struct Watcher *watcher) {
+  (void) watcher;
+}
+
+#endif
+
+bool GH_WatcherActive(const struct Watcher *watcher) {
+  return watcher->fd >= 0;
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <server/config.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifndef CACHE_WATCH_ENABLED
+#define CACHE_WATCH_ENABLED 1         //!< Default: invalidate entries from inotify events where available
+#endif
+#ifndef CACHE_WATCH_REFRESH
+#define CACHE_WATCH_REFRESH 1         //!< Default: reload changed files that were cached instead of waiting for a miss
+#endif
+#ifndef CACHE_WATCH_MAX_DIRS
+#define CACHE_WATCH_MAX_DIRS 4096     //!< Default cap on watched directories before falling back to revalidation
+#endif
+#ifndef CACHE_REVALIDATE_MS
+#define CACHE_REVALIDATE_MS 0         //!< Default mtime revalidation interval while watching, 0 = never
+#endif
+
+//! Struct for the served-root file watcher
+struct Watcher {
+    int fd; //!< inotify descriptor, -1 if not watching
+    char *root; //!< Watched root directory
+    char **dirs; //!< Directory path per watch descriptor, NULL for unused descriptors
+    int dir_capacity; //!< Length of dirs
+    int dir_count; //!< Number of watched directories
+    size_t invalidations; //!< Cache entries dropped because their file changed
+};
+
+// ============================================================================
+// Change-driven cache invalidation (inotify)
+// ============================================================================
+
+/**
+ * @brief Start watching a directory tree for changes to cached files
+ * 
+ * @param watcher Watcher to initialize
+ * @param root Root directory served by the cache (cache paths are root + "/" + relative path)
+ * @return bool true if every directory is watched, false if unsupported or over CACHE_WATCH_MAX_DIRS
+ */
+bool GH_WatcherInit(struct Watcher *watcher, const char *root);
+
+/**
+ * @brief Check whether the watcher is running, so entries need no periodic revalidation
+ * 
+ * @param watcher Watcher
+ * @return bool true if change events are being received
+ */
+bool GH_WatcherActive(const struct Watcher *watcher);
+
+/**
+ * @brief Apply pending change events without blocking
+ * 
+ * Changed, moved or deleted files are removed from the cache and, with
+ * CACHE_WATCH_REFRESH, reloaded in the background. Call from one thread only.
+ * 
+ * @param watcher Watcher
+ */
+void GH_WatcherPoll(struct Watcher *watcher);
+
+/**
+ * @brief Stop watching and free resources
+ * 
+ * @param watcher Watcher
+ */
+void GH_WatcherCleanup(struct Watcher *watcher);
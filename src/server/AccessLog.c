@@ -0,0 +1,386 @@
+#include "AccessLog.h"
+#include "Metrics.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+GH_THREAD_LOCAL struct AccessLogRing *g_access_log_ring = NULL;
+
+// Longest line GH_AccessLogFormat writes: IPv6 address, stamp, request, three numbers
+#define ACCESS_LOG_LINE_MAX (40 + 5 + 32 + 2 + 8 + 1 + ACCESS_LOG_URI_MAX + 3 + 2 + 3 * 21 + 1)
+
+_Static_assert(sizeof(struct AccessRecord) == 256, "AccessRecord should stay one 256-byte slot");
+_Static_assert((ACCESS_LOG_RING_RECORDS & (ACCESS_LOG_RING_RECORDS - 1)) == 0, "ACCESS_LOG_RING_RECORDS must be a power of two");
+
+// ==============================================================================
+// Internal helpers
+// ==============================================================================
+
+static const char s_months[12][4] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                     "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+//! Struct for the timestamp last formatted by this thread; requests in the same second reuse it
+struct AccessLogStamp {
+    int64_t time; //!< Seconds since the epoch, -1 before the first record
+    char text[32]; //!< "[06/Nov/1994:08:49:37 +0000] "
+    size_t len; //!< Length of text
+};
+
+static GH_THREAD_LOCAL struct AccessLogStamp s_stamp = {-1, {0}, 0};
+
+static char *put_bytes(char *p, const char *s, size_t len) {
+  memcpy(p, s, len);
+  return p + len;
+}
+
+// "00".."99", so numbers take one division per two digits
+static const char s_digit_pairs[201] = "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+                                       "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+                                       "8081828384858687888990919293949596979899";
+
+#define BYTES_01 0x0101010101010101ULL
+#define BYTES_80 0x8080808080808080ULL
+
+// Whether any of the eight bytes is a control byte, DEL or '"' (bytes >= 0x80 pass)
+static bool word_needs_escape(uint64_t w) {
+  uint64_t quote = w ^ (BYTES_01 * '"'), del = w ^ (BYTES_01 * 0x7f);
+  return (((w - BYTES_01 * 0x20) & ~w) | ((quote - BYTES_01) & ~quote) | ((del - BYTES_01) & ~del)) & BYTES_80;
+}
+
+// Client-supplied text; quotes and control bytes would let it forge fields or lines.
+// Clean text is copied a word at a time, the rest byte by byte
+static char *put_text(char *p, const char *s, size_t len) {
+  size_t i = 0;
+  for (uint64_t w; i + 8 <= len; i += 8, p += 8) {
+    memcpy(&w, s + i, 8);
+    if (word_needs_escape(w)) {
+      break;
+    }
+    memcpy(p, &w, 8);
+  }
+  for (; i < len; i++) {
+    unsigned char ch = (unsigned char) s[i];
+    *p++ = ch < 0x20 || ch == 0x7f || ch == '"' ? '?' : (char) ch;
+  }
+  return p;
+}
+
+static char *put_u64(char *p, uint64_t value) {
+  char digits[20];
+  char *d = digits + sizeof(digits);
+  for (; value >= 100; value /= 100) {
+    d -= 2;
+    memcpy(d, &s_digit_pairs[value % 100 * 2], 2);
+  }
+  if (value >= 10) {
+    d -= 2;
+    memcpy(d, &s_digit_pairs[value * 2], 2);
+  } else {
+    *--d = (char) ('0' + value);
+  }
+  size_t n = (size_t) (digits + sizeof(digits) - d);
+  memcpy(p, d, n);
+  return p + n;
+}
+
+static char *put_2digits(char *p, int value) {
+  *p++ = (char) ('0' + value / 10 % 10);
+  *p++ = (char) ('0' + value % 10);
+  return p;
+}
+
+static char *put_octet(char *p, unsigned value) {
+  if (value >= 100) {
+    *p++ = (char) ('0' + value / 100);
+  }
+  if (value >= 10) {
+    p = put_bytes(p, &s_digit_pairs[value % 100 * 2], 2);
+  } else {
+    *p++ = (char) ('0' + value);
+  }
+  return p;
+}
+
+// RFC 5952 text form: lowercase hex groups, the longest run of zero groups as "::"
+static char *put_ip6(char *p, const uint8_t ip[16]) {
+  static const char hex[] = "0123456789abcdef";
+  uint16_t groups[8];
+  int zero_start = -1, zero_len = 0;
+  for (int i = 0, run = 0; i < 8; i++) {
+    groups[i] = (uint16_t) (ip[2 * i] << 8 | ip[2 * i + 1]);
+    run = groups[i] == 0 ? run + 1 : 0;
+    if (run > zero_len && run > 1) {
+      zero_len = run;
+      zero_start = i - run + 1;
+    }
+  }
+  for (int i = 0; i < 8; i++) {
+    if (i == zero_start) {
+      *p++ = ':';
+      if (i == 0) {
+        *p++ = ':';
+      }
+      i += zero_len - 1;
+      continue;
+    }
+    bool leading = true;
+    for (int shift = 12; shift >= 0; shift -= 4) {
+      int nibble = (groups[i] >> shift) & 15;
+      if (nibble != 0 || !leading || shift == 0) {
+        *p++ = hex[nibble];
+        leading = false;
+      }
+    }
+    if (i < 7) {
+      *p++ = ':';
+    }
+  }
+  return p;
+}
+
+static char *put_ip(char *p, const struct AccessRecord *rec) {
+  if (rec->is_ip6) {
+    return put_ip6(p, rec->ip);
+  }
+  for (int i = 0; i < 4; i++) {
+    p = put_octet(p, rec->ip[i]);
+    if (i < 3) {
+      *p++ = '.';
+    }
+  }
+  return p;
+}
+
+static const struct AccessLogStamp *stamp_for(int64_t t) {
+  if (s_stamp.time != t) {
+    time_t tt = (time_t) t;
+    struct tm tm;
+#if defined(_WIN32)
+    gmtime_s(&tm, &tt);
+#else
+    gmtime_r(&tt, &tm);
+#endif
+    char *p = s_stamp.text;
+    *p++ = '[';
+    p = put_2digits(p, tm.tm_mday);
+    *p++ = '/';
+    p = put_bytes(p, s_months[tm.tm_mon % 12], 3);
+    *p++ = '/';
+    p = put_u64(p, (uint64_t) (tm.tm_year + 1900));
+    *p++ = ':';
+    p = put_2digits(p, tm.tm_hour);
+    *p++ = ':';
+    p = put_2digits(p, tm.tm_min);
+    *p++ = ':';
+    p = put_2digits(p, tm.tm_sec);
+    p = put_bytes(p, " +0000] ", 8);
+    s_stamp.len = (size_t) (p - s_stamp.text);
+    s_stamp.time = t;
+  }
+  return &s_stamp;
+}
+
+// Rotate <file> to <file>.1, shifting older files up to ACCESS_LOG_ROTATE_KEEP
+static void log_rotate(struct AccessLog *log) {
+  char from[512], to[512];
+  fclose(log->file);
+  for (int i = ACCESS_LOG_ROTATE_KEEP - 1; i >= 1; i--) {
+    mg_snprintf(from, sizeof(from), "%s.%d", log->path, i);
+    mg_snprintf(to, sizeof(to), "%s.%d", log->path, i + 1);
+    rename(from, to);
+  }
+  mg_snprintf(to, sizeof(to), "%s.1", log->path);
+  rename(log->path, to);
+
+  log->file = fopen(log->path, "ab");
+  log->file_size = 0;
+  if (log->file == NULL) {
+    MG_ERROR(("Cannot reopen access log %s after rotation, records are discarded", log->path));
+  } else {
+    setvbuf(log->file, NULL, _IONBF, 0);  // Batches are written whole, one write each
+  }
+}
+
+static void log_write(struct AccessLog *log, const char *batch, size_t len) {
+  if (len == 0 || log->file == NULL) {
+    return;
+  }
+  if (fwrite(batch, 1, len, log->file) != len) {
+    MG_ERROR(("Short write to access log %s", log->path));
+  }
+  log->file_size += len;
+  if (log->rotate_bytes > 0 && log->file_size >= log->rotate_bytes) {
+    log_rotate(log);
+  }
+}
+
+// Wall clock minus mg_millis(): records carry the monotonic time the worker already read
+static int64_t wall_clock_offset_ms(void) {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000 - (int64_t) mg_millis();
+}
+
+// Format everything published so far into batches; returns the records drained
+static size_t log_drain(struct AccessLog *log) {
+  char *batch = log->batch;
+  GH_MutexLock(&log->lock);
+  struct AccessLogRing *rings = log->rings;
+  GH_MutexUnlock(&log->lock);
+  int64_t offset = wall_clock_offset_ms();
+
+  size_t drained = 0, len = 0;
+  uint64_t dropped = 0;
+  for (struct AccessLogRing *ring = rings; ring != NULL; ring = ring->next) {
+    size_t tail = ring->tail;
+    size_t head = GH_AtomicLoadAcquireSize(&ring->head);
+    for (; tail != head; tail++) {
+      if (ACCESS_LOG_BATCH_SIZE - len < ACCESS_LOG_LINE_MAX) {
+        log_write(log, batch, len);
+        len = 0;
+        GH_AtomicStoreReleaseSize(&ring->tail, tail);  // Hand the slots back early
+      }
+      len += GH_AccessLogFormat(&ring->records[tail & (ACCESS_LOG_RING_RECORDS - 1)], offset, batch + len,
+                                ACCESS_LOG_BATCH_SIZE - len);
+      drained++;
+    }
+    GH_AtomicStoreReleaseSize(&ring->tail, tail);
+    dropped += GH_AtomicLoadU64(&ring->dropped);
+  }
+  log_write(log, batch, len);
+
+  GH_MetricsAdd(MC_ACCESS_LOG_RECORDS, drained);
+  if (dropped > log->dropped_reported) {
+    GH_MetricsAdd(MC_ACCESS_LOG_DROPPED, dropped - log->dropped_reported);
+    log->dropped_reported = dropped;
+  }
+  return drained;
+}
+
+static void log_close(struct AccessLog *log) {
+  if (log->file != NULL) {
+    fclose(log->file);
+    log->file = NULL;
+  }
+  free(log->path);
+  log->path = NULL;
+  free(log->batch);
+  log->batch = NULL;
+}
+
+static void writer_run(void *arg) {
+  struct AccessLog *log = (struct AccessLog *) arg;
+  for (;;) {
+    // Read the flag first: whatever was published before it was set gets drained below
+    bool stopping = GH_AtomicLoadInt(&log->stopping) != 0;
+    size_t drained = log_drain(log);
+    if (drained == 0 && stopping) {
+      break;
+    }
+    // Drain right away only while the rings fill up: otherwise fewer, larger
+    // writes, and no wakeup taking a core from the workers per trickle of records
+    if (drained < ACCESS_LOG_RING_RECORDS / 8) {
+      GH_SleepMs(ACCESS_LOG_FLUSH_MS);
+    }
+  }
+}
+
+// ==============================================================================
+// Public API
+// ==============================================================================
+
+bool GH_AccessLogInit(struct AccessLog *log, const char *path, uint64_t rotate_bytes) {
+  memset(log, 0, sizeof(*log));
+  GH_MutexInit(&log->lock);
+  log->rotate_bytes = rotate_bytes;
+  if (path == NULL || path[0] == '\0') {
+    return false;
+  }
+
+  log->file = fopen(path, "ab");
+  log->path = strdup(path);
+  log->batch = malloc(ACCESS_LOG_BATCH_SIZE);
+  if (log->file == NULL || log->path == NULL || log->batch == NULL) {
+    log_close(log);
+    return false;
+  }
+  setvbuf(log->file, NULL, _IONBF, 0);  // Batches are written whole, one write each
+  fseek(log->file, 0, SEEK_END);
+  long size = ftell(log->file);
+  log->file_size = size > 0 ? (uint64_t) size : 0;
+
+  GH_AtomicStoreInt(&log->running, 1);
+  if (!GH_ThreadStart(&log->writer, writer_run, log)) {
+    GH_AtomicStoreInt(&log->running, 0);
+    log_close(log);
+    return false;
+  }
+  return true;
+}
+
+void GH_AccessLogCleanup(struct AccessLog *log) {
+  if (GH_AtomicLoadInt(&log->running)) {
+    GH_AtomicStoreInt(&log->stopping, 1);
+    GH_ThreadJoin(log->writer);
+    GH_AtomicStoreInt(&log->running, 0);
+  }
+  log_close(log);
+  while (log->rings != NULL) {
+    struct AccessLogRing *next = log->rings->next;
+    free(log->rings);
+    log->rings = next;
+  }
+  g_access_log_ring = NULL;
+  GH_MutexDestroy(&log->lock);
+}
+
+struct AccessLogRing *GH_AccessLogRegisterThread(struct AccessLog *log) {
+  struct AccessLogRing *ring = (struct AccessLogRing *) calloc(1, sizeof(*ring));
+  if (ring == NULL) {
+    return NULL;
+  }
+  GH_MutexLock(&log->lock);
+  ring->next = log->rings;
+  log->rings = ring;
+  GH_MutexUnlock(&log->lock);
+  g_access_log_ring = ring;
+  return ring;
+}
+
+uint64_t GH_AccessLogDropped(struct AccessLog *log) {
+  uint64_t dropped = 0;
+  GH_MutexLock(&log->lock);
+  for (struct AccessLogRing *ring = log->rings; ring != NULL; ring = ring->next) {
+    dropped += GH_AtomicLoadU64(&ring->dropped);
+  }
+  GH_MutexUnlock(&log->lock);
+  return dropped;
+}
+
+size_t GH_AccessLogFormat(const struct AccessRecord *rec, int64_t clock_offset_ms, char *buf, size_t len) {
+  if (len < ACCESS_LOG_LINE_MAX) {
+    return 0;
+  }
+
+  char *p = buf;
+  p = put_ip(p, rec);
+  p = put_bytes(p, " - - ", 5);
+  int64_t wall_ms = (int64_t) rec->millis + clock_offset_ms;
+  const struct AccessLogStamp *stamp = stamp_for(wall_ms > 0 ? wall_ms / 1000 : 0);
+  p = put_bytes(p, stamp->text, stamp->len);
+  *p++ = '"';
+  p = put_text(p, rec->method, strnlen(rec->method, sizeof(rec->method)));
+  *p++ = ' ';
+  p = put_text(p, rec->uri, rec->uri_len < ACCESS_LOG_URI_MAX ? rec->uri_len : ACCESS_LOG_URI_MAX);
+  if (rec->uri_truncated) {
+    p = put_bytes(p, "...", 3);
+  }
+  p = put_bytes(p, "\" ", 2);
+  p = put_u64(p, rec->status);
+  *p++ = ' ';
+  p = put_u64(p, rec->bytes);
+  *p++ = ' ';
+  p = put_u64(p, rec->duration_us);
+  *p++ = '\n';
+  return (size_t) (p - buf);
+}
@@ -0,0 +1,163 @@
+#pragma once
+#include <server/config.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <mongoose.h>
+#include <utils/Sync.h>
+
+#ifndef APP_ACCESS_LOG
+#define APP_ACCESS_LOG ""               //!< Default access log file, "" for none
+#endif
+#ifndef APP_ACCESS_LOG_ROTATE_MB
+#define APP_ACCESS_LOG_ROTATE_MB 64     //!< Default size at which the log is rotated to "<file>.1", 0 = never
+#endif
+#ifndef ACCESS_LOG_RING_RECORDS
+#define ACCESS_LOG_RING_RECORDS 8192    //!< Default records buffered per thread (power of two)
+#endif
+#ifndef ACCESS_LOG_FLUSH_MS
+#define ACCESS_LOG_FLUSH_MS 2           //!< Default writer sleep between drains unless the rings are filling up
+#endif
+
+#define ACCESS_LOG_URI_MAX 200          //!< Longer URIs are truncated (marked with "..."); records are 256 bytes
+#define ACCESS_LOG_ROTATE_KEEP 3        //!< Rotated files kept: <file>.1 (newest) to <file>.3
+#define ACCESS_LOG_BATCH_SIZE (256 * 1024)  //!< Formatted bytes collected before each write
+
+//! Struct for one request as captured on the request path; fixed size, formatted later
+struct AccessRecord {
+    uint64_t millis; //!< mg_millis() when the request arrived; the writer turns it into wall time
+    uint64_t bytes; //!< Response size: head plus body
+    uint32_t duration_us; //!< Handling time in microseconds
+    uint16_t status; //!< Response status code, 0 if unknown
+    uint8_t ip[16]; //!< Client address (first 4 bytes for IPv4)
+    uint8_t is_ip6; //!< Address family of ip
+    uint8_t uri_truncated; //!< URI was longer than ACCESS_LOG_URI_MAX
+    uint8_t uri_len; //!< Length of uri
+    char method[8]; //!< Request method, NUL padded (truncated past 8 bytes)
+    char uri[ACCESS_LOG_URI_MAX]; //!< Request URI, not NUL-terminated
+};
+
+//! Struct for one thread's ring: the thread produces, the writer consumes
+struct AccessLogRing {
+    size_t head; //!< Records ever published (producer-owned)
+    size_t tail_seen; //!< Last tail the producer read; reread only when the ring looks full (producer-owned)
+    uint64_t dropped; //!< Records dropped because the ring was full (producer-owned)
+    char pad[64 - 2 * sizeof(size_t) - sizeof(uint64_t)]; //!< Keeps tail off the producer's cache line
+    size_t tail; //!< Records ever consumed (writer-owned)
+    struct AccessLogRing *next; //!< Next registered ring
+    struct AccessRecord records[ACCESS_LOG_RING_RECORDS]; //!< Record slots
+};
+
+//! Struct for the access log: per-thread rings drained by one writer thread
+struct AccessLog {
+    char *path; //!< Log file path, NULL if logging is off
+    FILE *file; //!< Open log file (writer thread only)
+    uint64_t file_size; //!< Bytes in the open file
+    uint64_t rotate_bytes; //!< Rotate once the file reaches this size, 0 = never
+    char *batch; //!< Formatting buffer of ACCESS_LOG_BATCH_SIZE bytes (writer thread only)
+    GH_Mutex lock; //!< Guards rings
+    struct AccessLogRing *rings; //!< Registered rings, freed by GH_AccessLogCleanup
+    uint64_t dropped_reported; //!< Drops already noted in the log (writer thread only)
+    GH_Thread writer; //!< Writer thread
+    int running; //!< Writer thread is running (atomic)
+    int stopping; //!< Set by GH_AccessLogCleanup (atomic)
+};
+
+// ============================================================================
+// Asynchronous access log (hot path: thread-local ring, no locks, no syscalls)
+// ============================================================================
+
+extern GH_THREAD_LOCAL struct AccessLogRing *g_access_log_ring; //!< Calling thread's ring, NULL until first use
+
+/**
+ * @brief Open the log file and start the writer thread
+ * 
+ * One access log per process: each thread registers its ring with the log
+ * it first records into.
+ * 
+ * @param log Log to initialize
+ * @param path Log file path, copied ("" for none: records are then refused)
+ * @param rotate_bytes Rotate once the file reaches this size, 0 = never
+ * @return bool true if logging is on, false if off or the file cannot be opened
+ */
+bool GH_AccessLogInit(struct AccessLog *log, const char *path, uint64_t rotate_bytes);
+
+/**
+ * @brief Stop the writer after a final drain, close the file and free the rings
+ * 
+ * Call once no thread records anymore.
+ * 
+ * @param log Log
+ */
+void GH_AccessLogCleanup(struct AccessLog *log);
+
+/**
+ * @brief Allocate and register the calling thread's ring
+ * 
+ * @param log Log
+ * @return struct AccessLogRing* Ring, NULL on allocation failure (records are then dropped)
+ */
+struct AccessLogRing *GH_AccessLogRegisterThread(struct AccessLog *log);
+
+/**
+ * @brief Claim the next free record of the calling thread's ring
+ * 
+ * Never blocks: when the writer falls behind, the record is dropped and
+ * counted. Fill the record, then publish it with GH_AccessLogCommit.
+ * 
+ * @param log Log
+ * @return struct AccessRecord* Record to fill, NULL if logging is off or the ring is full
+ */
+static inline struct AccessRecord *GH_AccessLogReserve(struct AccessLog *log) {
+  if (!GH_AtomicLoadInt(&log->running)) {
+    return NULL;
+  }
+  struct AccessLogRing *ring = g_access_log_ring;
+  if (ring == NULL && (ring = GH_AccessLogRegisterThread(log)) == NULL) {
+    return NULL;
+  }
+  // The writer's tail line is only touched when the ring looks full
+  if (ring->head - ring->tail_seen >= ACCESS_LOG_RING_RECORDS) {
+    ring->tail_seen = GH_AtomicLoadAcquireSize(&ring->tail);
+    if (ring->head - ring->tail_seen >= ACCESS_LOG_RING_RECORDS) {
+      GH_AtomicStoreU64(&ring->dropped, ring->dropped + 1);
+      return NULL;
+    }
+  }
+  return &ring->records[ring->head & (ACCESS_LOG_RING_RECORDS - 1)];
+}
+
+/**
+ * @brief Publish the record returned by the last GH_AccessLogReserve
+ * 
+ * @param log Log
+ */
+static inline void GH_AccessLogCommit(struct AccessLog *log) {
+  (void) log;
+  struct AccessLogRing *ring = g_access_log_ring;
+  GH_AtomicStoreReleaseSize(&ring->head, ring->head + 1);
+}
+
+/**
+ * @brief Records dropped so far because a ring was full
+ * 
+ * @param log Log
+ * @return uint64_t Dropped records, summed over every thread
+ */
+uint64_t GH_AccessLogDropped(struct AccessLog *log);
+
+/**
+ * @brief Format one record as a log line
+ * 
+ * Common Log Format plus the handling time:
+ * 203.0.113.9 - - [06/Nov/1994:08:49:37 +0000] "GET /index.html" 200 5120 182
+ * 
+ * @param rec Record
+ * @param clock_offset_ms Wall clock minus mg_millis(), in milliseconds since the epoch
+ * @param buf Output buffer
+ * @param len Size of buf
+ * @return size_t Length of the line including its newline, 0 if buf is too small
+ */
+size_t GH_AccessLogFormat(const struct AccessRecord *rec, int64_t clock_offset_ms, char *buf, size_t len);
@@ -0,0 +1,159 @@
+#include "Admission.h"
+#include <stdlib.h>
+#include <string.h>
+
+// ==============================================================================
+// Internal helpers
+// ==============================================================================
+
+//! Struct for an address as the table keys it
+struct AdmissionKey {
+    uint8_t ip[16]; //!< IPv4 address, or IPv6 /64 prefix, zero padded
+    uint8_t is_ip6; //!< Address family
+    size_t set; //!< Set the address maps to
+};
+
+static struct AdmissionKey admission_key(const struct Admission *adm, const struct mg_addr *addr) {
+  struct AdmissionKey key;
+  memset(&key, 0, sizeof(key));
+  key.is_ip6 = addr->is_ip6 ? 1 : 0;
+  memcpy(key.ip, addr->ip, addr->is_ip6 ? 8 : 4);
+
+  uint64_t hi, lo;
+  memcpy(&hi, key.ip, 8);
+  memcpy(&lo, key.ip + 8, 8);
+  uint64_t hash = (hi ^ (lo * 0x9e3779b97f4a7c15ULL) ^ key.is_ip6) * 0xff51afd7ed558ccdULL;
+  key.set = (size_t) (hash ^ (hash >> 32)) & adm->set_mask;
+  return key;
+}
+
+static GH_Mutex *admission_lock(struct Admission *adm, size_t set) {
+  return &adm->locks[set & (ADMISSION_LOCKS - 1)];
+}
+
+static struct AdmissionSlot *slot_find(struct Admission *adm, const struct AdmissionKey *key) {
+  struct AdmissionSlot *set = &adm->slots[key->set * ADMISSION_WAYS];
+  for (size_t i = 0; i < ADMISSION_WAYS; i++) {
+    if (set[i].used && set[i].is_ip6 == key->is_ip6 && memcmp(set[i].ip, key->ip, sizeof(key->ip)) == 0) {
+      return &set[i];
+    }
+  }
+  return NULL;
+}
+
+// Slot of an address, claiming a free one or the least busy, least recent one.
+// Caller holds the set's lock.
+static struct AdmissionSlot *slot_claim(struct Admission *adm, const struct AdmissionKey *key, uint64_t now) {
+  struct AdmissionSlot *slot = slot_find(adm, key);
+  if (slot != NULL) {
+    return slot;
+  }
+  struct AdmissionSlot *set = &adm->slots[key->set * ADMISSION_WAYS];
+  slot = &set[0];
+  for (size_t i = 0; i < ADMISSION_WAYS && slot->used; i++) {
+    if (!set[i].used || set[i].conns < slot->conns ||
+        (set[i].conns == slot->conns && set[i].last < slot->last)) {
+      slot = &set[i];
+    }
+  }
+  memcpy(slot->ip, key->ip, sizeof(slot->ip));
+  slot->is_ip6 = key->is_ip6;
+  slot->used = 1;
+  slot->last = now;
+  slot->tokens = adm->burst;
+  slot->conns = 0;
+  return slot;
+}
+
+// ==============================================================================
+// Public API
+// ==============================================================================
+
+bool GH_AdmissionInit(struct Admission *adm, size_t entries, uint32_t rate, uint32_t burst,
+                      uint32_t max_conns) {
+  memset(adm, 0, sizeof(*adm));
+  for (size_t i = 0; i < ADMISSION_LOCKS; i++) {
+    GH_MutexInit(&adm->locks[i]);
+  }
+  adm->rate = rate;
+  adm->burst = (int32_t) ((burst > 0 ? burst : 1) * 1000);
+  adm->max_conns = max_conns;
+  if (entries == 0 || (rate == 0 && max_conns == 0)) {
+    return true;
+  }
+
+  size_t sets = 1;
+  while (sets * 2 * ADMISSION_WAYS <= entries) {
+    sets *= 2;
+  }
+  adm->slots = calloc(sets * ADMISSION_WAYS, sizeof(struct AdmissionSlot));
+  if (adm->slots == NULL) {
+    return false;
+  }
+  adm->set_mask = sets - 1;
+  return true;
+}
+
+void GH_AdmissionCleanup(struct Admission *adm) {
+  free(adm->slots);
+  adm->slots = NULL;
+  for (size_t i = 0; i < ADMISSION_LOCKS; i++) {
+    GH_MutexDestroy(&adm->locks[i]);
+  }
+}
+
+bool GH_AdmissionConnect(struct Admission *adm, const struct mg_addr *addr, uint64_t now) {
+  if (adm->slots == NULL || adm->max_conns == 0) {
+    return true;
+  }
+  struct AdmissionKey key = admission_key(adm, addr);
+  GH_MutexLock(admission_lock(adm, key.set));
+  struct AdmissionSlot *slot = slot_claim(adm, &key, now);
+  bool admitted = slot->conns < adm->max_conns;
+  if (admitted) {
+    slot->conns++;
+  }
+  GH_MutexUnlock(admission_lock(adm, key.set));
+  return admitted;
+}
+
+void GH_AdmissionDisconnect(struct Admission *adm, const struct mg_addr *addr) {
+  if (adm->slots == NULL || adm->max_conns == 0) {
+    return;
+  }
+  struct AdmissionKey key = admission_key(adm, addr);
+  GH_MutexLock(admission_lock(adm, key.set));
+  // The slot may have been handed to another address meanwhile; then there is nothing to release
+  struct AdmissionSlot *slot = slot_find(adm, &key);
+  if (slot != NULL && slot->conns > 0) {
+    slot->conns--;
+  }
+  GH_MutexUnlock(admission_lock(adm, key.set));
+}
+
+bool GH_AdmissionRequest(struct Admission *adm, const struct mg_addr *addr, uint64_t now) {
+  if (adm->slots == NULL || adm->rate == 0) {
+    return true;
+  }
+  struct AdmissionKey key = admission_key(adm, addr);
+  GH_MutexLock(admission_lock(adm, key.set));
+  struct AdmissionSlot *slot = slot_claim(adm, &key, now);
+
+  // Lazy refill: rate tokens per second is rate thousandths per millisecond.
+  // Workers read the clock independently, so a slightly older now adds nothing.
+  // rate >= 1, so an idle spell of burst milliseconds or more refills it all.
+  if (now > slot->last) {
+    uint64_t elapsed = now - slot->last;
+    uint64_t tokens = elapsed >= (uint64_t) adm->burst ? (uint64_t) adm->burst
+                                                       : (uint64_t) slot->tokens + elapsed * adm->rate;
+    slot->tokens = tokens > (uint64_t) adm->burst ? adm->burst : (int32_t) tokens;
+    slot->last = now;
+  }
+
+  bool allowed = slot->tokens >= 1000;
+  if (allowed) {
+    slot->tokens -= 1000;
+  }
+  GH_MutexUnlock(admission_lock(adm, key.set));
+  return allowed;
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include <server/config.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <mongoose.h>
+#include <utils/Sync.h>
+
+#ifndef APP_RATE_LIMIT_RPS
+#define APP_RATE_LIMIT_RPS 0          //!< Default sustained requests per second per client address, 0 = unlimited
+#endif
+#ifndef APP_RATE_LIMIT_BURST
+#define APP_RATE_LIMIT_BURST 0        //!< Default requests a client address may send at once after idling, 0 = twice the rate
+#endif
+#ifndef APP_CONN_LIMIT_PER_IP
+#define APP_CONN_LIMIT_PER_IP 0       //!< Default open connections per client address, 0 = unlimited
+#endif
+#ifndef ADMISSION_TABLE_ENTRIES
+#define ADMISSION_TABLE_ENTRIES 65536 //!< Default client addresses tracked at once
+#endif
+
+#define ADMISSION_WAYS 4              //!< Slots per set; a full set replaces its least busy, least recent slot
+#define ADMISSION_LOCKS 64            //!< Lock stripes over the sets (power of two)
+
+//! Struct for one tracked client address: token bucket plus open connections
+struct AdmissionSlot {
+    uint8_t ip[16]; //!< IPv4 address, or the /64 prefix of an IPv6 address
+    uint64_t last; //!< Last refill timestamp in milliseconds; 64 bits, so idle addresses never wrap
+    int32_t tokens; //!< Request tokens in thousandths
+    uint16_t conns; //!< Open connections counted against the cap
+    uint8_t is_ip6; //!< Address family of ip
+    uint8_t used; //!< Slot holds an address
+};
+
+//! Struct for per-address admission control, shared by every worker
+struct Admission {
+    struct AdmissionSlot *slots; //!< Sets of ADMISSION_WAYS slots, NULL if every limit is off
+    size_t set_mask; //!< Number of sets minus one
+    uint32_t rate; //!< Tokens per second (= thousandths per millisecond), 0 = unlimited
+    int32_t burst; //!< Bucket capacity in thousandths
+    uint32_t max_conns; //!< Open connections per address, 0 = unlimited
+    GH_Mutex locks[ADMISSION_LOCKS]; //!< Lock stripes, chosen by set index
+};
+
+// ============================================================================
+// Per-address admission control (token buckets and connection caps)
+// ============================================================================
+
+/**
+ * @brief Initialize the admission table
+ * 
+ * IPv6 clients are limited per /64, the smallest block a host usually gets.
+ * When the table is full, the least busy address of a set is forgotten, so
+ * tracking stays bounded whatever the number of clients.
+ * 
+ * @param adm Table to initialize
+ * @param entries Addresses tracked at once (rounded down to a power of two)
+ * @param rate Sustained requests per second per address, 0 = unlimited
+ * @param burst Requests allowed at once (at least 1 when rate is set)
+ * @param max_conns Open connections per address, 0 = unlimited
+ * @return bool true on success, false if the table could not be allocated
+ */
+bool GH_AdmissionInit(struct Admission *adm, size_t entries, uint32_t rate, uint32_t burst,
+                      uint32_t max_conns);
+
+/**
+ * @brief Free the table
+ * 
+ * @param adm Table
+ */
+void GH_AdmissionCleanup(struct Admission *adm);
+
+/**
+ * @brief Count a new connection against its address
+ * 
+ * @param adm Table
+ * @param addr Client address
+ * @param now Current timestamp in milliseconds
+ * @return bool true if admitted (call GH_AdmissionDisconnect when it closes), false if over the cap
+ */
+bool GH_AdmissionConnect(struct Admission *adm, const struct mg_addr *addr, uint64_t now);
+
+/**
+ * @brief Release a connection admitted by GH_AdmissionConnect
+ * 
+ * @param adm Table
+ * @param addr Client address
+ */
+void GH_AdmissionDisconnect(struct Admission *adm, const struct mg_addr *addr);
+
+/**
+ * @brief Take one request token from an address's bucket, refilled lazily
+ * 
+ * @param adm Table
+ * @param addr Client address
+ * @param now Current timestamp in milliseconds
+ * @return bool true if the request may proceed, false if the address is over its rate
+ */
+bool GH_AdmissionRequest(struct Admission *adm, const struct mg_addr *addr, uint64_t now);
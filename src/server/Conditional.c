@@ -0,0 +1,127 @@
+#include "Conditional.h"
+#include "utils/Utils.h"
+#include <string.h>
+
+// ==============================================================================
+// Internal helpers
+// ==============================================================================
+
+//! Struct for the conditional fields of one request, collected in a single pass
+struct Conditions {
+    bool if_match; //!< If-Match present
+    bool if_match_ok; //!< Some If-Match field matched
+    bool if_none_match; //!< If-None-Match present
+    bool if_none_match_hit; //!< Some If-None-Match field matched
+    int if_unmodified_since; //!< If-Unmodified-Since fields seen
+    int if_modified_since; //!< If-Modified-Since fields seen
+    struct mg_str unmodified_since; //!< Last If-Unmodified-Since value
+    struct mg_str modified_since; //!< Last If-Modified-Since value
+};
+
+static bool is_ows(char ch) {
+  return ch == ' ' || ch == '\t';
+}
+
+static bool name_is(struct mg_str name, const char *field, size_t field_len) {
+  return name.len == field_len && mg_strcasecmp(name, mg_str_n(field, field_len)) == 0;
+}
+
+// Read one date field: a single IMF-fixdate, anything else is ignored (13.1.3, 13.1.4)
+static bool date_field(struct mg_str value, int seen, time_t *date) {
+  while (value.len > 0 && is_ows(value.buf[0])) value.buf++, value.len--;
+  while (value.len > 0 && is_ows(value.buf[value.len - 1])) value.len--;
+  return seen == 1 && value.len == 29 && ParseHttpDate(value.buf, value.len, date);
+}
+
+static bool is_safe_method(struct mg_str method) {
+  return mg_strcmp(method, mg_str("GET")) == 0 || mg_strcmp(method, mg_str("HEAD")) == 0;
+}
+
+// ==============================================================================
+// Public API
+// ==============================================================================
+
+bool GH_ConditionalEtagMatches(struct mg_str list, const char *etag, bool weak) {
+  size_t etag_len = etag != NULL ? strlen(etag) : 0;
+  const char *p = list.buf, *end = list.buf + list.len;
+  // Our own ETags are never weak; a W/ tag can only match under weak comparison
+  bool etag_weak = etag_len >= 2 && etag[0] == 'W' && etag[1] == '/';
+  const char *opaque = etag_weak ? etag + 2 : etag;
+  size_t opaque_len = etag_weak ? etag_len - 2 : etag_len;
+
+  while (p < end) {
+    if (is_ows(*p) || *p == ',') {
+      p++;
+      continue;
+    }
+    if (*p == '*') {
+      return true;
+    }
+    bool member_weak = end - p >= 2 && p[0] == 'W' && p[1] == '/';
+    if (member_weak) {
+      p += 2;
+    }
+    if (p >= end || *p != '"') {
+      return false;
+    }
+    const char *close = memchr(p + 1, '"', (size_t) (end - p - 1));
+    if (close == NULL) {
+      return false;
+    }
+    size_t member_len = (size_t) (close - p + 1);
+    if (opaque != NULL && (weak || (!member_weak && !etag_weak)) && member_len == opaque_len &&
+        memcmp(p, opaque, member_len) == 0) {
+      return true;
+    }
+    p = close + 1;
+  }
+  return false;
+}
+
+enum Precondition GH_ConditionalEvaluate(const struct mg_http_message *hm, const char *etag, time_t mtime) {
+  struct Conditions cond;
+  memset(&cond, 0, sizeof(cond));
+
+  // Every field name starts with "If-"; only the lengths that fit are compared in full
+  for (size_t i = 0; i < MG_MAX_HTTP_HEADERS && hm->headers[i].name.len > 0; i++) {
+    struct mg_str name = hm->headers[i].name, value = hm->headers[i].value;
+    if (name.len < 8 || (name.buf[0] != 'I' && name.buf[0] != 'i')) {
+      continue;
+    }
+    if (name_is(name, "If-Match", 8)) {
+      cond.if_match = true;
+      cond.if_match_ok = cond.if_match_ok || GH_ConditionalEtagMatches(value, etag, false);
+    } else if (name_is(name, "If-None-Match", 13)) {
+      cond.if_none_match = true;
+      cond.if_none_match_hit = cond.if_none_match_hit || GH_ConditionalEtagMatches(value, etag, true);
+    } else if (name_is(name, "If-Modified-Since", 17)) {
+      cond.if_modified_since++;
+      cond.modified_since = value;
+    } else if (name_is(name, "If-Unmodified-Since", 19)) {
+      cond.if_unmodified_since++;
+      cond.unmodified_since = value;
+    }
+  }
+
+  // Steps 1 and 2: the client's copy must still be current
+  time_t date;
+  if (cond.if_match) {
+    if (!cond.if_match_ok) {
+      return PRECONDITION_FAILED;
+    }
+  } else if (cond.if_unmodified_since > 0 && mtime > 0 &&
+             date_field(cond.unmodified_since, cond.if_unmodified_since, &date) && mtime > date) {
+    return PRECONDITION_FAILED;
+  }
+
+  // Steps 3 and 4: the client's copy may be reused
+  if (cond.if_none_match) {
+    if (cond.if_none_match_hit) {
+      return is_safe_method(hm->method) ? PRECONDITION_NOT_MODIFIED : PRECONDITION_FAILED;
+    }
+  } else if (cond.if_modified_since > 0 && mtime > 0 && is_safe_method(hm->method) &&
+             date_field(cond.modified_since, cond.if_modified_since, &date) && mtime <= date) {
+    return PRECONDITION_NOT_MODIFIED;
+  }
+  return PRECONDITION_PASS;
+}
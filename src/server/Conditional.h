@@ -0,0 +1,43 @@
+#pragma once
+#include <server/config.h>
+
+#include <stdbool.h>
+#include <time.h>
+#include <mongoose.h>
+
+//! Outcome of evaluating a request's preconditions
+enum Precondition {
+    PRECONDITION_PASS, //!< Serve the request as usual (Range and If-Range still apply)
+    PRECONDITION_NOT_MODIFIED, //!< Send 304 Not Modified
+    PRECONDITION_FAILED, //!< Send 412 Precondition Failed
+};
+
+// ============================================================================
+// HTTP conditional requests (RFC 9110, section 13)
+// ============================================================================
+
+/**
+ * @brief Evaluate If-Match, If-Unmodified-Since, If-None-Match and If-Modified-Since
+ * 
+ * Follows the order of section 13.2.2: If-Match (strong comparison) or else
+ * If-Unmodified-Since may fail the request; If-None-Match (weak comparison)
+ * or else If-Modified-Since may turn GET and HEAD into a 304. Lists, "*" and
+ * repeated fields are handled; malformed dates are ignored. The headers are
+ * scanned once, and dates are only parsed when no ETag condition decides.
+ * 
+ * @param hm HTTP message
+ * @param etag Current strong ETag of the selected representation, NULL if none
+ * @param mtime Its modification time, 0 if unknown (date conditions are then ignored)
+ * @return enum Precondition What to answer
+ */
+enum Precondition GH_ConditionalEvaluate(const struct mg_http_message *hm, const char *etag, time_t mtime);
+
+/**
+ * @brief Check an If-Match / If-None-Match field value against an ETag
+ * 
+ * @param list Field value: "*" or a comma-separated list of entity tags
+ * @param etag Quoted ETag to look for, NULL if the representation has none
+ * @param weak Weak comparison (W/ prefixes ignored) instead of strong
+ * @return bool true if a member matches; false for no match or from the first malformed member on
+ */
+bool GH_ConditionalEtagMatches(struct mg_str list, const char *etag, bool weak);
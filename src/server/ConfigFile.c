@@ -0,0 +1,100 @@
+#include "ConfigFile.h"
+#include <mongoose.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ==============================================================================
+// Internal helpers
+// ==============================================================================
+
+static struct mg_str trim(struct mg_str s) {
+  while (s.len > 0 && (s.buf[0] == ' ' || s.buf[0] == '\t')) {
+    s.buf++, s.len--;
+  }
+  while (s.len > 0 && (s.buf[s.len - 1] == ' ' || s.buf[s.len - 1] == '\t' || s.buf[s.len - 1] == '\r')) {
+    s.len--;
+  }
+  return s;
+}
+
+// Option name without its leading dashes: "--workers" -> "workers", "-w" -> "w"
+static const char *bare_name(const char *name) {
+  while (*name == '-') {
+    name++;
+  }
+  return name;
+}
+
+// ==============================================================================
+// Public API
+// ==============================================================================
+
+bool GH_ConfigFileLoad(struct ConfigFile *cf, const char *path) {
+  memset(cf, 0, sizeof(*cf));
+  struct mg_str text = mg_file_read(&mg_fs_posix, path);
+  if (text.buf == NULL) {
+    return false;
+  }
+  if (text.len > CONFIG_FILE_MAX_SIZE) {
+    MG_ERROR(("Config file %s is larger than %d bytes", path, CONFIG_FILE_MAX_SIZE));
+    free(text.buf);
+    return false;
+  }
+  cf->text = text.buf;
+
+  // Split in place: each key and value is terminated where its trimmed text ends
+  struct mg_str rest = text, line, key, value;
+  while (rest.len > 0 && mg_span(rest, &line, &rest, '\n')) {
+    line = trim(line);
+    if (line.len == 0 || line.buf[0] == '#') {
+      continue;
+    }
+    mg_span(line, &key, &value, '=');
+    if (key.len == line.len || (key = trim(key)).len == 0) {
+      MG_ERROR(("Config file %s: ignoring \"%.*s\", expected key = value", path, (int) line.len, line.buf));
+      continue;
+    }
+    if (cf->count == CONFIG_FILE_MAX_ENTRIES) {
+      MG_ERROR(("Config file %s: more than %d options, ignoring the rest", path, CONFIG_FILE_MAX_ENTRIES));
+      break;
+    }
+    value = trim(value);
+    key.buf[key.len] = '\0';
+    value.buf[value.len] = '\0';
+    cf->entries[cf->count].key = key.buf;
+    cf->entries[cf->count].value = value.buf;
+    cf->count++;
+  }
+  return true;
+}
+
+const char *GH_ConfigFileGet(struct ConfigFile *cf, const char *name, const char *fallback) {
+  const char *key = bare_name(name);
+  const char *value = fallback;
+  bool found = false;
+  // Last one wins; earlier duplicates count as used too
+  for (size_t i = cf->count; i-- > 0;) {
+    if (strcmp(cf->entries[i].key, key) == 0) {
+      value = found ? value : cf->entries[i].value;
+      found = true;
+      cf->entries[i].used = true;
+    }
+  }
+  return value;
+}
+
+size_t GH_ConfigFileReportUnused(const struct ConfigFile *cf) {
+  size_t unused = 0;
+  for (size_t i = 0; i < cf->count; i++) {
+    if (!cf->entries[i].used) {
+      MG_ERROR(("Config file: %s was not used (misspelled, or it does not apply)", cf->entries[i].key));
+      unused++;
+    }
+  }
+  return unused;
+}
+
+void GH_ConfigFileFree(struct ConfigFile *cf) {
+  free(cf->text);
+  memset(cf, 0, sizeof(*cf));
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <server/config.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define CONFIG_FILE_MAX_ENTRIES 64       //!< "key = value" lines kept at most, later ones are ignored
+#define CONFIG_FILE_MAX_SIZE (64 * 1024) //!< Larger config files are refused
+
+//! Struct for one "key = value" line of a config file
+struct ConfigFileEntry {
+    const char *key; //!< Option name without leading dashes, NUL-terminated
+    const char *value; //!< Value, NUL-terminated, surrounding whitespace trimmed
+    bool used; //!< Looked up by GH_ConfigFileGet()
+};
+
+//! Struct for the startup options read from a config file
+struct ConfigFile {
+    char *text; //!< File contents, split in place into the entries' strings (owned)
+    struct ConfigFileEntry entries[CONFIG_FILE_MAX_ENTRIES]; //!< Entries in file order
+    size_t count; //!< Number of entries
+};
+
+// ============================================================================
+// Config file: "key = value" startup options, the command line overrides them
+// ============================================================================
+
+/**
+ * @brief Read a config file
+ * 
+ * One option per line, named as on the command line without the leading
+ * dashes ("cache-size-mb = 256"); '#' starts a comment line. A key given
+ * twice takes its last value, as on the command line.
+ * 
+ * @param cf Config to fill; empty if the file cannot be read
+ * @param path File path
+ * @return bool true if the file was read
+ */
+bool GH_ConfigFileLoad(struct ConfigFile *cf, const char *path);
+
+/**
+ * @brief Value of an option
+ * 
+ * @param cf Config from GH_ConfigFileLoad() (may be empty)
+ * @param name Option name, with or without its leading dashes ("--workers", "-w")
+ * @param fallback Returned if the file does not set it
+ * @return const char* Value, valid until GH_ConfigFileFree()
+ */
+const char *GH_ConfigFileGet(struct ConfigFile *cf, const char *name, const char *fallback);
+
+/**
+ * @brief Log every entry no GH_ConfigFileGet() asked for: misspelled, or of a feature that is off
+ * 
+ * @param cf Config from GH_ConfigFileLoad()
+ * @return size_t Unused entries
+ */
+size_t GH_ConfigFileReportUnused(const struct ConfigFile *cf);
+
+/**
+ * @brief Free the file contents
+ * 
+ * @param cf Config from GH_ConfigFileLoad()
+ */
+void GH_ConfigFileFree(struct ConfigFile *cf);
@@ -0,0 +1,59 @@
+#pragma once
+#include <server/config.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <mongoose.h>
+
+struct CacheEntry;
+struct ResponseParts;
+
+//! Struct for an in-flight response body, sent from a pinned cache entry or a file
+struct ResponseStream {
+    struct CacheEntry *entry; //!< Pinned cache entry backing the body, NULL if none
+    const char *body; //!< Next body byte to send (cache entry bodies)
+    uint64_t remaining; //!< Bytes of the current segment left to send
+    struct ResponseParts *parts; //!< Remaining multipart/byteranges parts, NULL if none
+    FILE *file; //!< File being streamed from disk, NULL if none
+    uint64_t file_offset; //!< Next file offset to send
+};
+
+//! Struct for a request parked while its file is loaded off the event loop
+struct PendingRequest {
+    uint64_t start_ns; //!< GH_MetricsNow() when the request was parked
+    size_t len; //!< Length of buf
+    char buf[]; //!< Copy of the raw request, re-parsed when the load completes
+};
+
+//! Struct for a connection's place on its worker's idle wheel (see KeepAlive.h)
+struct KeepAliveTimer {
+    struct KeepAliveTimer *prev; //!< Previous timer in the wheel slot, NULL while not armed
+    struct KeepAliveTimer *next; //!< Next timer in the wheel slot
+    uint32_t active; //!< Last progress (request or bytes sent), mg_millis() truncated to 32 bits
+    uint32_t requests; //!< Requests received on the connection
+};
+
+//! Struct for per-connection state, stored in mg_connection::data
+struct ConnState {
+    struct ResponseStream stream; //!< Zero-copy body being sent
+    struct PendingRequest *pending; //!< Request waiting for an async load, NULL if none
+    bool admitted; //!< Counted against its address's connection cap
+    bool counted; //!< Counted against the global connection cap and armed on its worker's wheel
+    uint16_t sent_status; //!< Status of the last response whose head bypassed c->send, 0 once logged
+    uint64_t sent_bytes; //!< Head plus body size of that response
+    struct KeepAliveTimer keepalive; //!< Idle timeout and request count
+};
+
+_Static_assert(sizeof(struct ConnState) <= MG_DATA_SIZE, "ConnState must fit in MG_DATA_SIZE");
+
+/**
+ * @brief Get the per-connection state of a connection
+ * 
+ * @param c Connection
+ * @return struct ConnState* State living in c->data (zeroed by mongoose on accept)
+ */
+static inline struct ConnState *GH_ConnState(struct mg_connection *c) {
+  return (struct ConnState *) c->data;
+}
@@ -0,0 +1,284 @@
+#include "HotRestart.h"
+#include <mongoose.h>
+#include <string.h>
+
+#if !defined(_WIN32)
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+//! Struct for a control message; the request and the ack carry no descriptors
+struct HotRestartMessage {
+    uint32_t magic; //!< HOT_RESTART_MAGIC
+    uint32_t version; //!< HOT_RESTART_VERSION
+    uint32_t fd_count; //!< Plain listeners attached
+    uint32_t tls_fd_count; //!< HTTPS listeners attached after them
+    char snapshot[HOT_RESTART_PATH_MAX]; //!< Snapshot path, NUL-terminated
+};
+
+static bool fill_address(struct sockaddr_un *addr, const char *path) {
+  memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  size_t len = strlen(path);
+  if (len == 0 || len >= sizeof(addr->sun_path)) {
+    MG_ERROR(("Hot restart socket path too long: %s", path));
+    return false;
+  }
+  memcpy(addr->sun_path, path, len + 1);
+  return true;
+}
+
+// Wait until fd can be read (or written); false on timeout
+static bool wait_fd(int fd, short events, uint32_t timeout_ms) {
+  struct pollfd pfd = {fd, events, 0};
+  int rc;
+  do {
+    rc = poll(&pfd, 1, (int) timeout_ms);
+  } while (rc < 0 && errno == EINTR);
+  return rc > 0;
+}
+
+static bool valid_message(const struct HotRestartMessage *msg) {
+  return msg->magic == HOT_RESTART_MAGIC && msg->version == HOT_RESTART_VERSION &&
+         msg->fd_count + msg->tls_fd_count <= HOT_RESTART_MAX_FDS &&
+         memchr(msg->snapshot, '\0', sizeof(msg->snapshot)) != NULL;
+}
+
+static bool send_message(int fd, const struct HotRestartMessage *msg, const int *fds, int fd_count,
+                         uint32_t timeout_ms) {
+  struct iovec iov = {(void *) msg, sizeof(*msg)};
+  union {
+    char buf[CMSG_SPACE(sizeof(int) * HOT_RESTART_MAX_FDS)];
+    struct cmsghdr align;
+  } control;
+  struct msghdr mh;
+  memset(&mh, 0, sizeof(mh));
+  mh.msg_iov = &iov;
+  mh.msg_iovlen = 1;
+  if (fd_count > 0) {
+    memset(&control, 0, sizeof(control));
+    mh.msg_control = control.buf;
+    mh.msg_controllen = CMSG_SPACE(sizeof(int) * (size_t) fd_count);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&mh);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * (size_t) fd_count);
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * (size_t) fd_count);
+  }
+  // The message is far below the socket buffer size: it goes out whole or not at all
+  if (!wait_fd(fd, POLLOUT, timeout_ms)) {
+    return false;
+  }
+  ssize_t n;
+  do {
+    n = sendmsg(fd, &mh, MSG_NOSIGNAL);
+  } while (n < 0 && errno == EINTR);
+  return n == (ssize_t) sizeof(*msg);
+}
+
+// Receive one message; attached descriptors land in fds (close-on-exec), *fd_count says how many
+static bool recv_message(int fd, struct HotRestartMessage *msg, int *fds, int *fd_count, uint32_t timeout_ms) {
+  struct iovec iov = {msg, sizeof(*msg)};
+  union {
+    char buf[CMSG_SPACE(sizeof(int) * HOT_RESTART_MAX_FDS)];
+    struct cmsghdr align;
+  } control;
+  struct msghdr mh;
+  memset(&mh, 0, sizeof(mh));
+  mh.msg_iov = &iov;
+  mh.msg_iovlen = 1;
+  mh.msg_control = control.buf;
+  mh.msg_controllen = sizeof(control.buf);
+  *fd_count = 0;
+  if (!wait_fd(fd, POLLIN, timeout_ms)) {
+    return false;
+  }
+  ssize_t n;
+  do {
+    n = recvmsg(fd, &mh, MSG_CMSG_CLOEXEC);
+  } while (n < 0 && errno == EINTR);
+
+  for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&mh); n >= 0 && cmsg != NULL; cmsg = CMSG_NXTHDR(&mh, cmsg)) {
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+      int count = (int) ((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+      memcpy(fds + *fd_count, CMSG_DATA(cmsg), sizeof(int) * (size_t) count);
+      *fd_count += count;
+    }
+  }
+  return n == (ssize_t) sizeof(*msg) && (mh.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) == 0 && valid_message(msg);
+}
+
+static void close_fds(int *fds, int count) {
+  for (int i = 0; i < count; i++) {
+    close(fds[i]);
+  }
+}
+
+// ============================================================================
+// Public API
+// ============================================================================
+
+bool GH_HotRestartListen(struct HotRestart *hr, const char *path) {
+  struct sockaddr_un addr;
+  hr->fd = -1;
+  if (!fill_address(&addr, path)) {
+    return false;
+  }
+  snprintf(hr->path, sizeof(hr->path), "%s", path);
+  unlink(path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return false;
+  }
+  if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0 || listen(fd, 4) != 0) {
+    MG_ERROR(("Cannot listen for hot restarts on %s: %d", path, errno));
+    close(fd);
+    return false;
+  }
+  hr->fd = fd;
+  return true;
+}
+
+int GH_HotRestartAccept(struct HotRestart *hr) {
+  if (hr->fd < 0) {
+    return -1;
+  }
+  return accept4(hr->fd, NULL, NULL, SOCK_CLOEXEC);  // Blocking: every wait below is bounded by poll()
+}
+
+bool GH_HotRestartOffer(int peer, const struct HotRestartHandoff *handoff, uint32_t timeout_ms) {
+  struct HotRestartMessage msg;
+  int fds[HOT_RESTART_MAX_FDS], fd_count = 0;
+  bool ok = recv_message(peer, &msg, fds, &fd_count, timeout_ms) && fd_count == 0;
+  close_fds(fds, fd_count);
+
+  if (ok) {
+    memset(&msg, 0, sizeof(msg));
+    msg.magic = HOT_RESTART_MAGIC;
+    msg.version = HOT_RESTART_VERSION;
+    msg.fd_count = (uint32_t) handoff->fd_count;
+    msg.tls_fd_count = (uint32_t) handoff->tls_fd_count;
+    snprintf(msg.snapshot, sizeof(msg.snapshot), "%s", handoff->snapshot);
+    ok = send_message(peer, &msg, handoff->fds, handoff->fd_count + handoff->tls_fd_count, timeout_ms);
+  }
+
+  // The ack comes once the new process serves the sockets; a close means it gave up
+  ok = ok && recv_message(peer, &msg, fds, &fd_count, 2 * timeout_ms) && fd_count == 0;
+  close_fds(fds, fd_count);
+  close(peer);
+  return ok;
+}
+
+int GH_HotRestartConnect(const char *path, struct HotRestartHandoff *handoff, uint32_t timeout_ms) {
+  struct sockaddr_un addr;
+  memset(handoff, 0, sizeof(*handoff));
+  if (!fill_address(&addr, path)) {
+    return -1;
+  }
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+    close(fd);  // Nobody listening: a cold start
+    return -1;
+  }
+
+  struct HotRestartMessage msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.magic = HOT_RESTART_MAGIC;
+  msg.version = HOT_RESTART_VERSION;
+  int fd_count = 0;
+  // The old process writes its cache out before answering
+  bool ok = send_message(fd, &msg, NULL, 0, timeout_ms) &&
+            recv_message(fd, &msg, handoff->fds, &fd_count, timeout_ms) &&
+            fd_count == (int) (msg.fd_count + msg.tls_fd_count) && msg.fd_count > 0 &&
+            (msg.tls_fd_count == 0 || msg.tls_fd_count == msg.fd_count);
+  if (!ok) {
+    MG_ERROR(("Hot restart from %s failed, starting cold", path));
+    close_fds(handoff->fds, fd_count);
+    memset(handoff, 0, sizeof(*handoff));
+    close(fd);
+    return -1;
+  }
+
+  for (int i = 0; i < fd_count; i++) {
+    fcntl(handoff->fds[i], F_SETFL, fcntl(handoff->fds[i], F_GETFL, 0) | O_NONBLOCK);
+  }
+  handoff->fd_count = (int) msg.fd_count;
+  handoff->tls_fd_count = (int) msg.tls_fd_count;
+  memcpy(handoff->snapshot, msg.snapshot, sizeof(handoff->snapshot));
+  return fd;
+}
+
+void GH_HotRestartDropTls(struct HotRestartHandoff *handoff) {
+  close_fds(handoff->fds + handoff->fd_count, handoff->tls_fd_count);
+  handoff->tls_fd_count = 0;
+}
+
+bool GH_HotRestartConfirm(int peer) {
+  struct HotRestartMessage msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.magic = HOT_RESTART_MAGIC;
+  msg.version = HOT_RESTART_VERSION;
+  bool ok = send_message(peer, &msg, NULL, 0, APP_HOT_RESTART_TIMEOUT_MS);
+  close(peer);
+  return ok;
+}
+
+void GH_HotRestartClose(struct HotRestart *hr, bool unlink_path) {
+  if (hr->fd >= 0) {
+    close(hr->fd);
+    hr->fd = -1;
+    if (unlink_path) {
+      unlink(hr->path);
+    }
+  }
+}
+
+#else
+
+bool GH_HotRestartListen(struct HotRestart *hr, const char *path) {
+  (void) path;
+  hr->fd = -1;
+  return false;
+}
+
+int GH_HotRestartAccept(struct HotRestart *hr) {
+  (void) hr;
+  return -1;
+}
+
+bool GH_HotRestartOffer(int peer, const struct HotRestartHandoff *handoff, uint32_t timeout_ms) {
+  (void) peer;
+  (void) handoff;
+  (void) timeout_ms;
+  return false;
+}
+
+int GH_HotRestartConnect(const char *path, struct HotRestartHandoff *handoff, uint32_t timeout_ms) {
+  (void) path;
+  (void) timeout_ms;
+  memset(handoff, 0, sizeof(*handoff));
+  return -1;
+}
+
+void GH_HotRestartDropTls(struct HotRestartHandoff *handoff) {
+  handoff->tls_fd_count = 0;
+}
+
+bool GH_HotRestartConfirm(int peer) {
+  (void) peer;
+  return false;
+}
+
+void GH_HotRestartClose(struct HotRestart *hr, bool unlink_path) {
+  (void) unlink_path;
+  hr->fd = -1;
+}
+
+#endif
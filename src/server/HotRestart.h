@@ -0,0 +1,107 @@
+#pragma once
+#include <server/config.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef APP_HOT_RESTART_TIMEOUT_MS
+#define APP_HOT_RESTART_TIMEOUT_MS 10000 //!< Default wait for the other process at each step of a handoff
+#endif
+#ifndef APP_HOT_RESTART_DRAIN_MS
+#define APP_HOT_RESTART_DRAIN_MS 30000   //!< Default time a replaced process lets its connections finish
+#endif
+
+#define HOT_RESTART_MAX_FDS 128          //!< Listening sockets handed over at most (one or two per worker)
+#define HOT_RESTART_PATH_MAX 256         //!< Size of the snapshot path sent with them, terminator included
+#define HOT_RESTART_MAGIC 0x47485253u    //!< "GHRS", first field of every control message
+#define HOT_RESTART_VERSION 1u           //!< Bumped when the control messages change
+
+//! Struct for the control socket a running server takes hot restart requests on
+struct HotRestart {
+    int fd; //!< Listening Unix socket, -1 if closed
+    char path[108]; //!< Its path (sizeof(sockaddr_un.sun_path))
+};
+
+//! Struct for what a running server hands its replacement
+struct HotRestartHandoff {
+    int fds[HOT_RESTART_MAX_FDS]; //!< Listening sockets: fd_count plain ones, then tls_fd_count HTTPS ones
+    int fd_count; //!< Plain HTTP listeners, one per worker
+    int tls_fd_count; //!< HTTPS listeners, 0 or fd_count
+    char snapshot[HOT_RESTART_PATH_MAX]; //!< Snapshot file holding the cache, "" if none was written
+};
+
+// ============================================================================
+// Hot restart: listener handoff over a Unix socket (SCM_RIGHTS)
+// ============================================================================
+
+/**
+ * @brief Take hot restart requests on a Unix socket
+ * 
+ * A stale socket file left by a process that is gone is replaced. Call once
+ * no other server answers on path, i.e. after GH_HotRestartConnect() failed
+ * or the handoff was confirmed.
+ * 
+ * @param hr Control socket to initialize
+ * @param path Socket path
+ * @return bool true if listening, false on error or if path is too long
+ */
+bool GH_HotRestartListen(struct HotRestart *hr, const char *path);
+
+/**
+ * @brief Accept a pending hot restart request without blocking
+ * 
+ * @param hr Control socket
+ * @return int Connected peer, -1 if none is waiting
+ */
+int GH_HotRestartAccept(struct HotRestart *hr);
+
+/**
+ * @brief Hand the listeners to a new process and wait until it serves them
+ * 
+ * Reads the peer's request, sends handoff (the descriptors travel as
+ * SCM_RIGHTS, so both processes share the same sockets and nothing queued in
+ * them is lost), then waits for GH_HotRestartConfirm(). Each step waits up to
+ * timeout_ms, the confirmation twice that. Closes peer.
+ * 
+ * @param peer Connection from GH_HotRestartAccept()
+ * @param handoff Listeners and snapshot to hand over
+ * @param timeout_ms Wait for each message
+ * @return bool true if the new process took over; false if it failed or went
+ *              away, and this process keeps serving
+ */
+bool GH_HotRestartOffer(int peer, const struct HotRestartHandoff *handoff, uint32_t timeout_ms);
+
+/**
+ * @brief Ask the server running on path for its listeners
+ * 
+ * @param path Control socket path
+ * @param handoff Receives the listeners (close-on-exec, non-blocking) and the snapshot path
+ * @param timeout_ms Wait for the answer
+ * @return int Connection to confirm on once the listeners are served, or -1
+ *             for a cold start (no server, or the handoff failed)
+ */
+int GH_HotRestartConnect(const char *path, struct HotRestartHandoff *handoff, uint32_t timeout_ms);
+
+/**
+ * @brief Close the HTTPS listeners of a handoff, for a process that serves none
+ * 
+ * @param handoff Handoff from GH_HotRestartConnect(); tls_fd_count becomes 0
+ */
+void GH_HotRestartDropTls(struct HotRestartHandoff *handoff);
+
+/**
+ * @brief Tell the old process this one now serves the listeners; closes peer
+ * 
+ * @param peer Connection from GH_HotRestartConnect()
+ * @return bool true if the old process was told
+ */
+bool GH_HotRestartConfirm(int peer);
+
+/**
+ * @brief Stop taking requests
+ * 
+ * @param hr Control socket
+ * @param unlink_path true to remove the socket file, false if a new process already bound it
+ */
+void GH_HotRestartClose(struct HotRestart *hr, bool unlink_path);
@@ -0,0 +1,111 @@
+#include "KeepAlive.h"
+#include <string.h>
+
+_Static_assert((KEEPALIVE_WHEEL_SLOTS & (KEEPALIVE_WHEEL_SLOTS - 1)) == 0, "KEEPALIVE_WHEEL_SLOTS must be a power of two");
+
+// ==============================================================================
+// Internal helpers
+// ==============================================================================
+
+// The timer lives in c->data, so the connection is found from its address
+static struct mg_connection *timer_conn(struct KeepAliveTimer *timer) {
+  char *state = (char *) timer - offsetof(struct ConnState, keepalive);
+  return (struct mg_connection *) (state - offsetof(struct mg_connection, data));
+}
+
+static void timer_unlink(struct KeepAliveTimer *timer) {
+  timer->prev->next = timer->next;
+  timer->next->prev = timer->prev;
+  timer->prev = timer->next = NULL;
+}
+
+// Put a timer in the slot of the first tick at or after deadline; ticks already
+// expired go to the next one, so nothing waits a whole revolution by mistake
+static void timer_link(struct KeepAlive *ka, struct KeepAliveTimer *timer, uint64_t deadline) {
+  uint64_t tick = (deadline + KEEPALIVE_TICK_MS - 1) / KEEPALIVE_TICK_MS;
+  if (tick < ka->tick) {
+    tick = ka->tick;
+  }
+  struct KeepAliveTimer *head = &ka->slots[tick & (KEEPALIVE_WHEEL_SLOTS - 1)];
+  timer->prev = head->prev;
+  timer->next = head;
+  head->prev->next = timer;
+  head->prev = timer;
+}
+
+// Close the connection, or move its timer to when it may next be due
+static bool timer_expire(struct KeepAlive *ka, struct KeepAliveTimer *timer, uint64_t now) {
+  struct mg_connection *c = timer_conn(timer);
+  int32_t idle = (int32_t) ((uint32_t) now - timer->active);
+  if (GH_ConnState(c)->pending != NULL) {
+    timer_link(ka, timer, now + ka->timeout_ms);  // Waiting on us, not on the client
+    return false;
+  }
+  if (idle < (int32_t) ka->timeout_ms) {
+    timer_link(ka, timer, now + (uint64_t) (ka->timeout_ms - (uint32_t) (idle > 0 ? idle : 0)));
+    return false;
+  }
+  c->is_closing = 1;
+  return true;
+}
+
+// ==============================================================================
+// Public API
+// ==============================================================================
+
+void GH_KeepAliveInit(struct KeepAlive *ka, uint32_t timeout_ms, uint32_t max_requests, uint64_t now) {
+  memset(ka, 0, sizeof(*ka));
+  for (size_t i = 0; i < KEEPALIVE_WHEEL_SLOTS; i++) {
+    ka->slots[i].prev = ka->slots[i].next = &ka->slots[i];
+  }
+  ka->tick = now / KEEPALIVE_TICK_MS;
+  ka->timeout_ms = timeout_ms;
+  ka->max_requests = max_requests;
+}
+
+void GH_KeepAliveAdd(struct KeepAlive *ka, struct mg_connection *c, uint64_t now) {
+  struct KeepAliveTimer *timer = &GH_ConnState(c)->keepalive;
+  timer->active = (uint32_t) now;
+  timer->requests = 0;
+  if (ka->timeout_ms > 0) {
+    timer_link(ka, timer, now + ka->timeout_ms);
+  }
+}
+
+void GH_KeepAliveRemove(struct mg_connection *c) {
+  struct KeepAliveTimer *timer = &GH_ConnState(c)->keepalive;
+  if (timer->prev != NULL) {
+    timer_unlink(timer);
+  }
+}
+
+size_t GH_KeepAliveExpire(struct KeepAlive *ka, uint64_t now) {
+  uint64_t now_tick = now / KEEPALIVE_TICK_MS;
+  if (now_tick < ka->tick) {
+    return 0;
+  }
+  // After a stall longer than a revolution, visiting every slot once is enough
+  if (now_tick - ka->tick >= KEEPALIVE_WHEEL_SLOTS) {
+    ka->tick = now_tick - KEEPALIVE_WHEEL_SLOTS + 1;
+  }
+
+  size_t closed = 0;
+  while (ka->tick <= now_tick) {
+    struct KeepAliveTimer *head = &ka->slots[ka->tick & (KEEPALIVE_WHEEL_SLOTS - 1)];
+    ka->tick++;
+    if (head->next == head) {
+      continue;
+    }
+    // Detach the slot first: timers re-armed below land in later ones
+    struct KeepAliveTimer *timer = head->next;
+    head->prev->next = NULL;
+    head->prev = head->next = head;
+    while (timer != NULL) {
+      struct KeepAliveTimer *next = timer->next;
+      timer->prev = timer->next = NULL;
+      closed += timer_expire(ka, timer, now);
+      timer = next;
+    }
+  }
+  return closed;
+}
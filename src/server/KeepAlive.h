@@ -0,0 +1,108 @@
+#pragma once
+#include <server/config.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <mongoose.h>
+#include <server/Connection.h>
+
+#ifndef APP_KEEPALIVE_TIMEOUT_MS
+#define APP_KEEPALIVE_TIMEOUT_MS 30000 //!< Default time a connection may go without progress before it is closed, 0 = never
+#endif
+#ifndef APP_KEEPALIVE_MAX_REQUESTS
+#define APP_KEEPALIVE_MAX_REQUESTS 1000 //!< Default requests served per connection before it is closed, 0 = unlimited
+#endif
+
+#define KEEPALIVE_WHEEL_SLOTS 512      //!< Wheel slots (power of two); timers further out go round again
+#define KEEPALIVE_TICK_MS 100          //!< Time covered by one slot; idle connections close up to one tick late
+
+//! Struct for one worker's keep-alive limits: a timer wheel over its connections
+struct KeepAlive {
+    struct KeepAliveTimer slots[KEEPALIVE_WHEEL_SLOTS]; //!< Circular list heads, one per tick
+    uint64_t tick; //!< Next tick to expire, in KEEPALIVE_TICK_MS units of mg_millis()
+    uint32_t timeout_ms; //!< Time without progress before a connection is closed, 0 = never
+    uint32_t max_requests; //!< Requests per connection, 0 = unlimited
+};
+
+// ============================================================================
+// Keep-alive limits (per worker, event loop thread only, no locks)
+// ============================================================================
+
+/**
+ * @brief Initialize a worker's wheel
+ * 
+ * Progress is a complete request or bytes sent; reading does not count, so a
+ * client trickling a request in never takes longer than the timeout either.
+ * 
+ * @param ka Wheel to initialize
+ * @param timeout_ms Time without progress before a connection is closed, 0 = never
+ * @param max_requests Requests per connection, 0 = unlimited
+ * @param now Current timestamp in milliseconds
+ */
+void GH_KeepAliveInit(struct KeepAlive *ka, uint32_t timeout_ms, uint32_t max_requests, uint64_t now);
+
+/**
+ * @brief Arm the timer of a newly accepted connection
+ * 
+ * @param ka Wheel of the connection's worker
+ * @param c Connection
+ * @param now Current timestamp in milliseconds
+ */
+void GH_KeepAliveAdd(struct KeepAlive *ka, struct mg_connection *c, uint64_t now);
+
+/**
+ * @brief Take a connection off the wheel; call on MG_EV_CLOSE
+ * 
+ * @param c Connection, armed or not
+ */
+void GH_KeepAliveRemove(struct mg_connection *c);
+
+/**
+ * @brief Close connections whose timeout passed; call on every poll
+ * 
+ * Activity only stamps the connection. Timers are moved when their slot
+ * comes up, so a busy connection costs one relink per timeout at most, and
+ * a poll between ticks costs one comparison. Connections waiting on a load
+ * are never closed.
+ * 
+ * @param ka Wheel
+ * @param now Current timestamp in milliseconds
+ * @return size_t Connections marked for closing
+ */
+size_t GH_KeepAliveExpire(struct KeepAlive *ka, uint64_t now);
+
+/**
+ * @brief Note progress on a connection
+ * 
+ * @param c Connection
+ * @param now Current timestamp in milliseconds
+ */
+static inline void GH_KeepAliveTouch(struct mg_connection *c, uint64_t now) {
+  GH_ConnState(c)->keepalive.active = (uint32_t) now;
+}
+
+/**
+ * @brief Count a request received on a connection
+ * 
+ * Once the count reaches the limit, GH_KeepAliveExhausted reports it.
+ * 
+ * @param c Connection
+ * @param now Current timestamp in milliseconds
+ */
+static inline void GH_KeepAliveRequest(struct mg_connection *c, uint64_t now) {
+  struct KeepAliveTimer *timer = &GH_ConnState(c)->keepalive;
+  timer->active = (uint32_t) now;
+  timer->requests++;
+}
+
+/**
+ * @brief Check whether a connection has served its last request
+ * 
+ * @param ka Wheel of the connection's worker
+ * @param c Connection
+ * @return bool true once max_requests requests were received
+ */
+static inline bool GH_KeepAliveExhausted(const struct KeepAlive *ka, struct mg_connection *c) {
+  return ka->max_requests != 0 && GH_ConnState(c)->keepalive.requests >= ka->max_requests;
+}
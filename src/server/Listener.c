@@ -0,0 +1,180 @@
+#include "Listener.h"
+
+#if !defined(_WIN32)
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+#if MG_ENABLE_EPOLL
+#include <sys/epoll.h>
+#endif
+
+#ifndef APP_LISTEN_BACKLOG
+#define APP_LISTEN_BACKLOG 1024
+#endif
+
+// Mongoose's HTTP protocol handler is private; borrow it from a throwaway
+// listener so our own sockets parse HTTP exactly like mg_http_listen() ones
+static mg_event_handler_t http_protocol_handler(void) {
+  static mg_event_handler_t s_pfn = NULL;
+  if (s_pfn == NULL) {
+    struct mg_mgr mgr;
+    mg_mgr_init(&mgr);
+    struct mg_connection *c = mg_http_listen(&mgr, "http://127.0.0.1:0", NULL, NULL);
+    if (c != NULL) {
+      s_pfn = c->pfn;
+    }
+    mg_mgr_free(&mgr);
+  }
+  return s_pfn;
+}
+
+bool GH_ListenerReusePortSupported(void) {
+#if defined(SO_REUSEPORT) && !defined(_WIN32)
+  return true;
+#else
+  return false;
+#endif
+}
+
+struct mg_connection *GH_ListenerHttpReusePort(struct mg_mgr *mgr, const char *url,
+                                               mg_event_handler_t fn, void *fn_data) {
+#if defined(SO_REUSEPORT) && !defined(_WIN32)
+  mg_event_handler_t pfn = http_protocol_handler();
+  if (pfn == NULL) {
+    MG_ERROR(("Cannot resolve HTTP protocol handler"));
+    return NULL;
+  }
+
+  struct mg_addr addr;
+  memset(&addr, 0, sizeof(addr));
+  if (!mg_aton(mg_url_host(url), &addr)) {
+    MG_ERROR(("Invalid listen address: %s", url));
+    return NULL;
+  }
+  addr.port = mg_htons(mg_url_port(url));
+
+  struct sockaddr_storage ss;
+  socklen_t ss_len;
+  memset(&ss, 0, sizeof(ss));
+  if (addr.is_ip6) {
+    struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)&ss;
+    sin6->sin6_family = AF_INET6;
+    sin6->sin6_port = addr.port;
+    memcpy(&sin6->sin6_addr, addr.ip, 16);
+    ss_len = sizeof(*sin6);
+  } else {
+    struct sockaddr_in *sin = (struct sockaddr_in *)&ss;
+    sin->sin_family = AF_INET;
+    sin->sin_port = addr.port;
+    memcpy(&sin->sin_addr, addr.ip, 4);
+    ss_len = sizeof(*sin);
+  }
+
+  int on = 1;
+  int fd = socket(ss.ss_family, SOCK_STREAM, IPPROTO_TCP);
+  if (fd < 0) {
+    MG_ERROR(("socket: %d", errno));
+    return NULL;
+  }
+  if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) != 0 ||
+      setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) != 0 ||
+      bind(fd, (struct sockaddr *)&ss, ss_len) != 0 ||
+      listen(fd, APP_LISTEN_BACKLOG) != 0 ||
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK) != 0) {
+    MG_ERROR(("Cannot listen on %s: %d", url, errno));
+    close(fd);
+    return NULL;
+  }
+
+  struct mg_connection *c = GH_ListenerHttpAdopt(mgr, fd, fn, fn_data);
+  if (c == NULL) {
+    close(fd);
+  }
+  return c;
+#else
+  (void)mgr;
+  (void)fn;
+  (void)fn_data;
+  MG_ERROR(("SO_REUSEPORT is not available, cannot listen on %s per worker", url));
+  return NULL;
+#endif
+}
+
+struct mg_connection *GH_ListenerHttpAdopt(struct mg_mgr *mgr, int fd, mg_event_handler_t fn, void *fn_data) {
+#if !defined(_WIN32)
+  mg_event_handler_t pfn = http_protocol_handler();
+  struct sockaddr_storage ss;
+  socklen_t ss_len = sizeof(ss);
+  if (pfn == NULL || getsockname(fd, (struct sockaddr *)&ss, &ss_len) != 0) {
+    MG_ERROR(("Cannot adopt listening socket %d", fd));
+    return NULL;
+  }
+
+  struct mg_addr addr;
+  memset(&addr, 0, sizeof(addr));
+  if (ss.ss_family == AF_INET6) {
+    struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)&ss;
+    addr.is_ip6 = true;
+    addr.port = sin6->sin6_port;
+    memcpy(addr.ip, &sin6->sin6_addr, 16);
+  } else {
+    struct sockaddr_in *sin = (struct sockaddr_in *)&ss;
+    addr.port = sin->sin_port;
+    memcpy(addr.ip, &sin->sin_addr, 4);
+  }
+
+  struct mg_connection *c = mg_wrapfd(mgr, fd, fn, fn_data);
+  if (c == NULL) {
+    return NULL;
+  }
+  c->is_listening = 1;
+  c->pfn = pfn;
+  c->loc = addr;
+  return c;
+#else
+  (void)mgr;
+  (void)fn;
+  (void)fn_data;
+  MG_ERROR(("Cannot adopt listening socket %d on this platform", fd));
+  return NULL;
+#endif
+}
+
+void GH_ListenerPause(struct mg_connection *c, bool paused) {
+  c->is_full = paused ? 1 : 0;
+#if MG_ENABLE_EPOLL
+  // Level-triggered EPOLLIN would wake the loop on every poll while the backlog is non-empty
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = paused ? 0 : EPOLLIN | EPOLLERR | EPOLLHUP;
+  ev.data.ptr = c;
+  if (epoll_ctl(c->mgr->epoll_fd, EPOLL_CTL_MOD, (int) (size_t) c->fd, &ev) != 0) {
+    MG_ERROR(("epoll_ctl on listener %lu: %d", c->id, errno));
+  }
+#endif
+}
+
+size_t GH_ListenerRaiseFdLimit(size_t wanted) {
+#if !defined(_WIN32)
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) != 0) {
+    return SIZE_MAX;
+  }
+  rlim_t target = wanted == SIZE_MAX || (rlim_t) wanted > limit.rlim_max ? limit.rlim_max : (rlim_t) wanted;
+  if (target > limit.rlim_cur) {
+    limit.rlim_cur = target;
+    if (setrlimit(RLIMIT_NOFILE, &limit) != 0) {
+      getrlimit(RLIMIT_NOFILE, &limit);
+    }
+  }
+  return limit.rlim_cur == RLIM_INFINITY || limit.rlim_cur > (rlim_t) SIZE_MAX ? SIZE_MAX : (size_t) limit.rlim_cur;
+#else
+  (void) wanted;
+  return SIZE_MAX;
+#endif
+}
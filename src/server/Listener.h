@@ -0,0 +1,76 @@
+#pragma once
+#include <server/config.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <mongoose.h>
+
+#ifndef APP_MAX_CONNECTIONS
+#define APP_MAX_CONNECTIONS 50000     //!< Default open connections across all workers, 0 = unlimited
+#endif
+
+#define LISTENER_FD_RESERVE 64        //!< Descriptors kept apart from connections: listeners, files, logs, wakeups
+#define ACCEPT_BACKOFF_MIN_MS 10      //!< First accept pause once the connection cap is reached
+#define ACCEPT_BACKOFF_MAX_MS 1000    //!< Longest accept pause; it doubles while the cap stays reached
+
+// ============================================================================
+// Listener helpers for multi-worker mode
+// ============================================================================
+
+/**
+ * @brief Check whether this platform can run several SO_REUSEPORT listeners
+ * 
+ * @return bool true if per-worker listeners are supported
+ */
+bool GH_ListenerReusePortSupported(void);
+
+/**
+ * @brief Create an HTTP listener whose socket has SO_REUSEPORT set
+ * 
+ * Every worker calls this with the same URL; the kernel then spreads incoming
+ * connections across the workers' sockets. The returned connection behaves like
+ * one created by mg_http_listen().
+ * 
+ * @param mgr Event manager owning the listener
+ * @param url Listen URL, e.g. "http://0.0.0.0:8000"
+ * @param fn Event handler
+ * @param fn_data Event handler data
+ * @return struct mg_connection* Listening connection, NULL on failure
+ */
+struct mg_connection *GH_ListenerHttpReusePort(struct mg_mgr *mgr, const char *url,
+                                               mg_event_handler_t fn, void *fn_data);
+
+/**
+ * @brief Serve HTTP on a socket that is already bound and listening
+ * 
+ * For sockets handed over by another process (see server/HotRestart.h); the
+ * listening address is read back from the socket. The returned connection
+ * behaves like one created by mg_http_listen() and owns fd.
+ * 
+ * @param mgr Event manager owning the listener
+ * @param fd Non-blocking listening socket
+ * @param fn Event handler
+ * @param fn_data Event handler data
+ * @return struct mg_connection* Listening connection, NULL on failure (fd is left open)
+ */
+struct mg_connection *GH_ListenerHttpAdopt(struct mg_mgr *mgr, int fd, mg_event_handler_t fn, void *fn_data);
+
+/**
+ * @brief Stop or resume accepting on a listener
+ * 
+ * While paused, new connections wait in the kernel backlog instead of being
+ * accepted and closed. With the epoll backend the socket is taken out of the
+ * interest set; the poll() and select() backends skip it while it is full.
+ * 
+ * @param c Listening connection
+ * @param paused true to stop accepting, false to resume
+ */
+void GH_ListenerPause(struct mg_connection *c, bool paused);
+
+/**
+ * @brief Raise the open file limit toward what a connection cap needs
+ * 
+ * @param wanted Descriptors wanted, SIZE_MAX for as many as allowed
+ * @return size_t Soft limit now in effect, SIZE_MAX if the platform has none
+ */
+size_t GH_ListenerRaiseFdLimit(size_t wanted);
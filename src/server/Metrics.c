@@ -0,0 +1,266 @@
+#include "Metrics.h"
+
+#include <stdio.h>
+#include <string.h>
+
+GH_THREAD_LOCAL struct MetricsShard *g_metrics_shard = NULL;
+
+// Registered shards; never freed, so exporters can walk them after reading the head
+static GH_Mutex s_lock;
+static bool s_lock_ready = false;
+static struct MetricsShard *s_shards = NULL;
+
+//! Export description of a counter; rows sharing a name must be adjacent
+struct MetricsCounterInfo {
+    const char *name; //!< Prometheus metric name
+    const char *labels; //!< Label set without braces, "" for none
+    const char *help; //!< HELP text, printed once per name
+    const char *key; //!< JSON key
+};
+
+static const struct MetricsCounterInfo s_counters[MC_COUNT] = {
+  [MC_REQUESTS] = {"gh_http_requests_total", "", "HTTP requests handled", "requests"},
+  [MC_SERVED_SNAPSHOT] = {"gh_static_responses_total", "source=\"snapshot\"", "Static responses by source", "served_snapshot"},
+  [MC_SERVED_CACHE] = {"gh_static_responses_total", "source=\"cache\"", NULL, "served_cache"},
+  [MC_SERVED_DISK] = {"gh_static_responses_total", "source=\"disk\"", NULL, "served_disk"},
+  [MC_NOT_MODIFIED] = {"gh_http_responses_total", "code=\"304\"", "Responses by notable status code", "not_modified"},
+  [MC_PARTIAL] = {"gh_http_responses_total", "code=\"206\"", NULL, "partial"},
+  [MC_PRECONDITION_FAILED] = {"gh_http_responses_total", "code=\"412\"", NULL, "precondition_failed"},
+  [MC_RANGE_NOT_SATISFIABLE] = {"gh_http_responses_total", "code=\"416\"", NULL, "range_not_satisfiable"},
+  [MC_NOT_FOUND] = {"gh_http_responses_total", "code=\"404\"", NULL, "not_found"},
+  [MC_BAD_REQUEST] = {"gh_http_responses_total", "code=\"400\"", NULL, "bad_request"},
+  [MC_ENCODED] = {"gh_http_encoded_responses_total", "", "Responses with a br or gzip body", "encoded"},
+  [MC_BYTES_SENT] = {"gh_http_sent_bytes_total", "", "Bytes written to client sockets", "bytes_sent"},
+  [MC_CACHE_HITS] = {"gh_cache_lookups_total", "result=\"hit\"", "Cache lookups by result", "hits"},
+  [MC_CACHE_MISSES] = {"gh_cache_lookups_total", "result=\"miss\"", NULL, "misses"},
+  [MC_CACHE_ADDS] = {"gh_cache_adds_total", "", "Entries added to the cache", "adds"},
+  [MC_CACHE_ADDED_BYTES] = {"gh_cache_added_bytes_total", "", "Bytes charged by added entries", "added_bytes"},
+  [MC_CACHE_REJECTED] = {"gh_cache_rejected_total", "", "Entries refused by size-aware admission", "rejected"},
+  [MC_CACHE_EVICTIONS] = {"gh_cache_drops_total", "reason=\"evicted\"", "Entries dropped from the cache by reason", "evictions"},
+  [MC_CACHE_EXPIRATIONS] = {"gh_cache_drops_total", "reason=\"expired\"", NULL, "expirations"},
+  [MC_CACHE_REMOVALS] = {"gh_cache_drops_total", "reason=\"removed\"", NULL, "removals"},
+  [MC_CACHE_REVALIDATIONS] = {"gh_cache_revalidations_total", "", "Files stat'ed to revalidate cache entries", "revalidations"},
+  [MC_CACHE_STALE] = {"gh_cache_stale_total", "", "Revalidations that found a changed file", "stale"},
+  [MC_CACHE_BUDGET_ADMIN] = {"gh_cache_budget_changes_total", "cause=\"admin\"", "Cache budget changes by cause", "budget_admin"},
+  [MC_CACHE_BUDGET_SHRINKS] = {"gh_cache_budget_changes_total", "cause=\"pressure\"", NULL, "budget_shrinks"},
+  [MC_CACHE_BUDGET_GROWS] = {"gh_cache_budget_changes_total", "cause=\"headroom\"", NULL, "budget_grows"},
+  [MC_NEGATIVE_HITS] = {"gh_negative_cache_hits_total", "", "404s answered from the negative cache", "negative_hits"},
+  [MC_NEGATIVE_ADDS] = {"gh_negative_cache_adds_total", "", "Missing paths remembered by the negative cache", "negative_adds"},
+  [MC_SERVER_DATA] = {"gh_server_data_total", "", "server_data.php responses sent from the prebuilt block", "server_data"},
+  [MC_SERVER_DATA_OUTDATED] = {"gh_server_data_outdated_total", "", "server_data.php requests from clients below min_version", "server_data_outdated"},
+  [MC_SERVER_DATA_RELOADS] = {"gh_server_data_reloads_total", "", "server_data config reloads", "server_data_reloads"},
+  [MC_ADMISSION_CONN_REJECTED] = {"gh_admission_rejected_total", "reason=\"connections\"", "Connections and requests refused by per-address limits", "conns_rejected"},
+  [MC_ADMISSION_RATE_LIMITED] = {"gh_admission_rejected_total", "reason=\"rate\"", NULL, "rate_limited"},
+  [MC_CONNS_IDLE_CLOSED] = {"gh_connections_closed_total", "reason=\"idle\"", "Connections closed by the server's connection limits", "conns_idle_closed"},
+  [MC_CONNS_MAX_REQUESTS] = {"gh_connections_closed_total", "reason=\"max_requests\"", NULL, "conns_max_requests"},
+  [MC_CONNS_OVER_CAPACITY] = {"gh_connections_closed_total", "reason=\"capacity\"", NULL, "conns_over_capacity"},
+  [MC_ACCEPT_PAUSES] = {"gh_accept_pauses_total", "", "Times a listener stopped accepting at the connection cap", "accept_pauses"},
+  [MC_TLS_HANDSHAKES_FULL] = {"gh_tls_handshakes_total", "kind=\"full\"", "TLS handshakes by outcome", "tls_full"},
+  [MC_TLS_HANDSHAKES_RESUMED] = {"gh_tls_handshakes_total", "kind=\"resumed\"", NULL, "tls_resumed"},
+  [MC_TLS_HANDSHAKES_FAILED] = {"gh_tls_handshakes_total", "kind=\"failed\"", NULL, "tls_failed"},
+  [MC_ACCESS_LOG_RECORDS] = {"gh_access_log_records_total", "", "Access log records written", "access_log_records"},
+  [MC_ACCESS_LOG_DROPPED] = {"gh_access_log_dropped_total", "", "Access log records dropped because the writer fell behind", "access_log_dropped"},
+  [MC_LOADS] = {"gh_loader_loads_total", "", "Files loaded by the loader pool", "loads"},
+  [MC_LOAD_BYTES] = {"gh_loader_read_bytes_total", "", "Bytes read by the loader pool", "load_bytes"},
+  [MC_LOADS_FAILED] = {"gh_loader_failed_total", "", "Loads that produced no cache entry", "loads_failed"},
+  [MC_LOADS_COALESCED] = {"gh_loader_coalesced_total", "", "Requests that joined an in-flight load", "loads_coalesced"},
+};
+
+//! Export description of a histogram; rows sharing a name must be adjacent
+struct MetricsHistInfo {
+    const char *name; //!< Prometheus metric name
+    const char *labels; //!< Label set without braces, "" for none
+    const char *help; //!< HELP text, printed once per name
+    const char *key; //!< JSON key
+};
+
+static const struct MetricsHistInfo s_hists[MH_COUNT] = {
+  [MH_CACHE_HIT] = {"gh_request_duration_seconds", "route=\"cache_hit\"", "Request handling time by route", "cache_hit"},
+  [MH_CACHE_MISS] = {"gh_request_duration_seconds", "route=\"cache_miss\"", NULL, "cache_miss"},
+  [MH_DISK] = {"gh_request_duration_seconds", "route=\"disk\"", NULL, "disk"},
+  [MH_API] = {"gh_request_duration_seconds", "route=\"api\"", NULL, "api"},
+  [MH_NEGATIVE] = {"gh_request_duration_seconds", "route=\"negative\"", NULL, "negative"},
+  [MH_ERROR] = {"gh_request_duration_seconds", "route=\"error\"", NULL, "error"},
+  [MH_LOAD] = {"gh_loader_duration_seconds", "", "Time to stat, read, compress and cache one file", "load"},
+};
+
+void GH_MetricsInit(void) {
+  if (!s_lock_ready) {
+    GH_MutexInit(&s_lock);
+    s_lock_ready = true;
+  }
+}
+
+struct MetricsShard *GH_MetricsRegisterThread(void) {
+  struct MetricsShard *shard = (struct MetricsShard *) calloc(1, sizeof(*shard));
+  if (shard == NULL) {
+    return NULL;
+  }
+  GH_MetricsInit();
+  GH_MutexLock(&s_lock);
+  shard->next = s_shards;
+  s_shards = shard;
+  GH_MutexUnlock(&s_lock);
+  g_metrics_shard = shard;
+  return shard;
+}
+
+void GH_MetricsCollect(struct MetricsShard *out) {
+  memset(out, 0, sizeof(*out));
+  GH_MetricsInit();
+  GH_MutexLock(&s_lock);
+  struct MetricsShard *shard = s_shards;
+  GH_MutexUnlock(&s_lock);
+
+  for (; shard != NULL; shard = shard->next) {
+    for (int i = 0; i < MC_COUNT; i++) {
+      out->counters[i] += GH_AtomicLoadU64(&shard->counters[i]);
+    }
+    for (int h = 0; h < MH_COUNT; h++) {
+      for (int b = 0; b < METRICS_BUCKETS; b++) {
+        out->hists[h].buckets[b] += GH_AtomicLoadU64(&shard->hists[h].buckets[b]);
+      }
+      out->hists[h].sum_ns += GH_AtomicLoadU64(&shard->hists[h].sum_ns);
+    }
+  }
+}
+
+static uint64_t hist_count(const struct MetricsHist *hist) {
+  uint64_t count = 0;
+  for (int b = 0; b < METRICS_BUCKETS; b++) {
+    count += hist->buckets[b];
+  }
+  return count;
+}
+
+// Upper bound of a bucket in microseconds
+static double bucket_bound_us(int bucket) {
+  return (double) (1ULL << bucket);
+}
+
+double GH_MetricsQuantile(const struct MetricsHist *hist, double q) {
+  uint64_t count = hist_count(hist);
+  if (count == 0) {
+    return 0;
+  }
+  uint64_t rank = (uint64_t) (q * (double) count);
+  if (rank >= count) {
+    rank = count - 1;
+  }
+  uint64_t seen = 0;
+  for (int b = 0; b < METRICS_BUCKETS; b++) {
+    seen += hist->buckets[b];
+    if (seen > rank) {
+      return bucket_bound_us(b);
+    }
+  }
+  return bucket_bound_us(METRICS_BUCKETS - 1);
+}
+
+// Label set for a sample, merging the row labels with an extra one
+static void put_labels(struct mg_iobuf *out, const char *labels, const char *extra) {
+  bool has_labels = labels[0] != '\0';
+  bool has_extra = extra != NULL && extra[0] != '\0';
+  if (!has_labels && !has_extra) {
+    return;
+  }
+  mg_xprintf(mg_pfn_iobuf, out, "{%s%s%s}", labels,
+             has_labels && has_extra ? "," : "", has_extra ? extra : "");
+}
+
+static void put_header(struct mg_iobuf *out, const char *name, const char *help, const char *type) {
+  mg_xprintf(mg_pfn_iobuf, out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+static void put_gauge(struct mg_iobuf *out, const char *name, const char *help, size_t value) {
+  put_header(out, name, help, "gauge");
+  mg_xprintf(mg_pfn_iobuf, out, "%s %llu\n", name, (unsigned long long) value);
+}
+
+void GH_MetricsRenderPrometheus(struct mg_iobuf *out, const struct MetricsGauges *gauges) {
+  struct MetricsShard totals;
+  GH_MetricsCollect(&totals);
+
+  for (int i = 0; i < MC_COUNT; i++) {
+    const struct MetricsCounterInfo *info = &s_counters[i];
+    if (info->help != NULL) {
+      put_header(out, info->name, info->help, "counter");
+    }
+    mg_xprintf(mg_pfn_iobuf, out, "%s", info->name);
+    put_labels(out, info->labels, NULL);
+    mg_xprintf(mg_pfn_iobuf, out, " %llu\n", (unsigned long long) totals.counters[i]);
+  }
+
+  for (int h = 0; h < MH_COUNT; h++) {
+    const struct MetricsHistInfo *info = &s_hists[h];
+    const struct MetricsHist *hist = &totals.hists[h];
+    char le[48];
+    uint64_t cumulative = 0;
+    if (info->help != NULL) {
+      put_header(out, info->name, info->help, "histogram");
+    }
+    // The last bucket is open-ended and only appears as +Inf
+    for (int b = 0; b < METRICS_BUCKETS - 1; b++) {
+      cumulative += hist->buckets[b];
+      snprintf(le, sizeof(le), "le=\"%g\"", bucket_bound_us(b) / 1e6);
+      mg_xprintf(mg_pfn_iobuf, out, "%s_bucket", info->name);
+      put_labels(out, info->labels, le);
+      mg_xprintf(mg_pfn_iobuf, out, " %llu\n", (unsigned long long) cumulative);
+    }
+    cumulative += hist->buckets[METRICS_BUCKETS - 1];
+    mg_xprintf(mg_pfn_iobuf, out, "%s_bucket", info->name);
+    put_labels(out, info->labels, "le=\"+Inf\"");
+    mg_xprintf(mg_pfn_iobuf, out, " %llu\n", (unsigned long long) cumulative);
+
+    snprintf(le, sizeof(le), "%.9f", (double) hist->sum_ns / 1e9);
+    mg_xprintf(mg_pfn_iobuf, out, "%s_sum", info->name);
+    put_labels(out, info->labels, NULL);
+    mg_xprintf(mg_pfn_iobuf, out, " %s\n%s_count", le, info->name);
+    put_labels(out, info->labels, NULL);
+    mg_xprintf(mg_pfn_iobuf, out, " %llu\n", (unsigned long long) cumulative);
+  }
+
+  put_gauge(out, "gh_cache_entries", "Entries in the cache", gauges->cache_entries);
+  put_gauge(out, "gh_cache_size_bytes", "Bytes charged to the cache", gauges->cache_bytes);
+  put_gauge(out, "gh_cache_budget_bytes", "Cache budget", gauges->cache_budget);
+  put_gauge(out, "gh_cache_reserved_bytes", "Memory the cache allocator holds from the OS", gauges->cache_reserved);
+  put_gauge(out, "gh_snapshot_files", "Files in the mapped snapshot", gauges->snapshot_files);
+  put_gauge(out, "gh_connections_open", "Open client connections", gauges->connections);
+  put_gauge(out, "gh_connections_max", "Connection cap, 0 if unlimited", gauges->connections_max);
+}
+
+void GH_MetricsRenderJson(struct mg_iobuf *out, const struct MetricsGauges *gauges) {
+  struct MetricsShard totals;
+  char number[32];
+  GH_MetricsCollect(&totals);
+
+  uint64_t hits = totals.counters[MC_CACHE_HITS];
+  uint64_t lookups = hits + totals.counters[MC_CACHE_MISSES];
+  snprintf(number, sizeof(number), "%.4f", lookups > 0 ? (double) hits / (double) lookups : 0.0);
+  mg_xprintf(mg_pfn_iobuf, out,
+             "{\"entries\":%llu,\"size_bytes\":%llu,\"size_mb\":%llu,\"budget_bytes\":%llu,"
+             "\"reserved_bytes\":%llu,\"snapshot_files\":%llu,\"connections\":%llu,\"connections_max\":%llu,"
+             "\"hit_ratio\":%s,\"counters\":{",
+             (unsigned long long) gauges->cache_entries, (unsigned long long) gauges->cache_bytes,
+             (unsigned long long) (gauges->cache_bytes / (1024 * 1024)),
+             (unsigned long long) gauges->cache_budget, (unsigned long long) gauges->cache_reserved,
+             (unsigned long long) gauges->snapshot_files, (unsigned long long) gauges->connections,
+             (unsigned long long) gauges->connections_max, number);
+  for (int i = 0; i < MC_COUNT; i++) {
+    mg_xprintf(mg_pfn_iobuf, out, "%s\"%s\":%llu", i == 0 ? "" : ",", s_counters[i].key,
+               (unsigned long long) totals.counters[i]);
+  }
+
+  mg_xprintf(mg_pfn_iobuf, out, "},\"latency_us\":{");
+  for (int h = 0; h < MH_COUNT; h++) {
+    const struct MetricsHist *hist = &totals.hists[h];
+    uint64_t count = hist_count(hist);
+    snprintf(number, sizeof(number), "%.1f", count > 0 ? (double) hist->sum_ns / 1e3 / (double) count : 0.0);
+    mg_xprintf(mg_pfn_iobuf, out, "%s\"%s\":{\"count\":%llu,\"mean\":%s,\"p50\":%llu,\"p99\":%llu,\"p999\":%llu}",
+               h == 0 ? "" : ",", s_hists[h].key, (unsigned long long) count, number,
+               (unsigned long long) GH_MetricsQuantile(hist, 0.50),
+               (unsigned long long) GH_MetricsQuantile(hist, 0.99),
+               (unsigned long long) GH_MetricsQuantile(hist, 0.999));
+  }
+  mg_xprintf(mg_pfn_iobuf, out, "}}");
+}
@@ -0,0 +1,254 @@
+#pragma once
+#include <server/config.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <mongoose.h>
+#include <utils/Sync.h>
+
+#if !defined(_WIN32)
+#include <time.h>
+#endif
+
+#ifndef APP_METRICS_ENABLED
+#define APP_METRICS_ENABLED 1         //!< Default: record counters and latency histograms
+#endif
+#define METRICS_BUCKETS 32            //!< Histogram buckets: [0,1us), [1,2us), [2,4us) ... last one open-ended
+
+//! Monotonic counters, recorded per thread and summed on export
+enum MetricsCounter {
+    MC_REQUESTS, //!< HTTP requests handled
+    MC_SERVED_SNAPSHOT, //!< Static responses from the mapped snapshot
+    MC_SERVED_CACHE, //!< Static responses from the cache
+    MC_SERVED_DISK, //!< Static responses streamed from disk
+    MC_NOT_MODIFIED, //!< 304 responses
+    MC_PARTIAL, //!< 206 responses
+    MC_PRECONDITION_FAILED, //!< 412 responses
+    MC_RANGE_NOT_SATISFIABLE, //!< 416 responses
+    MC_NOT_FOUND, //!< 404 responses
+    MC_BAD_REQUEST, //!< 400 responses to request targets that do not canonicalize
+    MC_ENCODED, //!< Responses with a br/gzip body
+    MC_BYTES_SENT, //!< Bytes written to client sockets
+    MC_CACHE_HITS, //!< GH_CacheAcquire hits
+    MC_CACHE_MISSES, //!< GH_CacheAcquire misses
+    MC_CACHE_ADDS, //!< Entries added
+    MC_CACHE_ADDED_BYTES, //!< Bytes charged by added entries
+    MC_CACHE_REJECTED, //!< Entries refused by size-aware admission
+    MC_CACHE_EVICTIONS, //!< Entries evicted for space
+    MC_CACHE_EXPIRATIONS, //!< Entries dropped by GH_CacheEvictExpired
+    MC_CACHE_REMOVALS, //!< Entries removed because they changed or were replaced
+    MC_CACHE_REVALIDATIONS, //!< stat calls made to revalidate entries
+    MC_CACHE_STALE, //!< Revalidations that found a changed file
+    MC_CACHE_BUDGET_ADMIN, //!< Budget or TTL changes made through the admin API
+    MC_CACHE_BUDGET_SHRINKS, //!< Budget cuts made by the adaptive mode under memory pressure
+    MC_CACHE_BUDGET_GROWS, //!< Budget raises made by the adaptive mode with memory to spare
+    MC_NEGATIVE_HITS, //!< 404s answered from the negative cache
+    MC_NEGATIVE_ADDS, //!< Missing paths remembered by the negative cache
+    MC_SERVER_DATA, //!< server_data.php responses sent from the prebuilt block
+    MC_SERVER_DATA_OUTDATED, //!< server_data.php requests from clients below min_version
+    MC_SERVER_DATA_RELOADS, //!< server_data config reloads
+    MC_ADMISSION_CONN_REJECTED, //!< Connections closed on accept, over their address's cap
+    MC_ADMISSION_RATE_LIMITED, //!< Requests answered 429, over their address's rate
+    MC_CONNS_IDLE_CLOSED, //!< Connections closed after the keep-alive timeout without progress
+    MC_CONNS_MAX_REQUESTS, //!< Connections closed after their last allowed request
+    MC_CONNS_OVER_CAPACITY, //!< Connections closed on accept, over the global connection cap
+    MC_ACCEPT_PAUSES, //!< Times a listener stopped accepting because the cap was reached
+    MC_TLS_HANDSHAKES_FULL, //!< TLS handshakes completed with a full key exchange
+    MC_TLS_HANDSHAKES_RESUMED, //!< TLS handshakes that resumed a session (cache or ticket)
+    MC_TLS_HANDSHAKES_FAILED, //!< TLS handshakes that failed; their connections are closed
+    MC_ACCESS_LOG_RECORDS, //!< Access log records written
+    MC_ACCESS_LOG_DROPPED, //!< Access log records dropped, their thread's ring was full
+    MC_LOADS, //!< Files loaded by the loader pool
+    MC_LOAD_BYTES, //!< Bytes read by the loader pool
+    MC_LOADS_FAILED, //!< Loads that found nothing to cache
+    MC_LOADS_COALESCED, //!< Requests that joined an in-flight load
+    MC_COUNT //!< Number of counters
+};
+
+//! Latency histograms
+enum MetricsHistogram {
+    MH_CACHE_HIT, //!< Static request answered from memory (handler time)
+    MH_CACHE_MISS, //!< Static request answered after an async load (request to response)
+    MH_DISK, //!< Static request answered from disk or with 404 (handler time)
+    MH_API, //!< API request (handler time)
+    MH_NEGATIVE, //!< Static request answered 404 by the negative cache (handler time)
+    MH_ERROR, //!< Request rejected before any lookup, e.g. 400 for a bad path (handler time)
+    MH_LOAD, //!< Loader: stat, read, compress and cache one file
+    MH_COUNT //!< Number of histograms
+};
+
+//! Struct for a log-bucketed latency histogram
+struct MetricsHist {
+    uint64_t buckets[METRICS_BUCKETS]; //!< Observation counts per bucket
+    uint64_t sum_ns; //!< Sum of observations in nanoseconds
+};
+
+//! Struct for one thread's metrics; only the owning thread writes it
+struct MetricsShard {
+    uint64_t counters[MC_COUNT]; //!< Counters by enum MetricsCounter
+    struct MetricsHist hists[MH_COUNT]; //!< Histograms by enum MetricsHistogram
+    struct MetricsShard *next; //!< Next registered shard
+};
+
+//! Struct for point-in-time values exported next to the counters
+struct MetricsGauges {
+    size_t cache_entries; //!< Entries in the cache
+    size_t cache_bytes; //!< Bytes charged to the cache
+    size_t cache_budget; //!< Cache budget in bytes
+    size_t cache_reserved; //!< Bytes the cache allocator holds from the OS
+    size_t snapshot_files; //!< Files in the mapped snapshot
+    size_t connections; //!< Open client connections across all workers
+    size_t connections_max; //!< Global connection cap, 0 = unlimited
+};
+
+// ============================================================================
+// Recording (hot path: thread-local, no locks, no atomic read-modify-write)
+// ============================================================================
+
+extern GH_THREAD_LOCAL struct MetricsShard *g_metrics_shard; //!< Calling thread's shard, NULL until first use
+
+/**
+ * @brief Prepare the shard registry
+ * 
+ * Call once before starting threads; single-threaded programs may skip it.
+ */
+void GH_MetricsInit(void);
+
+/**
+ * @brief Allocate and register the calling thread's shard
+ * 
+ * @return struct MetricsShard* Shard, NULL on allocation failure (metrics are then dropped)
+ */
+struct MetricsShard *GH_MetricsRegisterThread(void);
+
+static inline struct MetricsShard *GH_MetricsShard(void) {
+  struct MetricsShard *shard = g_metrics_shard;
+  return shard != NULL ? shard : GH_MetricsRegisterThread();
+}
+
+// Single writer: a relaxed load and store is enough and compiles to a plain add
+static inline void GH_MetricsBump(uint64_t *cell, uint64_t value) {
+  GH_AtomicStoreU64(cell, GH_AtomicLoadU64(cell) + value);
+}
+
+/**
+ * @brief Add to a counter
+ * 
+ * @param id Counter
+ * @param value Amount to add
+ */
+static inline void GH_MetricsAdd(enum MetricsCounter id, uint64_t value) {
+#if APP_METRICS_ENABLED
+  struct MetricsShard *shard = GH_MetricsShard();
+  if (shard != NULL) {
+    GH_MetricsBump(&shard->counters[id], value);
+  }
+#else
+  (void) id;
+  (void) value;
+#endif
+}
+
+#define GH_MetricsInc(id) GH_MetricsAdd((id), 1)  //!< Increment a counter
+
+/**
+ * @brief Monotonic clock for latency measurements
+ * 
+ * @return uint64_t Nanoseconds from an arbitrary epoch, 0 when metrics are disabled
+ */
+static inline uint64_t GH_MetricsNow(void) {
+#if !APP_METRICS_ENABLED
+  return 0;
+#elif defined(_WIN32)
+  LARGE_INTEGER freq, now;
+  QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&now);
+  return (uint64_t) ((double) now.QuadPart * 1e9 / (double) freq.QuadPart);
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+#endif
+}
+
+/**
+ * @brief Histogram bucket for a duration
+ * 
+ * @param ns Duration in nanoseconds
+ * @return int Bucket index: 0 below 1us, b for [2^(b-1), 2^b) us
+ */
+static inline int GH_MetricsBucket(uint64_t ns) {
+  uint64_t us = ns / 1000;
+  int bucket = 0;
+  while (us != 0 && bucket < METRICS_BUCKETS - 1) {
+    us >>= 1;
+    bucket++;
+  }
+  return bucket;
+}
+
+/**
+ * @brief Record a duration measured by the caller
+ * 
+ * @param id Histogram
+ * @param ns Duration in nanoseconds
+ */
+static inline void GH_MetricsObserveNs(enum MetricsHistogram id, uint64_t ns) {
+#if APP_METRICS_ENABLED
+  struct MetricsShard *shard = GH_MetricsShard();
+  if (shard != NULL) {
+    GH_MetricsBump(&shard->hists[id].buckets[GH_MetricsBucket(ns)], 1);
+    GH_MetricsBump(&shard->hists[id].sum_ns, ns);
+  }
+#else
+  (void) id;
+  (void) ns;
+#endif
+}
+
+/**
+ * @brief Record a duration
+ * 
+ * @param id Histogram
+ * @param start_ns GH_MetricsNow() taken at the start of the measured work
+ */
+static inline void GH_MetricsObserve(enum MetricsHistogram id, uint64_t start_ns) {
+  GH_MetricsObserveNs(id, GH_MetricsNow() - start_ns);
+}
+
+// ============================================================================
+// Export
+// ============================================================================
+
+/**
+ * @brief Sum every thread's shard
+ * 
+ * @param out Receives the totals
+ */
+void GH_MetricsCollect(struct MetricsShard *out);
+
+/**
+ * @brief Estimate a quantile from a histogram (upper bucket bound)
+ * 
+ * @param hist Histogram
+ * @param q Quantile in [0, 1]
+ * @return double Estimated latency in microseconds, 0 if empty
+ */
+double GH_MetricsQuantile(const struct MetricsHist *hist, double q);
+
+/**
+ * @brief Append the Prometheus text exposition of every metric
+ * 
+ * @param out Output buffer
+ * @param gauges Current gauge values
+ */
+void GH_MetricsRenderPrometheus(struct mg_iobuf *out, const struct MetricsGauges *gauges);
+
+/**
+ * @brief Append a JSON object with gauges, counters, hit ratio and latency percentiles
+ * 
+ * @param out Output buffer
+ * @param gauges Current gauge values
+ */
+void GH_MetricsRenderJson(struct mg_iobuf *out, const struct MetricsGauges *gauges);
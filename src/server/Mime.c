@@ -0,0 +1,73 @@
+#include "Mime.h"
+#include <stdlib.h>
+#include <string.h>
+
+//! Struct for one extension to MIME type mapping
+struct MimeEntry {
+    const char *ext; //!< Lowercase extension without the dot
+    const char *type; //!< Content-Type value
+};
+
+// Sorted by extension for bsearch
+static const struct MimeEntry s_mime_types[] = {
+  {"avif", "image/avif"},
+  {"bmp", "image/bmp"},
+  {"css", "text/css"},
+  {"csv", "text/csv"},
+  {"gif", "image/gif"},
+  {"htm", "text/html"},
+  {"html", "text/html"},
+  {"ico", "image/x-icon"},
+  {"jpeg", "image/jpeg"},
+  {"jpg", "image/jpeg"},
+  {"js", "application/javascript"},
+  {"json", "application/json"},
+  {"map", "application/json"},
+  {"mjs", "application/javascript"},
+  {"mp3", "audio/mpeg"},
+  {"mp4", "video/mp4"},
+  {"ogg", "audio/ogg"},
+  {"otf", "font/otf"},
+  {"pdf", "application/pdf"},
+  {"png", "image/png"},
+  {"svg", "image/svg+xml"},
+  {"ttf", "font/ttf"},
+  {"txt", "text/plain"},
+  {"wasm", "application/wasm"},
+  {"wav", "audio/wav"},
+  {"webm", "video/webm"},
+  {"webp", "image/webp"},
+  {"woff", "font/woff"},
+  {"woff2", "font/woff2"},
+  {"xml", "application/xml"},
+  {"zip", "application/zip"},
+};
+
+#define MIME_MAX_EXT_LEN 8
+
+static int compare_mime(const void *key, const void *item) {
+  return strcmp((const char *) key, ((const struct MimeEntry *) item)->ext);
+}
+
+const char *GH_MimeType(const char *path, size_t path_len) {
+  // Walk back to the last dot of the final path component
+  size_t dot = path_len;
+  while (dot > 0 && path[dot - 1] != '.' && path[dot - 1] != '/') {
+    dot--;
+  }
+  size_t ext_len = path_len - dot;
+  if (dot == 0 || path[dot - 1] != '.' || ext_len == 0 || ext_len > MIME_MAX_EXT_LEN) {
+    return "application/octet-stream";
+  }
+
+  char ext[MIME_MAX_EXT_LEN + 1];
+  for (size_t i = 0; i < ext_len; i++) {
+    char ch = path[dot + i];
+    ext[i] = (ch >= 'A' && ch <= 'Z') ? (char) (ch - 'A' + 'a') : ch;
+  }
+  ext[ext_len] = '\0';
+
+  const struct MimeEntry *found = bsearch(ext, s_mime_types, sizeof(s_mime_types) / sizeof(s_mime_types[0]),
+                                          sizeof(s_mime_types[0]), compare_mime);
+  return found != NULL ? found->type : "application/octet-stream";
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <server/config.h>
+
+#include <stddef.h>
+
+// ============================================================================
+// Content-Type lookup
+// ============================================================================
+
+/**
+ * @brief Look up the Content-Type for a file path by its extension
+ * 
+ * Only the final extension counts and matching is case-insensitive, so
+ * ".json" is never taken for ".js" nor ".woff2" for ".woff".
+ * 
+ * @param path File path
+ * @param path_len Length of file path
+ * @return const char* Static MIME type string, "application/octet-stream" if unknown
+ */
+const char *GH_MimeType(const char *path, size_t path_len);
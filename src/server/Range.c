@@ -0,0 +1,118 @@
+#include "Range.h"
+#include "utils/Utils.h"
+#include <stdlib.h>
+#include <string.h>
+
+static struct mg_str trim_spaces(struct mg_str s) {
+  while (s.len > 0 && (s.buf[0] == ' ' || s.buf[0] == '\t')) s.buf++, s.len--;
+  while (s.len > 0 && (s.buf[s.len - 1] == ' ' || s.buf[s.len - 1] == '\t')) s.len--;
+  return s;
+}
+
+// Parse decimal digits; false on empty input, junk or overflow
+static bool parse_u64(struct mg_str s, uint64_t *out) {
+  uint64_t v = 0;
+  if (s.len == 0) {
+    return false;
+  }
+  for (size_t i = 0; i < s.len; i++) {
+    if (s.buf[i] < '0' || s.buf[i] > '9' || v > (UINT64_MAX - 9) / 10) {
+      return false;
+    }
+    v = v * 10 + (uint64_t) (s.buf[i] - '0');
+  }
+  *out = v;
+  return true;
+}
+
+static int compare_ranges(const void *a, const void *b) {
+  const struct ByteRange *x = a, *y = b;
+  return x->first < y->first ? -1 : x->first > y->first;
+}
+
+int GH_RangeParse(const struct mg_str *header, uint64_t size, struct ByteRange *ranges, int max_ranges) {
+  if (header == NULL || header->len < 6 || mg_strcasecmp(mg_str_n(header->buf, 6), mg_str("bytes=")) != 0) {
+    return -1;
+  }
+
+  int count = 0;
+  struct mg_str list = mg_str_n(header->buf + 6, header->len - 6), item;
+  while (mg_span(list, &item, &list, ',')) {
+    item = trim_spaces(item);
+    if (item.len == 0) {
+      continue;  // Empty list elements are allowed
+    }
+
+    struct mg_str first = item, last = mg_str_n("", 0);
+    if (!mg_span(item, &first, &last, '-') || first.len == item.len) {
+      return -1;  // No dash
+    }
+
+    struct ByteRange r;
+    uint64_t a, b;
+    if (first.len == 0) {
+      // Suffix range "-n": the last n bytes
+      if (!parse_u64(last, &b)) {
+        return -1;
+      }
+      if (b == 0 || size == 0) {
+        continue;
+      }
+      r.first = b < size ? size - b : 0;
+      r.last = size - 1;
+    } else {
+      if (!parse_u64(first, &a)) {
+        return -1;
+      }
+      if (last.len == 0) {
+        b = UINT64_MAX;
+      } else if (!parse_u64(last, &b) || b < a) {
+        return -1;
+      }
+      if (a >= size) {
+        continue;  // Unsatisfiable, but other ranges may be fine
+      }
+      r.first = a;
+      r.last = b < size ? b : size - 1;
+    }
+
+    if (count == max_ranges) {
+      return -1;  // Too many ranges to bother; serve the whole body
+    }
+    ranges[count++] = r;
+  }
+
+  // Coalesce overlapping or adjacent ranges so clients cannot multiply the body
+  if (count > 1) {
+    qsort(ranges, (size_t) count, sizeof(*ranges), compare_ranges);
+    int merged = 0;
+    for (int i = 1; i < count; i++) {
+      if (ranges[i].first <= ranges[merged].last + 1) {
+        if (ranges[i].last > ranges[merged].last) {
+          ranges[merged].last = ranges[i].last;
+        }
+      } else {
+        ranges[++merged] = ranges[i];
+      }
+    }
+    count = merged + 1;
+  }
+  return count;
+}
+
+bool GH_RangeIfRangeAllows(const struct mg_str *if_range, const char *etag, time_t mtime) {
+  if (if_range == NULL) {
+    return true;
+  }
+
+  struct mg_str value = trim_spaces(*if_range);
+  if (value.len >= 2 && value.buf[0] == 'W' && value.buf[1] == '/') {
+    return false;  // Weak validators never match If-Range
+  }
+  if (value.len > 0 && value.buf[0] == '"') {
+    return etag != NULL && mg_strcmp(value, mg_str(etag)) == 0;
+  }
+
+  time_t date;
+  return ParseHttpDate(value.buf, value.len, &date) && date == mtime;
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <server/config.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <mongoose.h>
+
+#ifndef APP_RANGE_DISK_MIN_SIZE
+#define APP_RANGE_DISK_MIN_SIZE (1024 * 1024)  //!< Default size from which uncached files serve ranges from disk
+#endif
+
+//! Struct for a resolved byte range, bounds inclusive
+struct ByteRange {
+    uint64_t first; //!< First byte offset
+    uint64_t last; //!< Last byte offset
+};
+
+// ============================================================================
+// HTTP Range / If-Range handling (RFC 9110, section 14)
+// ============================================================================
+
+/**
+ * @brief Parse a Range header against a representation of the given size
+ * 
+ * Overlapping and adjacent ranges are coalesced and returned in ascending order.
+ * 
+ * @param header Range header value
+ * @param size Representation size in bytes
+ * @param ranges Receives the satisfiable ranges
+ * @param max_ranges Capacity of ranges
+ * @return int Number of ranges (> 0); 0 if none is satisfiable (send 416);
+ *             -1 if the header must be ignored (malformed, other unit, too many ranges)
+ */
+int GH_RangeParse(const struct mg_str *header, uint64_t size, struct ByteRange *ranges, int max_ranges);
+
+/**
+ * @brief Evaluate If-Range: may the Range header be honoured?
+ * 
+ * @param if_range If-Range header value, or NULL if absent
+ * @param etag Current strong ETag of the representation
+ * @param mtime Current modification time of the representation
+ * @return bool true if ranges may be served, false to send the full 200 response
+ */
+bool GH_RangeIfRangeAllows(const struct mg_str *if_range, const char *etag, time_t mtime);
@@ -0,0 +1,410 @@
+#include "Response.h"
+#include "Connection.h"
+#include "KeepAlive.h"
+#include "Metrics.h"
+#include "plugins/CacheManager.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(_WIN32)
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#endif
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#endif
+
+#ifndef APP_ZEROCOPY_MIN_SIZE
+#define APP_ZEROCOPY_MIN_SIZE 16384
+#endif
+#ifndef APP_ZEROCOPY_WINDOW
+#define APP_ZEROCOPY_WINDOW 16384
+#endif
+
+#if defined(_WIN32)
+#define file_seek(f, ofs) _fseeki64((f), (__int64) (ofs), SEEK_SET)
+#else
+#define file_seek(f, ofs) fseeko((f), (off_t) (ofs), SEEK_SET)
+#endif
+
+//! Struct for the multipart parts still to be sent after the current one
+struct ResponseParts {
+    int count; //!< Number of parts
+    int next; //!< Index of the next part to start
+    char trailer[64]; //!< Closing boundary
+    struct ResponsePart items[]; //!< Parts
+};
+
+#if !defined(_WIN32)
+#define SOCKET_FD(c) ((int) (size_t) (c)->fd)
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+// Direct socket writes are only possible for plain TCP with nothing queued ahead
+static bool can_write_direct(struct mg_connection *c) {
+  return !c->is_tls && c->send.len == 0 && !c->is_closing;
+}
+
+// Vectored non-blocking write; returns bytes written, 0 if the socket is full, -1 on error
+static long write_direct(struct mg_connection *c, const struct iovec *iov, int iovcnt) {
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = (struct iovec *) iov;
+  msg.msg_iovlen = (size_t) iovcnt;
+
+  for (;;) {
+    ssize_t n = sendmsg(SOCKET_FD(c), &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (n >= 0) {
+      GH_MetricsAdd(MC_BYTES_SENT, (uint64_t) n);
+      if (n > 0) {
+        GH_KeepAliveTouch(c, mg_millis());  // Bypasses c->send, so no MG_EV_WRITE reports it
+      }
+      return (long) n;
+    }
+    if (errno == EINTR) {
+      continue;
+    }
+    return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+  }
+}
+#endif
+
+static bool stream_busy(const struct ResponseStream *stream) {
+  return stream->entry != NULL || stream->file != NULL;
+}
+
+// Release everything the stream holds; safe to call on an idle stream
+static void stream_reset(struct ResponseStream *stream) {
+  GH_CacheRelease(stream->entry);
+  if (stream->file != NULL) {
+    fclose(stream->file);
+  }
+  free(stream->parts);
+  memset(stream, 0, sizeof(*stream));
+}
+
+static void stream_finish(struct mg_connection *c) {
+  stream_reset(&GH_ConnState(c)->stream);
+  GH_ResponseDone(c);
+}
+
+static void stream_advance(struct ResponseStream *stream, size_t n) {
+  if (stream->file != NULL) {
+    stream->file_offset += n;
+  } else {
+    stream->body += n;
+  }
+  stream->remaining -= n;
+}
+
+// Current segment is done: queue the next part's headers, or the trailer.
+// Returns false once nothing is left to send.
+static bool stream_next_part(struct mg_connection *c) {
+  struct ResponseParts *parts = GH_ConnState(c)->stream.parts;
+  if (parts == NULL) {
+    return false;
+  }
+  if (parts->next >= parts->count) {
+    mg_send(c, parts->trailer, strlen(parts->trailer));
+    return false;
+  }
+
+  struct ResponsePart *part = &parts->items[parts->next++];
+  struct ResponseStream *stream = &GH_ConnState(c)->stream;
+  mg_send(c, part->head, part->head_len);
+  stream->body = part->body;
+  stream->remaining = part->body_len;
+  return true;
+}
+
+// Send file bytes; returns true to keep pumping, false to wait for MG_EV_WRITE
+static bool pump_file(struct mg_connection *c, struct ResponseStream *stream) {
+#if defined(__linux__)
+  if (can_write_direct(c)) {
+    off_t offset = (off_t) stream->file_offset;
+    size_t want = stream->remaining > (1u << 20) ? (1u << 20) : (size_t) stream->remaining;
+    ssize_t n = sendfile(SOCKET_FD(c), fileno(stream->file), &offset, want);
+    if (n > 0) {
+      GH_MetricsAdd(MC_BYTES_SENT, (uint64_t) n);
+      GH_KeepAliveTouch(c, mg_millis());
+      stream_advance(stream, (size_t) n);
+      return true;
+    }
+    if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+      c->is_closing = 1;  // File shrank underneath us, or the socket failed
+      return true;
+    }
+  }
+#endif
+  if (c->send.len >= APP_ZEROCOPY_WINDOW) {
+    return false;
+  }
+
+  // Read straight into the send iobuf tail
+  size_t chunk = APP_ZEROCOPY_WINDOW - c->send.len;
+  if (chunk > stream->remaining) {
+    chunk = (size_t) stream->remaining;
+  }
+  size_t got = 0;
+  if (file_seek(stream->file, stream->file_offset) == 0 &&
+      mg_iobuf_resize(&c->send, c->send.len + chunk)) {
+    got = fread(c->send.buf + c->send.len, 1, chunk, stream->file);
+    c->send.len += got;
+  }
+  if (got == 0) {
+    c->is_closing = 1;
+    return true;
+  }
+  stream_advance(stream, got);
+#if defined(__linux__)
+  return c->is_tls;  // Plain TCP is armed now; sendfile resumes once drained
+#else
+  return true;
+#endif
+}
+
+// Send entry bytes; returns true to keep pumping, false to wait for MG_EV_WRITE.
+// When the socket is full, at most one small window is copied into c->send:
+// that makes mongoose poll for writability and raise MG_EV_WRITE, after which
+// direct writes resume.
+static bool pump_memory(struct mg_connection *c, struct ResponseStream *stream) {
+#if !defined(_WIN32)
+  if (can_write_direct(c)) {
+    struct iovec iov = {(void *) stream->body, (size_t) stream->remaining};
+    long n = write_direct(c, &iov, 1);
+    if (n < 0) {
+      c->is_closing = 1;
+      return true;
+    }
+    if (n > 0) {
+      stream_advance(stream, (size_t) n);
+      return true;
+    }
+  }
+#endif
+  if (c->send.len >= APP_ZEROCOPY_WINDOW) {
+    return false;
+  }
+  size_t chunk = APP_ZEROCOPY_WINDOW - c->send.len;
+  if (chunk > stream->remaining) {
+    chunk = (size_t) stream->remaining;
+  }
+  if (!mg_send(c, stream->body, chunk)) {
+    c->is_closing = 1;
+    return true;
+  }
+  stream_advance(stream, chunk);
+#if !defined(_WIN32)
+  return c->is_tls;  // Plain TCP is armed now; direct writes resume once drained
+#else
+  return true;
+#endif
+}
+
+static void stream_pump(struct mg_connection *c) {
+  struct ResponseStream *stream = &GH_ConnState(c)->stream;
+
+  while (!c->is_closing) {
+    if (stream->remaining == 0) {
+      if (!stream_next_part(c)) {
+        break;
+      }
+      continue;
+    }
+    bool more = stream->file != NULL ? pump_file(c, stream) : pump_memory(c, stream);
+    if (!more) {
+      return;  // Wait for MG_EV_WRITE
+    }
+  }
+
+  stream_finish(c);
+}
+
+// Write head (and the first body segment when possible) straight to the socket
+static void stream_start(struct mg_connection *c, const char *head, size_t head_len) {
+  struct ResponseStream *stream = &GH_ConnState(c)->stream;
+  c->is_resp = 1;  // Hold pipelined requests until the body is out
+
+  struct ResponseSummary summary;
+  if (GH_ResponseSummarize(head, head_len, &summary)) {
+    GH_ConnState(c)->sent_status = summary.status;
+    GH_ConnState(c)->sent_bytes = summary.head_len + summary.body_len;
+  }
+
+#if !defined(_WIN32)
+  if (can_write_direct(c)) {
+    // File bodies follow via sendfile, so only the head goes out here for them
+    struct iovec iov[2] = {{(void *) head, head_len}, {(void *) stream->body, (size_t) stream->remaining}};
+    long n = write_direct(c, iov, stream->file != NULL ? 1 : 2);
+    if (n < 0) {
+      c->is_closing = 1;
+      stream_finish(c);
+      return;
+    }
+    size_t written = (size_t) n;
+    if (written < head_len) {
+      // Header rarely splits; queue its tail so ordering is preserved
+      mg_send(c, head + written, head_len - written);
+    } else {
+      stream_advance(stream, written - head_len);
+    }
+  } else {
+    mg_send(c, head, head_len);
+  }
+#else
+  mg_send(c, head, head_len);
+#endif
+
+  stream_pump(c);
+}
+
+void GH_ResponseDone(struct mg_connection *c) {
+  c->is_resp = 0;
+}
+
+void GH_ResponseSendEntry(struct mg_connection *c, const char *head, size_t head_len,
+                          struct CacheEntry *entry, const char *body, size_t body_len) {
+  struct ResponseStream *stream = &GH_ConnState(c)->stream;
+
+  // Small bodies, or a connection still busy with a previous body, take the copy path
+  if (body_len < APP_ZEROCOPY_MIN_SIZE || stream_busy(stream)) {
+    mg_send(c, head, head_len);
+    mg_send(c, body, body_len);
+    GH_ResponseDone(c);
+    return;
+  }
+
+  GH_CacheRetain(entry);
+  stream->entry = entry;
+  stream->body = body;
+  stream->remaining = body_len;
+  stream_start(c, head, head_len);
+}
+
+bool GH_ResponseSendEntryParts(struct mg_connection *c, const char *head, size_t head_len,
+                               struct CacheEntry *entry, const struct ResponsePart *parts,
+                               int count, const char *trailer) {
+  struct ResponseStream *stream = &GH_ConnState(c)->stream;
+  if (count <= 0 || count > APP_RANGE_MAX_PARTS || stream_busy(stream)) {
+    return false;
+  }
+
+  struct ResponseParts *rest = malloc(sizeof(*rest) + sizeof(struct ResponsePart) * (size_t) count);
+  if (rest == NULL) {
+    return false;
+  }
+  rest->count = count;
+  rest->next = 1;
+  mg_snprintf(rest->trailer, sizeof(rest->trailer), "%s", trailer);
+  memcpy(rest->items, parts, sizeof(struct ResponsePart) * (size_t) count);
+
+  GH_CacheRetain(entry);
+  stream->entry = entry;
+  stream->parts = rest;
+  stream->body = parts[0].body;
+  stream->remaining = parts[0].body_len;
+
+  // The first part's headers ride along with the response head
+  char first[1024];
+  if (head_len + parts[0].head_len <= sizeof(first)) {
+    memcpy(first, head, head_len);
+    memcpy(first + head_len, parts[0].head, parts[0].head_len);
+    stream_start(c, first, head_len + parts[0].head_len);
+  } else {
+    mg_send(c, head, head_len);
+    stream_start(c, parts[0].head, parts[0].head_len);
+  }
+  return true;
+}
+
+bool GH_ResponseSendFile(struct mg_connection *c, const char *head, size_t head_len,
+                         const char *path, uint64_t offset, uint64_t len) {
+  struct ResponseStream *stream = &GH_ConnState(c)->stream;
+  if (stream_busy(stream)) {
+    return false;
+  }
+
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    return false;
+  }
+
+  stream->file = file;
+  stream->file_offset = offset;
+  stream->remaining = len;
+  stream_start(c, head, head_len);
+  return true;
+}
+
+void GH_ResponseOnEvent(struct mg_connection *c, int ev) {
+  struct ResponseStream *stream = &GH_ConnState(c)->stream;
+  if (!stream_busy(stream)) {
+    return;
+  }
+
+  if (ev == MG_EV_CLOSE) {
+    stream_reset(stream);
+  } else if (ev == MG_EV_WRITE || ev == MG_EV_POLL) {
+    stream_pump(c);
+  }
+}
+
+// Case-insensitive "Content-Length:" check; every pattern byte already has bit 0x20 set
+static bool header_is_content_length(const char *line) {
+  static const char pattern[] = "content-length:";
+  if ((line[8] | 0x20) != 'l') {
+    return false;  // Content-Type and Connection differ here
+  }
+  unsigned diff = 0;
+  for (size_t i = 0; i < sizeof(pattern) - 1; i++) {
+    diff |= (unsigned) ((line[i] | 0x20) ^ pattern[i]);
+  }
+  return diff == 0;
+}
+
+uint16_t GH_ResponseStatus(const char *buf, size_t len) {
+  // "HTTP/1.1 200 ..."
+  if (len < 12 || memcmp(buf, "HTTP/", 5) != 0 || buf[8] != ' ') {
+    return 0;
+  }
+  uint16_t status = 0;
+  for (size_t i = 9; i < 12; i++) {
+    if (buf[i] < '0' || buf[i] > '9') {
+      return 0;
+    }
+    status = (uint16_t) (status * 10 + (buf[i] - '0'));
+  }
+  return status;
+}
+
+bool GH_ResponseSummarize(const char *buf, size_t len, struct ResponseSummary *out) {
+  out->status = GH_ResponseStatus(buf, len);
+  if (out->status == 0) {
+    return false;
+  }
+
+  // Jump from line to line; only Content-Length and the blank line matter
+  out->body_len = 0;
+  const char *end = buf + len;
+  const char *line = memchr(buf, '\n', len);
+  while (line != NULL && ++line < end) {
+    size_t rest = (size_t) (end - line);
+    if (line[0] == '\r' && rest >= 2 && line[1] == '\n') {
+      out->head_len = (size_t) (line + 2 - buf);
+      return true;
+    }
+    if (rest > 15 && header_is_content_length(line)) {
+      size_t j = 15;
+      while (j < rest && line[j] == ' ') {
+        j++;
+      }
+      for (; j < rest && line[j] >= '0' && line[j] <= '9'; j++) {
+        out->body_len = out->body_len * 10 + (uint64_t) (line[j] - '0');
+      }
+    }
+    line = memchr(line, '\n', rest);
+  }
+  return false;
+}
@@ -0,0 +1,124 @@
+#pragma once
+#include <server/config.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <mongoose.h>
+
+struct CacheEntry;
+
+#ifndef APP_RANGE_MAX_PARTS
+#define APP_RANGE_MAX_PARTS 16  //!< Default cap on ranges served in one multipart response
+#endif
+
+//! Struct for one part of a multipart/byteranges response
+struct ResponsePart {
+    char head[192]; //!< Boundary line plus part headers
+    size_t head_len; //!< Length of head
+    const char *body; //!< Part body, inside the pinned entry's memory
+    size_t body_len; //!< Length of part body
+};
+
+//! Struct for the status and size of a serialized response
+struct ResponseSummary {
+    uint16_t status; //!< Status code
+    size_t head_len; //!< Status line and headers, including the blank line
+    uint64_t body_len; //!< Content-Length, 0 if absent
+};
+
+// ============================================================================
+// Zero-copy response sending
+// ============================================================================
+
+/**
+ * @brief Send a complete response whose body lives in a cache entry
+ * 
+ * Bodies of at least APP_ZEROCOPY_MIN_SIZE bytes are written straight from the
+ * entry to the socket (header and body in one vectored write) instead of being
+ * copied into c->send. Whatever the socket does not take immediately is sent
+ * as it drains; the entry stays pinned until then, even if it is removed from
+ * the cache or the cache is cleared meanwhile.
+ * 
+ * @param c Connection
+ * @param head Serialized status line and headers
+ * @param head_len Length of head
+ * @param entry Cache entry owning body (pinned by the caller for the duration of this call)
+ * @param body Body bytes, inside entry's memory
+ * @param body_len Length of body
+ */
+void GH_ResponseSendEntry(struct mg_connection *c, const char *head, size_t head_len,
+                          struct CacheEntry *entry, const char *body, size_t body_len);
+
+/**
+ * @brief Send a multipart response whose part bodies live in a cache entry
+ * 
+ * @param c Connection
+ * @param head Serialized status line and headers
+ * @param head_len Length of head
+ * @param entry Cache entry owning the part bodies (pinned by the caller)
+ * @param parts Parts to send, copied
+ * @param count Number of parts (1..APP_RANGE_MAX_PARTS)
+ * @param trailer Closing boundary sent after the last part
+ * @return bool true if the response was queued, false on allocation failure
+ */
+bool GH_ResponseSendEntryParts(struct mg_connection *c, const char *head, size_t head_len,
+                               struct CacheEntry *entry, const struct ResponsePart *parts,
+                               int count, const char *trailer);
+
+/**
+ * @brief Send a response whose body is a byte range of a file on disk
+ * 
+ * The file is streamed as the socket drains (sendfile for plain TCP where
+ * available), so memory stays bounded regardless of the range size.
+ * 
+ * @param c Connection
+ * @param head Serialized status line and headers
+ * @param head_len Length of head
+ * @param path File path
+ * @param offset First byte to send
+ * @param len Number of bytes to send
+ * @return bool true if the response was queued, false if the file cannot be opened
+ */
+bool GH_ResponseSendFile(struct mg_connection *c, const char *head, size_t head_len,
+                         const char *path, uint64_t offset, uint64_t len);
+
+/**
+ * @brief Mark the current response as complete so pipelined requests get parsed
+ * 
+ * @param c Connection
+ */
+void GH_ResponseDone(struct mg_connection *c);
+
+/**
+ * @brief Drive in-flight bodies; call for MG_EV_WRITE, MG_EV_POLL and MG_EV_CLOSE
+ * 
+ * @param c Connection
+ * @param ev Event
+ */
+void GH_ResponseOnEvent(struct mg_connection *c, int ev);
+
+/**
+ * @brief Read the status code and size of a serialized response head
+ * 
+ * Responses whose head goes straight to the socket record the same summary
+ * in the connection state (sent_status and sent_bytes) for the access log.
+ * 
+ * @param buf Response, starting at its status line
+ * @param len Bytes available in buf
+ * @param out Receives the summary
+ * @return bool true if buf holds a complete response head, false otherwise
+ */
+bool GH_ResponseSummarize(const char *buf, size_t len, struct ResponseSummary *out);
+
+/**
+ * @brief Read only the status code of a serialized response
+ * 
+ * Fixed offsets, no header scan: what the access log needs for a response
+ * queued whole, whose size is then simply what was queued.
+ * 
+ * @param buf Response, starting at its status line
+ * @param len Bytes available in buf
+ * @return uint16_t Status code, 0 if buf does not start with a status line
+ */
+uint16_t GH_ResponseStatus(const char *buf, size_t len);
@@ -0,0 +1,493 @@
+#include "Router.h"
+#include <stdlib.h>
+#include <string.h>
+
+// ==============================================================================
+// Internal helpers
+// ==============================================================================
+
+// Displacements tried per bucket before the exact routes fall back to the trie
+#define ROUTER_MAX_DISPLACE (1u << 20)
+
+//! Struct for a method name and its bit
+struct RouteMethodName {
+    const char *name; //!< Method token
+    unsigned bit; //!< enum RouteMethod bit
+};
+
+static const struct RouteMethodName s_methods[] = {
+  {"GET", ROUTE_GET},
+  {"HEAD", ROUTE_HEAD},
+  {"POST", ROUTE_POST},
+  {"PUT", ROUTE_PUT},
+  {"DELETE", ROUTE_DELETE},
+  {"OPTIONS", ROUTE_OPTIONS},
+  {"PATCH", ROUTE_PATCH},
+};
+
+static uint64_t route_hash(const char *path, size_t len) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < len; i++) {
+    hash ^= (unsigned char) path[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+// Finalizer so every bit of the FNV-1a hash affects the bucket and slot bits
+static uint64_t route_mix(uint64_t hash) {
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+  hash *= 0xc4ceb9fe1a85ec53ULL;
+  return hash ^ (hash >> 33);
+}
+
+static size_t route_bucket(const struct Router *router, uint64_t hash) {
+  return (size_t) route_mix(hash) & router->bucket_mask;
+}
+
+static size_t route_slot(size_t mask, uint64_t hash, uint32_t displace) {
+  return (size_t) route_mix(hash ^ ((uint64_t) (displace + 1) * 0x9e3779b97f4a7c15ULL)) & mask;
+}
+
+static size_t next_pow2(size_t n) {
+  size_t pow2 = 1;
+  while (pow2 < n) {
+    pow2 *= 2;
+  }
+  return pow2;
+}
+
+static bool is_wildcard(const char *segment, size_t len) {
+  return len == 1 && (segment[0] == '*' || segment[0] == '#');
+}
+
+// Patterns are "/" followed by "/"-separated segments; "*" and "#" only as whole segments, "#" last
+static bool pattern_valid(const char *pattern, bool *wildcard) {
+  if (pattern[0] != '/') {
+    return false;
+  }
+  int caps = 0;
+  *wildcard = false;
+  const char *segment = pattern + 1;
+  for (;;) {
+    const char *end = strchr(segment, '/');
+    size_t len = end != NULL ? (size_t) (end - segment) : strlen(segment);
+    if (is_wildcard(segment, len)) {
+      *wildcard = true;
+      if (++caps > ROUTER_MAX_CAPS || (segment[0] == '#' && end != NULL)) {
+        return false;
+      }
+    } else if (memchr(segment, '*', len) != NULL || memchr(segment, '#', len) != NULL) {
+      return false;
+    }
+    if (end == NULL) {
+      return true;
+    }
+    segment = end + 1;
+  }
+}
+
+static int compare_segment(const char *a, size_t a_len, const char *b, size_t b_len) {
+  int cmp = memcmp(a, b, a_len < b_len ? a_len : b_len);
+  return cmp != 0 ? cmp : (a_len > b_len) - (a_len < b_len);
+}
+
+// Registrations sorted by pattern, then in registration order, so each endpoint's targets are adjacent
+static int compare_spec(const void *a, const void *b) {
+  const struct RouteSpec *x = *(const struct RouteSpec *const *) a;
+  const struct RouteSpec *y = *(const struct RouteSpec *const *) b;
+  int cmp = strcmp(x->pattern, y->pattern);
+  return cmp != 0 ? cmp : (x > y) - (x < y);
+}
+
+static struct RouteNode *node_create(const char *segment, size_t len) {
+  struct RouteNode *node = calloc(1, sizeof(struct RouteNode));
+  if (node != NULL) {
+    node->segment = segment;
+    node->segment_len = len;
+    node->endpoint = -1;
+    node->rest = -1;
+  }
+  return node;
+}
+
+static void node_free(struct RouteNode *node) {
+  if (node == NULL) {
+    return;
+  }
+  for (size_t i = 0; i < node->child_count; i++) {
+    node_free(node->children[i]);
+  }
+  free(node->children);
+  node_free(node->star);
+  free(node);
+}
+
+// Literal child for a segment, created in sorted position if missing
+static struct RouteNode *node_child(struct RouteNode *node, const char *segment, size_t len) {
+  size_t lo = 0, hi = node->child_count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    int cmp = compare_segment(node->children[mid]->segment, node->children[mid]->segment_len, segment, len);
+    if (cmp == 0) {
+      return node->children[mid];
+    }
+    if (cmp < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  struct RouteNode **children = realloc(node->children, (node->child_count + 1) * sizeof(*children));
+  if (children == NULL) {
+    return NULL;
+  }
+  node->children = children;
+  struct RouteNode *child = node_create(segment, len);
+  if (child == NULL) {
+    return NULL;
+  }
+  memmove(&children[lo + 1], &children[lo], (node->child_count - lo) * sizeof(*children));
+  children[lo] = child;
+  node->child_count++;
+  return child;
+}
+
+static bool trie_insert(struct Router *router, const char *pattern, size_t endpoint) {
+  if (router->trie == NULL && (router->trie = node_create("", 0)) == NULL) {
+    return false;
+  }
+  struct RouteNode *node = router->trie;
+  const char *segment = pattern + 1;
+  for (;;) {
+    const char *end = strchr(segment, '/');
+    size_t len = end != NULL ? (size_t) (end - segment) : strlen(segment);
+    if (len == 1 && segment[0] == '#') {
+      node->rest = (long) endpoint;
+      return true;
+    }
+    if (len == 1 && segment[0] == '*') {
+      if (node->star == NULL && (node->star = node_create(segment, len)) == NULL) {
+        return false;
+      }
+      node = node->star;
+    } else if ((node = node_child(node, segment, len)) == NULL) {
+      return false;
+    }
+    if (end == NULL) {
+      node->endpoint = (long) endpoint;
+      return true;
+    }
+    segment = end + 1;
+  }
+}
+
+// Walk the trie from node; uri is what follows node's segment. Literal
+// segments are tried before "*", and "*" before "#", backtracking on failure.
+static long trie_match(const struct RouteNode *node, const char *uri, const char *end,
+                       struct RouteMatch *match) {
+  if (uri == end) {
+    return node->endpoint;
+  }
+  if (*uri != '/') {
+    return -1;
+  }
+  const char *segment = uri + 1;
+  const char *next = memchr(segment, '/', (size_t) (end - segment));
+  if (next == NULL) {
+    next = end;
+  }
+  size_t len = (size_t) (next - segment);
+
+  size_t lo = 0, hi = node->child_count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    const struct RouteNode *child = node->children[mid];
+    int cmp = compare_segment(child->segment, child->segment_len, segment, len);
+    if (cmp == 0) {
+      long endpoint = trie_match(child, next, end, match);
+      if (endpoint >= 0) {
+        return endpoint;
+      }
+      break;
+    }
+    if (cmp < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  if (node->star != NULL && match->cap_count < ROUTER_MAX_CAPS) {
+    int cap = match->cap_count++;
+    match->caps[cap] = mg_str_n(segment, len);
+    long endpoint = trie_match(node->star, next, end, match);
+    if (endpoint >= 0) {
+      return endpoint;
+    }
+    match->cap_count = cap;
+  }
+
+  if (node->rest >= 0 && match->cap_count < ROUTER_MAX_CAPS) {
+    match->caps[match->cap_count++] = mg_str_n(segment, (size_t) (end - segment));
+    return node->rest;
+  }
+  return -1;
+}
+
+static long exact_match(const struct Router *router, const char *uri, size_t len) {
+  if (router->exact == NULL) {
+    return -1;
+  }
+  uint64_t hash = route_hash(uri, len);
+  const struct RouteExact *slot =
+      &router->exact[route_slot(router->exact_mask, hash, router->displace[route_bucket(router, hash)])];
+  if (slot->path == NULL || slot->hash != hash || slot->path_len != len || memcmp(slot->path, uri, len) != 0) {
+    return -1;
+  }
+  return (long) slot->endpoint;
+}
+
+static void exact_free(struct Router *router) {
+  free(router->exact);
+  free(router->displace);
+  router->exact = NULL;
+  router->displace = NULL;
+  router->exact_mask = 0;
+  router->bucket_mask = 0;
+}
+
+//! Struct for an exact route while its perfect hash slot is searched
+struct RouteKey {
+    uint64_t hash; //!< Path hash
+    size_t bucket; //!< Bucket of the hash
+    size_t bucket_size; //!< Keys sharing the bucket
+    const char *path; //!< Path
+    size_t endpoint; //!< Endpoint index
+};
+
+// Keys of the largest buckets first: those are hardest to place while the table is emptiest
+static int compare_key(const void *a, const void *b) {
+  const struct RouteKey *x = a, *y = b;
+  if (x->bucket_size != y->bucket_size) {
+    return x->bucket_size < y->bucket_size ? 1 : -1;
+  }
+  return (x->bucket > y->bucket) - (x->bucket < y->bucket);
+}
+
+// Hash-and-displace perfect hash: each bucket of about four keys searches for
+// a displacement that sends all of its keys to free slots. Lookups then cost
+// one hash, one displacement read and one comparison.
+static bool exact_build(struct Router *router, struct RouteKey *keys, size_t count) {
+  size_t slots = next_pow2(count * 2);
+  size_t buckets = next_pow2((count + 3) / 4);
+  router->exact = calloc(slots, sizeof(struct RouteExact));
+  router->displace = calloc(buckets, sizeof(uint32_t));
+  size_t *sizes = calloc(buckets, sizeof(size_t));
+  size_t *taken = calloc(count, sizeof(size_t));
+  bool placed = router->exact != NULL && router->displace != NULL && sizes != NULL && taken != NULL;
+  if (placed) {
+    router->exact_mask = slots - 1;
+    router->bucket_mask = buckets - 1;
+    for (size_t i = 0; i < count; i++) {
+      keys[i].bucket = route_bucket(router, keys[i].hash);
+      sizes[keys[i].bucket]++;
+    }
+    for (size_t i = 0; i < count; i++) {
+      keys[i].bucket_size = sizes[keys[i].bucket];
+    }
+    qsort(keys, count, sizeof(struct RouteKey), compare_key);
+  }
+
+  for (size_t first = 0; placed && first < count;) {
+    size_t n = keys[first].bucket_size;
+    placed = false;
+    for (uint32_t d = 0; d < ROUTER_MAX_DISPLACE && !placed; d++) {
+      placed = true;
+      for (size_t k = 0; k < n && placed; k++) {
+        taken[k] = route_slot(router->exact_mask, keys[first + k].hash, d);
+        placed = router->exact[taken[k]].path == NULL;
+        for (size_t prev = 0; prev < k && placed; prev++) {
+          placed = taken[prev] != taken[k];
+        }
+      }
+      if (placed) {
+        router->displace[keys[first].bucket] = d;
+        for (size_t k = 0; k < n; k++) {
+          struct RouteExact *slot = &router->exact[taken[k]];
+          slot->hash = keys[first + k].hash;
+          slot->path = keys[first + k].path;
+          slot->path_len = strlen(slot->path);
+          slot->endpoint = keys[first + k].endpoint;
+        }
+      }
+    }
+    first += n;
+  }
+
+  free(sizes);
+  free(taken);
+  if (!placed) {
+    exact_free(router);
+  }
+  return placed;
+}
+
+// ==============================================================================
+// Public API
+// ==============================================================================
+
+void GH_RouterInit(struct Router *router) {
+  memset(router, 0, sizeof(*router));
+}
+
+bool GH_RouterAdd(struct Router *router, unsigned methods, const char *pattern, RouteHandler handler, void *arg) {
+  bool wildcard;
+  if (router->built || handler == NULL || !pattern_valid(pattern, &wildcard)) {
+    return false;
+  }
+  struct RouteSpec *specs = realloc(router->specs, (router->spec_count + 1) * sizeof(*specs));
+  if (specs == NULL) {
+    return false;
+  }
+  router->specs = specs;
+  char *copy = malloc(strlen(pattern) + 1);
+  if (copy == NULL) {
+    return false;
+  }
+  strcpy(copy, pattern);
+
+  struct RouteSpec *spec = &specs[router->spec_count++];
+  spec->pattern = copy;
+  spec->target.methods = methods & ROUTE_ANY;
+  spec->target.handler = handler;
+  spec->target.arg = arg;
+  return true;
+}
+
+bool GH_RouterBuild(struct Router *router) {
+  size_t count = router->spec_count;
+  const struct RouteSpec **sorted = calloc(count + 1, sizeof(*sorted));
+  struct RouteKey *keys = calloc(count + 1, sizeof(struct RouteKey));
+  router->targets = calloc(count + 1, sizeof(struct RouteTarget));
+  router->endpoints = calloc(count + 1, sizeof(struct RouteEndpoint));
+  if (sorted == NULL || keys == NULL || router->targets == NULL || router->endpoints == NULL) {
+    free(sorted);
+    free(keys);
+    return false;
+  }
+  for (size_t i = 0; i < count; i++) {
+    sorted[i] = &router->specs[i];
+  }
+  qsort(sorted, count, sizeof(*sorted), compare_spec);
+
+  // One endpoint per distinct pattern; exact paths go to the perfect hash, the rest to the trie
+  bool ok = true;
+  size_t key_count = 0;
+  for (size_t i = 0; i < count && ok; i++) {
+    router->targets[i] = sorted[i]->target;
+    if (i > 0 && strcmp(sorted[i]->pattern, sorted[i - 1]->pattern) == 0) {
+      struct RouteEndpoint *endpoint = &router->endpoints[router->endpoint_count - 1];
+      endpoint->methods |= sorted[i]->target.methods;
+      endpoint->target_count++;
+      continue;
+    }
+    struct RouteEndpoint *endpoint = &router->endpoints[router->endpoint_count++];
+    endpoint->methods = sorted[i]->target.methods;
+    endpoint->first_target = i;
+    endpoint->target_count = 1;
+
+    bool wildcard;
+    pattern_valid(sorted[i]->pattern, &wildcard);
+    if (wildcard) {
+      ok = trie_insert(router, sorted[i]->pattern, router->endpoint_count - 1);
+    } else {
+      keys[key_count].hash = route_hash(sorted[i]->pattern, strlen(sorted[i]->pattern));
+      keys[key_count].path = sorted[i]->pattern;
+      keys[key_count].endpoint = router->endpoint_count - 1;
+      key_count++;
+    }
+  }
+
+  // Colliding 64-bit hashes can never be separated; such tables are served by the trie instead
+  if (ok && key_count > 0 && !exact_build(router, keys, key_count)) {
+    for (size_t i = 0; i < key_count && ok; i++) {
+      ok = trie_insert(router, keys[i].path, keys[i].endpoint);
+    }
+  }
+  free(sorted);
+  free(keys);
+  router->built = ok;
+  return ok;
+}
+
+void GH_RouterFree(struct Router *router) {
+  for (size_t i = 0; i < router->spec_count; i++) {
+    free(router->specs[i].pattern);
+  }
+  free(router->specs);
+  free(router->targets);
+  free(router->endpoints);
+  exact_free(router);
+  node_free(router->trie);
+  memset(router, 0, sizeof(*router));
+}
+
+unsigned GH_RouterMethod(struct mg_str method) {
+  for (size_t i = 0; i < sizeof(s_methods) / sizeof(s_methods[0]); i++) {
+    if (method.len == strlen(s_methods[i].name) && memcmp(method.buf, s_methods[i].name, method.len) == 0) {
+      return s_methods[i].bit;
+    }
+  }
+  return 0;
+}
+
+bool GH_RouterMatch(const struct Router *router, struct mg_str method, struct mg_str uri, struct RouteMatch *match) {
+  match->target = NULL;
+  match->allowed = 0;
+  match->cap_count = 0;
+  if (!router->built || uri.len == 0) {
+    return false;
+  }
+
+  long index = exact_match(router, uri.buf, uri.len);
+  if (index < 0 && router->trie != NULL) {
+    index = trie_match(router->trie, uri.buf, uri.buf + uri.len, match);
+  }
+  if (index < 0) {
+    match->cap_count = 0;
+    return false;
+  }
+
+  const struct RouteEndpoint *endpoint = &router->endpoints[index];
+  unsigned bit = GH_RouterMethod(method);
+  match->allowed = endpoint->methods;
+  for (size_t i = 0; i < endpoint->target_count && bit != 0; i++) {
+    const struct RouteTarget *target = &router->targets[endpoint->first_target + i];
+    if (target->methods & bit) {
+      match->target = target;
+      break;
+    }
+  }
+  return true;
+}
+
+void GH_RouterFormatAllow(unsigned methods, char *buf, size_t len) {
+  size_t used = 0;
+  if (len == 0) {
+    return;
+  }
+  buf[0] = '\0';
+  for (size_t i = 0; i < sizeof(s_methods) / sizeof(s_methods[0]); i++) {
+    if (methods & s_methods[i].bit) {
+      used += mg_snprintf(buf + used, len - used, "%s%s", used > 0 ? ", " : "", s_methods[i].name);
+      if (used >= len) {
+        buf[len - 1] = '\0';
+        return;
+      }
+    }
+  }
+}
@@ -0,0 +1,164 @@
+#pragma once
+#include <server/config.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <mongoose.h>
+
+#define ROUTER_MAX_CAPS 4             //!< Wildcard segments captured per route
+
+//! HTTP methods a route accepts, combined as a bit mask
+enum RouteMethod {
+    ROUTE_GET = 1 << 0, //!< GET
+    ROUTE_HEAD = 1 << 1, //!< HEAD
+    ROUTE_POST = 1 << 2, //!< POST
+    ROUTE_PUT = 1 << 3, //!< PUT
+    ROUTE_DELETE = 1 << 4, //!< DELETE
+    ROUTE_OPTIONS = 1 << 5, //!< OPTIONS
+    ROUTE_PATCH = 1 << 6, //!< PATCH
+    ROUTE_ANY = (1 << 7) - 1 //!< Every method above
+};
+
+struct RouteMatch;
+
+//! Route callback; runs on the worker that received the request
+typedef void (*RouteHandler)(struct mg_connection *c, struct mg_http_message *hm, const struct RouteMatch *match);
+
+//! Struct for one registered handler of a path
+struct RouteTarget {
+    unsigned methods; //!< enum RouteMethod mask this handler serves
+    RouteHandler handler; //!< Callback
+    void *arg; //!< Passed through in RouteMatch
+};
+
+//! Struct for the result of a lookup
+struct RouteMatch {
+    const struct RouteTarget *target; //!< Handler for the request's method, NULL if the method is not allowed
+    unsigned allowed; //!< Methods the matched path accepts (for Allow on 405)
+    struct mg_str caps[ROUTER_MAX_CAPS]; //!< Captured "*" segments and "#" tails, in pattern order
+    int cap_count; //!< Number of captures
+};
+
+//! Struct for everything routed to one path or pattern
+struct RouteEndpoint {
+    unsigned methods; //!< Union of its targets' methods
+    size_t first_target; //!< Index of its first target
+    size_t target_count; //!< Number of targets
+};
+
+//! Struct for a slot of the exact-path perfect hash table
+struct RouteExact {
+    uint64_t hash; //!< Path hash
+    const char *path; //!< Path, NULL if the slot is empty
+    size_t path_len; //!< Length of path
+    size_t endpoint; //!< Index into the endpoints
+};
+
+//! Struct for a node of the segment trie holding wildcard routes
+struct RouteNode {
+    const char *segment; //!< Literal segment leading here ("" at the root)
+    size_t segment_len; //!< Length of segment
+    struct RouteNode **children; //!< Literal children, sorted by segment
+    size_t child_count; //!< Number of literal children
+    struct RouteNode *star; //!< Child for a "*" segment, or NULL
+    long endpoint; //!< Endpoint when the path ends here, -1 if none
+    long rest; //!< Endpoint for a trailing "#", -1 if none
+};
+
+//! Struct for a pending registration, compiled by GH_RouterBuild
+struct RouteSpec {
+    char *pattern; //!< Owned copy of the pattern
+    struct RouteTarget target; //!< Handler and methods
+};
+
+//! Struct for a route table: perfect hash for exact paths, segment trie for wildcards
+struct Router {
+    struct RouteSpec *specs; //!< Registrations, in order
+    size_t spec_count; //!< Number of registrations
+    struct RouteTarget *targets; //!< Targets grouped by endpoint
+    struct RouteEndpoint *endpoints; //!< One per distinct path or pattern
+    size_t endpoint_count; //!< Number of endpoints
+    struct RouteExact *exact; //!< Exact-path slots (power of two), NULL without exact routes
+    size_t exact_mask; //!< Number of slots minus one
+    uint32_t *displace; //!< Per-bucket displacement of the perfect hash
+    size_t bucket_mask; //!< Number of buckets minus one
+    struct RouteNode *trie; //!< Root of the wildcard trie, NULL without wildcard routes
+    bool built; //!< GH_RouterBuild succeeded; no more registrations
+};
+
+// ============================================================================
+// Route table compiled at startup
+// ============================================================================
+
+/**
+ * @brief Initialize an empty router
+ * 
+ * @param router Router to initialize
+ */
+void GH_RouterInit(struct Router *router);
+
+/**
+ * @brief Register a route; call before GH_RouterBuild
+ * 
+ * Patterns start with "/" and are matched segment by segment: a "*" segment
+ * matches any one segment, a final "#" segment matches the rest of the path
+ * (zero or more segments). Other segments match literally. An exact path wins
+ * over patterns; literal segments win over "*", and "*" over "#".
+ * 
+ * @param router Router
+ * @param methods enum RouteMethod mask
+ * @param pattern Path or pattern, copied
+ * @param handler Callback
+ * @param arg Passed to the callback in RouteMatch
+ * @return bool true on success, false if the pattern is invalid or the router is built
+ */
+bool GH_RouterAdd(struct Router *router, unsigned methods, const char *pattern, RouteHandler handler, void *arg);
+
+/**
+ * @brief Compile the registered routes into the dispatch structures
+ * 
+ * After this the router is read-only and may be shared by every worker.
+ * 
+ * @param router Router
+ * @return bool true on success, false on allocation failure
+ */
+bool GH_RouterBuild(struct Router *router);
+
+/**
+ * @brief Free everything a router owns
+ * 
+ * @param router Router
+ */
+void GH_RouterFree(struct Router *router);
+
+/**
+ * @brief Map a method token to its enum RouteMethod bit
+ * 
+ * @param method Request method
+ * @return unsigned Method bit, 0 for methods the router does not know
+ */
+unsigned GH_RouterMethod(struct mg_str method);
+
+/**
+ * @brief Look up a request
+ * 
+ * Cost depends on the URI (one hash for exact paths, one step per segment
+ * for patterns), not on the number of routes.
+ * 
+ * @param router Built router
+ * @param method Request method
+ * @param uri Request path
+ * @param match Receives the handler, the allowed methods and the captures
+ * @return bool true if a route matched the path (match->target is NULL if the method is not allowed)
+ */
+bool GH_RouterMatch(const struct Router *router, struct mg_str method, struct mg_str uri, struct RouteMatch *match);
+
+/**
+ * @brief Format a method mask for an Allow header, e.g. "GET, HEAD"
+ * 
+ * @param methods enum RouteMethod mask
+ * @param buf Output buffer
+ * @param len Size of buf
+ */
+void GH_RouterFormatAllow(unsigned methods, char *buf, size_t len);
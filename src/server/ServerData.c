@@ -0,0 +1,289 @@
+#include "ServerData.h"
+#include "Metrics.h"
+#include <stdlib.h>
+#include <string.h>
+
+// ==============================================================================
+// Internal helpers
+// ==============================================================================
+
+#define SERVER_DATA_END_MARKER "RTENDMARKERBS1001"
+#define SERVER_DATA_HEAD "HTTP/1.1 200 OK\r\n" \
+                         "Content-Type: text/html\r\n" \
+                         "Content-Length: %lu\r\n" \
+                         "Connection: keep-alive\r\n" \
+                         "\r\n"
+
+//! Struct for the block the calling thread holds a reference to
+struct ServerDataLocal {
+    struct ServerData *owner; //!< Responder the block came from
+    struct ServerDataBlock *block; //!< Held block
+    size_t generation; //!< Owner's generation when it was taken
+};
+
+static GH_THREAD_LOCAL struct ServerDataLocal s_local;
+
+// Drop one reference; caller holds the owner's lock
+static void block_release(struct ServerDataBlock *block) {
+  if (block != NULL && --block->refs == 0) {
+    free(block);
+  }
+}
+
+static struct mg_str trim(struct mg_str s) {
+  while (s.len > 0 && (s.buf[0] == ' ' || s.buf[0] == '\t')) {
+    s.buf++, s.len--;
+  }
+  while (s.len > 0 && (s.buf[s.len - 1] == ' ' || s.buf[s.len - 1] == '\t' || s.buf[s.len - 1] == '\r')) {
+    s.len--;
+  }
+  return s;
+}
+
+static bool key_is(struct mg_str key, const char *name) {
+  return key.len == strlen(name) && memcmp(key.buf, name, key.len) == 0;
+}
+
+// "4.61" -> 4610; stops at the first character that is not part of the number
+static uint32_t parse_version(struct mg_str s) {
+  uint32_t major = 0, minor = 0, scale = 100;
+  size_t i = 0;
+  for (; i < s.len && s.buf[i] >= '0' && s.buf[i] <= '9' && major < 1000000; i++) {
+    major = major * 10 + (uint32_t) (s.buf[i] - '0');
+  }
+  if (i == 0) {
+    return 0;
+  }
+  if (i < s.len && s.buf[i] == '.') {
+    for (i++; i < s.len && s.buf[i] >= '0' && s.buf[i] <= '9' && scale > 0; i++, scale /= 10) {
+      minor += (uint32_t) (s.buf[i] - '0') * scale;
+    }
+  }
+  return major * 1000 + minor;
+}
+
+// Append "key|value\n" lines for every rendered key, skipping "maint" if asked
+static bool render_lines(struct mg_str config, struct mg_iobuf *out, bool skip_maint) {
+  struct mg_str rest = config, line;
+  while (mg_span(rest, &line, &rest, '\n')) {
+    line = trim(line);
+    if (line.len == 0 || line.buf[0] == '#') {
+      continue;
+    }
+    struct mg_str key, value;
+    if (!mg_span(line, &key, &value, '=')) {
+      return false;
+    }
+    key = trim(key);
+    value = trim(value);
+    if (key.len == 0 || memchr(key.buf, '|', key.len) != NULL) {
+      return false;
+    }
+    if (key_is(key, "min_version") || key_is(key, "outdated") || (skip_maint && key_is(key, "maint"))) {
+      continue;
+    }
+    mg_xprintf(mg_pfn_iobuf, out, "%.*s|%.*s\n", (int) key.len, key.buf, (int) value.len, value.buf);
+  }
+  return true;
+}
+
+// Value of a config key, or an empty string
+static struct mg_str config_value(struct mg_str config, const char *name) {
+  struct mg_str rest = config, line, key, value, found = mg_str_n("", 0);
+  while (mg_span(rest, &line, &rest, '\n')) {
+    line = trim(line);
+    if (line.len > 0 && line.buf[0] != '#' && mg_span(line, &key, &value, '=') && key_is(trim(key), name)) {
+      found = trim(value);
+    }
+  }
+  return found;
+}
+
+// Render a config into one block holding every variant as a complete response
+static struct ServerDataBlock *render(struct mg_str config) {
+  struct mg_str outdated = config_value(config, "outdated");
+  uint32_t min_version = parse_version(config_value(config, "min_version"));
+  bool has_outdated = min_version > 0 && outdated.len > 0;
+  if (config_value(config, "server").len == 0 || config_value(config, "port").len == 0) {
+    return NULL;
+  }
+
+  struct mg_iobuf bodies[SERVER_DATA_VARIANT_COUNT] = {{NULL, 0, 0, 256}, {NULL, 0, 0, 256}};
+  bool ok = render_lines(config, &bodies[SERVER_DATA_CURRENT], false);
+  mg_xprintf(mg_pfn_iobuf, &bodies[SERVER_DATA_CURRENT], "%s", SERVER_DATA_END_MARKER);
+  if (ok && has_outdated) {
+    ok = render_lines(config, &bodies[SERVER_DATA_OUTDATED], true);
+    mg_xprintf(mg_pfn_iobuf, &bodies[SERVER_DATA_OUTDATED], "maint|%.*s\n%s", (int) outdated.len, outdated.buf,
+               SERVER_DATA_END_MARKER);
+  }
+
+  // Block header, then each response: head and body back to back
+  struct ServerDataBlock *block = NULL;
+  char heads[SERVER_DATA_VARIANT_COUNT][128];
+  size_t head_lens[SERVER_DATA_VARIANT_COUNT] = {0};
+  size_t total = sizeof(struct ServerDataBlock);
+  int variants = has_outdated ? SERVER_DATA_VARIANT_COUNT : 1;
+  for (int v = 0; ok && v < variants; v++) {
+    head_lens[v] = mg_snprintf(heads[v], sizeof(heads[v]), SERVER_DATA_HEAD, (unsigned long) bodies[v].len);
+    total += head_lens[v] + bodies[v].len;
+  }
+  if (ok && (block = calloc(1, total)) != NULL) {
+    char *cursor = (char *) (block + 1);
+    for (int v = 0; v < variants; v++) {
+      block->responses[v] = cursor;
+      block->response_lens[v] = head_lens[v] + bodies[v].len;
+      memcpy(cursor, heads[v], head_lens[v]);
+      memcpy(cursor + head_lens[v], bodies[v].buf, bodies[v].len);
+      cursor += block->response_lens[v];
+    }
+    if (!has_outdated) {
+      block->responses[SERVER_DATA_OUTDATED] = block->responses[SERVER_DATA_CURRENT];
+      block->response_lens[SERVER_DATA_OUTDATED] = block->response_lens[SERVER_DATA_CURRENT];
+    }
+    block->min_version = has_outdated ? min_version : 0;
+    block->crc = mg_crc32(0, config.buf, config.len);
+  }
+  for (int v = 0; v < SERVER_DATA_VARIANT_COUNT; v++) {
+    mg_iobuf_free(&bodies[v]);
+  }
+  return block;
+}
+
+// Install a block as current; the previous one is freed once no thread holds it
+static void swap_block(struct ServerData *sd, struct ServerDataBlock *block) {
+  block->refs = 1;
+  GH_MutexLock(&sd->lock);
+  struct ServerDataBlock *previous = sd->block;
+  sd->block = block;
+  GH_AtomicAddSize(&sd->generation, 1);
+  block_release(previous);
+  GH_MutexUnlock(&sd->lock);
+}
+
+// ==============================================================================
+// Public API
+// ==============================================================================
+
+bool GH_ServerDataInit(struct ServerData *sd, const char *path) {
+  memset(sd, 0, sizeof(*sd));
+  GH_MutexInit(&sd->lock);
+  if (path[0] == '\0' || (sd->path = malloc(strlen(path) + 1)) == NULL) {
+    return false;
+  }
+  strcpy(sd->path, path);
+  return GH_ServerDataReload(sd);
+}
+
+bool GH_ServerDataReload(struct ServerData *sd) {
+  if (sd->path == NULL) {
+    return false;
+  }
+  struct mg_str config = mg_file_read(&mg_fs_posix, sd->path);
+  if (config.buf == NULL) {
+    return false;
+  }
+
+  bool swapped = false;
+  uint32_t crc = mg_crc32(0, config.buf, config.len);
+  if (config.len > SERVER_DATA_MAX_CONFIG) {
+    MG_ERROR(("%s: larger than %d bytes, ignored", sd->path, SERVER_DATA_MAX_CONFIG));
+  } else if ((sd->block == NULL || sd->block->crc != crc) && sd->rejected_crc != crc) {
+    struct ServerDataBlock *block = render(config);
+    if (block != NULL) {
+      if (sd->block != NULL) {
+        sd->reloads++;
+        GH_MetricsInc(MC_SERVER_DATA_RELOADS);
+      }
+      swap_block(sd, block);
+      swapped = true;
+    } else {
+      sd->rejected_crc = crc;  // Reported once, not on every check
+      MG_ERROR(("%s: invalid server_data config (needs server and port), keeping the previous one", sd->path));
+    }
+  }
+  free(config.buf);
+  return swapped;
+}
+
+void GH_ServerDataPoll(struct ServerData *sd, uint64_t now) {
+  // Without a first render the endpoint is not routed, so there is nothing to refresh
+  if (sd->block == NULL || now < sd->next_check) {
+    return;
+  }
+  sd->next_check = now + APP_SERVER_DATA_CHECK_MS;
+  // The config is small: comparing its CRC catches edits within the same mtime second
+  if (GH_ServerDataReload(sd)) {
+    MG_INFO(("%s reloaded", sd->path));
+  }
+}
+
+const struct ServerDataBlock *GH_ServerDataAcquire(struct ServerData *sd) {
+  size_t generation = GH_AtomicLoadSize(&sd->generation);
+  if (s_local.owner == sd && s_local.generation == generation) {
+    return s_local.block;
+  }
+
+  // First call on this thread, or a reload since: trade the held block for the current one
+  if (s_local.owner != NULL) {
+    GH_MutexLock(&s_local.owner->lock);
+    block_release(s_local.block);
+    GH_MutexUnlock(&s_local.owner->lock);
+  }
+  GH_MutexLock(&sd->lock);
+  s_local.owner = sd;
+  s_local.block = sd->block;
+  s_local.generation = GH_AtomicLoadSize(&sd->generation);
+  if (s_local.block != NULL) {
+    s_local.block->refs++;
+  }
+  GH_MutexUnlock(&sd->lock);
+  return s_local.block;
+}
+
+uint32_t GH_ServerDataVersion(struct mg_str form) {
+  struct mg_str rest = form, field, key, value;
+  while (mg_span(rest, &field, &rest, '&')) {
+    if (mg_span(field, &key, &value, '=') && key_is(key, "version")) {
+      return parse_version(value);
+    }
+  }
+  return 0;
+}
+
+struct mg_str GH_ServerDataResponse(const struct ServerDataBlock *block, struct mg_str form) {
+  // Requests without a version (browsers, health checks) get the regular response
+  enum ServerDataVariant variant = SERVER_DATA_CURRENT;
+  uint32_t version = block->min_version > 0 ? GH_ServerDataVersion(form) : 0;
+  if (version > 0 && version < block->min_version) {
+    variant = SERVER_DATA_OUTDATED;
+    GH_MetricsInc(MC_SERVER_DATA_OUTDATED);
+  }
+  GH_MetricsInc(MC_SERVER_DATA);
+  return mg_str_n(block->responses[variant], block->response_lens[variant]);
+}
+
+void GH_ServerDataRelease(struct ServerData *sd) {
+  if (s_local.owner != sd) {
+    return;
+  }
+  GH_MutexLock(&sd->lock);
+  block_release(s_local.block);
+  GH_MutexUnlock(&sd->lock);
+  memset(&s_local, 0, sizeof(s_local));
+}
+
+void GH_ServerDataCleanup(struct ServerData *sd) {
+  GH_ServerDataRelease(sd);
+  GH_MutexLock(&sd->lock);
+  struct ServerDataBlock *block = sd->block;
+  if (block != NULL && block->refs > 1) {
+    MG_ERROR(("%s: %lu thread(s) still hold the server_data block, not freed", sd->path,
+              (unsigned long) (block->refs - 1)));
+  }
+  block_release(block);
+  sd->block = NULL;
+  GH_MutexUnlock(&sd->lock);
+  free(sd->path);
+  sd->path = NULL;
+  GH_MutexDestroy(&sd->lock);
+}
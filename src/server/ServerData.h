@@ -0,0 +1,136 @@
+#pragma once
+#include <server/config.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <mongoose.h>
+#include <utils/Sync.h>
+
+#ifndef APP_SERVER_DATA_CONFIG
+#define APP_SERVER_DATA_CONFIG "server_data.cfg"  //!< Default config rendered into /growtopia/server_data.php, "" for none
+#endif
+#ifndef APP_SERVER_DATA_CHECK_MS
+#define APP_SERVER_DATA_CHECK_MS 1000 //!< Default interval between checks of the config for changes
+#endif
+
+#define SERVER_DATA_PATH "/growtopia/server_data.php"  //!< Endpoint polled by the client before it connects
+#define SERVER_DATA_MAX_CONFIG (64 * 1024)  //!< Larger config files are rejected
+
+//! Response variants prebuilt for every config
+enum ServerDataVariant {
+    SERVER_DATA_CURRENT, //!< Regular response
+    SERVER_DATA_OUTDATED, //!< Response for clients below min_version (maint message)
+    SERVER_DATA_VARIANT_COUNT //!< Number of variants
+};
+
+//! Struct for one rendered config: complete HTTP responses, ready to send
+struct ServerDataBlock {
+    size_t refs; //!< Holders: the ServerData while current, plus each thread that acquired it
+    uint32_t crc; //!< CRC32 of the config text it was rendered from
+    uint32_t min_version; //!< Oldest client version served SERVER_DATA_CURRENT, in thousandths (0 = any)
+    const char *responses[SERVER_DATA_VARIANT_COUNT]; //!< Status line, headers and body, inside this block
+    size_t response_lens[SERVER_DATA_VARIANT_COUNT]; //!< Length of each response
+};
+
+//! Struct for the server_data.php responder and its config file
+struct ServerData {
+    char *path; //!< Config file path, NULL if not configured
+    GH_Mutex lock; //!< Guards block and the reference counts
+    struct ServerDataBlock *block; //!< Current block, NULL until a config was rendered
+    size_t generation; //!< Bumped by every swap (atomic)
+    uint32_t rejected_crc; //!< CRC32 of the last config that failed to render
+    uint64_t next_check; //!< Timestamp of the next change check in milliseconds
+    size_t reloads; //!< Successful reloads after the first load
+};
+
+// ============================================================================
+// Prebuilt server_data.php responses
+// ============================================================================
+
+/**
+ * @brief Load and render a server_data config
+ * 
+ * The config has one "key = value" per line; blank lines and lines starting
+ * with "#" are skipped. Every key is rendered as "key|value" in file order,
+ * followed by the RTENDMARKERBS1001 end marker; "server" and "port" are
+ * required. Two keys are not rendered: "min_version" (e.g. 4.61) and
+ * "outdated", sent as the "maint" message to clients that report an older
+ * version; both are needed to turn that check on.
+ * 
+ * @param sd Responder to initialize
+ * @param path Config file path, copied ("" for none)
+ * @return bool true if the config was rendered, false if it is missing or invalid
+ */
+bool GH_ServerDataInit(struct ServerData *sd, const char *path);
+
+/**
+ * @brief Re-render the config and swap it in atomically
+ * 
+ * Requests keep getting the previous block until the swap; a config that
+ * fails to render leaves the previous block in place.
+ * 
+ * @param sd Responder
+ * @return bool true if a new block was swapped in, false if unchanged or invalid
+ */
+bool GH_ServerDataReload(struct ServerData *sd);
+
+/**
+ * @brief Reload the config if it changed, checking at most every APP_SERVER_DATA_CHECK_MS
+ * 
+ * Does nothing if GH_ServerDataInit found no valid config.
+ * 
+ * @param sd Responder
+ * @param now Current timestamp in milliseconds
+ */
+void GH_ServerDataPoll(struct ServerData *sd, uint64_t now);
+
+/**
+ * @brief Current block for the calling thread
+ * 
+ * Lock-free unless a reload happened since this thread's last call. The
+ * block stays valid until the calling thread's next call; the thread holds a
+ * reference to it until then, so it must call GH_ServerDataRelease() before
+ * it exits.
+ * 
+ * @param sd Responder
+ * @return const struct ServerDataBlock* Block, NULL if no config was ever rendered
+ */
+const struct ServerDataBlock *GH_ServerDataAcquire(struct ServerData *sd);
+
+/**
+ * @brief Drop the block the calling thread holds, if any
+ * 
+ * Call on every thread that used GH_ServerDataAcquire() before it exits; the
+ * last holder of a replaced block frees it.
+ * 
+ * @param sd Responder
+ */
+void GH_ServerDataRelease(struct ServerData *sd);
+
+/**
+ * @brief Client version from a url-encoded form, without copying or allocating
+ * 
+ * @param form Request body (or query string), e.g. "version=4.61&platform=0"
+ * @return uint32_t Version in thousandths (4.61 -> 4610), 0 if absent or malformed
+ */
+uint32_t GH_ServerDataVersion(struct mg_str form);
+
+/**
+ * @brief Pick the prebuilt response for a request
+ * 
+ * @param block Block from GH_ServerDataAcquire
+ * @param form Request body (or query string)
+ * @return struct mg_str Complete response to send
+ */
+struct mg_str GH_ServerDataResponse(const struct ServerDataBlock *block, struct mg_str form);
+
+/**
+ * @brief Drop the current block and free the responder
+ * 
+ * Releases the calling thread's block; call once every other thread called
+ * GH_ServerDataRelease(). A block some thread still holds is not freed.
+ * 
+ * @param sd Responder
+ */
+void GH_ServerDataCleanup(struct ServerData *sd);
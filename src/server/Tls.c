@@ -0,0 +1,432 @@
+#include "Tls.h"
+#include "Metrics.h"
+#include <limits.h>
+#include <string.h>
+
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/rand.h>
+#include <openssl/x509v3.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#else
+#include <openssl/hmac.h>
+#endif
+
+#if MG_TLS != MG_TLS_CUSTOM
+#error "server/Tls.c implements mongoose's TLS hooks: set MG_TLS to MG_TLS_CUSTOM in config.h"
+#endif
+
+// ==============================================================================
+// Internal helpers
+// ==============================================================================
+
+// Fill a key from the CSPRNG; false leaves the current keys in charge
+static bool make_key(struct TlsTicketKey *key) {
+  return RAND_bytes(key->name, sizeof(key->name)) == 1 && RAND_bytes(key->aes_key, sizeof(key->aes_key)) == 1 &&
+         RAND_bytes(key->hmac_key, sizeof(key->hmac_key)) == 1;
+}
+
+// Put a new key in front, dropping the oldest once TLS_TICKET_KEYS are kept. Lock held.
+static bool rotate_locked(struct TlsContext *tls) {
+  struct TlsTicketKey key;
+  if (!make_key(&key)) {
+    return false;
+  }
+  int keep = tls->key_count < TLS_TICKET_KEYS ? tls->key_count : TLS_TICKET_KEYS - 1;
+  OPENSSL_cleanse(&tls->keys[keep], sizeof(tls->keys[keep]));
+  memmove(&tls->keys[1], &tls->keys[0], (size_t) keep * sizeof(tls->keys[0]));
+  tls->keys[0] = key;
+  tls->key_count = keep + 1;
+  OPENSSL_cleanse(&key, sizeof(key));
+  return true;
+}
+
+// Key for a ticket: the issuing one when sealing (name filled in), the named
+// one when opening. Returns 1, 2 if the ticket should be renewed, 0 if unknown.
+static int ticket_key(struct TlsContext *tls, unsigned char name[16], bool seal, struct TlsTicketKey *out) {
+  int found = 0;
+  uint64_t now = mg_millis();
+  GH_MutexLock(&tls->lock);
+  // Rotate lazily; after a long quiet spell every period missed retires a key
+  for (int i = 0; i < TLS_TICKET_KEYS && now >= tls->next_rotation; i++) {
+    if (rotate_locked(tls)) {
+      tls->next_rotation += tls->rotate_ms;
+    }
+  }
+  if (now >= tls->next_rotation) {
+    tls->next_rotation = now + tls->rotate_ms;
+  }
+  if (seal) {
+    *out = tls->keys[0];
+    memcpy(name, out->name, sizeof(out->name));
+    found = 1;
+  } else {
+    for (int i = 0; i < tls->key_count; i++) {
+      if (memcmp(name, tls->keys[i].name, sizeof(tls->keys[i].name)) == 0) {
+        *out = tls->keys[i];
+        found = i == 0 ? 1 : 2;
+        break;
+      }
+    }
+  }
+  GH_MutexUnlock(&tls->lock);
+  return found;
+}
+
+// Ticket callback: OpenSSL seals (enc = 1) or opens a ticket with the cipher
+// and MAC contexts set up here. Returns as ticket_key does, -1 on failure.
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+static int ticket_cb(SSL *ssl, unsigned char name[16], unsigned char *iv, EVP_CIPHER_CTX *cipher,
+                     EVP_MAC_CTX *mac, int enc) {
+#else
+static int ticket_cb(SSL *ssl, unsigned char name[16], unsigned char *iv, EVP_CIPHER_CTX *cipher,
+                     HMAC_CTX *mac, int enc) {
+#endif
+  struct TlsContext *tls = (struct TlsContext *) SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl));
+  struct TlsTicketKey key;
+  if (enc && RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) != 1) {
+    return -1;
+  }
+  int found = ticket_key(tls, name, enc != 0, &key);
+  if (found > 0) {
+    bool ok = EVP_CipherInit_ex(cipher, EVP_aes_256_cbc(), NULL, key.aes_key, iv, enc) == 1;
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    OSSL_PARAM params[] = {
+      OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, key.hmac_key, sizeof(key.hmac_key)),
+      OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, (char *) "SHA256", 0),
+      OSSL_PARAM_construct_end(),
+    };
+    ok = ok && EVP_MAC_CTX_set_params(mac, params) == 1;
+#else
+    ok = ok && HMAC_Init_ex(mac, key.hmac_key, sizeof(key.hmac_key), EVP_sha256(), NULL) == 1;
+#endif
+    found = ok ? found : -1;
+  }
+  OPENSSL_cleanse(&key, sizeof(key));
+  return found;
+}
+
+// BIO over mongoose's socket I/O, so records go wherever mongoose reads and
+// writes (including bytes it already pulled into c->rtls)
+static int bio_write(BIO *bio, const char *buf, int len) {
+  long n = mg_io_send((struct mg_connection *) BIO_get_data(bio), buf, (size_t) len);
+  BIO_clear_retry_flags(bio);
+  if (n == MG_IO_WAIT) {
+    BIO_set_retry_write(bio);
+  }
+  return n >= 0 ? (int) n : -1;
+}
+
+static int bio_read(BIO *bio, char *buf, int len) {
+  long n = mg_io_recv((struct mg_connection *) BIO_get_data(bio), buf, (size_t) len);
+  BIO_clear_retry_flags(bio);
+  if (n == MG_IO_WAIT) {
+    BIO_set_retry_read(bio);
+  }
+  return n > 0 ? (int) n : -1;
+}
+
+static long bio_ctrl(BIO *bio, int cmd, long num, void *ptr) {
+  (void) bio;
+  (void) num;
+  (void) ptr;
+  return cmd == BIO_CTRL_FLUSH ? 1 : 0;
+}
+
+// MG_IO_WAIT if OpenSSL only waits for the socket, else MG_IO_ERR (queue cleared)
+static long io_result(SSL *ssl, int rc) {
+  int err = SSL_get_error(ssl, rc);
+  if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) {
+    return MG_IO_WAIT;
+  }
+  ERR_clear_error();  // The queue is per thread; a stale error would fail the next connection
+  return MG_IO_ERR;
+}
+
+// Record handling shared by the server and client contexts: idle keep-alive
+// connections give their buffers back; mongoose may retry a partial write from
+// a reallocated send buffer
+static void set_common_options(SSL_CTX *ctx) {
+  SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+  SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER |
+                            SSL_MODE_RELEASE_BUFFERS);
+}
+
+// Context of outgoing connections, built by the first one: peers are verified
+// against the system trust store unless the connection brings its own CA
+static SSL_CTX *client_ctx(struct TlsContext *tls) {
+  GH_MutexLock(&tls->lock);
+  if (tls->client_ctx == NULL && (tls->client_ctx = SSL_CTX_new(TLS_client_method())) != NULL) {
+    set_common_options(tls->client_ctx);
+    SSL_CTX_set_options(tls->client_ctx, SSL_OP_NO_RENEGOTIATION);
+    SSL_CTX_set_verify(tls->client_ctx, SSL_VERIFY_PEER, NULL);
+    if (SSL_CTX_set_default_verify_paths(tls->client_ctx) != 1) {
+      MG_ERROR(("TLS: no system trust store, outgoing connections need a CA"));
+      ERR_clear_error();
+    }
+  }
+  SSL_CTX *ctx = tls->client_ctx;
+  GH_MutexUnlock(&tls->lock);
+  return ctx;
+}
+
+// Trust store holding every certificate of a PEM bundle, NULL if it has none
+static X509_STORE *load_ca(struct mg_str pem) {
+  BIO *bio = BIO_new_mem_buf(pem.buf, (int) pem.len);
+  X509_STORE *store = bio != NULL ? X509_STORE_new() : NULL;
+  int count = 0;
+  X509 *cert;
+  while (store != NULL && (cert = PEM_read_bio_X509(bio, NULL, NULL, NULL)) != NULL) {
+    count += X509_STORE_add_cert(store, cert) == 1;
+    X509_free(cert);
+  }
+  ERR_clear_error();  // Reading stops with an end-of-data error
+  BIO_free(bio);
+  if (count == 0) {
+    X509_STORE_free(store);
+    return NULL;
+  }
+  return store;
+}
+
+// Client certificate (leaf first, then its chain) and private key, PEM in memory
+static bool use_client_cert(SSL *ssl, struct mg_str cert_pem, struct mg_str key_pem) {
+  BIO *bio = BIO_new_mem_buf(cert_pem.buf, (int) cert_pem.len);
+  X509 *cert = bio != NULL ? PEM_read_bio_X509(bio, NULL, NULL, NULL) : NULL;
+  bool ok = cert != NULL && SSL_use_certificate(ssl, cert) == 1;
+  X509_free(cert);
+  while (ok && (cert = PEM_read_bio_X509(bio, NULL, NULL, NULL)) != NULL) {
+    ok = SSL_add0_chain_cert(ssl, cert) == 1;
+    if (!ok) {
+      X509_free(cert);
+    }
+  }
+  BIO_free(bio);
+
+  bio = ok ? BIO_new_mem_buf(key_pem.buf, (int) key_pem.len) : NULL;
+  EVP_PKEY *key = bio != NULL ? PEM_read_bio_PrivateKey(bio, NULL, NULL, NULL) : NULL;
+  ok = key != NULL && SSL_use_PrivateKey(ssl, key) == 1 && SSL_check_private_key(ssl) == 1;
+  EVP_PKEY_free(key);
+  BIO_free(bio);
+  ERR_clear_error();
+  return ok;
+}
+
+// Per-connection client settings from mongoose's options: the server name is
+// sent as SNI and checked against the certificate (an IP address only checked),
+// ca replaces the system trust store, cert and key are offered if asked for
+static bool client_setup(SSL *ssl, const struct mg_tls_opts *opts) {
+  char name[256];
+  if (opts->name.len >= sizeof(name)) {
+    return false;
+  }
+  memcpy(name, opts->name.buf, opts->name.len);
+  name[opts->name.len] = '\0';
+
+  if (opts->skip_verification) {
+    SSL_set_verify(ssl, SSL_VERIFY_NONE, NULL);
+  } else if (opts->ca.len > 0) {
+    X509_STORE *store = load_ca(opts->ca);
+    bool ok = store != NULL && SSL_set1_verify_cert_store(ssl, store) == 1;
+    X509_STORE_free(store);
+    if (!ok) {
+      return false;
+    }
+  }
+  if (name[0] != '\0') {
+    bool is_ip = X509_VERIFY_PARAM_set1_ip_asc(SSL_get0_param(ssl), name) == 1;
+    ERR_clear_error();
+    if (!is_ip && (SSL_set_tlsext_host_name(ssl, name) != 1 || SSL_set1_host(ssl, name) != 1)) {
+      return false;
+    }
+  }
+  if (opts->cert.len > 0 && !use_client_cert(ssl, opts->cert, opts->key.len > 0 ? opts->key : opts->cert)) {
+    return false;
+  }
+  return true;
+}
+
+// ==============================================================================
+// Public API
+// ==============================================================================
+
+bool GH_TlsInit(struct TlsContext *tls, const char *cert, const char *key, uint32_t cache_size, uint32_t rotate_s) {
+  memset(tls, 0, sizeof(*tls));
+  GH_MutexInit(&tls->lock);
+  tls->ctx = SSL_CTX_new(TLS_server_method());
+  tls->bio_method = BIO_meth_new(BIO_get_new_index() | BIO_TYPE_SOURCE_SINK, "mongoose");
+  if (tls->ctx == NULL || tls->bio_method == NULL) {
+    GH_TlsCleanup(tls);
+    return false;
+  }
+  BIO_meth_set_write(tls->bio_method, bio_write);
+  BIO_meth_set_read(tls->bio_method, bio_read);
+  BIO_meth_set_ctrl(tls->bio_method, bio_ctrl);
+
+  set_common_options(tls->ctx);
+  SSL_CTX_set_options(tls->ctx, SSL_OP_NO_RENEGOTIATION | SSL_OP_CIPHER_SERVER_PREFERENCE |
+                                    (rotate_s == 0 ? SSL_OP_NO_TICKET : 0));
+  if (SSL_CTX_use_certificate_chain_file(tls->ctx, cert) != 1 ||
+      SSL_CTX_use_PrivateKey_file(tls->ctx, key, SSL_FILETYPE_PEM) != 1 ||
+      SSL_CTX_check_private_key(tls->ctx) != 1) {
+    ERR_clear_error();
+    GH_TlsCleanup(tls);
+    return false;
+  }
+
+  SSL_CTX_set_app_data(tls->ctx, tls);
+  SSL_CTX_set_session_id_context(tls->ctx, (const unsigned char *) TLS_SESSION_ID_CONTEXT,
+                                 sizeof(TLS_SESSION_ID_CONTEXT) - 1);
+  SSL_CTX_set_session_cache_mode(tls->ctx, SSL_SESS_CACHE_SERVER);
+  SSL_CTX_sess_set_cache_size(tls->ctx, (long) cache_size);
+  if (rotate_s > 0) {
+    tls->rotate_ms = (uint64_t) rotate_s * 1000;
+    tls->next_rotation = mg_millis() + tls->rotate_ms;
+    if (!rotate_locked(tls)) {
+      GH_TlsCleanup(tls);
+      return false;
+    }
+    // A session must not outlive the last key that can open its ticket
+    SSL_CTX_set_timeout(tls->ctx, (long) rotate_s * (TLS_TICKET_KEYS - 1));
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    SSL_CTX_set_tlsext_ticket_key_evp_cb(tls->ctx, ticket_cb);
+#else
+    SSL_CTX_set_tlsext_ticket_key_cb(tls->ctx, ticket_cb);
+#endif
+  }
+  return true;
+}
+
+void GH_TlsCleanup(struct TlsContext *tls) {
+  SSL_CTX_free(tls->ctx);
+  SSL_CTX_free(tls->client_ctx);
+  BIO_meth_free(tls->bio_method);
+  OPENSSL_cleanse(tls->keys, sizeof(tls->keys));
+  GH_MutexDestroy(&tls->lock);
+  tls->ctx = NULL;
+  tls->client_ctx = NULL;
+  tls->bio_method = NULL;
+  tls->key_count = 0;
+}
+
+bool GH_TlsRotateTicketKeys(struct TlsContext *tls, uint64_t now) {
+  if (tls->rotate_ms == 0) {
+    return false;
+  }
+  GH_MutexLock(&tls->lock);
+  bool rotated = rotate_locked(tls);
+  if (rotated) {
+    tls->next_rotation = now + tls->rotate_ms;
+  }
+  GH_MutexUnlock(&tls->lock);
+  return rotated;
+}
+
+// ==============================================================================
+// Mongoose TLS hooks (MG_TLS_CUSTOM); c->tls is the connection's SSL, accepted
+// connections use the server context, outgoing ones the client context
+// ==============================================================================
+
+void mg_tls_ctx_init(struct mg_mgr *mgr) {
+  (void) mgr;  // The application points mgr->tls_ctx at its struct TlsContext
+}
+
+void mg_tls_ctx_free(struct mg_mgr *mgr) {
+  mgr->tls_ctx = NULL;  // Not owned by the manager
+}
+
+void mg_tls_init(struct mg_connection *c, const struct mg_tls_opts *opts) {
+  struct TlsContext *tls = (struct TlsContext *) c->mgr->tls_ctx;
+  if (c->tls != NULL) {
+    return;  // Already set up
+  }
+  // A server's certificate and settings come from the shared context, opts only shape outgoing connections
+  SSL_CTX *ctx = tls == NULL || tls->ctx == NULL ? NULL : c->is_client ? client_ctx(tls) : tls->ctx;
+  if (ctx == NULL) {
+    mg_error(c, c->is_client ? "TLS: no client context" : "TLS: no server context");
+    return;
+  }
+  SSL *ssl = SSL_new(ctx);
+  BIO *bio = BIO_new(tls->bio_method);
+  if (ssl == NULL || bio == NULL) {
+    SSL_free(ssl);
+    BIO_free(bio);
+    mg_error(c, "TLS: out of memory");
+    return;
+  }
+  if (c->is_client && !client_setup(ssl, opts)) {
+    SSL_free(ssl);
+    BIO_free(bio);
+    mg_error(c, "TLS: bad client options (name, ca, cert or key)");
+    return;
+  }
+  BIO_set_data(bio, c);
+  BIO_set_init(bio, 1);
+  SSL_set_bio(ssl, bio, bio);
+  if (c->is_client) {
+    SSL_set_connect_state(ssl);
+  } else {
+    SSL_set_accept_state(ssl);
+  }
+  c->tls = ssl;
+  c->is_tls = 1;
+  c->is_tls_hs = 1;
+}
+
+void mg_tls_handshake(struct mg_connection *c) {
+  SSL *ssl = (SSL *) c->tls;
+  int rc = SSL_do_handshake(ssl);
+  // The handshake counters are about clients of this server, not its own outgoing connections
+  if (rc == 1) {
+    c->is_tls_hs = 0;
+    if (!c->is_client) {
+      GH_MetricsInc(SSL_session_reused(ssl) ? MC_TLS_HANDSHAKES_RESUMED : MC_TLS_HANDSHAKES_FULL);
+    }
+    mg_call(c, MG_EV_TLS_HS, NULL);
+  } else if (io_result(ssl, rc) != MG_IO_WAIT) {
+    long verify = SSL_get_verify_result(ssl);
+    if (!c->is_client) {
+      GH_MetricsInc(MC_TLS_HANDSHAKES_FAILED);
+    }
+    mg_error(c, "TLS handshake failed%s%s", verify != X509_V_OK ? ": " : "",
+             verify != X509_V_OK ? X509_verify_cert_error_string(verify) : "");
+  }
+}
+
+void mg_tls_free(struct mg_connection *c) {
+  SSL *ssl = (SSL *) c->tls;
+  if (ssl == NULL) {
+    return;
+  }
+  // Freeing without a shutdown evicts the session from the cache; most clients
+  // just close, so mark it shut down quietly (no close_notify is written)
+  if (SSL_is_init_finished(ssl)) {
+    SSL_set_quiet_shutdown(ssl, 1);
+    SSL_shutdown(ssl);
+  }
+  ERR_clear_error();
+  SSL_free(ssl);
+  c->tls = NULL;
+}
+
+long mg_tls_send(struct mg_connection *c, const void *buf, size_t len) {
+  SSL *ssl = (SSL *) c->tls;
+  int n = SSL_write(ssl, buf, len > INT_MAX ? INT_MAX : (int) len);
+  return n > 0 ? n : io_result(ssl, n);
+}
+
+long mg_tls_recv(struct mg_connection *c, void *buf, size_t len) {
+  SSL *ssl = (SSL *) c->tls;
+  int n = SSL_read(ssl, buf, len > INT_MAX ? INT_MAX : (int) len);
+  return n > 0 ? n : io_result(ssl, n);
+}
+
+size_t mg_tls_pending(struct mg_connection *c) {
+  return c->tls != NULL ? (size_t) SSL_pending((SSL *) c->tls) : 0;
+}
+
+void mg_tls_flush(struct mg_connection *c) {
+  (void) c;  // SSL_write hands every record to the socket itself
+}
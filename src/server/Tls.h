@@ -0,0 +1,89 @@
+#pragma once
+#include <server/config.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <mongoose.h>
+#include <openssl/ssl.h>
+#include <utils/Sync.h>
+
+#ifndef APP_TLS_SESSION_CACHE_SIZE
+#define APP_TLS_SESSION_CACHE_SIZE 20480 //!< Default sessions kept for ID-based resumption
+#endif
+#ifndef APP_TLS_TICKET_ROTATE_S
+#define APP_TLS_TICKET_ROTATE_S 3600   //!< Default time a ticket key issues tickets, 0 = no tickets
+#endif
+
+#define TLS_TICKET_KEYS 3              //!< Keys kept: the issuing one and two retired ones that still decrypt
+#define TLS_SESSION_ID_CONTEXT "growplus-http" //!< Sessions only resume in a context with the same id
+
+//! Struct for one session ticket key
+struct TlsTicketKey {
+    unsigned char name[16]; //!< Sent in the clear with each ticket, picks the key that opens it
+    unsigned char aes_key[32]; //!< AES-256-CBC key sealing the ticket
+    unsigned char hmac_key[32]; //!< HMAC-SHA256 key authenticating it
+};
+
+//! Struct for the TLS state shared by every HTTPS connection of every worker
+struct TlsContext {
+    SSL_CTX *ctx; //!< Certificate, settings and session cache, parsed once
+    SSL_CTX *client_ctx; //!< Outgoing (https:// mg_connect) connections, built by the first one
+    BIO_METHOD *bio_method; //!< Routes TLS records through mongoose's socket I/O
+    GH_Mutex lock; //!< Guards the ticket keys and client_ctx; handshakes run on every worker thread
+    struct TlsTicketKey keys[TLS_TICKET_KEYS]; //!< keys[0] issues tickets, all of them decrypt
+    int key_count; //!< Keys in use
+    uint64_t rotate_ms; //!< Time a key issues tickets, 0 if tickets are off
+    uint64_t next_rotation; //!< mg_millis() at which keys[0] is retired
+};
+
+// ============================================================================
+// HTTPS: shared OpenSSL context with session resumption
+// ============================================================================
+
+/**
+ * @brief Load the certificate and set up resumption
+ * 
+ * Mongoose's OpenSSL backend builds an SSL_CTX, and parses the certificate,
+ * for every connection, so no session outlives its connection. This context
+ * is built once and shared; server/Tls.c implements mongoose's TLS hooks
+ * (MG_TLS_CUSTOM) on top of it for every event manager whose tls_ctx points
+ * to it.
+ * 
+ * Outgoing connections of such a manager use a separate client context,
+ * built when the first one starts. Their mg_tls_opts apply per connection:
+ * name is sent as SNI and must match the server certificate, ca (PEM)
+ * replaces the system trust store, cert and key (PEM) are a client
+ * certificate, and skip_verification turns the checks off.
+ * 
+ * Reconnecting clients resume in two ways. Session IDs (TLS 1.2), and
+ * stateful TLS 1.3 tickets when tickets are off, are looked up in a server
+ * session cache. Stateless tickets are sealed with keys[0], which is replaced
+ * every rotate_s seconds; a retired key still opens tickets, and the client
+ * gets a fresh one, until TLS_TICKET_KEYS - 1 newer keys exist. Sessions are
+ * advertised for no longer than that.
+ * 
+ * @param tls Context to initialize
+ * @param cert PEM certificate chain file, leaf first
+ * @param key PEM private key file
+ * @param cache_size Sessions kept in the server cache
+ * @param rotate_s Time a ticket key issues tickets, 0 = no stateless tickets
+ * @return bool true on success, false if the files cannot be loaded or do not match
+ */
+bool GH_TlsInit(struct TlsContext *tls, const char *cert, const char *key, uint32_t cache_size, uint32_t rotate_s);
+
+/**
+ * @brief Free the context; connections using it must be closed first
+ * 
+ * @param tls Context
+ */
+void GH_TlsCleanup(struct TlsContext *tls);
+
+/**
+ * @brief Retire the issuing ticket key now instead of when it is due
+ * 
+ * @param tls Context
+ * @param now Current mg_millis(); the new key issues tickets until now + rotate_s
+ * @return bool true if a new key was made, false if tickets are off or no key could be made
+ */
+bool GH_TlsRotateTicketKeys(struct TlsContext *tls, uint64_t now);
@@ -0,0 +1,176 @@
+#include "Uri.h"
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// FNV-1a, as GH_CacheHash computes it
+#define URI_FNV_OFFSET 0xcbf29ce484222325ULL
+#define URI_FNV_PRIME 0x100000001b3ULL
+
+// Segments need two bytes each ("x/"), so this many start positions always fit
+#define URI_MAX_SEGMENTS (URI_PATH_MAX / 2)
+
+// ==============================================================================
+// Internal helpers
+// ==============================================================================
+
+// Byte classes: copied as is, separator or terminator, escape, refused
+enum UriClass { URI_PLAIN, URI_BREAK, URI_ESCAPE, URI_REJECT };
+
+static enum UriClass byte_class(unsigned char ch) {
+  if (ch == '/' || ch == '?' || ch == '#') {
+    return URI_BREAK;
+  }
+  if (ch == '%') {
+    return URI_ESCAPE;
+  }
+  // Controls would reach the filesystem and logs, '\\' is a separator on Windows
+  return ch < 0x20 || ch == 0x7f || ch == '\\' ? URI_REJECT : URI_PLAIN;
+}
+
+static int hex_value(unsigned char ch) {
+  return ch >= '0' && ch <= '9' ? ch - '0'
+       : ch >= 'a' && ch <= 'f' ? ch - 'a' + 10
+       : ch >= 'A' && ch <= 'F' ? ch - 'A' + 10 : -1;
+}
+
+// Length of the run of plain bytes at the start of s
+static size_t plain_run(const unsigned char *s, size_t len) {
+  size_t n = 0;
+#if defined(__SSE2__)
+  // 16 bytes per step: flag '/', '?', '#', '%', '\', controls and DEL
+  const __m128i slash = _mm_set1_epi8('/'), question = _mm_set1_epi8('?'), hash = _mm_set1_epi8('#');
+  const __m128i percent = _mm_set1_epi8('%'), backslash = _mm_set1_epi8('\\');
+  const __m128i del = _mm_set1_epi8(0x7f), ctl_max = _mm_set1_epi8(0x1f);
+  for (; n + 16 <= len; n += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *) (s + n));
+    __m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, slash), _mm_cmpeq_epi8(v, question)),
+                                   _mm_or_si128(_mm_cmpeq_epi8(v, hash), _mm_cmpeq_epi8(v, percent)));
+    special = _mm_or_si128(special, _mm_or_si128(_mm_cmpeq_epi8(v, backslash), _mm_cmpeq_epi8(v, del)));
+    special = _mm_or_si128(special, _mm_cmpeq_epi8(_mm_min_epu8(v, ctl_max), v));  // v <= 0x1f
+    int mask = _mm_movemask_epi8(special);
+    if (mask != 0) {
+      return n + (size_t) __builtin_ctz((unsigned) mask);
+    }
+  }
+#endif
+  while (n < len && byte_class(s[n]) == URI_PLAIN) {
+    n++;
+  }
+  return n;
+}
+
+static uint64_t fnv_bytes(uint64_t hash, const unsigned char *s, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    hash ^= s[i];
+    hash *= URI_FNV_PRIME;
+  }
+  return hash;
+}
+
+// ==============================================================================
+// Public API
+// ==============================================================================
+
+size_t GH_UriCanonicalize(const char *uri, size_t uri_len, char *path, size_t path_len, uint64_t *hash) {
+  if (path_len < 3 || path_len > URI_PATH_MAX) {
+    return 0;
+  }
+
+  const unsigned char *in = (const unsigned char *) uri, *end = in + uri_len;
+  unsigned char *out = (unsigned char *) path;
+  size_t limit = path_len - 1, o = 2;
+  uint64_t h = fnv_bytes(URI_FNV_OFFSET, (const unsigned char *) "./", 2);
+  out[0] = '.';
+  out[1] = '/';
+
+  // Where each open segment starts and the hash up to there, so ".." rewinds both
+  uint16_t starts[URI_MAX_SEGMENTS];
+  uint64_t hashes[URI_MAX_SEGMENTS];
+  size_t depth = 0;
+  starts[0] = (uint16_t) o;
+  hashes[0] = h;
+
+  if (in < end && *in == '/') {
+    in++;
+  }
+  for (;;) {
+    // Copy the plain run, then deal with the byte that ended it
+    size_t run = plain_run(in, (size_t) (end - in));
+    if (run > limit - o) {
+      return 0;
+    }
+    memcpy(out + o, in, run);
+    h = fnv_bytes(h, in, run);
+    o += run;
+    in += run;
+
+    int ch = -1;  // Decoded byte, -1 at the end of the path
+    if (in < end) {
+      switch (byte_class(*in)) {
+        case URI_ESCAPE:
+          if (end - in < 3 || hex_value(in[1]) < 0 || hex_value(in[2]) < 0) {
+            return 0;
+          }
+          ch = hex_value(in[1]) << 4 | hex_value(in[2]);
+          in += 3;
+          if (byte_class((unsigned char) ch) == URI_REJECT) {
+            return 0;
+          }
+          if (ch != '/') {
+            if (o == limit) {
+              return 0;
+            }
+            out[o++] = (unsigned char) ch;
+            h = (h ^ (uint64_t) ch) * URI_FNV_PRIME;
+            continue;
+          }
+          break;  // %2F separates segments like '/' does
+        case URI_BREAK:
+          ch = *in == '/' ? '/' : -1;  // '?' and '#' end the path
+          in = ch == '/' ? in + 1 : end;
+          break;
+        default:
+          return 0;
+      }
+    }
+
+    // A segment ended: resolve "." and "..", drop empty ones, keep the rest
+    size_t seg = o - starts[depth];
+    bool dot = seg == 1 && out[o - 1] == '.';
+    bool dotdot = seg == 2 && out[o - 2] == '.' && out[o - 1] == '.';
+    if (dotdot && depth > 0) {
+      depth--;
+    }
+    if (dot || dotdot) {
+      o = starts[depth];
+      h = hashes[depth];
+    } else if (seg > 0 && ch == '/') {
+      if (o == limit || depth + 1 == URI_MAX_SEGMENTS) {
+        return 0;
+      }
+      out[o++] = '/';
+      h = (h ^ '/') * URI_FNV_PRIME;
+      starts[++depth] = (uint16_t) o;
+      hashes[depth] = h;
+    }
+    if (ch == -1) {
+      break;
+    }
+  }
+
+  if (o == 2) {
+    size_t index_len = sizeof(URI_INDEX_FILE) - 1;
+    if (index_len > limit - o) {
+      return 0;
+    }
+    memcpy(out + o, URI_INDEX_FILE, index_len);
+    h = fnv_bytes(h, out + o, index_len);
+    o += index_len;
+  }
+  out[o] = '\0';
+  *hash = h;
+  return o;
+}
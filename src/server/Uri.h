@@ -0,0 +1,35 @@
+#pragma once
+#include <server/config.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define URI_PATH_MAX 256                  //!< Size of a canonical path buffer, terminator included
+#define URI_INDEX_FILE "index.html"       //!< File served for "/"
+
+// ============================================================================
+// Request path canonicalization (RFC 3986, sections 2.1 and 5.2.4)
+// ============================================================================
+
+/**
+ * @brief Turn a request target into the file path every cache is keyed by
+ * 
+ * One pass, no allocation: the query and fragment are dropped, %XX escapes
+ * decoded, "//" collapsed and "." / ".." segments resolved, never above the
+ * root. "/" maps to "./" URI_INDEX_FILE. Every spelling of a file therefore
+ * shares one cache entry, and no spelling escapes the served directory.
+ * 
+ * The hash is GH_CacheHash of the result, built while it is written, so
+ * lookups need not hash the path again.
+ * 
+ * @param uri Request target as received (not NUL-terminated)
+ * @param uri_len Length of uri
+ * @param path Output buffer, "./" followed by the canonical path, NUL-terminated
+ * @param path_len Size of path, at most URI_PATH_MAX
+ * @param hash Receives the path hash
+ * @return size_t Length of path; 0 if the target is rejected (bad escape, NUL,
+ *                control byte or backslash, or more than path_len - 1 bytes
+ *                even before its dot segments are resolved)
+ */
+size_t GH_UriCanonicalize(const char *uri, size_t uri_len, char *path, size_t path_len, uint64_t *hash);
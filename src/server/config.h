@@ -4,46 +4,112 @@
 // Server configuration
 // ============================================================================
 #define APP_LISTEN_URL "http://0.0.0.0:8000"  //!< URL to listen on
-#define APP_POLL_TIMEOUT_MS 50                //!< Poll timeout in milliseconds (reduced for better responsiveness)
+#define APP_CONFIG_FILE ""                    //!< "key = value" file of startup options, never served; the command line overrides it ("" = none, or --config)
+#define APP_POLL_TIMEOUT_MS 50                //!< Poll timeout in milliseconds (reduced for better responsiveness, or --poll-timeout-ms)
+#define APP_WORKER_COUNT 1                    //!< Event-loop worker threads, 0 = one per CPU (>1 needs SO_REUSEPORT)
+#define APP_LISTEN_BACKLOG 1024               //!< listen() backlog for per-worker SO_REUSEPORT sockets
+#define APP_ZEROCOPY_MIN_SIZE 16384           //!< Cached bodies at least this large are written straight from the entry
+#define APP_ZEROCOPY_WINDOW 16384             //!< Bytes staged in the send iobuf while waiting for a full socket to drain
+#define APP_LOADER_THREADS 4                  //!< Threads reading cache misses off the event loop (0 = inline)
+#define APP_STREAM_MIN_SIZE (64 * 1024 * 1024) //!< Files this large are streamed from disk in bounded chunks, never read whole
+#define APP_SNAPSHOT_PATH ""                  //!< Packed snapshot mapped at startup ("" = none, or --snapshot)
+#define APP_WARMUP_PATHS ""                   //!< Directories/manifests preloaded at startup ("" = none, or --warmup)
+#define APP_RANGE_MAX_PARTS 16                //!< Requests asking for more (coalesced) ranges get the full body
+#define APP_RANGE_DISK_MIN_SIZE (1024 * 1024) //!< Uncached files this large answer single ranges from disk
+#define APP_METRICS_ENABLED 1                 //!< Per-thread counters/histograms behind /metrics and /api/cache/stats
+#define APP_SERVER_DATA_CONFIG "server_data.cfg"  //!< Rendered into /growtopia/server_data.php, never served itself ("" = serve the file, or --server-data)
+#define APP_RATE_LIMIT_RPS 0                  //!< Requests per second per client address before 429 (0 = off, or --rate-limit <rps>[:<burst>])
+#define APP_RATE_LIMIT_BURST 0                //!< Requests a client address may send at once (0 = twice the rate)
+#define APP_CONN_LIMIT_PER_IP 0               //!< Open connections per client address, more are closed on accept (0 = off, or --conn-limit)
+#define APP_ACCESS_LOG ""                     //!< Access log file ("" = off, or --access-log), written by a background thread
+#define APP_ACCESS_LOG_ROTATE_MB 64           //!< Access log size that triggers rotation to <file>.1 (0 = never)
+#define APP_MAX_CONNECTIONS 50000             //!< Open connections across all workers; accepting pauses at the cap (or --max-connections)
+#define APP_KEEPALIVE_TIMEOUT_MS 30000        //!< Connections without a request or sent bytes for this long are closed (or --keepalive-timeout)
+#define APP_KEEPALIVE_MAX_REQUESTS 1000       //!< Requests per connection before it is closed (0 = unlimited, or --keepalive-requests)
+#define APP_HTTPS_LISTEN_URL ""               //!< Also serve HTTPS here, e.g. "https://0.0.0.0:8443" ("" = off, or --https)
+#define APP_TLS_CERT "cert.pem"               //!< PEM certificate chain of the HTTPS listener, never served (or --tls-cert)
+#define APP_TLS_KEY "key.pem"                 //!< PEM private key of the HTTPS listener, never served (or --tls-key)
+#define APP_TLS_SESSION_CACHE_SIZE 20480      //!< TLS sessions kept for resumption by session ID / stateful ticket
+#define APP_TLS_TICKET_ROTATE_S 3600          //!< Ticket key rotation period; tickets open for 2 more (0 = no tickets, or --tls-ticket-rotate)
+#define APP_HOT_RESTART_SOCKET ""             //!< Unix socket a new binary takes the listeners and cache over from ("" = off, or --hot-restart)
+#define APP_HOT_RESTART_TIMEOUT_MS 10000      //!< Wait for the other process at each step of a handoff
+#define APP_HOT_RESTART_DRAIN_MS 30000        //!< Time a replaced process lets its open connections finish before exiting
+#define APP_ADMIN_TOKEN ""                    //!< Bearer token of /api/admin/cache and /api/admin/cache/clear ("" = no admin API, or --admin-token; prefer --config)
 
 // ============================================================================
 // Mongoose configuration - Optimized for high RPS
 // ============================================================================
 
-// TLS Configuration
-#define MG_TLS MG_TLS_OPENSSL                 //!< Use openssl for TLS
+// TLS Configuration: mongoose's TLS hooks are implemented in server/Tls.c, on
+// OpenSSL with one context shared by every accepted connection (sessions
+// resume) and one by every outgoing connection
+#define MG_TLS MG_TLS_CUSTOM
+
+// Event backend: epoll on Linux (cmake -DGH_ENABLE_EPOLL=OFF for poll), poll() elsewhere;
+// select() would stop at FD_SETSIZE descriptors
+#ifndef MG_ENABLE_EPOLL
+#if defined(__linux__)
+#define MG_ENABLE_EPOLL 1                     //!< Readiness from epoll_wait, not a pollfd array rebuilt per loop
+#else
+#define MG_ENABLE_EPOLL 0
+#endif
+#endif
+#if !MG_ENABLE_EPOLL && !defined(_WIN32) && !defined(MG_ENABLE_POLL)
+#define MG_ENABLE_POLL 1                      //!< poll() instead of select()
+#endif
 
 // Enable required features
-#define MG_ENABLE_MD5 1                       //!< Enable native MD5 (for ETags)
 #define MG_ENABLE_LINES 1                     //!< Show file in logs
 
 // Buffer sizes - Optimized for static file serving
 // Larger IO size reduces system calls and improves throughput
 #define MG_IO_SIZE 65536                      //!< IO buffer growth granularity (64KB, optimal for most files)
 #define MG_MAX_RECV_SIZE 8192                 //!< Maximum recv buffer size (8KB, sufficient for HTTP headers)
+#define MG_DATA_SIZE 96                       //!< Per-connection scratch space, holds struct ConnState
 
 // HTTP Configuration
 #define MG_MAX_HTTP_HEADERS 20                //!< Maximum number of HTTP headers
 #define MG_HTTP_DIRLIST_TIME_FMT "%Y-%m-%d %H:%M:%S"  //!< Directory listing time format
 
 // Enable performance features
-#define MG_ENABLE_PACKED_FS 0                 //!< Disable packed FS (using regular FS)
+#define MG_ENABLE_PACKED_FS 0                 //!< Disable compiled-in packed FS (packed trees are mapped snapshots instead)
 #define MG_ENABLE_SSI 0                       //!< Disable SSI for better performance
 
 // ============================================================================
 // Cache configuration - Optimized for high RPS static file serving
 // ============================================================================
-#define CACHE_TTL_MS (5 * 60 * 1000)          //!< Cache Time-To-Live: 5 minutes
-#define CACHE_MAX_SIZE_MB 100                 //!< Maximum cache size: 100 MB (increased for better hit rate)
+#define CACHE_TTL_MS (5 * 60 * 1000)          //!< mtime revalidation interval when no file watcher runs: 5 minutes (or --cache-ttl-ms)
+#define CACHE_MAX_SIZE_MB 100                 //!< Maximum cache size: 100 MB (or --cache-size-mb; both change at runtime via the admin API)
+#define CACHE_MIN_SIZE_MB 16                  //!< Smallest budget the adaptive mode shrinks to (or --cache-min-mb)
+#define CACHE_ADAPTIVE 0                      //!< Follow the cgroup memory limit and PSI between min and max size (or --cache-adaptive 1)
+#define CACHE_SHRINK_STEP_BYTES (4 * 1024 * 1024)  //!< Bytes evicted per event loop pass while the cache is over a lowered budget
+#define CACHE_CONTROL_VALUE "public, max-age=300"  //!< Cache-Control for cached files, baked into prebuilt headers
+#define CACHE_WATCH_ENABLED 1                 //!< Invalidate entries from inotify events on the served root
+#define CACHE_REVALIDATE_MS 0                 //!< Extra mtime revalidation while watching (0 = trust the watcher)
+#define CACHE_SHARD_COUNT 16                  //!< Independently locked cache shards shared by all workers
+#define CACHE_POLICY "tinylfu"                //!< Admission/eviction policy: "lru" or "tinylfu" (or --cache-policy)
+#define CACHE_ADMIT_MAX_PERCENT 10            //!< Files above this share of the budget are streamed, never cached
+#define CACHE_ARENA_ENABLED 1                 //!< One slab chunk per entry (path, ETags, headers, bodies), charged in full
+#define NEGATIVE_CACHE_ENTRIES 8192           //!< Missing paths remembered apart from the cache budget (~200 KB)
+#define NEGATIVE_CACHE_TTL_MS 2000            //!< How long a 404 is served without looking at the disk again
+#define FILE_ETAG_ENTRIES 1024                //!< Content ETags of files served from disk, remembered by (device, inode, mtime, size) (~64 KB)
+
+// Compression: variants come from fresh .br/.gz siblings, else from zlib/brotli when built in
+#define CACHE_COMPRESS_MIN_SIZE 1024          //!< Bodies smaller than this are never compressed
+#define CACHE_COMPRESS_EXTENSIONS "html,htm,css,js,json,txt,xml,svg,php"  //!< Compressible file extensions
+#define CACHE_COMPRESS_GZIP_LEVEL 6           //!< zlib level for load-time gzip
+#define CACHE_COMPRESS_BROTLI_QUALITY 5       //!< Brotli quality for load-time compression
 
 // ============================================================================
 // Performance tuning notes:
 // ============================================================================
-// 1. Keep-Alive: Enabled in code to reuse TCP connections
-// 2. ETag Support: Implemented for conditional requests (304 responses)
-// 3. Cache-Control: Set to public, max-age=300 for client-side caching
-// 4. Buffer Sizes: Optimized for typical static file sizes
-// 5. Poll Timeout: Reduced to 50ms for better responsiveness
-// 6. Memory Caching: Implemented with TTL and size-based eviction
-// 7. Connection Reuse: Connection: keep-alive header added
+// 1. Connections: keep-alive reuse, epoll backend, idle wheel, global cap with accept backoff
+// 2. Workers: N event loops on SO_REUSEPORT sockets share one sharded cache
+// 3. Buffer Sizes: Optimized for typical static file sizes; large bodies zero-copy or sendfile
+// 4. Poll Timeout: Reduced to 50ms for better responsiveness
+// 5. Caching: prebuilt headers and br/gzip variants per entry, W-TinyLFU admission, inotify invalidation
+// 6. Revalidation: content-hash ETags on every path, public max-age=300 for client-side caching
+// 7. Memory: budget charges whole slab chunks; size/TTL via --config, admin API or cgroup pressure
+// 8. Rate limits: per-address token buckets and connection caps, off by default (NAT shares addresses)
+// 9. Observability: per-thread metrics and access log rings, summed or written off the event loop
 // ============================================================================
\ No newline at end of file
@@ -0,0 +1,285 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <process.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+// ============================================================================
+// Portable threading and atomics used by the multi-worker server
+// ============================================================================
+
+#if defined(_MSC_VER)
+#define GH_CACHELINE_ALIGNED __declspec(align(64))  //!< Keep hot shared data on its own cache line
+#else
+#define GH_CACHELINE_ALIGNED __attribute__((aligned(64)))  //!< Keep hot shared data on its own cache line
+#endif
+
+#if defined(_MSC_VER)
+#define GH_THREAD_LOCAL __declspec(thread)  //!< Per-thread storage
+#else
+#define GH_THREAD_LOCAL _Thread_local       //!< Per-thread storage
+#endif
+
+#if defined(_WIN32)
+typedef SRWLOCK GH_Mutex;   //!< Non-recursive mutex
+typedef CONDITION_VARIABLE GH_Cond;  //!< Condition variable paired with a GH_Mutex
+typedef HANDLE GH_Thread;   //!< Thread handle
+#else
+typedef pthread_mutex_t GH_Mutex;  //!< Non-recursive mutex
+typedef pthread_cond_t GH_Cond;    //!< Condition variable paired with a GH_Mutex
+typedef pthread_t GH_Thread;       //!< Thread handle
+#endif
+
+//! Thread entry point
+typedef void (*GH_ThreadFn)(void *arg);
+
+/**
+ * @brief Initialize a mutex
+ * 
+ * @param m Mutex to initialize
+ */
+static inline void GH_MutexInit(GH_Mutex *m) {
+#if defined(_WIN32)
+  InitializeSRWLock(m);
+#else
+  pthread_mutex_init(m, NULL);
+#endif
+}
+
+/**
+ * @brief Destroy a mutex
+ * 
+ * @param m Mutex to destroy
+ */
+static inline void GH_MutexDestroy(GH_Mutex *m) {
+#if defined(_WIN32)
+  (void)m;
+#else
+  pthread_mutex_destroy(m);
+#endif
+}
+
+/**
+ * @brief Lock a mutex
+ * 
+ * @param m Mutex to lock
+ */
+static inline void GH_MutexLock(GH_Mutex *m) {
+#if defined(_WIN32)
+  AcquireSRWLockExclusive(m);
+#else
+  pthread_mutex_lock(m);
+#endif
+}
+
+/**
+ * @brief Unlock a mutex
+ * 
+ * @param m Mutex to unlock
+ */
+static inline void GH_MutexUnlock(GH_Mutex *m) {
+#if defined(_WIN32)
+  ReleaseSRWLockExclusive(m);
+#else
+  pthread_mutex_unlock(m);
+#endif
+}
+
+/**
+ * @brief Initialize a condition variable
+ * 
+ * @param cond Condition variable to initialize
+ */
+static inline void GH_CondInit(GH_Cond *cond) {
+#if defined(_WIN32)
+  InitializeConditionVariable(cond);
+#else
+  pthread_cond_init(cond, NULL);
+#endif
+}
+
+/**
+ * @brief Destroy a condition variable
+ * 
+ * @param cond Condition variable to destroy
+ */
+static inline void GH_CondDestroy(GH_Cond *cond) {
+#if defined(_WIN32)
+  (void)cond;
+#else
+  pthread_cond_destroy(cond);
+#endif
+}
+
+/**
+ * @brief Atomically unlock m and wait for a signal, then relock m
+ * 
+ * Wakeups may be spurious, so callers re-check their predicate in a loop.
+ * 
+ * @param cond Condition variable
+ * @param m Mutex held by the caller
+ */
+static inline void GH_CondWait(GH_Cond *cond, GH_Mutex *m) {
+#if defined(_WIN32)
+  SleepConditionVariableSRW(cond, m, INFINITE, 0);
+#else
+  pthread_cond_wait(cond, m);
+#endif
+}
+
+/**
+ * @brief Wake one waiter
+ * 
+ * @param cond Condition variable
+ */
+static inline void GH_CondSignal(GH_Cond *cond) {
+#if defined(_WIN32)
+  WakeConditionVariable(cond);
+#else
+  pthread_cond_signal(cond);
+#endif
+}
+
+/**
+ * @brief Wake every waiter
+ * 
+ * @param cond Condition variable
+ */
+static inline void GH_CondBroadcast(GH_Cond *cond) {
+#if defined(_WIN32)
+  WakeAllConditionVariable(cond);
+#else
+  pthread_cond_broadcast(cond);
+#endif
+}
+
+//! Trampoline arguments for GH_ThreadStart
+struct GH_ThreadStartArgs {
+    GH_ThreadFn fn; //!< Function to run
+    void *arg; //!< Function argument
+};
+
+#if defined(_WIN32)
+static inline unsigned __stdcall GH_ThreadTrampoline(void *p) {
+#else
+static inline void *GH_ThreadTrampoline(void *p) {
+#endif
+  struct GH_ThreadStartArgs args = *(struct GH_ThreadStartArgs *)p;
+  free(p);
+  args.fn(args.arg);
+  return 0;
+}
+
+/**
+ * @brief Start a new thread
+ * 
+ * @param thread Receives the thread handle
+ * @param fn Function to run
+ * @param arg Function argument
+ * @return bool true on success, false on failure
+ */
+static inline bool GH_ThreadStart(GH_Thread *thread, GH_ThreadFn fn, void *arg) {
+  struct GH_ThreadStartArgs *args = (struct GH_ThreadStartArgs *)malloc(sizeof(*args));
+  if (args == NULL) {
+    return false;
+  }
+  args->fn = fn;
+  args->arg = arg;
+#if defined(_WIN32)
+  *thread = (HANDLE)_beginthreadex(NULL, 0, GH_ThreadTrampoline, args, 0, NULL);
+  if (*thread == 0) {
+#else
+  if (pthread_create(thread, NULL, GH_ThreadTrampoline, args) != 0) {
+#endif
+    free(args);
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Wait for a thread to finish
+ * 
+ * @param thread Thread handle
+ */
+static inline void GH_ThreadJoin(GH_Thread thread) {
+#if defined(_WIN32)
+  WaitForSingleObject(thread, INFINITE);
+  CloseHandle(thread);
+#else
+  pthread_join(thread, NULL);
+#endif
+}
+
+/**
+ * @brief Suspend the calling thread
+ * 
+ * @param ms Milliseconds to sleep
+ */
+static inline void GH_SleepMs(unsigned ms) {
+#if defined(_WIN32)
+  Sleep(ms);
+#else
+  usleep((useconds_t)ms * 1000);
+#endif
+}
+
+/**
+ * @brief Number of online CPUs
+ * 
+ * @return int CPU count, at least 1
+ */
+static inline int GH_CpuCount(void) {
+#if defined(_WIN32)
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+#else
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? (int)n : 1;
+#endif
+}
+
+// ============================================================================
+// Atomics (sequentially consistent unless noted)
+// ============================================================================
+
+#if defined(_MSC_VER)
+#if defined(_WIN64)
+#define GH_AtomicAddSize(p, v) ((size_t)InterlockedExchangeAdd64((volatile LONG64 *)(p), (LONG64)(v)) + (size_t)(v))
+#define GH_AtomicLoadSize(p) ((size_t)InterlockedOr64((volatile LONG64 *)(p), 0))
+#else
+#define GH_AtomicAddSize(p, v) ((size_t)InterlockedExchangeAdd((volatile LONG *)(p), (LONG)(v)) + (size_t)(v))
+#define GH_AtomicLoadSize(p) ((size_t)InterlockedOr((volatile LONG *)(p), 0))
+#endif
+#define GH_AtomicLoadU64(p) ((uint64_t)InterlockedOr64((volatile LONG64 *)(p), 0))
+#define GH_AtomicStoreU64(p, v) ((void)InterlockedExchange64((volatile LONG64 *)(p), (LONG64)(v)))
+#define GH_AtomicLoadAcquireSize(p) GH_AtomicLoadSize(p)
+#define GH_AtomicStoreReleaseSize(p, v) ((void)InterlockedExchangePointer((PVOID volatile *)(p), (PVOID)(size_t)(v)))
+#define GH_AtomicLoadInt(p) ((int)InterlockedOr((volatile LONG *)(p), 0))
+#define GH_AtomicStoreInt(p, v) ((void)InterlockedExchange((volatile LONG *)(p), (LONG)(v)))
+#define GH_AtomicIncInt(p) ((int)InterlockedIncrement((volatile LONG *)(p)))
+#define GH_AtomicDecInt(p) ((int)InterlockedDecrement((volatile LONG *)(p)))
+#else
+#define GH_AtomicAddSize(p, v) __atomic_add_fetch((p), (size_t)(v), __ATOMIC_SEQ_CST)  //!< Add and return new value
+#define GH_AtomicLoadSize(p) __atomic_load_n((p), __ATOMIC_SEQ_CST)                   //!< Load value
+#define GH_AtomicLoadU64(p) __atomic_load_n((p), __ATOMIC_RELAXED)                    //!< Load a 64-bit value (no ordering)
+#define GH_AtomicStoreU64(p, v) __atomic_store_n((p), (uint64_t)(v), __ATOMIC_RELAXED)  //!< Store a 64-bit value (no ordering)
+#define GH_AtomicLoadAcquireSize(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)            //!< Load, later reads stay after it
+#define GH_AtomicStoreReleaseSize(p, v) __atomic_store_n((p), (size_t)(v), __ATOMIC_RELEASE)  //!< Store, earlier writes stay before it
+#define GH_AtomicLoadInt(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)                    //!< Load an int
+#define GH_AtomicStoreInt(p, v) __atomic_store_n((p), (int)(v), __ATOMIC_RELEASE)       //!< Store an int
+#define GH_AtomicIncInt(p) __atomic_add_fetch((p), 1, __ATOMIC_SEQ_CST)               //!< Increment and return new value
+#define GH_AtomicDecInt(p) __atomic_sub_fetch((p), 1, __ATOMIC_SEQ_CST)               //!< Decrement and return new value
+#endif
+#define GH_AtomicSubSize(p, v) GH_AtomicAddSize((p), (size_t)0 - (size_t)(v))  //!< Subtract and return new value
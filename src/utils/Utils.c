@@ -3,15 +3,17 @@
 #include <string.h>
 #include <ctype.h>
 #include <stdio.h>
+#include <mongoose.h>
 
 char* ToUpper(const char* str)
 {
   if (str == NULL) return NULL;
   size_t len = strlen(str);
   char* result = (char*)malloc(len + 1);
+  if (result == NULL) return NULL;
   for (size_t i = 0; i < len; i++)
   {
-    result[i] = toupper(str[i]);
+    result[i] = (char)toupper((unsigned char)str[i]);
   }
   result[len] = '\0';
   return result;
@@ -22,9 +24,10 @@ char* ToLower(const char* str)
   if (str == NULL) return NULL;
   size_t len = strlen(str);
   char* result = (char*)malloc(len + 1);
+  if (result == NULL) return NULL;
   for (size_t i = 0; i < len; i++)
   {
-    result[i] = tolower(str[i]);
+    result[i] = (char)tolower((unsigned char)str[i]);
   }
   result[len] = '\0';
   return result;
@@ -34,12 +37,13 @@ char* Trim(const char* str)
 {
   if (str == NULL) return NULL;
   const char* start = str;
-  while (isspace(*start)) start++;
-  const char* end = str + strlen(str) - 1;
-  while (end > start && isspace(*end)) end--;
-  size_t len = end - start + 1;
+  while (isspace((unsigned char)*start)) start++;
+  const char* end = start + strlen(start);
+  while (end > start && isspace((unsigned char)end[-1])) end--;
+  size_t len = (size_t)(end - start);
   char* result = (char*)malloc(len + 1);
-  strncpy_s(result, len + 1, start, len);
+  if (result == NULL) return NULL;
+  memcpy(result, start, len);
   result[len] = '\0';
   return result;
 }
@@ -54,6 +58,129 @@ char* HashString(const char* str)
     hash = ((hash << 5) + hash) + c;
   }
   char* result = (char*)malloc(11); // enough for 32-bit unsigned int
+  if (result == NULL) return NULL;
   snprintf(result, 11, "%u", hash);
   return result;
-}
\ No newline at end of file
+}
+
+static const char* const kMonths[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                      "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+static const char* const kWeekdays[] = {"Thu", "Fri", "Sat", "Sun", "Mon", "Tue", "Wed"};
+
+// Days since 1970-01-01 for a proleptic Gregorian date (month 1..12)
+static long long DaysFromCivil(long long y, unsigned m, unsigned d)
+{
+  y -= m <= 2;
+  long long era = (y >= 0 ? y : y - 399) / 400;
+  unsigned yoe = (unsigned)(y - era * 400);
+  unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + (long long)doe - 719468;
+}
+
+bool ParseHttpDate(const char* str, size_t len, time_t* out)
+{
+  if (str == NULL || out == NULL || len < 29 || len > 63) return false;
+  char buf[64], wday[4], mon[4];
+  int day, year, hour, min, sec;
+  memcpy(buf, str, len);
+  buf[len] = '\0';
+  if (sscanf(buf, "%3s, %d %3s %d %d:%d:%d GMT", wday, &day, mon, &year, &hour, &min, &sec) != 7 ||
+      wday[0] == '\0' || buf[3] != ',')
+  {
+    return false;
+  }
+
+  unsigned month = 0;
+  while (month < 12 && strcmp(mon, kMonths[month]) != 0) month++;
+  if (month == 12 || day < 1 || day > 31 || hour > 23 || min > 59 || sec > 60 || year < 1970)
+  {
+    return false;
+  }
+
+  long long days = DaysFromCivil(year, month + 1, (unsigned)day);
+  *out = (time_t)(days * 86400 + hour * 3600 + min * 60 + sec);
+  return true;
+}
+
+size_t FormatHttpDate(time_t t, char* buf, size_t len)
+{
+  if (buf == NULL || len < 30) return 0;
+  long long secs = (long long)t;
+  long long days = secs >= 0 ? secs / 86400 : (secs - 86399) / 86400;
+  long long rem = secs - days * 86400;
+
+  // Inverse of DaysFromCivil
+  long long z = days + 719468;
+  long long era = (z >= 0 ? z : z - 146096) / 146097;
+  unsigned doe = (unsigned)(z - era * 146097);
+  unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  unsigned mp = (5 * doy + 2) / 153;
+  unsigned d = doy - (153 * mp + 2) / 5 + 1;
+  unsigned m = mp < 10 ? mp + 3 : mp - 9;
+  long long y = (long long)yoe + era * 400 + (m <= 2);
+
+  int n = snprintf(buf, len, "%s, %02u %s %04lld %02d:%02d:%02d GMT",
+                   kWeekdays[((days % 7) + 7) % 7], d, kMonths[m - 1], y,
+                   (int)(rem / 3600), (int)(rem / 60 % 60), (int)(rem % 60));
+  return n > 0 && (size_t)n < len ? (size_t)n : 0;
+}
+
+// Deepest directory level WalkFiles descends to (guards against symlink loops)
+#define WALK_MAX_DEPTH 32
+
+struct WalkState
+{
+  char path[1024];
+  size_t len;
+  int depth;
+  size_t count;
+  FileVisitor fn;
+  void* arg;
+};
+
+static void WalkEntry(const char* name, void* userdata)
+{
+  struct WalkState* state = (struct WalkState*)userdata;
+  size_t saved = state->len;
+  int n = snprintf(state->path + saved, sizeof(state->path) - saved, "/%s", name);
+  if (n < 0 || (size_t)n >= sizeof(state->path) - saved) return;
+  state->len += (size_t)n;
+
+  size_t size = 0;
+  time_t mtime = 0;
+  int flags = mg_fs_posix.st(state->path, &size, &mtime);
+  if ((flags & MG_FS_DIR) && state->depth < WALK_MAX_DEPTH)
+  {
+    state->depth++;
+    mg_fs_posix.ls(state->path, WalkEntry, state);
+    state->depth--;
+  }
+  else if (flags != 0 && !(flags & MG_FS_DIR))
+  {
+    state->fn(state->path, size, mtime, state->arg);
+    state->count++;
+  }
+
+  state->len = saved;
+  state->path[saved] = '\0';
+}
+
+size_t WalkFiles(const char* dir, FileVisitor fn, void* arg)
+{
+  if (dir == NULL || fn == NULL) return 0;
+  struct WalkState state;
+  size_t len = strlen(dir);
+  while (len > 1 && dir[len - 1] == '/') len--;
+  if (len >= sizeof(state.path)) return 0;
+  memcpy(state.path, dir, len);
+  state.path[len] = '\0';
+  state.len = len;
+  state.depth = 0;
+  state.count = 0;
+  state.fn = fn;
+  state.arg = arg;
+  mg_fs_posix.ls(state.path, WalkEntry, &state);
+  return state.count;
+}
@@ -1,10 +1,14 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
 /**
  * @brief Convert a string to uppercase
  * 
  * @param str Input string
- * @return char* Uppercase string (must be freed)
+ * @return char* Uppercase string (must be freed), NULL if out of memory
  */
 char* ToUpper(const char* str);
 
@@ -12,7 +16,7 @@ char* ToUpper(const char* str);
  * @brief Convert a string to lowercase
  * 
  * @param str Input string
- * @return char* Lowercase string (must be freed)
+ * @return char* Lowercase string (must be freed), NULL if out of memory
  */
 char* ToLower(const char* str);
 
@@ -20,7 +24,7 @@ char* ToLower(const char* str);
  * @brief Trim whitespace from both ends of a string
  * 
  * @param str Input string
- * @return char* Trimmed string (must be freed)
+ * @return char* Trimmed string (must be freed), NULL if out of memory
  */
 char* Trim(const char* str);
 
@@ -28,6 +32,46 @@ char* Trim(const char* str);
  * @brief Generate a simple hash from a string
  * 
  * @param str Input string
- * @return char* Hash string (must be freed)
+ * @return char* Hash string (must be freed), NULL if out of memory
  */
 char* HashString(const char* str);
+
+/**
+ * @brief Parse an HTTP date (IMF-fixdate, e.g. "Sun, 06 Nov 1994 08:49:37 GMT")
+ * 
+ * @param str Input string (not necessarily NUL-terminated)
+ * @param len Length of input
+ * @param out Receives the time as seconds since the epoch (UTC)
+ * @return bool true on success, false if the date is malformed
+ */
+bool ParseHttpDate(const char* str, size_t len, time_t* out);
+
+/**
+ * @brief Format a time as an HTTP date (IMF-fixdate)
+ * 
+ * @param t Seconds since the epoch (UTC)
+ * @param buf Output buffer, at least 30 bytes
+ * @param len Size of output buffer
+ * @return size_t Length of the formatted date, 0 if buf is too small
+ */
+size_t FormatHttpDate(time_t t, char* buf, size_t len);
+
+/**
+ * @brief Callback for WalkFiles
+ * 
+ * @param path Path of a regular file (directory argument + "/" + relative path)
+ * @param size File size
+ * @param mtime File modification time
+ * @param arg User argument
+ */
+typedef void (*FileVisitor)(const char* path, size_t size, time_t mtime, void* arg);
+
+/**
+ * @brief Visit every regular file below a directory, recursively
+ * 
+ * @param dir Directory to walk
+ * @param fn Called once per regular file
+ * @param arg User argument passed to fn
+ * @return size_t Number of files visited
+ */
+size_t WalkFiles(const char* dir, FileVisitor fn, void* arg);
@@ -0,0 +1,18 @@
+#!/usr/bin/env bash
+# Write .gz/.br siblings next to compressible assets so the server can load
+# maximum-ratio variants instead of compressing at load time.
+# Usage: tools/precompress.sh <asset root> [min size in bytes]
+
+set -eu
+
+ROOT="${1:?usage: $0 <asset root> [min size]}"
+MIN_SIZE="${2:-1024}"
+
+find "$ROOT" -type f \( -name '*.html' -o -name '*.htm' -o -name '*.css' -o -name '*.js' \
+  -o -name '*.json' -o -name '*.txt' -o -name '*.xml' -o -name '*.svg' -o -name '*.php' \) \
+  -size +"$((MIN_SIZE - 1))"c | while read -r FILE; do
+  gzip -9 -k -f -n "$FILE"
+  if command -v brotli > /dev/null; then
+    brotli -q 11 -k -f "$FILE"
+  fi
+done
@@ -0,0 +1,124 @@
+// Offline packer: writes a served directory tree into one snapshot file that
+// GrowplusHttp maps with --snapshot. Bodies, compressed variants, ETags and
+// header blocks are produced by the same code the server caches with, so a
+// packed file is byte-for-byte what a live cache hit would send.
+//
+// Usage: gh_snapshot_pack [-n] <root> <output.ghsnap>
+//   -n  do not store br/gzip variants
+
+#include "plugins/CacheManager.h"
+#include "plugins/Compression.h"
+#include "plugins/Snapshot.h"
+#include "utils/Utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <direct.h>
+#define change_dir _chdir
+#else
+#include <unistd.h>
+#define change_dir chdir
+#endif
+
+// Satisfies the extern declared by CacheManager.h
+struct CacheBucket g_cache = {0};
+
+//! Struct for packing progress
+struct PackState {
+    struct SnapshotWriter writer; //!< Output
+    bool compress; //!< Store br/gzip variants
+    bool ok; //!< Cleared on the first write error
+    size_t files; //!< Files packed
+    size_t skipped; //!< Files left out
+    uint64_t bytes; //!< Body bytes packed (identity only)
+};
+
+static bool has_suffix(const char *s, const char *suffix) {
+  size_t len = strlen(s), suffix_len = strlen(suffix);
+  return len >= suffix_len && strcmp(s + len - suffix_len, suffix) == 0;
+}
+
+static void pack_file(const char *path, size_t size, time_t mtime, void *arg) {
+  struct PackState *state = (struct PackState *) arg;
+  if (!state->ok || has_suffix(path, GH_SNAPSHOT_EXTENSION)) {
+    return;
+  }
+  if (!GH_CacheAdmits(&g_cache, size)) {
+    // The server streams these from disk; keep the snapshot to what it would cache
+    fprintf(stderr, "skip %s (%lu bytes, over the cache admission limit)\n", path, (unsigned long) size);
+    state->skipped++;
+    return;
+  }
+
+  struct mg_str data = mg_file_read(&mg_fs_posix, path);
+  if (data.buf == NULL) {
+    fprintf(stderr, "skip %s (unreadable)\n", path);
+    state->skipped++;
+    return;
+  }
+
+  char etag[64];
+  GH_CacheMakeContentEtag(data.buf, data.len, etag, sizeof(etag));
+  struct CacheVariant variants[CACHE_ENC_COUNT];
+  bool has_variants = state->compress && GH_CompressionEligible(path, data.len) &&
+                      GH_CompressionBuildVariants(path, mtime, data.buf, data.len, variants);
+
+  // Build the entry exactly as the server would, then serialize it
+  struct CacheEntry *entry = NULL;
+  if (GH_CacheAddEncoded(&g_cache, path, data.buf, data.len, etag, mtime, has_variants ? variants : NULL)) {
+    entry = GH_CacheAcquire(&g_cache, path);
+  }
+  if (entry == NULL || !GH_SnapshotWriterAdd(&state->writer, entry)) {
+    fprintf(stderr, "failed to pack %s\n", path);
+    state->ok = false;
+  } else {
+    state->files++;
+    state->bytes += data.len;
+  }
+  GH_CacheRelease(entry);
+  GH_CacheRemove(&g_cache, path);
+
+  if (has_variants) {
+    GH_CompressionFreeVariants(variants);
+  }
+  free((void *) data.buf);
+}
+
+int main(int argc, char *argv[]) {
+  struct PackState state = {.compress = true, .ok = true};
+  int arg = 1;
+  if (arg < argc && strcmp(argv[arg], "-n") == 0) {
+    state.compress = false;
+    arg++;
+  }
+  if (argc - arg != 2) {
+    fprintf(stderr, "usage: %s [-n] <root> <output%s>\n", argv[0], GH_SNAPSHOT_EXTENSION);
+    return 2;
+  }
+  const char *root = argv[arg], *output = argv[arg + 1];
+
+  // Open the output first: it may be relative to the current directory
+  if (!GH_SnapshotWriterOpen(&state.writer, output)) {
+    fprintf(stderr, "cannot create %s\n", output);
+    return 1;
+  }
+
+  // Keys must look like the server's ("./dir/file"), so walk from inside root
+  if (change_dir(root) != 0) {
+    fprintf(stderr, "cannot enter %s\n", root);
+    return 1;
+  }
+  GH_CacheInit(&g_cache);
+  WalkFiles(".", pack_file, &state);
+  GH_CacheCleanup(&g_cache);
+
+  if (!GH_SnapshotWriterFinish(&state.writer) || !state.ok) {
+    fprintf(stderr, "failed to write %s\n", output);
+    return 1;
+  }
+  printf("packed %lu files (%llu bytes), skipped %lu\n", (unsigned long) state.files,
+         (unsigned long long) state.bytes, (unsigned long) state.skipped);
+  return 0;
+}